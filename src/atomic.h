@@ -1,10 +1,20 @@
 #ifndef _ATOMIC_H
 #define _ATOMIC_H
 
-#include "lib/cli.h"
 #include "lib/stdint.h"
+#include "lib/stdbool.h"
 #include "compiler.h"
 
+// All read-modify-write operations here are single lock-prefixed
+// instructions, so they are atomic against interrupts and other processors
+// alike, and double as full memory barriers.
+
+// Memory barriers, for ordering plain accesses around lock-free code. x86
+// never reorders loads with loads or stores with stores to normal memory,
+// so ordering those only needs to stop the compiler
+#define smp_rmb() asm volatile ("" : : : "memory")
+#define smp_wmb() asm volatile ("" : : : "memory")
+
 // This is typedef-ed because this should never be accessed outside of accessor
 // methods
 typedef struct {
@@ -21,19 +31,153 @@ static inline __always_inline void atomic_set(atomic_t *var, int32_t val) {
     *(volatile int32_t *)var = val;
 }
 
-static inline __always_inline int32_t atomic_add(atomic_t *var, int32_t val) {
-    unsigned long flags;
-    cli_and_save(flags);
+// Atomically add val, returning the new value
+static inline __always_inline int32_t atomic_add_return(atomic_t *var, int32_t val) {
+    int32_t old = val;
+    asm volatile (
+        "lock xaddl %0,%1"
+        : "+r"(old), "+m"(var->val)
+        :
+        : "memory", "cc"
+    );
+    return old + val;
+}
+
+// Atomically compare *ptr with old and if equal, store new. Returns the
+// value *ptr had before
+static inline __always_inline uint32_t cmpxchg(volatile uint32_t *ptr, uint32_t old, uint32_t new) {
+    uint32_t prev;
+    asm volatile (
+        "lock cmpxchgl %2,%1"
+        : "=a"(prev), "+m"(*ptr)
+        : "r"(new), "0"(old)
+        : "memory", "cc"
+    );
+    return prev;
+}
+
+// Atomically swap *ptr with val, returning the old value
+static inline __always_inline uint32_t xchg(volatile uint32_t *ptr, uint32_t val) {
+    // xchg with memory is always locked
+    asm volatile ("xchgl %0,%1" : "+r"(val), "+m"(*ptr) : : "memory");
+    return val;
+}
+
+static inline __always_inline int32_t atomic_cmpxchg(atomic_t *var, int32_t old, int32_t new) {
+    return cmpxchg((volatile uint32_t *)&var->val, old, new);
+}
+
+static inline __always_inline int32_t atomic_xchg(atomic_t *var, int32_t val) {
+    return xchg((volatile uint32_t *)&var->val, val);
+}
+
+// Add val unless the value is `unless`, returning whether it was added. Used
+// to take a reference only if the object isn't already being freed
+static inline __always_inline bool atomic_add_unless(atomic_t *var, int32_t val, int32_t unless) {
+    int32_t cur = atomic_get(var);
+    for (;;) {
+        if (cur == unless)
+            return false;
+        int32_t old = atomic_cmpxchg(var, cur, cur + val);
+        if (old == cur)
+            return true;
+        cur = old;
+    }
+}
+
+#define atomic_add(var, val) atomic_add_return((var), (val))
+#define atomic_sub(var, val) atomic_add_return((var), -(val))
+#define atomic_inc(var) atomic_add_return((var), 1)
+#define atomic_dec(var) atomic_add_return((var), -1)
+#define atomic_inc_not_zero(var) atomic_add_unless((var), 1, 0)
+
+// Bit operations on arrays of 32-bit words, nr may exceed 31
+
+static inline __always_inline void set_bit(uint32_t nr, volatile uint32_t *addr) {
+    asm volatile ("lock btsl %1,%0" : "+m"(*addr) : "r"(nr) : "memory", "cc");
+}
+
+static inline __always_inline void clear_bit(uint32_t nr, volatile uint32_t *addr) {
+    asm volatile ("lock btrl %1,%0" : "+m"(*addr) : "r"(nr) : "memory", "cc");
+}
+
+static inline __always_inline bool test_and_set_bit(uint32_t nr, volatile uint32_t *addr) {
+    bool old;
+    asm volatile (
+        "lock btsl %2,%1\n"
+        "setc %0"
+        : "=qm"(old), "+m"(*addr)
+        : "r"(nr)
+        : "memory", "cc"
+    );
+    return old;
+}
+
+static inline __always_inline bool test_and_clear_bit(uint32_t nr, volatile uint32_t *addr) {
+    bool old;
+    asm volatile (
+        "lock btrl %2,%1\n"
+        "setc %0"
+        : "=qm"(old), "+m"(*addr)
+        : "r"(nr)
+        : "memory", "cc"
+    );
+    return old;
+}
+
+static inline __always_inline bool test_bit(uint32_t nr, const volatile uint32_t *addr) {
+    return (addr[nr / 32] >> (nr % 32)) & 1;
+}
+
+// 64-bit counters, built on cmpxchg8b since there is no 64-bit xadd here
 
-    var->val += val;
-    int32_t ret = var->val;
+typedef struct {
+    int64_t val;
+} __attribute__((aligned(8))) atomic64_t;
+
+#define ATOMIC64_INITIALIZER(_val) ((atomic64_t){ .val = _val })
+
+// Atomically compare var with old and if equal, store new. Returns the
+// value var had before
+static inline __always_inline int64_t atomic64_cmpxchg(atomic64_t *var, int64_t old, int64_t new) {
+    int64_t prev;
+    asm volatile (
+        "lock cmpxchg8b %1"
+        : "=A"(prev), "+m"(var->val)
+        : "b"((uint32_t)new), "c"((uint32_t)(new >> 32)), "0"(old)
+        : "memory", "cc"
+    );
+    return prev;
+}
+
+// A plain 64-bit load can tear, so read with a cmpxchg8b; if it matches, it
+// stores back the same value
+static inline __always_inline int64_t atomic64_get(atomic64_t *var) {
+    return atomic64_cmpxchg(var, 0, 0);
+}
+
+static inline __always_inline int64_t atomic64_add_return(atomic64_t *var, int64_t val) {
+    int64_t cur = atomic64_get(var);
+    for (;;) {
+        int64_t old = atomic64_cmpxchg(var, cur, cur + val);
+        if (old == cur)
+            return cur + val;
+        cur = old;
+    }
+}
 
-    restore_flags(flags);
-    return ret;
+static inline __always_inline void atomic64_set(atomic64_t *var, int64_t val) {
+    int64_t cur = atomic64_get(var);
+    for (;;) {
+        int64_t old = atomic64_cmpxchg(var, cur, val);
+        if (old == cur)
+            return;
+        cur = old;
+    }
 }
 
-#define atomic_sub(var, val) atomic_add((var), -(val))
-#define atomic_inc(var) atomic_add((var), 1)
-#define atomic_dec(var) atomic_add((var), -1)
+#define atomic64_add(var, val) atomic64_add_return((var), (val))
+#define atomic64_inc(var) atomic64_add_return((var), 1)
+#define atomic64_dec(var) atomic64_add_return((var), -1)
 
 #endif
@@ -88,8 +88,7 @@ static struct ata_data secondary_slave = {
     .prt_size     = 0,
 };
 
-static struct mutex ata_mutex;
-MUTEX_STATIC_INIT(ata_mutex);
+static DEFINE_MUTEX(ata_mutex);
 
 static struct task_struct *in_service;
 
@@ -386,9 +385,10 @@ static struct file_operations ata_dev_op = {
  *   ata_handler
  *   DESCRIPTION: wake up the read_28
  */
-static void ata_handler(struct intr_info *info) {
+static irqreturn_t ata_handler(struct intr_info *info, void *dev_id) {
     if (in_service)
         wake_up_process(in_service);
+    return IRQ_HANDLED;
 }
 
 /*
@@ -396,8 +396,8 @@ static void ata_handler(struct intr_info *info) {
  *   DESCRIPTION: initialize the ata
  */
 static void ata_init() {
-    set_irq_handler(ATA_IRQ_PRIM, &ata_handler);
-    set_irq_handler(ATA_IRQ_SEC, &ata_handler);
+    request_irq(ATA_IRQ_PRIM, &ata_handler, 0, "ata", NULL);
+    request_irq(ATA_IRQ_SEC, &ata_handler, 0, "ata", NULL);
 
     // ATA has major device number 8
     register_dev(S_IFBLK, MKDEV(8, MINORMASK), &ata_dev_op);
@@ -0,0 +1,173 @@
+#include "../lib/string.h"
+#include "../mm/kmalloc.h"
+#include "../mm/slab.h"
+#include "../mm/paging.h"
+#include "../lockstat.h"
+#include "../systrace.h"
+#include "../irq.h"
+#include "../vfs/file.h"
+#include "../vfs/device.h"
+#include "../initcall.h"
+#include "../errno.h"
+
+// Text snapshots of the kernel heap, locks, IRQs and syscalls, taken at open
+#define MEMINFO_DEV     MKDEV(10, 240)
+#define SLABINFO_DEV    MKDEV(10, 241)
+#define LOCKSTAT_DEV    MKDEV(10, 242)
+#define INTERRUPTS_DEV  MKDEV(10, 243)
+#define SYSTRACE_DEV    MKDEV(10, 244)
+#define SYSCALLSTAT_DEV MKDEV(10, 245)
+
+#define MEMINFO_BUFSIZE (PAGE_SIZE_SMALL * 2)
+// a line for every event in the ring
+#define SYSTRACE_BUFSIZE (PAGE_SIZE_SMALL * 8)
+
+struct meminfo_private {
+    uint32_t len;
+    char buf[];
+};
+
+/*
+ *   meminfo_open
+ *   DESCRIPTION: take a snapshot of the heap, lock or IRQ statistics
+ *   INPUTS: struct file *file, struct inode *inode
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, or negative errno
+ */
+static int32_t meminfo_open(struct file *file, struct inode *inode) {
+    uint32_t bufsize = inode->rdev == SYSTRACE_DEV ? SYSTRACE_BUFSIZE : MEMINFO_BUFSIZE;
+    struct meminfo_private *private = kmalloc(sizeof(*private) + bufsize);
+    if (!private)
+        return -ENOMEM;
+
+    switch (inode->rdev) {
+    case SLABINFO_DEV:
+        private->len = slab_report(private->buf, MEMINFO_BUFSIZE);
+        break;
+    case LOCKSTAT_DEV:
+        private->len = lock_stat_report(private->buf, MEMINFO_BUFSIZE);
+        break;
+    case INTERRUPTS_DEV:
+        private->len = irq_report(private->buf, MEMINFO_BUFSIZE);
+        break;
+    case SYSTRACE_DEV:
+        private->len = systrace_report(private->buf, SYSTRACE_BUFSIZE);
+        break;
+    case SYSCALLSTAT_DEV:
+        private->len = syscall_latency_report(private->buf, MEMINFO_BUFSIZE);
+        break;
+    default:
+        private->len = kmalloc_report(private->buf, MEMINFO_BUFSIZE);
+        break;
+    }
+
+    file->vendor = private;
+    return 0;
+}
+
+/*
+ *   meminfo_read
+ *   DESCRIPTION: read from the snapshot
+ *   INPUTS: struct file *file, char *buf, uint32_t nbytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of bytes read
+ */
+static int32_t meminfo_read(struct file *file, char *buf, uint32_t nbytes) {
+    struct meminfo_private *private = file->vendor;
+
+    if (file->pos >= private->len)
+        return 0;
+    if (nbytes > private->len - file->pos)
+        nbytes = private->len - file->pos;
+
+    memcpy(buf, private->buf + file->pos, nbytes);
+    file->pos += nbytes;
+    return nbytes;
+}
+
+/*
+ *   systrace_write
+ *   DESCRIPTION: "1" turns syscall tracing on, "0" turns it off, and "c"
+ *                clears what was recorded
+ *   INPUTS: const char *buf, uint32_t nbytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: nbytes, or negative errno
+ */
+static int32_t systrace_write(const char *buf, uint32_t nbytes) {
+#if SYSTRACE
+    switch (buf[0]) {
+    case '0':
+        systrace_enabled = false;
+        return nbytes;
+    case '1':
+        systrace_enabled = true;
+        return nbytes;
+    case 'c':
+        systrace_clear();
+        return nbytes;
+    default:
+        return -EINVAL;
+    }
+#else
+    return -EINVAL;
+#endif
+}
+
+/*
+ *   meminfo_write
+ *   DESCRIPTION: "1" turns allocation tracking, or syscall tracing, on, "0"
+ *                turns it off. The lock and IRQ statistics have nothing to
+ *                turn.
+ *   INPUTS: struct file *file, const char *buf, uint32_t nbytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: nbytes, or negative errno
+ */
+static int32_t meminfo_write(struct file *file, const char *buf, uint32_t nbytes) {
+    if (!nbytes)
+        return 0;
+
+    switch (file->inode->rdev) {
+    case SYSTRACE_DEV:
+    case SYSCALLSTAT_DEV:
+        return systrace_write(buf, nbytes);
+    case LOCKSTAT_DEV:
+    case INTERRUPTS_DEV:
+        return -EINVAL;
+    }
+
+#if KMALLOC_TRACK
+    switch (buf[0]) {
+    case '0':
+        kmalloc_tracking = false;
+        return nbytes;
+    case '1':
+        kmalloc_tracking = true;
+        return nbytes;
+    default:
+        return -EINVAL;
+    }
+#else
+    return -EINVAL;
+#endif
+}
+
+static void meminfo_release(struct file *file) {
+    kfree(file->vendor);
+}
+
+static struct file_operations meminfo_dev_op = {
+    .read    = &meminfo_read,
+    .write   = &meminfo_write,
+    .open    = &meminfo_open,
+    .release = &meminfo_release,
+};
+
+static void init_meminfo_char() {
+    register_dev(S_IFCHR, MEMINFO_DEV, &meminfo_dev_op);
+    register_dev(S_IFCHR, SLABINFO_DEV, &meminfo_dev_op);
+    register_dev(S_IFCHR, LOCKSTAT_DEV, &meminfo_dev_op);
+    register_dev(S_IFCHR, INTERRUPTS_DEV, &meminfo_dev_op);
+    register_dev(S_IFCHR, SYSTRACE_DEV, &meminfo_dev_op);
+    register_dev(S_IFCHR, SYSCALLSTAT_DEV, &meminfo_dev_op);
+}
+DEFINE_INITCALL(init_meminfo_char, drivers);
@@ -10,6 +10,7 @@
 #include "../structure/list.h"
 #include "../mm/paging.h"
 #include "../mm/kmalloc.h"
+#include "../mm/uaccess.h"
 #include "../lib/io.h"
 #include "../lib/limits.h"
 #include "../lib/stdlib.h"
@@ -45,10 +46,12 @@ struct vidmaps_entry {
 };
 
 static inline bool tty_should_read(struct tty *tty) {
-    if (tty->termios.lflag & ICANON)
-        return tty->buffer_end && tty->buffer[tty->buffer_end - 1] == WAKEUP_CHAR;
-    else
-        return tty->buffer_end;
+    if (tty->termios.lflag & ICANON) {
+        char *last = ring_peek_back(&tty->input);
+        return last && *last == WAKEUP_CHAR;
+    } else {
+        return !ring_empty(&tty->input);
+    }
 }
 
 static int32_t raw_tty_write(struct tty *tty, const char *buf, uint32_t nbytes);
@@ -121,6 +124,7 @@ struct tty *tty_get(uint32_t device_num) {
     };
     // create list of vidmaps
     list_init(&ret->vidmaps);
+    ring_init(&ret->input, ret->buffer, TTY_BUFFER_SIZE, sizeof(char));
 
     // insert to back of ttys
     list_insert_back(&ttys, ret);
@@ -221,18 +225,13 @@ static int32_t tty_read(struct file *file, char *buf, uint32_t nbytes) {
     if (signal_pending(current))
         return -EINTR;
 
-    // Don't read more than you can read
-    if (nbytes > tty->buffer_end - tty->buffer_start)
-        nbytes = tty->buffer_end - tty->buffer_start;
-
-    memcpy(buf, &tty->buffer[tty->buffer_start], nbytes);
-
-    tty->buffer_start += nbytes;
-    // Buffer finished reading, clear it.
-    if (tty->buffer_start == tty->buffer_end)
-        tty->buffer_start = tty->buffer_end = 0;
+    // a backspace takes back from the same end of the ring we pop up to
+    unsigned long flags;
+    cli_and_save(flags);
+    int32_t ret = ring_pop(&tty->input, buf, nbytes);
+    restore_flags(flags);
 
-    return nbytes;
+    return ret;
 }
 
 /*
@@ -302,8 +301,11 @@ static char decode_ansi_type(struct ansi_decode *ansi_dec)  {
 }
 
 static void decode_ansi(struct ansi_decode *ansi_dec, uint8_t *arg1, uint8_t *arg2)  {
-    const char *buf = strndup(ansi_dec->buffer, ansi_dec->buffer_end);
-    const char *buf_free = buf;
+    // null-terminated copy, so atoi stops at the end of the sequence
+    char buf_copy[sizeof(ansi_dec->buffer) + 1];
+    memcpy(buf_copy, ansi_dec->buffer, ansi_dec->buffer_end);
+    buf_copy[ansi_dec->buffer_end] = '\0';
+    const char *buf = buf_copy;
 
     char type = decode_ansi_type(ansi_dec);
     switch (type) {
@@ -323,25 +325,22 @@ static void decode_ansi(struct ansi_decode *ansi_dec, uint8_t *arg1, uint8_t *ar
 
     arg = atoi(buf, &end);
     if (end == buf)
-        goto out;
+        return;
 
     if (arg1)
         *arg1 = arg;
     buf = end;
 
     if (buf[0] != ';')
-        goto out;
+        return;
     buf++;
 
     arg = atoi(buf, &end);
     if (end == buf)
-        goto out;
+        return;
 
     *arg2 = arg;
     buf = end;
-
-out:
-    kfree((void *)buf_free);
 }
 
 static void tty_fixscroll(struct tty *tty) {
@@ -721,6 +720,28 @@ void tty_foreground_signal(uint16_t signum) {
     send_sig_info_pg(foreground_tty->session->foreground_pgid, &siginfo);
 }
 
+/*
+ *   tty_erase
+ *   DESCRIPTION: take back the last character of the line being edited.
+ *                Anything up to the last line terminator is committed to
+ *                the reader and stays
+ *   INPUTS: struct tty *tty
+ *   OUTPUTS: whether a character was erased
+ */
+static bool tty_erase(struct tty *tty) {
+    unsigned long flags;
+    bool erased = false;
+
+    // the reader may be popping the ring, so keep it out
+    cli_and_save(flags);
+    char *last = ring_peek_back(&tty->input);
+    if (last && *last != WAKEUP_CHAR)
+        erased = ring_unpush(&tty->input);
+    restore_flags(flags);
+
+    return erased;
+}
+
 /*
  *   tty_foreground_keyboard
  *   DESCRIPTION: react to the keyboard for foreground teminal
@@ -756,14 +777,12 @@ void tty_foreground_keyboard(char chr, bool has_ctrl, bool has_alt) {
             return;
 
         if ((foreground_tty->termios.lflag & ICANON) && chr == '\b') {
-            if (foreground_tty->buffer_end) {
+            if (tty_erase(foreground_tty)) {
                 if (foreground_tty->termios.lflag & ECHO)
                     tty_foreground_puts((char []){chr, 0});
-                foreground_tty->buffer_end--;
             }
         } else {
-            if (foreground_tty->buffer_end < TTY_BUFFER_SIZE) {
-                foreground_tty->buffer[foreground_tty->buffer_end++] = chr;
+            if (ring_push(&foreground_tty->input, &chr, 1)) {
                 if (foreground_tty->termios.lflag & ECHO)
                     tty_foreground_puts((char []){chr, 0});
 
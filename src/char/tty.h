@@ -5,6 +5,7 @@
 #include "../lib/stdbool.h"
 #include "../vfs/device.h"
 #include "../structure/list.h"
+#include "../structure/ring.h"
 #include "../atomic.h"
 
 #define TTY_MAJOR 4
@@ -219,8 +220,8 @@ struct tty {
     int16_t mouse_cursor_x;
     int16_t mouse_cursor_y;
     // FIXME: This should be handled by the line discipline
-    uint8_t buffer_start;
-    uint8_t buffer_end;
+    // filled by the keyboard interrupt, drained by tty_read
+    struct ring input;
     char buffer[TTY_BUFFER_SIZE];
 };
 
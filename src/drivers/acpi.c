@@ -0,0 +1,136 @@
+#include "acpi.h"
+#include "../mm/paging.h"
+#include "../lib/string.h"
+#include "../lib/stdbool.h"
+
+// the real mode segment of the Extended BIOS Data Area is kept here
+#define EBDA_SEG_ADDR  0x40E
+#define BIOS_ROM_START 0xE0000
+#define BIOS_ROM_END   0x100000
+
+// Root System Description Pointer, ACPI 1.0 part
+struct acpi_rsdp {
+    char signature[8];     // "RSD PTR "
+    uint8_t checksum;      // over this struct
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_addr;
+} __attribute__((packed));
+
+static struct acpi_sdt_header *rsdt;
+static bool acpi_probed;
+
+static uint8_t acpi_checksum(const void *data, uint32_t len) {
+    const uint8_t *bytes = data;
+    uint8_t sum = 0;
+    while (len--)
+        sum += *bytes++;
+    return sum;
+}
+
+/*  find_rsdp
+ *  DESCRIPTION: look for the RSDP on the 16 byte boundaries of a range of
+ *               physical memory
+ *  INPUTS: uint32_t start, uint32_t len
+ *  OUTPUTS: none
+ *  RETURN VALUE: the physical address of the RSDT, or 0
+ */
+static uint32_t find_rsdp(uint32_t start, uint32_t len) {
+    uint8_t *area = ioremap(start, len);
+    uint32_t offset, ret = 0;
+
+    if (!area)
+        return 0;
+
+    for (offset = 0; offset + sizeof(struct acpi_rsdp) <= len; offset += 16) {
+        struct acpi_rsdp *rsdp = (void *)(area + offset);
+        if (!memcmp(rsdp->signature, "RSD PTR ", sizeof(rsdp->signature)) &&
+                !acpi_checksum(rsdp, sizeof(*rsdp))) {
+            ret = rsdp->rsdt_addr;
+            break;
+        }
+    }
+
+    iounmap(area, len);
+    return ret;
+}
+
+/*  map_table
+ *  DESCRIPTION: map a whole system description table
+ *  INPUTS: uint32_t physaddr
+ *  OUTPUTS: none
+ *  RETURN VALUE: the table, or NULL if it could not be mapped or its
+ *                checksum is wrong
+ */
+static struct acpi_sdt_header *map_table(uint32_t physaddr) {
+    struct acpi_sdt_header *header = ioremap(physaddr, sizeof(*header));
+    if (!header)
+        return NULL;
+
+    uint32_t length = header->length;
+    iounmap(header, sizeof(*header));
+    if (length < sizeof(*header))
+        return NULL;
+
+    header = ioremap(physaddr, length);
+    if (!header)
+        return NULL;
+
+    if (acpi_checksum(header, length)) {
+        iounmap(header, length);
+        return NULL;
+    }
+    return header;
+}
+
+static void acpi_probe(void) {
+    uint32_t rsdt_addr = 0;
+
+    uint16_t *ebda_seg = ioremap(EBDA_SEG_ADDR, sizeof(*ebda_seg));
+    if (ebda_seg) {
+        // only the first KiB of the EBDA is searched
+        if (*ebda_seg)
+            rsdt_addr = find_rsdp((uint32_t)*ebda_seg << 4, LEN_1K);
+        iounmap(ebda_seg, sizeof(*ebda_seg));
+    }
+
+    if (!rsdt_addr)
+        rsdt_addr = find_rsdp(BIOS_ROM_START, BIOS_ROM_END - BIOS_ROM_START);
+    if (!rsdt_addr)
+        return;
+
+    rsdt = map_table(rsdt_addr);
+    if (rsdt && memcmp(rsdt->signature, "RSDT", sizeof(rsdt->signature))) {
+        iounmap(rsdt, rsdt->length);
+        rsdt = NULL;
+    }
+}
+
+/*  acpi_find_table
+ *  DESCRIPTION: find a table through the RSDT. The table stays mapped
+ *  INPUTS: const char *signature -- four characters, such as "APIC"
+ *  OUTPUTS: none
+ *  RETURN VALUE: the table, or NULL if there is no ACPI or no such table
+ */
+struct acpi_sdt_header *acpi_find_table(const char *signature) {
+    uint32_t i;
+
+    if (!acpi_probed) {
+        acpi_probe();
+        acpi_probed = true;
+    }
+    if (!rsdt)
+        return NULL;
+
+    uint32_t *entries = (void *)(rsdt + 1);
+    uint32_t num = (rsdt->length - sizeof(*rsdt)) / sizeof(*entries);
+    for (i = 0; i < num; i++) {
+        struct acpi_sdt_header *header = map_table(entries[i]);
+        if (!header)
+            continue;
+        if (!memcmp(header->signature, signature, sizeof(header->signature)))
+            return header;
+        iounmap(header, header->length);
+    }
+    return NULL;
+}
@@ -0,0 +1,65 @@
+// acpi.h -- find ACPI tables left by the firmware
+
+#ifndef _ACPI_H
+#define _ACPI_H
+
+#include "../lib/stdint.h"
+
+// the header every system description table starts with
+struct acpi_sdt_header {
+    char signature[4];
+    uint32_t length;       // of the whole table, header included
+    uint8_t revision;
+    uint8_t checksum;      // makes the bytes of the whole table sum to zero
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+// Multiple APIC Description Table, "APIC"
+struct acpi_madt {
+    struct acpi_sdt_header header;
+    uint32_t lapic_addr;
+    uint32_t flags;
+    uint8_t entries[];
+} __attribute__((packed));
+
+#define ACPI_MADT_PCAT_COMPAT 1 // there are 8259s too
+
+#define ACPI_MADT_LAPIC   0
+#define ACPI_MADT_IOAPIC  1
+#define ACPI_MADT_ISO     2 // interrupt source override
+
+struct acpi_madt_entry {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed));
+
+struct acpi_madt_ioapic {
+    struct acpi_madt_entry entry;
+    uint8_t id;
+    uint8_t reserved;
+    uint32_t addr;
+    uint32_t gsi_base;
+} __attribute__((packed));
+
+struct acpi_madt_iso {
+    struct acpi_madt_entry entry;
+    uint8_t bus;
+    uint8_t source;        // ISA IRQ
+    uint32_t gsi;
+    uint16_t flags;
+} __attribute__((packed));
+
+#define ACPI_MPS_POLARITY_MASK   0x3
+#define ACPI_MPS_POLARITY_HIGH   0x1
+#define ACPI_MPS_POLARITY_LOW    0x3
+#define ACPI_MPS_TRIGGER_MASK    0xc
+#define ACPI_MPS_TRIGGER_EDGE    0x4
+#define ACPI_MPS_TRIGGER_LEVEL   0xc
+
+struct acpi_sdt_header *acpi_find_table(const char *signature);
+
+#endif
@@ -0,0 +1,466 @@
+#include "apic.h"
+#include "acpi.h"
+#include "i8259.h"
+#include "pit.h"
+#include "../irq.h"
+#include "../softirq.h"
+#include "../cpuid.h"
+#include "../mm/paging.h"
+#include "../lib/io.h"
+#include "../lib/cli.h"
+#include "../lib/msr.h"
+#include "../lib/stdbool.h"
+#include "../initcall.h"
+#include "../errno.h"
+
+/*
+ * With a local APIC, the EOI is a single uncached store instead of one or
+ * two port writes to the 8259s, and the APIC timer gives a tick that does not
+ * go through the ISA interrupt lines. With IOAPICs as well, the ISA and PCI
+ * lines are routed through them and the 8259s are masked. MSI lines only
+ * need the local APIC. Without an APIC, or without the ACPI tables that
+ * describe the IOAPICs, the 8259s and the PIT stay in charge.
+ */
+
+// local APIC registers, as offsets from its base
+#define LAPIC_ID        0x020
+#define LAPIC_TPR       0x080
+#define LAPIC_EOI       0x0B0
+#define LAPIC_SVR       0x0F0
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_LVT_LINT0 0x350
+#define LAPIC_TIMER_ICR 0x380
+#define LAPIC_TIMER_CCR 0x390
+#define LAPIC_TIMER_DCR 0x3E0
+
+#define LAPIC_SVR_ENABLE     (1 << 8)
+#define LAPIC_LVT_MASKED     (1 << 16)
+#define LAPIC_TIMER_PERIODIC (1 << 17)
+#define LAPIC_TIMER_DIV16    0x3
+
+#define APIC_BASE_ENABLE    (1 << 11)
+#define APIC_BASE_ADDR_MASK 0xFFFFF000
+
+// IOAPIC registers are selected through IOREGSEL and accessed through IOWIN
+#define IOAPIC_IOREGSEL  0x00
+#define IOAPIC_IOWIN     0x10
+#define IOAPIC_SIZE      0x20
+#define IOAPIC_VER       0x01
+#define IOAPIC_REDTBL(n) (0x10 + 2 * (n))
+
+#define IOAPIC_POLARITY_LOW  (1 << 13)
+#define IOAPIC_TRIGGER_LEVEL (1 << 15)
+#define IOAPIC_MASKED        (1 << 16)
+
+#define MAX_IOAPICS 4
+#define NO_GSI      0xFFFFFFFF
+
+// MSI messages are writes to the local APIC of the destination
+#define MSI_ADDR_BASE      0xFEE00000
+#define MSI_ADDR_DEST_SHIFT 12
+
+// PIT channel 2, which can be polled without an interrupt
+#define PIT_CH2_PORT    0x42
+#define PIT_CMD_PORT    0x43
+#define PIT_CH2_ONESHOT 0xB0 // channel 2, low byte then high byte, mode 0
+#define PIT_GATE_PORT   0x61
+#define PIT_GATE_CH2    0x01
+#define PIT_GATE_SPKR   0x02
+#define PIT_OUT_CH2     0x20
+#define CALIBRATE_MS    10
+
+struct ioapic {
+    volatile uint32_t *regs;
+    uint32_t gsi_base;
+    uint32_t num_pins;
+};
+
+// which IOAPIC input a line comes in on, and how
+struct irq_route {
+    uint32_t gsi;
+    uint32_t flags; // IOAPIC_POLARITY_LOW, IOAPIC_TRIGGER_LEVEL
+};
+
+static volatile uint32_t *lapic;
+static uint8_t lapic_id;
+
+static struct ioapic ioapics[MAX_IOAPICS];
+static uint32_t num_ioapics;
+static struct irq_route irq_routes[IRQ_MSI_MIN];
+
+// allocated MSI lines, bit n for IRQ_MSI_MIN + n
+static uint32_t msi_used;
+
+static uint32_t lapic_spurious_count;
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic[reg / sizeof(*lapic)];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t val) {
+    lapic[reg / sizeof(*lapic)] = val;
+}
+
+static void lapic_eoi(uint32_t irq_num) {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+static uint32_t ioapic_read(struct ioapic *ioapic, uint32_t reg) {
+    ioapic->regs[IOAPIC_IOREGSEL / sizeof(uint32_t)] = reg;
+    return ioapic->regs[IOAPIC_IOWIN / sizeof(uint32_t)];
+}
+
+static void ioapic_write(struct ioapic *ioapic, uint32_t reg, uint32_t val) {
+    ioapic->regs[IOAPIC_IOREGSEL / sizeof(uint32_t)] = reg;
+    ioapic->regs[IOAPIC_IOWIN / sizeof(uint32_t)] = val;
+}
+
+static struct ioapic *find_ioapic(uint32_t gsi) {
+    uint32_t i;
+    for (i = 0; i < num_ioapics; i++) {
+        if (gsi >= ioapics[i].gsi_base && gsi - ioapics[i].gsi_base < ioapics[i].num_pins)
+            return &ioapics[i];
+    }
+    return NULL;
+}
+
+/*  ioapic_route
+ *  DESCRIPTION: point the IOAPIC input of a line at the line's vector on
+ *               this CPU
+ *  INPUTS: uint32_t irq_num, bool masked
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+static void ioapic_route(uint32_t irq_num, bool masked) {
+    struct irq_route *route = &irq_routes[irq_num];
+    struct ioapic *ioapic = find_ioapic(route->gsi);
+    unsigned long flags;
+
+    if (!ioapic)
+        return;
+
+    uint32_t pin = route->gsi - ioapic->gsi_base;
+    uint32_t low = (INTR_IRQ_MIN + irq_num) | route->flags;
+    if (masked)
+        low |= IOAPIC_MASKED;
+
+    // IOREGSEL is shared by both writes
+    cli_and_save(flags);
+    ioapic_write(ioapic, IOAPIC_REDTBL(pin) + 1, (uint32_t)lapic_id << 24);
+    ioapic_write(ioapic, IOAPIC_REDTBL(pin), low);
+    restore_flags(flags);
+}
+
+static void ioapic_enable_irq(uint32_t irq_num) {
+    ioapic_route(irq_num, false);
+}
+
+static void ioapic_disable_irq(uint32_t irq_num) {
+    ioapic_route(irq_num, true);
+}
+
+// the local APIC forwards the EOI of a level-triggered line to the IOAPIC
+static struct irq_chip ioapic_chip = {
+    .name    = "ioapic",
+    .enable  = &ioapic_enable_irq,
+    .disable = &ioapic_disable_irq,
+    .eoi     = &lapic_eoi,
+};
+
+// masking an MSI is up to the device
+static void msi_nop(uint32_t irq_num) {}
+
+static struct irq_chip msi_chip = {
+    .name    = "msi",
+    .enable  = &msi_nop,
+    .disable = &msi_nop,
+    .eoi     = &lapic_eoi,
+};
+
+/*  msi_alloc_irq
+ *  DESCRIPTION: reserve a line for a device's MSI
+ *  INPUTS: none
+ *  OUTPUTS: none
+ *  RETURN VALUE: the line, or -ENODEV if there is no local APIC, or
+ *                -ENOSPC if they are all taken
+ */
+int32_t msi_alloc_irq(void) {
+    unsigned long flags;
+    int32_t ret = -ENOSPC;
+    unsigned int i;
+
+    if (!lapic)
+        return -ENODEV;
+
+    cli_and_save(flags);
+    for (i = 0; i < IRQ_NUM - IRQ_MSI_MIN; i++) {
+        if (!(msi_used & (1 << i))) {
+            msi_used |= 1 << i;
+            ret = IRQ_MSI_MIN + i;
+            break;
+        }
+    }
+    restore_flags(flags);
+    return ret;
+}
+
+/*  msi_free_irq
+ *  DESCRIPTION: release a line from msi_alloc_irq
+ *  INPUTS: unsigned int irq_num
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void msi_free_irq(unsigned int irq_num) {
+    unsigned long flags;
+
+    if (irq_num < IRQ_MSI_MIN || irq_num >= IRQ_NUM)
+        return;
+
+    cli_and_save(flags);
+    msi_used &= ~(1 << (irq_num - IRQ_MSI_MIN));
+    restore_flags(flags);
+}
+
+/*  msi_compose_msg
+ *  DESCRIPTION: make the message a device writes to raise a line
+ *  INPUTS: unsigned int irq_num -- from msi_alloc_irq
+ *  OUTPUTS: uint32_t *addr, uint16_t *data
+ *  RETURN VALUE: none
+ */
+void msi_compose_msg(unsigned int irq_num, uint32_t *addr, uint16_t *data) {
+    // fixed delivery, edge triggered, physical destination
+    *addr = MSI_ADDR_BASE | ((uint32_t)lapic_id << MSI_ADDR_DEST_SHIFT);
+    *data = INTR_IRQ_MIN + irq_num;
+}
+
+asmlinkage
+void do_lapic_timer(struct intr_info *info) {
+    irq_enter();
+    timer_tick(info);
+    lapic_write(LAPIC_EOI, 0);
+    irq_exit(info);
+}
+
+// the local APIC retracted an interrupt, and wants no EOI for it
+asmlinkage
+void do_lapic_spurious(struct intr_info *info) {
+    lapic_spurious_count++;
+}
+
+static uint32_t iso_flags(uint16_t mps_flags) {
+    uint32_t flags = 0;
+    if ((mps_flags & ACPI_MPS_POLARITY_MASK) == ACPI_MPS_POLARITY_LOW)
+        flags |= IOAPIC_POLARITY_LOW;
+    if ((mps_flags & ACPI_MPS_TRIGGER_MASK) == ACPI_MPS_TRIGGER_LEVEL)
+        flags |= IOAPIC_TRIGGER_LEVEL;
+    return flags;
+}
+
+static void add_ioapic(struct acpi_madt_ioapic *entry) {
+    uint32_t pin;
+
+    if (num_ioapics >= MAX_IOAPICS)
+        return;
+
+    struct ioapic *ioapic = &ioapics[num_ioapics];
+    ioapic->regs = ioremap(entry->addr, IOAPIC_SIZE);
+    if (!ioapic->regs)
+        return;
+
+    ioapic->gsi_base = entry->gsi_base;
+    ioapic->num_pins = ((ioapic_read(ioapic, IOAPIC_VER) >> 16) & 0xff) + 1;
+    for (pin = 0; pin < ioapic->num_pins; pin++)
+        ioapic_write(ioapic, IOAPIC_REDTBL(pin), IOAPIC_MASKED);
+
+    num_ioapics++;
+}
+
+/*  parse_madt
+ *  DESCRIPTION: find the IOAPICs and how the ISA IRQs are wired to them
+ *  INPUTS: struct acpi_madt *madt
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+static void parse_madt(struct acpi_madt *madt) {
+    uint8_t *pos = madt->entries;
+    uint8_t *end = (uint8_t *)madt + madt->header.length;
+    unsigned int i;
+
+    // ISA IRQs are identity mapped, active high and edge triggered unless
+    // overridden, and PCI ones are active low and level triggered
+    for (i = 0; i < IRQ_MSI_MIN; i++) {
+        irq_routes[i] = (struct irq_route){
+            .gsi   = i,
+            .flags = i < IRQ_ISA_NUM ? 0 : IOAPIC_POLARITY_LOW | IOAPIC_TRIGGER_LEVEL,
+        };
+    }
+
+    while (pos + sizeof(struct acpi_madt_entry) <= end) {
+        struct acpi_madt_entry *entry = (void *)pos;
+        if (entry->length < sizeof(*entry) || pos + entry->length > end)
+            break;
+
+        if (entry->type == ACPI_MADT_IOAPIC && entry->length >= sizeof(struct acpi_madt_ioapic)) {
+            add_ioapic((void *)entry);
+        } else if (entry->type == ACPI_MADT_ISO && entry->length >= sizeof(struct acpi_madt_iso)) {
+            struct acpi_madt_iso *iso = (void *)entry;
+            if (!iso->bus && iso->source < IRQ_ISA_NUM) {
+                // the ISA IRQ whose input got taken is not wired anywhere
+                if (iso->gsi != iso->source && iso->gsi < IRQ_ISA_NUM)
+                    irq_routes[iso->gsi].gsi = NO_GSI;
+                irq_routes[iso->source] = (struct irq_route){
+                    .gsi   = iso->gsi,
+                    .flags = iso_flags(iso->flags),
+                };
+            }
+        }
+
+        pos += entry->length;
+    }
+}
+
+/*  lapic_timer_calibrate
+ *  DESCRIPTION: count the APIC timer while PIT channel 2 runs down
+ *  INPUTS: none
+ *  OUTPUTS: none
+ *  RETURN VALUE: APIC timer counts, divided by 16, in CALIBRATE_MS
+ */
+static uint32_t lapic_timer_calibrate(void) {
+    uint32_t count = PIT_OSCILLATOR / (1000 / CALIBRATE_MS);
+    uint8_t gate = inb(PIT_GATE_PORT) & ~(PIT_GATE_CH2 | PIT_GATE_SPKR);
+
+    // channel 2 holds its count while the gate is low
+    outb(gate, PIT_GATE_PORT);
+    outb(PIT_CH2_ONESHOT, PIT_CMD_PORT);
+    outb(count & 0xff, PIT_CH2_PORT);
+    outb(count >> 8, PIT_CH2_PORT);
+
+    lapic_write(LAPIC_TIMER_DCR, LAPIC_TIMER_DIV16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+
+    outb(gate | PIT_GATE_CH2, PIT_GATE_PORT);
+    lapic_write(LAPIC_TIMER_ICR, 0xFFFFFFFF);
+    while (!(inb(PIT_GATE_PORT) & PIT_OUT_CH2));
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CCR);
+
+    lapic_write(LAPIC_TIMER_ICR, 0);
+    outb(gate, PIT_GATE_PORT);
+    return elapsed;
+}
+
+// start the APIC timer as the scheduler tick
+static bool lapic_timer_init(void) {
+    uint32_t initial = lapic_timer_calibrate() * (1000 / CALIBRATE_MS) / TICK_HZ;
+    if (!initial)
+        return false;
+
+    lapic_write(LAPIC_TIMER_DCR, LAPIC_TIMER_DIV16);
+    lapic_write(LAPIC_LVT_TIMER, INTR_LAPIC_TIMER | LAPIC_TIMER_PERIODIC);
+    lapic_write(LAPIC_TIMER_ICR, initial);
+    return true;
+}
+
+/*
+ *   init_apic
+ *   DESCRIPTION: switch interrupt handling over to the APICs, if there are
+ *                any. Lines already requested move along with their handlers
+ */
+static void init_apic() {
+    uint32_t eax, edx;
+    unsigned long flags;
+    unsigned int i;
+
+    cpuid(CPUID_GETFEATURES, &eax, &edx);
+    if (!(edx & CPUID_FEAT_EDX_APIC))
+        return;
+
+    uint64_t apic_base = rdmsr(MSR_IA32_APIC_BASE);
+    uint32_t lapic_addr = (uint32_t)apic_base & APIC_BASE_ADDR_MASK;
+
+    struct acpi_madt *madt = (void *)acpi_find_table("APIC");
+    if (madt) {
+        lapic_addr = madt->lapic_addr;
+        parse_madt(madt);
+    }
+
+    cli_and_save(flags);
+
+    lapic = ioremap(lapic_addr, PAGE_SIZE_SMALL);
+    if (!lapic) {
+        restore_flags(flags);
+        return;
+    }
+
+    wrmsr(MSR_IA32_APIC_BASE, apic_base | APIC_BASE_ENABLE);
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | INTR_LAPIC_SPURIOUS);
+    lapic_id = lapic_read(LAPIC_ID) >> 24;
+
+    for (i = IRQ_MSI_MIN; i < IRQ_NUM; i++)
+        irq_set_chip(i, &msi_chip);
+
+    if (num_ioapics) {
+        for (i = 0; i < IRQ_MSI_MIN; i++) {
+            if (irq_routes[i].gsi != NO_GSI && find_ioapic(irq_routes[i].gsi))
+                irq_set_chip(i, &ioapic_chip);
+        }
+
+        // every line has moved off the 8259s, and so has their virtual
+        // wire into LINT0
+        i8259_disable_irq(SLAVE_IRQ);
+        lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+    }
+
+    if (lapic_timer_init())
+        pit_stop();
+
+    restore_flags(flags);
+}
+DEFINE_INITCALL(init_apic, drivers);
+
+#include "../tests.h"
+#if RUN_TESTS
+static irqreturn_t msi_test_handler(struct intr_info *info, void *dev_id) {
+    (*(uint32_t *)dev_id)++;
+    return IRQ_HANDLED;
+}
+
+/* MSI line tests
+ *
+ * Asserts that MSI lines are handed out once each, and that a message's
+ * vector reaches the handler of its line
+ * Coverage: msi_alloc_irq, msi_free_irq, msi_compose_msg, msi_chip
+ */
+__testfunc
+static void msi_test() {
+    uint32_t count = 0, addr;
+    uint16_t data;
+
+    int32_t irq_num = msi_alloc_irq();
+    if (!lapic) {
+        TEST_ASSERT(irq_num == -ENODEV);
+        return;
+    }
+    TEST_ASSERT(irq_num >= IRQ_MSI_MIN && irq_num < IRQ_NUM);
+
+    int32_t other = msi_alloc_irq();
+    TEST_ASSERT(other != irq_num);
+    if (other >= 0)
+        msi_free_irq(other);
+
+    msi_compose_msg(irq_num, &addr, &data);
+    TEST_ASSERT((addr & 0xFFF00000) == MSI_ADDR_BASE);
+    TEST_ASSERT(data == INTR_IRQ_MIN + irq_num);
+
+    TEST_ASSERT(!request_irq(irq_num, &msi_test_handler, 0, "test", &count));
+    // the vector has to be a constant
+    if (irq_num == IRQ_MSI_MIN) {
+        asm volatile ("int %0" : : "i"(INTR_IRQ_MIN + IRQ_MSI_MIN));
+        TEST_ASSERT(count == 1);
+    }
+
+    free_irq(irq_num, &count);
+    msi_free_irq(irq_num);
+}
+DEFINE_TEST(msi_test);
+#endif
@@ -0,0 +1,17 @@
+// apic.h -- the local APIC and IOAPICs, when the machine has them
+
+#ifndef _APIC_H
+#define _APIC_H
+
+#include "../lib/stdint.h"
+#include "../interrupt.h"
+#include "../compiler.h"
+
+int32_t msi_alloc_irq(void);
+void msi_free_irq(unsigned int irq_num);
+void msi_compose_msg(unsigned int irq_num, uint32_t *addr, uint16_t *data);
+
+asmlinkage void do_lapic_timer(struct intr_info *info);
+asmlinkage void do_lapic_spurious(struct intr_info *info);
+
+#endif
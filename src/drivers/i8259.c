@@ -3,6 +3,7 @@
  */
 
 #include "i8259.h"
+#include "../irq.h"
 #include "../lib/io.h"
 #include "../lib/cli.h"
 #include "../delay.h"
@@ -139,3 +140,10 @@ void send_eoi(uint32_t irq_num) {
         outb(EOI + irq_num, MASTER_8259_CMD_PORT);
     }
 }
+
+struct irq_chip i8259_chip = {
+    .name    = "i8259",
+    .enable  = &i8259_enable_irq,
+    .disable = &i8259_disable_irq,
+    .eoi     = &send_eoi,
+};
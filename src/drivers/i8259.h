@@ -41,4 +41,8 @@ void i8259_disable_irq(uint32_t irq_num);
 /* Send end-of-interrupt signal for the specified IRQ */
 void send_eoi(uint32_t irq_num);
 
+/* The chip behind the ISA IRQs unless there is an IOAPIC */
+struct irq_chip;
+extern struct irq_chip i8259_chip;
+
 #endif /* _I8259_H */
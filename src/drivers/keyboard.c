@@ -148,10 +148,10 @@ static unsigned char scancode_fixup_caps(unsigned char scancode, bool has_shift,
  *   DESCRIPTION: handle interupt comes from the keyboard
  *   INPUTS: intr_info
  *   OUTPUTS: none
- *   RETURN VALUE: none
+ *   RETURN VALUE: IRQ_HANDLED
  *   SIDE EFFECTS: none
  */
-static void keyboard_handler(struct intr_info *info) {
+static irqreturn_t keyboard_handler(struct intr_info *info, void *dev_id) {
     unsigned char scancode;
     while (inb(PS2_CTRL_PORT) & 1) { // the LSB is whether there are more scancodes to read
         scancode = inb(PS2_DATA_PORT);
@@ -203,6 +203,7 @@ static void keyboard_handler(struct intr_info *info) {
             }
         }
     }
+    return IRQ_HANDLED;
 }
 
 /*
@@ -271,7 +272,7 @@ static bool do_function(unsigned char scancode_mapped) {
  *   SIDE EFFECTS: none
  */
 static void init_keyboard() {
-    set_irq_handler(KEYBOARD_IRQ, &keyboard_handler);
+    request_irq(KEYBOARD_IRQ, &keyboard_handler, 0, "keyboard", NULL);
 }
 DEFINE_INITCALL(init_keyboard, drivers);
 
@@ -3,6 +3,8 @@
 #include "../lib/io.h"
 #include "../initcall.h"
 #include "../char/tty.h"
+#include "../task/kthread.h"
+#include "../structure/ring.h"
 
 #define MOUSE_IRQ 12
 
@@ -23,18 +25,27 @@
 // xm	X-Axis Movement Value
 // ym	Y-Axis Movement Value
 
+struct mouse_event {
+    int16_t dx;
+    int16_t dy;
+};
+
+// Packets are decoded in the interrupt and drawn by kmoused. Events that
+// arrive while the ring is full are dropped.
+static DEFINE_RING(mouse_events, struct mouse_event, 64);
+static struct task_struct *kmoused_task;
 
 /*
  *   mouse_handler
  *   DESCRIPTION: handle interupt comes from the mouse
  *   INPUTS: intr_info
  */
-static void mouse_handler(struct intr_info *info){
+static irqreturn_t mouse_handler(struct intr_info *info, void *dev_id) {
     // mouse's package
     unsigned char byte_1, byte_2, byte_3;
     int16_t dx, dy;
     if (!(inb(PS2_CTRL_PORT) & 1)) { // LSB = have something to read
-        return;
+        return IRQ_NONE;
     }
 
     byte_1 = inb(PS2_DATA_PORT);
@@ -46,15 +57,59 @@ static void mouse_handler(struct intr_info *info){
     // read the signal bits of package
     dx = (int16_t)byte_2 - ((dx << 4) & 0x100);
     dy = (int16_t)byte_3 - ((dy << 3) & 0x100);
-    //send the moving data to tty.c
-    tty_foreground_mouse(dx, dy);
+    // hand the movement to kmoused
+    struct mouse_event event = {
+        .dx = dx,
+        .dy = dy,
+    };
+    ring_push(&mouse_events, &event, 1);
+    if (kmoused_task)
+        wake_up_process(kmoused_task);
+    return IRQ_HANDLED;
+}
+
+/*
+ *   kmoused
+ *   DESCRIPTION: move the cursor of the foreground tty by queued mouse events
+ *   INPUTS: void *args
+ */
+static int kmoused(void *args) {
+    kmoused_task = current;
+    set_current_comm("kmoused");
+
+    while (1) {
+        current->state = TASK_INTERRUPTIBLE;
+        while (ring_empty(&mouse_events))
+            schedule();
+        current->state = TASK_RUNNING;
+
+        // coalesce everything queued into a single cursor update
+        struct mouse_event events[16];
+        int16_t dx = 0, dy = 0;
+        uint32_t n, i;
+        while ((n = ring_pop(&mouse_events, events, 16))) {
+            for (i = 0; i < n; i++) {
+                dx += events[i].dx;
+                dy += events[i].dy;
+            }
+        }
+
+        // the keyboard interrupt draws to the same tty
+        unsigned long flags;
+        cli_and_save(flags);
+        tty_foreground_mouse(dx, dy);
+        restore_flags(flags);
+    }
+
+    return 0;
 }
+DEFINE_INIT_KTHREAD(kmoused);
 
 /*
  *   init_mouse
  *   DESCRIPTION: initialize the mouse driver
  */
 static void init_mouse() {
-    set_irq_handler(MOUSE_IRQ, &mouse_handler);
+    request_irq(MOUSE_IRQ, &mouse_handler, 0, "mouse", NULL);
 }
 DEFINE_INITCALL(init_mouse, drivers);
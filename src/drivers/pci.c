@@ -1,6 +1,8 @@
 #include "pci.h"
 #include "../lib/io.h"
+#include "apic.h"
 #include "../irq.h"
+#include "../errno.h"
 #include "../printk.h"
 
 // adapted from: https://github.com/szhou42/osdev/tree/master/src/kernel
@@ -22,6 +24,7 @@ static uint32_t pci_size_map[100] = {
     [PCI_BAR3]            = 4,
     [PCI_BAR4]            = 4,
     [PCI_BAR5]            = 4,
+    [PCI_CAPABILITY_LIST] = 1,
     [PCI_INTERRUPT_LINE]  = 1,
     [PCI_SECONDARY_BUS]   = 1,
 };
@@ -183,3 +186,69 @@ pci_dev_t pci_get_device(uint16_t vendor_id, uint16_t device_id, int device_type
 
     return dev_zero;
 }
+
+/*
+ * Read a whole dword of config space, for fields not in the size map
+ * */
+static uint32_t pci_read_dword(pci_dev_t dev, uint32_t offset) {
+    dev.field_num = (offset & 0xFC) >> 2;
+    dev.enable = 1;
+    outl(dev.bits, PCI_CONFIG_ADDRESS);
+    return inl(PCI_CONFIG_DATA);
+}
+
+/*
+ * Walk the capability list for a capability, returning its offset in config
+ * space, or 0 if the device does not have it
+ * */
+uint32_t pci_find_capability(pci_dev_t dev, uint8_t cap_id) {
+    // a broken list could loop, but there is only room for so many
+    uint32_t ttl = 48;
+
+    if (!(pci_read(dev, PCI_STATUS) & PCI_STATUS_CAP_LIST))
+        return 0;
+
+    uint32_t pos = pci_read(dev, PCI_CAPABILITY_LIST) & 0xFC;
+    while (pos && ttl--) {
+        uint32_t header = pci_read_dword(dev, pos);
+        if ((header & 0xFF) == cap_id)
+            return pos;
+        pos = (header >> 8) & 0xFC;
+    }
+    return 0;
+}
+
+/*
+ * Switch a device from its INTx pin to a single MSI vector, returning the
+ * IRQ line to request, or negative errno if the device or the machine
+ * can't do MSI
+ * */
+int32_t pci_enable_msi(pci_dev_t dev) {
+    uint32_t cap = pci_find_capability(dev, PCI_CAP_ID_MSI);
+    if (!cap)
+        return -ENODEV;
+
+    int32_t irq_num = msi_alloc_irq();
+    if (irq_num < 0)
+        return irq_num;
+
+    uint32_t addr;
+    uint16_t data;
+    msi_compose_msg(irq_num, &addr, &data);
+
+    // message control is the upper half of the capability header
+    uint32_t header = pci_read_dword(dev, cap);
+    pci_write(dev, cap + 4, addr);
+    if (header & (PCI_MSI_FLAGS_64BIT << 16)) {
+        pci_write(dev, cap + 8, 0);
+        pci_write(dev, cap + 12, data);
+    } else {
+        pci_write(dev, cap + 8, data);
+    }
+
+    header &= ~(PCI_MSI_FLAGS_QSIZE << 16);
+    header |= PCI_MSI_FLAGS_ENABLE << 16;
+    pci_write(dev, cap, header);
+
+    return irq_num;
+}
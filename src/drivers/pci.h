@@ -42,9 +42,18 @@ typedef union pci_dev {
 #define PCI_BAR3                 0x1C
 #define PCI_BAR4                 0x20
 #define PCI_BAR5                 0x24
+#define PCI_CAPABILITY_LIST      0x34
 #define PCI_INTERRUPT_LINE       0x3C
 #define PCI_SECONDARY_BUS        0x09
 
+#define PCI_STATUS_CAP_LIST      (1 << 4)
+
+// Capabilities
+#define PCI_CAP_ID_MSI           0x05
+#define PCI_MSI_FLAGS_ENABLE     (1 << 0)
+#define PCI_MSI_FLAGS_QSIZE      (7 << 4) // vectors enabled, log2
+#define PCI_MSI_FLAGS_64BIT      (1 << 7)
+
 // Device type
 #define PCI_HEADER_TYPE_DEVICE  0
 #define PCI_HEADER_TYPE_BRIDGE  1
@@ -65,5 +74,7 @@ pci_dev_t pci_scan_function(uint16_t vendor_id, uint16_t device_id, uint32_t bus
 pci_dev_t pci_scan_device(uint16_t vendor_id, uint16_t device_id, uint32_t bus, uint32_t device, int device_type);
 pci_dev_t pci_scan_bus(uint16_t vendor_id, uint16_t device_id, uint32_t bus, int device_type);
 pci_dev_t pci_get_device(uint16_t vendor_id, uint16_t device_id, int device_type);
+uint32_t pci_find_capability(pci_dev_t dev, uint8_t cap_id);
+int32_t pci_enable_msi(pci_dev_t dev);
 
 #endif
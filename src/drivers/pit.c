@@ -1,4 +1,7 @@
+#include "pit.h"
 #include "../lib/io.h"
+#include "../lib/cli.h"
+#include "../lib/stdbool.h"
 #include "../task/sched.h"
 #include "../irq.h"
 
@@ -12,13 +15,16 @@
 
 #define MODE2 0x34
 
-#define OSCILLATOR 1193182
+#define OSCILLATOR PIT_OSCILLATOR
 #define LOWERMASK  0xFF
 #define UPPERSHIFT 8
 
 #define PIT_IRQ 0x0
 
+// counts scheduler ticks, whichever timer they come from
 static uint32_t pit_counter = 0;
+// the local APIC timer has taken over the tick
+static bool pit_stopped;
 // credit: https://github.com/elusive7/ECE391-TSF/blob/master/pit.c
 
 /*
@@ -40,15 +46,42 @@ static void set_pit_rate(uint32_t hz) {
 }
 
 /*
- *   void pit_handler(struct intr_info *info);
- *   DESCRIPTION: Handles PIT interrupts.
- *   INPUTS:struct intr_info *info
+ *   void timer_tick(struct intr_info *info);
+ *   DESCRIPTION: Counts a scheduler tick.
+ *   INPUTS: struct intr_info *info
  */
-static void pit_handler(struct intr_info *info) {
+void timer_tick(struct intr_info *info) {
     pit_counter++;
     pit_schedule(info);
 }
 
+/*
+ *   irqreturn_t pit_handler(struct intr_info *info, void *dev_id);
+ *   DESCRIPTION: Handles PIT interrupts.
+ *   INPUTS:struct intr_info *info, void *dev_id
+ */
+static irqreturn_t pit_handler(struct intr_info *info, void *dev_id) {
+    timer_tick(info);
+    return IRQ_HANDLED;
+}
+
+/*
+ *   void pit_stop();
+ *   DESCRIPTION: Stops the PIT from driving the scheduler tick, for when
+ *                another timer does.
+ */
+void pit_stop() {
+    unsigned long flags;
+    cli_and_save(flags);
+
+    if (!pit_stopped) {
+        pit_stopped = true;
+        free_irq(PIT_IRQ, NULL);
+    }
+
+    restore_flags(flags);
+}
+
 /*
  *   void init_pit();
  *   DESCRIPTION: Initializes the PIT to about 128 Hz.
@@ -57,7 +90,12 @@ static void init_pit() {
     unsigned long flags;
     cli_and_save(flags);
 
-    set_irq_handler(PIT_IRQ, &pit_handler);
+    if (pit_stopped) {
+        restore_flags(flags);
+        return;
+    }
+
+    request_irq(PIT_IRQ, &pit_handler, 0, "pit", NULL);
 
     // sets a rate generator byte to the command register
     outb(MODE2, COMMANDREG);
@@ -83,7 +121,7 @@ __testfunc
 static void pit_test() {
     uint8_t init_second;
     uint32_t init_count;
-    uint32_t expected_freq = 128;
+    uint32_t expected_freq = TICK_HZ;
 
     test_printf("PIT counter = %d\n", pit_counter);
 
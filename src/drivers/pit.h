@@ -0,0 +1,14 @@
+#ifndef _PIT_H
+#define _PIT_H
+
+#include "../interrupt.h"
+
+// the scheduler tick, from the PIT or the local APIC timer
+#define TICK_HZ 128
+
+#define PIT_OSCILLATOR 1193182
+
+void timer_tick(struct intr_info *info);
+void pit_stop(void);
+
+#endif
@@ -55,7 +55,7 @@ static inline __always_inline void cmos_write(uint8_t val, uint8_t reg) {
 }
 
 // RTC interrupt handler, make run with interrupts disabled
-static void rtc_hw_handler(struct intr_info *info) {
+static irqreturn_t rtc_hw_handler(struct intr_info *info, void *dev_id) {
     // discard register C to we get interrupts again
     cmos_read_irqdisabled(0xC);
 
@@ -66,6 +66,7 @@ static void rtc_hw_handler(struct intr_info *info) {
         void (*handler)(void) = node->value;
         (*handler)();
     }
+    return IRQ_HANDLED;
 }
 
 static void rtc_set_rate(unsigned char rate) {
@@ -90,7 +91,7 @@ static void init_rtc() {
     // initialize to default 1024Hz
     rtc_set_rate(RTC_HW_RATE);
 
-    set_irq_handler(RTC_IRQ, &rtc_hw_handler);
+    request_irq(RTC_IRQ, &rtc_hw_handler, 0, "rtc", NULL);
 
     struct rtc_timestamp timestamp;
     rtc_get_timestamp(&timestamp);
@@ -5,6 +5,7 @@
 #include "../mm/kmalloc.h"
 #include "../mm/paging.h"
 #include "../irq.h"
+#include "../softirq.h"
 #include "../initcall.h"
 #include "../printk.h"
 
@@ -19,7 +20,7 @@ uint32_t current_packet_ptr;
 uint8_t TSAD_array[4] = {0x20, 0x24, 0x28, 0x2C};
 uint8_t TSD_array[4] = {0x10, 0x14, 0x18, 0x1C};
 
-void receive_packet() {
+static void receive_packet() {
     uint16_t *t = (uint16_t *)(rtl8139_device.rx_buffer + current_packet_ptr);
     // Skip packet header, get packet length
     uint16_t packet_length = *(t + 1);
@@ -28,11 +29,12 @@ void receive_packet() {
     t = t + 2;
 
     // Now, ethernet layer starts to handle the packet(be sure to make a copy of the packet, insteading of using the buffer)
-    // and probabbly this should be done in a separate thread...
     void *packet = kmalloc(packet_length);
-    memcpy(packet, t, packet_length);
-    // TODO: this should be run in BH
-    ethernet_handle_packet(packet, packet_length);
+    if (packet) {
+        memcpy(packet, t, packet_length);
+        ethernet_handle_packet(packet, packet_length);
+        kfree(packet);
+    }
 
     current_packet_ptr = (current_packet_ptr + packet_length + 4 + 3) & RX_READ_POINTER_MASK;
 
@@ -42,8 +44,28 @@ void receive_packet() {
     outw(current_packet_ptr - 0x10, rtl8139_device.io_base + CAPR);
 }
 
-static void rtl8139_handler(struct intr_info *info) {
-    uint16_t status = inw(rtl8139_device.io_base + 0x3e);
+/*
+ *   rtl8139_rx_tasklet
+ *   DESCRIPTION: hand every packet in the receive ring to the network stack,
+ *                run as a bottom half of rtl8139_handler
+ *   INPUTS: unsigned long data
+ */
+static void rtl8139_rx_tasklet(unsigned long data) {
+    while (!(inb(rtl8139_device.io_base + ChipCmd) & RX_BUF_EMPTY))
+        receive_packet();
+}
+static DECLARE_TASKLET(rtl8139_rx, &rtl8139_rx_tasklet, 0);
+
+static irqreturn_t rtl8139_handler(struct intr_info *info, void *dev_id) {
+    uint16_t status = inw(rtl8139_device.io_base + IntrStatus);
+
+    // someone else on a shared line
+    if (!status)
+        return IRQ_NONE;
+
+    // acknowledge first, so that packets arriving while the tasklet drains
+    // the ring raise a new interrupt
+    outw(status, rtl8139_device.io_base + IntrStatus);
 
     if (status & TOK) {
         if (rtl8139_device.send_buffer)
@@ -51,8 +73,8 @@ static void rtl8139_handler(struct intr_info *info) {
         rtl8139_device.send_buffer = NULL;
     }
     if (status & ROK)
-        receive_packet();
-    outw(0x5, rtl8139_device.io_base + 0x3E);
+        tasklet_schedule(&rtl8139_rx);
+    return IRQ_HANDLED;
 }
 
 static void read_mac_addr() {
@@ -134,10 +156,17 @@ static void rtl8139_init() {
     // Sets the RE and TE bits high
     outb(0x0C, rtl8139_device.io_base + 0x37);
 
-    // Register and enable network interrupts
-    uint32_t irq_num = pci_read(pci_rtl8139_device, PCI_INTERRUPT_LINE);
+    // Register and enable network interrupts, through MSI if possible,
+    // which has the line to itself
+    uint32_t irq_flags = 0;
+    int32_t irq_num = pci_enable_msi(pci_rtl8139_device);
+    if (irq_num < 0) {
+        irq_num = pci_read(pci_rtl8139_device, PCI_INTERRUPT_LINE);
+        irq_flags = IRQF_SHARED;
+    }
     read_mac_addr();
 
-    set_irq_handler(irq_num, &rtl8139_handler);
+    if (request_irq(irq_num, &rtl8139_handler, irq_flags, "rtl8139", &rtl8139_device) < 0)
+        printk("rtl8139: IRQ %u is taken\n", irq_num);
 }
 DEFINE_INITCALL(rtl8139_init, drivers);
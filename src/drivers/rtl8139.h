@@ -18,6 +18,9 @@
 #define TER     (1<<3)
 #define TX_TOK  (1<<15)
 
+// in ChipCmd
+#define RX_BUF_EMPTY        (1<<0)
+
 enum RTL8139_registers {
     MAG0             = 0x00,       // Ethernet hardware address
     MAR0             = 0x08,       // Multicast filter
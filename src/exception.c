@@ -1,5 +1,6 @@
 #include "interrupt.h"
 #include "mm/paging.h"
+#include "mm/uaccess.h"
 #include "task/task.h"
 #include "task/signal.h"
 #include "panic.h"
@@ -77,6 +78,19 @@ static void page_fault(struct intr_info *info) {
         printk("%s[%d]: segfault at %p ip %#x sp %#x error %d\n", current->comm, current->pid, faultaddr, info->eip, info->esp, info->error_code);
         send_sig(current, SIGSEGV);
     } else {
+        // Kernel writes to userspace obey page protection since CR0.WP is
+        // set, so kernel can also hit COW pages.
+        if ((uint32_t)faultaddr >= USER_ADDR_START && (uint32_t)faultaddr < USER_ADDR_END) {
+            if ((info->error_code & PF_P) && (info->error_code & PF_W)) {
+                if (clone_cow(faultaddr))
+                    return;
+            }
+        }
+
+        // A uaccess function touching bad memory
+        if (fixup_exception(info))
+            return;
+
         panic_msgonly("#PF: %d ADDR: %p\n", info->error_code, faultaddr);
         dump_handler(info);
         abort();
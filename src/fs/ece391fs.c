@@ -153,8 +153,8 @@ static int32_t ece391fs_ino_lookup(struct inode *inode, const char *name, uint32
     if (res < 0)
         return res;
 
-    *next = kmalloc(sizeof(**next));
-    if (!next)
+    *next = kmem_cache_alloc(&inode_cache);
+    if (!*next)
         return -ENOMEM;
     **next = (struct inode){
         .sb = inode->sb,
@@ -164,7 +164,7 @@ static int32_t ece391fs_ino_lookup(struct inode *inode, const char *name, uint32
 
     res = (*inode->sb->op->read_inode)(*next);
     if (res < 0) {
-        kfree(*next);
+        kmem_cache_free(&inode_cache, *next);
         return res;
     }
     return 0;
@@ -239,7 +239,7 @@ static int32_t ustar_ino_lookup(struct inode *inode, const char *name, uint32_t
     info->sector_num = sector_num;
     info->path = path;
 
-    *next = kmalloc(sizeof(**next));
+    *next = kmem_cache_alloc(&inode_cache);
     if (!*next) {
         res = -ENOMEM;
         goto err_path_destroy;
@@ -258,7 +258,7 @@ static int32_t ustar_ino_lookup(struct inode *inode, const char *name, uint32_t
     return 0;
 
 err_free_inode:
-    kfree(*next);
+    kmem_cache_free(&inode_cache, *next);
 
 err_path_destroy:
     path_destroy(path);
@@ -7,6 +7,9 @@
 #include "panic.h"
 #include "eflags.h"
 #include "initcall.h"
+#include "lib/tsc.h"
+#include "syscall.h"
+#include "errno.h"
 #include "tests.h"
 
 asmlinkage
@@ -28,6 +31,23 @@ struct intr_action intr_getaction(uint8_t intr_num) {
     return intr_actions[intr_num];
 }
 
+/*  intr_set_entry
+ *  DESCRIPTION: point an initialized IDT entry at another entry stub,
+ *               keeping its gate type and privilege
+ *  INPUTS: uint8_t intr_num, void (*entry)(void)
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void intr_set_entry(uint8_t intr_num, void (*entry)(void)) {
+    uint32_t addr = (uint32_t)entry;
+    unsigned long flags;
+
+    cli_and_save(flags);
+    idt[intr_num].offset_15_00 = addr;
+    idt[intr_num].offset_31_16 = addr >> 16;
+    restore_flags(flags);
+}
+
 #define _init_IDT_entry(intr, _type, _dpl, suffix) do {     \
     /* function prototype don't matter here */              \
     extern void ISR_ ## intr ## _ ## suffix(void);          \
@@ -91,16 +111,35 @@ static void init_IDT() {
     init_IDT_entry(INTR_IRQ13, IDT_TYPE_INTERRUPT, KERNEL_DPL, nocode);
     init_IDT_entry(INTR_IRQ14, IDT_TYPE_INTERRUPT, KERNEL_DPL, nocode);
     init_IDT_entry(INTR_IRQ15, IDT_TYPE_INTERRUPT, KERNEL_DPL, nocode);
+    init_IDT_entry(INTR_IRQ16, IDT_TYPE_INTERRUPT, KERNEL_DPL, nocode);
+    init_IDT_entry(INTR_IRQ17, IDT_TYPE_INTERRUPT, KERNEL_DPL, nocode);
+    init_IDT_entry(INTR_IRQ18, IDT_TYPE_INTERRUPT, KERNEL_DPL, nocode);
+    init_IDT_entry(INTR_IRQ19, IDT_TYPE_INTERRUPT, KERNEL_DPL, nocode);
+    init_IDT_entry(INTR_IRQ20, IDT_TYPE_INTERRUPT, KERNEL_DPL, nocode);
+    init_IDT_entry(INTR_IRQ21, IDT_TYPE_INTERRUPT, KERNEL_DPL, nocode);
+    init_IDT_entry(INTR_IRQ22, IDT_TYPE_INTERRUPT, KERNEL_DPL, nocode);
+    init_IDT_entry(INTR_IRQ23, IDT_TYPE_INTERRUPT, KERNEL_DPL, nocode);
+    init_IDT_entry(INTR_IRQ24, IDT_TYPE_INTERRUPT, KERNEL_DPL, nocode);
+    init_IDT_entry(INTR_IRQ25, IDT_TYPE_INTERRUPT, KERNEL_DPL, nocode);
+    init_IDT_entry(INTR_IRQ26, IDT_TYPE_INTERRUPT, KERNEL_DPL, nocode);
+    init_IDT_entry(INTR_IRQ27, IDT_TYPE_INTERRUPT, KERNEL_DPL, nocode);
+    init_IDT_entry(INTR_IRQ28, IDT_TYPE_INTERRUPT, KERNEL_DPL, nocode);
+    init_IDT_entry(INTR_IRQ29, IDT_TYPE_INTERRUPT, KERNEL_DPL, nocode);
+    init_IDT_entry(INTR_IRQ30, IDT_TYPE_INTERRUPT, KERNEL_DPL, nocode);
+    init_IDT_entry(INTR_IRQ31, IDT_TYPE_INTERRUPT, KERNEL_DPL, nocode);
 
 #if RUN_TESTS
     init_IDT_entry(INTR_TEST, IDT_TYPE_TRAP, KERNEL_DPL, nocode);
 #endif
 
-    init_IDT_entry(INTR_SYSCALL, IDT_TYPE_TRAP,      USER_DPL,   nocode);
+    init_IDT_entry(INTR_SYSCALL, IDT_TYPE_TRAP,      USER_DPL,   direct);
     init_IDT_entry(INTR_SCHED,   IDT_TYPE_INTERRUPT, KERNEL_DPL, nocode);
     init_IDT_entry(INTR_ENTRY,   IDT_TYPE_TRAP,      KERNEL_DPL, nocode);
     init_IDT_entry(INTR_DUMP,    IDT_TYPE_INTERRUPT, KERNEL_DPL, nocode);
 
+    init_IDT_entry(INTR_LAPIC_TIMER,    IDT_TYPE_INTERRUPT, KERNEL_DPL, direct);
+    init_IDT_entry(INTR_LAPIC_SPURIOUS, IDT_TYPE_INTERRUPT, KERNEL_DPL, direct);
+
     lidt(idt_desc);
 }
 DEFINE_INITCALL(init_IDT, early);
@@ -230,4 +269,68 @@ static void idt_DF() {
     // asm volatile ("mov $0,%esp; mov (%esp),%esp");
 }
 DEFINE_TEST(idt_DF);
+
+/*  idt_dispatch_time
+ *  DESCRIPTION: time a bad syscall through whatever IDT entry is installed
+ *  INPUTS: uint32_t rounds
+ *  OUTPUTS: none
+ *  RETURN VALUE: cycles per int $0x80
+ */
+static uint32_t idt_dispatch_time(uint32_t rounds) {
+    uint64_t start;
+    uint32_t i, res;
+
+    start = rdtsc();
+    for (i = 0; i < rounds; i++)
+        asm volatile ("int %1" : "=a"(res) : "i"(INTR_SYSCALL), "a"(-1));
+    start = rdtsc() - start;
+
+    TEST_ASSERT(res == (uint32_t)-ENOSYS);
+    return (uint32_t)start / rounds;
+}
+
+/* Dispatch cost test
+ *
+ * Measures cycles per int $0x80, with the same vector and handler, through
+ * the table stub and do_interrupt, and through the direct stub
+ * Coverage: ISR_common, MAKE_DIRECT_ISR, do_interrupt, do_syscall
+ */
+__testfunc
+static void idt_dispatch_cost() {
+    extern void ISR_0x80_nocode(void);
+    extern void ISR_0x80_direct(void);
+    const uint32_t rounds = 1000;
+    uint32_t table, direct;
+
+    struct intr_action oldaction = intr_getaction(INTR_SYSCALL);
+    // asmlinkage is the default calling convention here
+    intr_setaction(INTR_SYSCALL, (struct intr_action){
+        .handler = (intr_handler_t *)&do_syscall });
+    intr_set_entry(INTR_SYSCALL, &ISR_0x80_nocode);
+    table = idt_dispatch_time(rounds);
+
+    intr_set_entry(INTR_SYSCALL, &ISR_0x80_direct);
+    intr_setaction(INTR_SYSCALL, oldaction);
+    direct = idt_dispatch_time(rounds);
+
+    test_printf("table: %u cycles, direct: %u cycles\n", table, direct);
+}
+DEFINE_TEST(idt_dispatch_cost);
+
+/* SYSENTER flags test
+ *
+ * Asserts that the user's NT, AC and DF do not survive into the kernel
+ * side of SYSENTER. TF is left out, as setting it would trap in the test.
+ * Coverage: sysenter_entry
+ */
+__testfunc
+static void sysenter_flags_test() {
+    extern uint32_t sysenter_flags_probe(uint32_t eflags);
+    uint32_t eflags;
+
+    eflags = sysenter_flags_probe(EFLAGS_BASE | NT | AC | DF);
+    TEST_ASSERT(!(eflags & (TF | NT | AC | DF | IF)));
+    TEST_ASSERT(eflags & EFLAGS_BASE);
+}
+DEFINE_TEST(sysenter_flags_test);
 #endif
@@ -42,6 +42,22 @@
 #define INTR_IRQ13 0x2D
 #define INTR_IRQ14 0x2E
 #define INTR_IRQ15 0x2F
+#define INTR_IRQ16 0x30
+#define INTR_IRQ17 0x31
+#define INTR_IRQ18 0x32
+#define INTR_IRQ19 0x33
+#define INTR_IRQ20 0x34
+#define INTR_IRQ21 0x35
+#define INTR_IRQ22 0x36
+#define INTR_IRQ23 0x37
+#define INTR_IRQ24 0x38
+#define INTR_IRQ25 0x39
+#define INTR_IRQ26 0x3A
+#define INTR_IRQ27 0x3B
+#define INTR_IRQ28 0x3C
+#define INTR_IRQ29 0x3D
+#define INTR_IRQ30 0x3E
+#define INTR_IRQ31 0x3F
 
 #define INTR_IRQ_MIN INTR_IRQ0
 
@@ -50,6 +66,9 @@
 #define INTR_ENTRY   0x82
 #define INTR_DUMP    0x83
 
+#define INTR_LAPIC_TIMER    0xEC
+#define INTR_LAPIC_SPURIOUS 0xEF // the low 4 bits must be set on old CPUs
+
 #ifndef ASM
 
 #include "lib/stdint.h"
@@ -100,5 +119,8 @@ void intr_setaction(uint8_t intr_num, struct intr_action action);
 // And get it
 struct intr_action intr_getaction(uint8_t intr_num);
 
+// Replace the entry stub of a vector, for ones that skip do_interrupt
+void intr_set_entry(uint8_t intr_num, void (*entry)(void));
+
 #endif
 #endif
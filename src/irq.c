@@ -1,26 +1,283 @@
 #include "irq.h"
 #include "drivers/i8259.h"
 #include "interrupt.h"
+#include "softirq.h"
 #include "printk.h"
+#include "mm/kmalloc.h"
+#include "lib/cli.h"
+#include "lib/stdio.h"
+#include "lib/tsc.h"
+#include "errno.h"
 
-// set up the array to function pointer
-static intr_handler_t *irq_handlers[IRQ_NUM];
-
-// handle hardware interrupt or else print interrupt request number
-static void irq_handler(struct intr_info *info) {
-    unsigned char irq_num = info->intr_num - INTR_IRQ_MIN;
-    send_eoi(irq_num);
-    if (irq_handlers[irq_num]) {
-        (*irq_handlers[irq_num])(info);
-    } else {
-        printk("[Unhandled IRQ] number = 0x%x\n", irq_num);
+// consecutive interrupts nobody claimed before a line is masked
+#define IRQ_UNHANDLED_LIMIT 1000
+
+struct irq_desc {
+    struct irq_chip *chip;   // NULL if nothing can raise the line
+    struct irqaction *action;
+    uint32_t count;
+    uint32_t unhandled;      // in total
+    uint32_t unhandled_run;  // in a row
+    uint64_t cycles;         // spent in the handlers
+};
+
+// until an IOAPIC takes over, only the ISA IRQs exist
+static struct irq_desc irq_descs[IRQ_NUM] = {
+    [0 ... IRQ_ISA_NUM - 1] = { .chip = &i8259_chip },
+};
+
+// the entry stubs that call do_irq directly, one per line
+extern void (*const irq_entries[IRQ_NUM])(void);
+
+/*  note_unhandled
+ *  DESCRIPTION: count an interrupt no handler claimed, and mask the line if
+ *               it keeps firing for nobody
+ *  INPUTS: unsigned int irq_num
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+static void note_unhandled(unsigned int irq_num) {
+    struct irq_desc *desc = &irq_descs[irq_num];
+
+    desc->unhandled++;
+    if (++desc->unhandled_run < IRQ_UNHANDLED_LIMIT)
+        return;
+
+    printk("[Unhandled IRQ] number = 0x%x, disabling\n", irq_num);
+    desc->chip->disable(irq_num);
+}
+
+// Run every handler on the line, then whatever bottom halves they raised.
+// The EOI comes after the handlers, so that a level-triggered line the
+// handlers have quieted does not fire again right away.
+asmlinkage
+void do_irq(struct intr_info *info) {
+    unsigned int irq_num = info->intr_num - INTR_IRQ_MIN;
+    struct irq_desc *desc = &irq_descs[irq_num];
+    irqreturn_t ret = IRQ_NONE;
+    struct irqaction *action;
+
+    irq_enter();
+
+    uint64_t start = rdtsc();
+    for (action = desc->action; action; action = action->next)
+        ret |= (*action->handler)(info, action->dev_id);
+    desc->cycles += rdtsc() - start;
+    desc->count++;
+
+    if (ret == IRQ_NONE)
+        note_unhandled(irq_num);
+    else
+        desc->unhandled_run = 0;
+
+    desc->chip->eoi(irq_num);
+    irq_exit(info);
+}
+
+/*  request_irq
+ *  DESCRIPTION: add a handler to an IRQ line and enable the line. The
+ *               vector then enters do_irq directly, skipping do_interrupt
+ *  INPUTS: unsigned int irq_num
+ *          irq_handler_t *handler
+ *          uint32_t flags -- IRQF_SHARED if the line can be shared
+ *          const char *name -- shown in the interrupt statistics
+ *          void *dev_id -- passed to the handler, and identifies it to
+ *                          free_irq
+ *  OUTPUTS: none
+ *  RETURN VALUE: 0 on success, or negative errno
+ */
+int32_t request_irq(unsigned int irq_num, irq_handler_t *handler, uint32_t flags,
+                    const char *name, void *dev_id) {
+    unsigned long intr_flags;
+    struct irqaction **pp;
+
+    if (irq_num >= IRQ_NUM || !handler)
+        return -EINVAL;
+
+    struct irqaction *action = kmalloc(sizeof(*action));
+    if (!action)
+        return -ENOMEM;
+
+    *action = (struct irqaction){
+        .handler = handler,
+        .flags   = flags,
+        .name    = name,
+        .dev_id  = dev_id,
+    };
+
+    cli_and_save(intr_flags);
+
+    struct irq_desc *desc = &irq_descs[irq_num];
+    if (!desc->chip) {
+        restore_flags(intr_flags);
+        kfree(action);
+        return -ENODEV;
+    }
+    if (desc->action && !(desc->action->flags & flags & IRQF_SHARED)) {
+        restore_flags(intr_flags);
+        kfree(action);
+        return -EBUSY;
+    }
+
+    for (pp = &desc->action; *pp; pp = &(*pp)->next);
+    *pp = action;
+    desc->unhandled_run = 0;
+
+    intr_set_entry(irq_num + INTR_IRQ_MIN, irq_entries[irq_num]);
+    desc->chip->enable(irq_num);
+
+    restore_flags(intr_flags);
+    return 0;
+}
+
+/*  free_irq
+ *  DESCRIPTION: remove a handler added by request_irq, and disable the line
+ *               if it was the last one
+ *  INPUTS: unsigned int irq_num, void *dev_id
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void free_irq(unsigned int irq_num, void *dev_id) {
+    unsigned long flags;
+    struct irqaction **pp, *action = NULL;
+
+    if (irq_num >= IRQ_NUM)
+        return;
+
+    cli_and_save(flags);
+
+    struct irq_desc *desc = &irq_descs[irq_num];
+    for (pp = &desc->action; *pp; pp = &(*pp)->next) {
+        if ((*pp)->dev_id == dev_id) {
+            action = *pp;
+            *pp = action->next;
+            break;
+        }
     }
+
+    if (!desc->action)
+        desc->chip->disable(irq_num);
+
+    restore_flags(flags);
+
+    if (action)
+        kfree(action);
 }
 
-// setup irq with given handler and enable the irq line
-void set_irq_handler(unsigned int irq_num, intr_handler_t *handler) {
-    irq_handlers[irq_num] = handler;
-    intr_setaction(irq_num + INTR_IRQ_MIN, (struct intr_action){
-        .handler = &irq_handler });
-    i8259_enable_irq(irq_num);
+/*  irq_set_chip
+ *  DESCRIPTION: hand a line over to another interrupt controller. If the
+ *               line has handlers, it is disabled on the old controller and
+ *               enabled on the new one
+ *  INPUTS: unsigned int irq_num, struct irq_chip *chip
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void irq_set_chip(unsigned int irq_num, struct irq_chip *chip) {
+    unsigned long flags;
+
+    if (irq_num >= IRQ_NUM || !chip)
+        return;
+
+    cli_and_save(flags);
+
+    struct irq_desc *desc = &irq_descs[irq_num];
+    if (desc->action) {
+        if (desc->chip)
+            desc->chip->disable(irq_num);
+        chip->enable(irq_num);
+    }
+    desc->chip = chip;
+
+    restore_flags(flags);
+}
+
+/*  irq_report
+ *  DESCRIPTION: write per-line interrupt counts, time spent in handlers,
+ *               and who handles them
+ *  INPUTS: char *buf, uint32_t size
+ *  OUTPUTS: none
+ *  RETURN VALUE: number of characters written, not including the terminator
+ */
+uint32_t irq_report(char *buf, uint32_t size) {
+    unsigned long flags;
+    uint32_t len = 0;
+    unsigned int irq_num;
+
+    len += scnprintf(buf + len, size - len,
+        "IRQ  CHIP    COUNT     UNHANDLED AVGCYCLES HANDLERS\n");
+
+    cli_and_save(flags);
+
+    for (irq_num = 0; irq_num < IRQ_NUM; irq_num++) {
+        struct irq_desc *desc = &irq_descs[irq_num];
+        struct irqaction *action;
+
+        if (!desc->action && !desc->count)
+            continue;
+
+        // scale down to avoid a 64-bit division
+        uint64_t total = desc->cycles;
+        uint32_t n = desc->count;
+        while (total >> 32) {
+            total >>= 1;
+            n >>= 1;
+        }
+        uint32_t avg = n ? (uint32_t)total / n : 0;
+
+        len += scnprintf(buf + len, size - len, "%-5u%-8s%-10u%-10u%-10u",
+            irq_num, desc->chip ? desc->chip->name : "-", desc->count,
+            desc->unhandled, avg);
+        for (action = desc->action; action; action = action->next)
+            len += scnprintf(buf + len, size - len, action->next ? "%s," : "%s",
+                action->name);
+        len += scnprintf(buf + len, size - len, "\n");
+    }
+
+    restore_flags(flags);
+    return len;
+}
+
+#include "tests.h"
+#if RUN_TESTS
+// nothing is wired to it under QEMU
+#define IRQ_TEST_LINE 5
+
+static irqreturn_t irq_test_none(struct intr_info *info, void *dev_id) {
+    (*(uint32_t *)dev_id)++;
+    return IRQ_NONE;
+}
+
+static irqreturn_t irq_test_handled(struct intr_info *info, void *dev_id) {
+    (*(uint32_t *)dev_id)++;
+    return IRQ_HANDLED;
+}
+
+/* Shared IRQ tests
+ *
+ * Asserts that every handler on a shared line runs, that an exclusive
+ * handler can't join it, and that an interrupt is only unhandled when no
+ * handler claims it
+ * Coverage: request_irq, free_irq, do_irq
+ */
+__testfunc
+static void irq_shared_test() {
+    struct irq_desc *desc = &irq_descs[IRQ_TEST_LINE];
+    uint32_t none = 0, handled = 0;
+
+    TEST_ASSERT(!request_irq(IRQ_TEST_LINE, &irq_test_none, IRQF_SHARED, "test", &none));
+    TEST_ASSERT(!request_irq(IRQ_TEST_LINE, &irq_test_handled, IRQF_SHARED, "test", &handled));
+    TEST_ASSERT(request_irq(IRQ_TEST_LINE, &irq_test_handled, 0, "test", NULL) == -EBUSY);
+
+    uint32_t unhandled = desc->unhandled;
+    asm volatile ("int %0" : : "i"(INTR_IRQ_MIN + IRQ_TEST_LINE));
+    TEST_ASSERT(none == 1 && handled == 1 && desc->unhandled == unhandled);
+
+    free_irq(IRQ_TEST_LINE, &handled);
+    asm volatile ("int %0" : : "i"(INTR_IRQ_MIN + IRQ_TEST_LINE));
+    TEST_ASSERT(none == 2 && handled == 1 && desc->unhandled == unhandled + 1);
+
+    free_irq(IRQ_TEST_LINE, &none);
+    TEST_ASSERT(!desc->action);
 }
+DEFINE_TEST(irq_shared_test);
+#endif
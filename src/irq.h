@@ -5,11 +5,52 @@
 
 #include "interrupt.h"
 
-#define IRQ_NUM 16
+// Lines 0-15 are the ISA IRQs, 16-23 the other IOAPIC inputs, and the rest
+// are handed out to MSI. Line n is always vector INTR_IRQ_MIN + n.
+#define IRQ_NUM     32
+#define IRQ_ISA_NUM 16
+#define IRQ_MSI_MIN 24
 
 #ifndef ASM
 
-void set_irq_handler(unsigned int irq_num, intr_handler_t *handler);
+#include "lib/stdint.h"
+
+// what a handler says about an interrupt, so that a shared line can tell
+// whether any of its devices raised it
+typedef enum {
+    IRQ_NONE    = 0,
+    IRQ_HANDLED = 1,
+} irqreturn_t;
+
+typedef irqreturn_t irq_handler_t(struct intr_info *info, void *dev_id);
+
+#define IRQF_SHARED 1 // may share the line with other IRQF_SHARED handlers
+
+struct irqaction {
+    struct irqaction *next;
+    irq_handler_t *handler;
+    uint32_t flags;
+    const char *name;
+    void *dev_id;
+};
+
+// the interrupt controller behind a line
+struct irq_chip {
+    const char *name;
+    void (*enable)(uint32_t irq_num);
+    void (*disable)(uint32_t irq_num);
+    void (*eoi)(uint32_t irq_num);
+};
+
+void irq_set_chip(unsigned int irq_num, struct irq_chip *chip);
+
+int32_t request_irq(unsigned int irq_num, irq_handler_t *handler, uint32_t flags,
+                    const char *name, void *dev_id);
+void free_irq(unsigned int irq_num, void *dev_id);
+
+uint32_t irq_report(char *buf, uint32_t size);
+
+asmlinkage void do_irq(struct intr_info *info);
 
 #endif
 #endif
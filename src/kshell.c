@@ -6,6 +6,11 @@
 #include "task/signal.h"
 #include "net/udp.h"
 #include "char/tty.h"
+#include "mm/kmalloc.h"
+#include "mm/slab.h"
+#include "mm/paging.h"
+#include "lockstat.h"
+#include "irq.h"
 #include "tests.h"
 
 #if RUN_TESTS
@@ -80,6 +85,30 @@ static int kshell(void *args) {
                 else
                     fprintf(tty, "[%s]\n", task->comm);
             }
+        } else if (!strcmp(buf, "meminfo") || !strcmp(buf, "slabinfo") ||
+                   !strcmp(buf, "lockstat") || !strcmp(buf, "interrupts")) {
+            char *report = kmalloc(PAGE_SIZE_SMALL * 2);
+            if (!report) {
+                fprintf(tty, "Out of memory\n");
+                continue;
+            }
+
+            if (!strcmp(buf, "meminfo"))
+                kmalloc_report(report, PAGE_SIZE_SMALL * 2);
+            else if (!strcmp(buf, "slabinfo"))
+                slab_report(report, PAGE_SIZE_SMALL * 2);
+            else if (!strcmp(buf, "lockstat"))
+                lock_stat_report(report, PAGE_SIZE_SMALL * 2);
+            else
+                irq_report(report, PAGE_SIZE_SMALL * 2);
+            fprintf(tty, "%s", report);
+            kfree(report);
+#if KMALLOC_TRACK
+        } else if (!strcmp(buf, "memtrack on")) {
+            kmalloc_tracking = true;
+        } else if (!strcmp(buf, "memtrack off")) {
+            kmalloc_tracking = false;
+#endif
         } else if (!strcmp(buf, "kselftest")) {
 #if RUN_TESTS
             struct task_struct *kselftest_task = kernel_thread(&kselftest, NULL);
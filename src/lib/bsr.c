@@ -16,6 +16,11 @@ static void bsr_test() {
     TEST_ASSERT(bsr(0x5) == 2);
     TEST_ASSERT(bsr(1<<31) == 31);
     TEST_ASSERT(bsr((1<<31)+0x1000) == 31);
+    TEST_ASSERT(bsf(0) == -1);
+    TEST_ASSERT(bsf(0x1) == 0);
+    TEST_ASSERT(bsf(0x6) == 1);
+    TEST_ASSERT(bsf(1<<31) == 31);
+    TEST_ASSERT(bsf((1<<31)+0x1000) == 12);
 }
 DEFINE_TEST(bsr_test);
 #endif
@@ -9,3 +9,13 @@ static inline int8_t bsr(uint32_t in) {
     asm volatile ("bsrl %1,%0" : "=r"(out) : "rm"(in) : "cc");
     return out;
 }
+
+// Find the bit number of the least significant true bit, or -1 if none
+static inline int8_t bsf(uint32_t in) {
+    if (!in)
+        return -1;
+
+    uint32_t out;
+    asm volatile ("bsfl %1,%0" : "=r"(out) : "rm"(in) : "cc");
+    return out;
+}
@@ -0,0 +1,23 @@
+#ifndef _MSR_H
+#define _MSR_H
+
+#include "stdint.h"
+
+#define MSR_IA32_APIC_BASE    0x01B
+#define MSR_IA32_SYSENTER_CS  0x174
+#define MSR_IA32_SYSENTER_ESP 0x175
+#define MSR_IA32_SYSENTER_EIP 0x176
+
+// Read a model specific register
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint64_t ret;
+    asm volatile ("rdmsr" : "=A"(ret) : "c"(msr));
+    return ret;
+}
+
+// Write a model specific register
+static inline void wrmsr(uint32_t msr, uint64_t val) {
+    asm volatile ("wrmsr" : : "c"(msr), "A"(val) : "memory");
+}
+
+#endif
@@ -347,6 +347,20 @@ int32_t vsnprintf(char *str, uint32_t size, const char *format, va_list ap) {
     return res;
 }
 
+// Like vsnprintf, but returns the number of characters actually written into
+// str, not including the null terminator, so it can be chained into a buffer
+int32_t vscnprintf(char *str, uint32_t size, const char *format, va_list ap) {
+    if (!size)
+        return 0;
+
+    int32_t res = vsnprintf(str, size, format, ap);
+    if (res >= size) {
+        str[size - 1] = '\0';
+        return size - 1;
+    }
+    return res;
+}
+
 __printf(1, 2)
 int32_t printf(const char *format, ...) {
     va_list ap;
@@ -379,3 +393,14 @@ int32_t snprintf(char *str, uint32_t size, const char *format, ...) {
     va_end(ap);
     return res;
 }
+
+__printf(3, 4)
+int32_t scnprintf(char *str, uint32_t size, const char *format, ...) {
+    va_list ap;
+    va_start(ap, format);
+
+    int32_t res = vscnprintf(str, size, format, ap);
+
+    va_end(ap);
+    return res;
+}
@@ -0,0 +1,13 @@
+#ifndef _TSC_H
+#define _TSC_H
+
+#include "stdint.h"
+
+// Read the time stamp counter
+static inline uint64_t rdtsc(void) {
+    uint64_t ret;
+    asm volatile ("rdtsc" : "=A"(ret));
+    return ret;
+}
+
+#endif
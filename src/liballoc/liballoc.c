@@ -1,4 +1,6 @@
 #include "liballoc.h"
+#include "../mm/kmalloc.h"
+#include "../lib/bsr.h"
 
 // adapted from: https://github.com/blanham/liballoc/blob/master/liballoc_1_1.c
 
@@ -94,6 +96,27 @@ static unsigned int l_pageCount  = 16;   ///< The number of pages to request per
 static unsigned long l_allocated = 0;    ///< Running total of allocated memory.
 static unsigned long l_inuse     = 0;    ///< Running total of used memory.
 
+/** Small allocations are served from power-of-two size classes instead.
+ * Each class keeps a free list of chunks carved out of whole pages, so
+ * allocating and freeing is a pop / push. The chunk header takes the place of
+ * the alignment info, and its tag has the high bit set, which ALIGN never
+ * writes, so kfree can tell the two kinds of allocations apart.
+ */
+#define LIBALLOC_CLASS_TAG  0x80
+#define LIBALLOC_CLASS_OBJS 8 ///< The minimum number of chunks carved per refill.
+
+struct liballoc_class_chunk {
+    unsigned char tag;                  ///< LIBALLOC_CLASS_TAG | class index.
+    unsigned char reserved[3];
+    unsigned int req_size;              ///< The size of memory requested.
+    struct liballoc_class_chunk *next;  ///< Free list link.
+    unsigned int magic;                 ///< A magic number to idenfity correctness.
+};
+
+static struct liballoc_class_chunk *l_classFree[KMALLOC_NUM_CLASSES]; ///< Free list of each class.
+static struct kmalloc_class_stats l_classStats[KMALLOC_NUM_CLASSES];
+static unsigned long l_largeCount = 0; ///< Number of allocations too large for a class.
+
 static long l_warningCount     = 0; ///< Number of warnings encountered
 static long l_errorCount       = 0; ///< Number of actual errors
 static long l_possibleOverruns = 0; ///< Number of possible overruns
@@ -143,6 +166,14 @@ static void liballoc_dump() {
     info_printf("liballoc: Error count: %li\n", l_errorCount);
     info_printf("liballoc: Possible overruns: %li\n", l_possibleOverruns);
 
+    int i;
+    for (i = 0; i < KMALLOC_NUM_CLASSES; i++) {
+        struct kmalloc_class_stats *st = &l_classStats[i];
+        info_printf("liballoc: class %u: %u hits, %u misses, %u in use, %u free\n",
+                    KMALLOC_MIN_CLASS << i, st->hits, st->misses, st->inuse, st->free);
+    }
+    info_printf("liballoc: large allocations: %li\n", l_largeCount);
+
 #ifdef DEBUG
         while (maj != NULL) {
             debug_printf("liballoc: %p: total = %i, used = %i\n",
@@ -208,8 +239,128 @@ static struct liballoc_major *allocate_new_page(unsigned int size) {
     return maj;
 }
 
+static inline int kmalloc_class(size_t req_size) {
+    if (req_size <= KMALLOC_MIN_CLASS)
+        return 0;
+    return bsr(req_size - 1) + 1 - bsr(KMALLOC_MIN_CLASS);
+}
+
+static inline int is_class_chunk(void *ptr) {
+    return *(unsigned char *)((uintptr_t)ptr - ALIGN_INFO) & LIBALLOC_CLASS_TAG;
+}
+
+static inline struct liballoc_class_chunk *ptr_to_chunk(void *ptr) {
+    return (struct liballoc_class_chunk *)((uintptr_t)ptr - sizeof(struct liballoc_class_chunk));
+}
+
+// Carve fresh pages into chunks for a class. Called with liballoc_lock held.
+static int class_refill(int cls) {
+    unsigned int stride = sizeof(struct liballoc_class_chunk) + (KMALLOC_MIN_CLASS << cls);
+    unsigned int pages = (stride * LIBALLOC_CLASS_OBJS + l_pageSize - 1) / l_pageSize;
+    unsigned int i, num = pages * l_pageSize / stride;
+
+    char *mem = liballoc_alloc(pages);
+    if (mem == NULL) {
+        l_warningCount += 1;
+        info_printf("liballoc: WARNING: liballoc_alloc(%i) return NULL\n", pages);
+        return -1;
+    }
+
+    l_allocated += pages * l_pageSize;
+
+    for (i = 0; i < num; i++, mem += stride) {
+        struct liballoc_class_chunk *chunk = (struct liballoc_class_chunk *)mem;
+        chunk->tag   = LIBALLOC_CLASS_TAG | cls;
+        chunk->magic = LIBALLOC_DEAD;
+        chunk->next  = l_classFree[cls];
+        l_classFree[cls] = chunk;
+    }
+
+    l_classStats[cls].free += num;
+    return 0;
+}
+
+static void *class_alloc(size_t req_size) {
+    unsigned long flags;
+    int cls = kmalloc_class(req_size);
+    struct kmalloc_class_stats *st = &l_classStats[cls];
+    struct liballoc_class_chunk *chunk;
+
+    liballoc_lock(&flags);
+
+    if (l_classFree[cls] != NULL) {
+        st->hits += 1;
+    } else {
+        st->misses += 1;
+        if (class_refill(cls)) {
+            liballoc_unlock(&flags);
+            return NULL;
+        }
+    }
+
+    chunk = l_classFree[cls];
+    l_classFree[cls] = chunk->next;
+    chunk->magic    = LIBALLOC_MAGIC;
+    chunk->req_size = req_size;
+    st->free  -= 1;
+    st->inuse += 1;
+    l_inuse   += KMALLOC_MIN_CLASS << cls;
+
+    liballoc_unlock(&flags);
+    return (void *)((uintptr_t)chunk + sizeof(struct liballoc_class_chunk));
+}
+
+static void class_free(void *ptr) {
+    unsigned long flags;
+    struct liballoc_class_chunk *chunk = ptr_to_chunk(ptr);
+    int cls = chunk->tag & ~LIBALLOC_CLASS_TAG;
+    struct kmalloc_class_stats *st;
+
+    liballoc_lock(&flags);
+
+    if (chunk->magic != LIBALLOC_MAGIC || cls >= KMALLOC_NUM_CLASSES) {
+        l_errorCount += 1;
+        if (chunk->magic == LIBALLOC_DEAD) {
+            info_printf("liballoc: ERROR: multiple kfree() attempt on %p from %#x.\n",
+                        ptr,
+                        __builtin_return_address(0));
+        } else {
+            info_printf("liballoc: ERROR: Bad kfree(%p) called from %#x\n",
+                        ptr,
+                        __builtin_return_address(0));
+        }
+        liballoc_unlock(&flags);
+        return;
+    }
+
+    st = &l_classStats[cls];
+    chunk->magic = LIBALLOC_DEAD;
+    chunk->next  = l_classFree[cls];
+    l_classFree[cls] = chunk;
+    st->free  += 1;
+    st->inuse -= 1;
+    l_inuse   -= KMALLOC_MIN_CLASS << cls;
+
+    liballoc_unlock(&flags);
+}
+
+void kmalloc_get_stats(struct kmalloc_stats *stats) {
+    unsigned long flags;
+
+    liballoc_lock(&flags);
+    stats->allocated = l_allocated;
+    stats->inuse     = l_inuse;
+    stats->large     = l_largeCount;
+    liballoc_memcpy(stats->classes, l_classStats, sizeof(l_classStats));
+    liballoc_unlock(&flags);
+
+    int i;
+    for (i = 0; i < KMALLOC_NUM_CLASSES; i++)
+        stats->classes[i].size = KMALLOC_MIN_CLASS << i;
+}
+
 __attribute__ ((malloc))
-void *kmalloc(size_t req_size) {
+static void *liballoc_kmalloc(size_t req_size) {
     unsigned long flags;
     int startedBet = 0;
     unsigned long bestSize = 0;
@@ -220,6 +371,9 @@ void *kmalloc(size_t req_size) {
     struct liballoc_minor *new_min;
     unsigned long size = req_size;
 
+    if (req_size && req_size <= KMALLOC_MAX_CLASS)
+        return class_alloc(req_size);
+
     // For alignment, we adjust size so there's enough space to align.
     if (ALIGNMENT > 1) {
         size += ALIGNMENT + ALIGN_INFO;
@@ -229,12 +383,14 @@ void *kmalloc(size_t req_size) {
 
     liballoc_lock(&flags);
 
+    l_largeCount += 1;
+
     if (size == 0) {
         l_warningCount += 1;
         info_printf("liballoc: WARNING: alloc(0) called from %#x\n",
                             __builtin_return_address(0));
         liballoc_unlock(&flags);
-        return kmalloc(1);
+        return liballoc_kmalloc(1);
     }
 
     if (l_memRoot == NULL) {
@@ -475,7 +631,7 @@ void *kmalloc(size_t req_size) {
     return NULL;
 }
 
-void kfree(void *ptr) {
+static void liballoc_kfree(void *ptr) {
     unsigned long flags;
     struct liballoc_minor *min;
     struct liballoc_major *maj;
@@ -487,6 +643,11 @@ void kfree(void *ptr) {
         return;
     }
 
+    if (is_class_chunk(ptr)) {
+        class_free(ptr);
+        return;
+    }
+
     UNALIGN(ptr);
 
     liballoc_lock(&flags);
@@ -566,13 +727,13 @@ void kfree(void *ptr) {
 }
 
 __attribute__ ((malloc))
-void *kcalloc(size_t nobj, size_t size) {
+static void *liballoc_kcalloc(size_t nobj, size_t size) {
     int real_size;
     void *p;
 
     real_size = nobj * size;
 
-    p = kmalloc(real_size);
+    p = liballoc_kmalloc(real_size);
 
     liballoc_memset(p, 0, real_size);
 
@@ -580,7 +741,7 @@ void *kcalloc(size_t nobj, size_t size) {
 }
 
 __attribute__ ((warn_unused_result))
-void *krealloc(void *p, size_t size) {
+static void *liballoc_krealloc(void *p, size_t size) {
     unsigned long flags;
     void *ptr;
     struct liballoc_minor *min;
@@ -588,12 +749,29 @@ void *krealloc(void *p, size_t size) {
 
     // Honour the case of size == 0 => free old and return NULL
     if (size == 0) {
-        kfree(p);
+        liballoc_kfree(p);
         return NULL;
     }
 
     // In the case of a NULL pointer, return a simple malloc.
-    if (p == NULL) return kmalloc(size);
+    if (p == NULL) return liballoc_kmalloc(size);
+
+    if (is_class_chunk(p)) {
+        struct liballoc_class_chunk *chunk = ptr_to_chunk(p);
+
+        // Still fits in the same chunk?
+        if (chunk->magic == LIBALLOC_MAGIC &&
+                size <= (KMALLOC_MIN_CLASS << (chunk->tag & ~LIBALLOC_CLASS_TAG))) {
+            chunk->req_size = size;
+            return p;
+        }
+
+        ptr = liballoc_kmalloc(size);
+        if (ptr == NULL) return NULL;
+        liballoc_memcpy(ptr, p, chunk->req_size < size ? chunk->req_size : size);
+        liballoc_kfree(p);
+        return ptr;
+    }
 
     // Unalign the pointer if required.
     ptr = p;
@@ -647,9 +825,50 @@ void *krealloc(void *p, size_t size) {
     liballoc_unlock(&flags);
 
     // If we got here then we're reallocating to a block bigger than us.
-    ptr = kmalloc(size);                    // We need to allocate new memory
+    ptr = liballoc_kmalloc(size);           // We need to allocate new memory
     liballoc_memcpy(ptr, p, real_size);
-    kfree(p);
+    liballoc_kfree(p);
+
+    return ptr;
+}
+
+// ***********   PUBLIC INTERFACE   *******************************
+// These record the real caller for allocation tracking, so liballoc itself
+// must only call the liballoc_* versions above.
+
+#define CALLER_ADDR() ((uintptr_t)__builtin_return_address(0))
+
+__attribute__ ((malloc))
+void *kmalloc(size_t size) {
+    void *p = liballoc_kmalloc(size);
+    kmalloc_track_alloc(p, size, CALLER_ADDR());
+    return p;
+}
+
+void kfree(void *ptr) {
+    kmalloc_track_free(ptr);
+    liballoc_kfree(ptr);
+}
+
+__attribute__ ((malloc))
+void *kcalloc(size_t nobj, size_t size) {
+    void *p = liballoc_kcalloc(nobj, size);
+    kmalloc_track_alloc(p, nobj * size, CALLER_ADDR());
+    return p;
+}
+
+__attribute__ ((warn_unused_result))
+void *krealloc(void *p, size_t size) {
+    unsigned long flags;
+    void *ptr;
+
+    // p may be freed and handed out again before we get to untrack it
+    liballoc_lock(&flags);
+    ptr = liballoc_krealloc(p, size);
+    if (p != NULL && (ptr != NULL || size == 0))
+        kmalloc_track_free(p);
+    kmalloc_track_alloc(ptr, size, CALLER_ADDR());
+    liballoc_unlock(&flags);
 
     return ptr;
 }
@@ -0,0 +1,116 @@
+#include "lockstat.h"
+#include "task/task.h"
+#include "lib/cli.h"
+#include "lib/stdio.h"
+#include "lib/tsc.h"
+
+static struct lock_stat *lock_stat_list;
+
+#if LOCK_STAT
+/*  lock_stat_acquired
+ *  DESCRIPTION: account for a successful acquisition
+ *  INPUTS: struct lock_stat *stat
+ *          uint64_t wait_start -- TSC when waiting began, 0 if uncontended
+ *          bool exclusive -- whether to record current as the holder
+ *          void *ip -- the caller of the lock function
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void lock_stat_acquired(struct lock_stat *stat, uint64_t wait_start, bool exclusive, void *ip) {
+    unsigned long flags;
+    cli_and_save(flags);
+
+    if (!stat->registered) {
+        stat->registered = true;
+        stat->next = lock_stat_list;
+        lock_stat_list = stat;
+    }
+
+    stat->acquired++;
+    if (wait_start) {
+        uint64_t wait = rdtsc() - wait_start;
+        stat->contended++;
+        stat->wait_cycles += wait;
+        if (wait > stat->max_wait_cycles)
+            stat->max_wait_cycles = wait;
+    }
+
+    if (exclusive) {
+        stat->holder = current;
+        stat->holder_ip = ip;
+    }
+
+    restore_flags(flags);
+}
+
+void lock_stat_released(struct lock_stat *stat) {
+    stat->holder = NULL;
+    stat->holder_ip = NULL;
+}
+
+/*  lock_stat_unregister
+ *  DESCRIPTION: unlink a lock that is about to be freed from the report
+ *  INPUTS: struct lock_stat *stat
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void lock_stat_unregister(struct lock_stat *stat) {
+    unsigned long flags;
+    cli_and_save(flags);
+
+    struct lock_stat **prevp;
+    for (prevp = &lock_stat_list; *prevp; prevp = &(*prevp)->next) {
+        if (*prevp == stat) {
+            *prevp = stat->next;
+            break;
+        }
+    }
+    stat->registered = false;
+
+    restore_flags(flags);
+}
+#endif
+
+/*  lock_stat_report
+ *  DESCRIPTION: write a per-lock summary of all locks taken so far
+ *  INPUTS: char *buf, uint32_t size
+ *  OUTPUTS: none
+ *  RETURN VALUE: number of characters written, not including the terminator
+ */
+uint32_t lock_stat_report(char *buf, uint32_t size) {
+    unsigned long flags;
+    uint32_t len = 0;
+
+#if LOCK_STAT
+    len += scnprintf(buf + len, size - len,
+        "NAME                    ACQUIRED  CONTENDED AVGWAIT   MAXWAIT   HOLDER\n");
+
+    cli_and_save(flags);
+
+    struct lock_stat *stat;
+    for (stat = lock_stat_list; stat; stat = stat->next) {
+        // scale down to avoid a 64-bit division
+        uint64_t total = stat->wait_cycles;
+        uint32_t n = stat->contended;
+        while (total >> 32) {
+            total >>= 1;
+            n >>= 1;
+        }
+        uint32_t avg = n ? (uint32_t)total / n : 0;
+        uint32_t max = stat->max_wait_cycles >> 32 ? 0xFFFFFFFF : stat->max_wait_cycles;
+        len += scnprintf(buf + len, size - len, "%-24s%-10u%-10u%-10u%-10u",
+            stat->name, stat->acquired, stat->contended, avg, max);
+        if (stat->holder)
+            len += scnprintf(buf + len, size - len, "%u@%p\n",
+                stat->holder->pid, stat->holder_ip);
+        else
+            len += scnprintf(buf + len, size - len, "-\n");
+    }
+
+    restore_flags(flags);
+#else
+    (void)flags;
+    len += scnprintf(buf + len, size - len, "lock statistics disabled\n");
+#endif
+    return len;
+}
@@ -0,0 +1,44 @@
+#ifndef _LOCKSTAT_H
+#define _LOCKSTAT_H
+
+#include "lib/stdint.h"
+#include "lib/stdbool.h"
+
+// Set to 0 to compile out lock contention statistics
+#define LOCK_STAT 1
+
+struct task_struct;
+
+/*
+ * Per-lock statistics, embedded in each rwsem. A lock is linked into
+ * lock_stat_list the first time it is taken, so statically and dynamically
+ * defined locks both show up without registration. Wait times are in TSC
+ * cycles.
+ */
+struct lock_stat {
+    const char *name;
+    uint32_t acquired;
+    uint32_t contended;
+    uint64_t wait_cycles;
+    uint64_t max_wait_cycles;
+
+    // exclusive holder, NULL if free or only held shared
+    struct task_struct *holder;
+    void *holder_ip;
+
+    bool registered;
+    struct lock_stat *next;
+};
+
+#define LOCK_STAT_INITIALIZER(_name) { .name = (_name) }
+
+#if LOCK_STAT
+void lock_stat_acquired(struct lock_stat *stat, uint64_t wait_start, bool exclusive, void *ip);
+void lock_stat_released(struct lock_stat *stat);
+void lock_stat_unregister(struct lock_stat *stat);
+#endif
+
+// Write a per-lock summary into buf, return length written
+uint32_t lock_stat_report(char *buf, uint32_t size);
+
+#endif
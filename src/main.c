@@ -201,6 +201,7 @@ noreturn void kernel_main(void) {
     *swapper_task = (struct task_struct){
         .comm      = "swapper",
     };
+    list_init(&swapper_task->children);
 
     swapper_task->sigactions = kmalloc(sizeof(*swapper_task->sigactions));
     *swapper_task->sigactions = (struct sigactions){
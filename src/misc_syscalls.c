@@ -1,6 +1,6 @@
 #include "syscall.h"
 #include "lib/string.h"
-#include "mm/paging.h"
+#include "mm/uaccess.h"
 #include "x86_desc.h"
 #include "errno.h"
 
@@ -23,11 +23,8 @@ static const struct utsname utsname = {
 };
 
 DEFINE_SYSCALL1(LINUX, uname, struct utsname *, buf) {
-    uint32_t nbytes = safe_buf(buf, sizeof(*buf), true);
-    if (nbytes != sizeof(*buf))
+    if (copy_to_user(buf, &utsname, sizeof(*buf)))
         return -EFAULT;
 
-    *buf = utsname;
-
     return 0;
 }
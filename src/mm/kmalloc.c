@@ -1,7 +1,10 @@
-// Functions needed by liballoc
+// Functions needed by liballoc, and kernel heap statistics
 
-#include "../lib/cli.h"
+#include "kmalloc.h"
+#include "slab.h"
 #include "paging.h"
+#include "../lib/cli.h"
+#include "../lib/stdio.h"
 
 void liballoc_lock(unsigned long *flags) {
     cli_and_save(*flags);
@@ -19,3 +22,205 @@ void *liballoc_alloc(uint16_t pages) {
 void liballoc_free(void *ptr, uint16_t pages) {
     free_pages(ptr, pages, 0);
 }
+
+#if KMALLOC_TRACK
+#define TRACK_HASH_SIZE 1024
+#define TRACK_MAX_SITES 256
+#define TRACK_REPORT_SITES 16
+
+struct kmalloc_site {
+    uint32_t caller;
+    uint32_t live_count;
+    uint32_t live_bytes;
+    uint32_t total_count;
+};
+
+struct kmalloc_record {
+    struct kmalloc_record *next;
+    void *ptr;
+    uint32_t size;
+    struct kmalloc_site *site;
+};
+
+bool kmalloc_tracking;
+
+// records are kept in a slab cache, so tracking never recurses into kmalloc
+static DEFINE_KMEM_CACHE(kmalloc_record_cache, struct kmalloc_record, NULL);
+static struct kmalloc_record *track_hash[TRACK_HASH_SIZE];
+static uint32_t track_records;
+static uint32_t track_dropped;
+
+// The last entry collects everything once the table is full
+static struct kmalloc_site track_sites[TRACK_MAX_SITES + 1];
+
+static inline uint32_t track_hash_ptr(void *ptr) {
+    // allocations are 16-byte aligned
+    return ((uint32_t)ptr >> 4) % TRACK_HASH_SIZE;
+}
+
+static struct kmalloc_site *track_get_site(uint32_t caller) {
+    uint32_t i, idx = (caller >> 2) % TRACK_MAX_SITES;
+    for (i = 0; i < TRACK_MAX_SITES; i++, idx = (idx + 1) % TRACK_MAX_SITES) {
+        struct kmalloc_site *site = &track_sites[idx];
+        if (site->caller == caller)
+            return site;
+        if (!site->caller) {
+            site->caller = caller;
+            return site;
+        }
+    }
+    return &track_sites[TRACK_MAX_SITES];
+}
+
+/*  kmalloc_track_alloc
+ *  DESCRIPTION: record a new allocation if tracking is enabled
+ *  INPUTS: void *ptr, uint32_t size, uint32_t caller
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void kmalloc_track_alloc(void *ptr, uint32_t size, uint32_t caller) {
+    unsigned long flags;
+
+    if (!kmalloc_tracking || !ptr)
+        return;
+
+    struct kmalloc_record *record = kmem_cache_alloc(&kmalloc_record_cache);
+
+    cli_and_save(flags);
+
+    if (!record) {
+        track_dropped++;
+        restore_flags(flags);
+        return;
+    }
+
+    struct kmalloc_site *site = track_get_site(caller);
+    site->live_count++;
+    site->live_bytes += size;
+    site->total_count++;
+
+    uint32_t hash = track_hash_ptr(ptr);
+    *record = (struct kmalloc_record){
+        .next = track_hash[hash],
+        .ptr = ptr,
+        .size = size,
+        .site = site,
+    };
+    track_hash[hash] = record;
+    track_records++;
+
+    restore_flags(flags);
+}
+
+/*  kmalloc_track_free
+ *  DESCRIPTION: forget an allocation, if it was recorded
+ *  INPUTS: void *ptr
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void kmalloc_track_free(void *ptr) {
+    unsigned long flags;
+    struct kmalloc_record *record = NULL;
+
+    // records stay around after tracking is turned off, until freed
+    if (!track_records || !ptr)
+        return;
+
+    cli_and_save(flags);
+
+    struct kmalloc_record **prevp;
+    for (prevp = &track_hash[track_hash_ptr(ptr)]; *prevp; prevp = &(*prevp)->next) {
+        if ((*prevp)->ptr == ptr) {
+            record = *prevp;
+            *prevp = record->next;
+            record->site->live_count--;
+            record->site->live_bytes -= record->size;
+            track_records--;
+            break;
+        }
+    }
+
+    restore_flags(flags);
+
+    if (record)
+        kmem_cache_free(&kmalloc_record_cache, record);
+}
+
+static uint32_t track_report(char *buf, uint32_t size) {
+    unsigned long flags;
+    struct kmalloc_site top[TRACK_REPORT_SITES];
+    uint32_t i, j, num_top = 0, records, dropped;
+
+    cli_and_save(flags);
+
+    // keep the sites with the most live bytes, sorted descending
+    for (i = 0; i <= TRACK_MAX_SITES; i++) {
+        struct kmalloc_site *site = &track_sites[i];
+        if (!site->live_count)
+            continue;
+
+        for (j = num_top; j > 0 && top[j - 1].live_bytes < site->live_bytes; j--) {
+            if (j < TRACK_REPORT_SITES)
+                top[j] = top[j - 1];
+        }
+        if (j < TRACK_REPORT_SITES) {
+            top[j] = *site;
+            if (num_top < TRACK_REPORT_SITES)
+                num_top++;
+        }
+    }
+
+    records = track_records;
+    dropped = track_dropped;
+
+    restore_flags(flags);
+
+    uint32_t len = 0;
+    len += scnprintf(buf + len, size - len, "Tracking:      %s\n",
+        kmalloc_tracking ? "on" : "off");
+    len += scnprintf(buf + len, size - len, "Tracked:       %u allocations, %u dropped\n",
+        records, dropped);
+    if (!num_top)
+        return len;
+
+    len += scnprintf(buf + len, size - len, "CALLER      LIVE    BYTES     TOTAL\n");
+    for (i = 0; i < num_top; i++) {
+        if (top[i].caller)
+            len += scnprintf(buf + len, size - len, "%#x  ", top[i].caller);
+        else
+            len += scnprintf(buf + len, size - len, "(other)     ");
+        len += scnprintf(buf + len, size - len, "%-8u%-10u%u\n",
+            top[i].live_count, top[i].live_bytes, top[i].total_count);
+    }
+    return len;
+}
+#endif
+
+/*  kmalloc_report
+ *  DESCRIPTION: write a human-readable summary of the kernel heap
+ *  INPUTS: char *buf, uint32_t size
+ *  OUTPUTS: none
+ *  RETURN VALUE: number of characters written, not including the terminator
+ */
+uint32_t kmalloc_report(char *buf, uint32_t size) {
+    struct kmalloc_stats stats;
+    uint32_t i, len = 0;
+
+    kmalloc_get_stats(&stats);
+
+    len += scnprintf(buf + len, size - len, "HeapTotal:     %u kB\n", stats.allocated / LEN_1K);
+    len += scnprintf(buf + len, size - len, "HeapInUse:     %u kB\n", stats.inuse / LEN_1K);
+    len += scnprintf(buf + len, size - len, "LargeAllocs:   %u\n", stats.large);
+
+    len += scnprintf(buf + len, size - len, "CLASS   HITS      MISSES  INUSE   FREE\n");
+    for (i = 0; i < KMALLOC_NUM_CLASSES; i++) {
+        struct kmalloc_class_stats *cls = &stats.classes[i];
+        len += scnprintf(buf + len, size - len, "%-8u%-10u%-8u%-8u%u\n",
+            cls->size, cls->hits, cls->misses, cls->inuse, cls->free);
+    }
+
+#if KMALLOC_TRACK
+    len += track_report(buf + len, size - len);
+#endif
+    return len;
+}
@@ -18,6 +18,49 @@ extern void *kcalloc(uint32_t, uint32_t);
 
 extern void  kfree(void *);
 
+// Allocations up to KMALLOC_MAX_CLASS bytes are rounded up to a power of two
+// and served from per-size free lists
+#define KMALLOC_MIN_CLASS   16
+#define KMALLOC_MAX_CLASS   2048
+#define KMALLOC_NUM_CLASSES 8
+
+struct kmalloc_class_stats {
+    uint32_t size;
+    uint32_t hits;      // allocations served straight from the free list
+    uint32_t misses;    // allocations that had to carve new pages
+    uint32_t inuse;
+    uint32_t free;
+};
+
+struct kmalloc_stats {
+    uint32_t allocated; // bytes of pages taken from the page allocator
+    uint32_t inuse;     // bytes handed out
+    uint32_t large;     // allocations too large for a size class
+    struct kmalloc_class_stats classes[KMALLOC_NUM_CLASSES];
+};
+
+void kmalloc_get_stats(struct kmalloc_stats *stats);
+
+// Allocation tracking records the caller and size of every live allocation
+// made while kmalloc_tracking is set, so leaks and memory growth can be
+// attributed to call sites.
+#define KMALLOC_TRACK 1
+
+#if KMALLOC_TRACK
+#include "../lib/stdbool.h"
+
+extern bool kmalloc_tracking;
+
+void kmalloc_track_alloc(void *ptr, uint32_t size, uint32_t caller);
+void kmalloc_track_free(void *ptr);
+#else
+static inline void kmalloc_track_alloc(void *ptr, uint32_t size, uint32_t caller) {}
+static inline void kmalloc_track_free(void *ptr) {}
+#endif
+
+// Write a human-readable summary of the heap into buf, return length written
+uint32_t kmalloc_report(char *buf, uint32_t size);
+
 #endif
 
 #endif
@@ -2,7 +2,6 @@
 #include "../task/task.h"
 #include "../lib/cli.h"
 #include "../lib/string.h"
-#include "../lib/limits.h"
 #include "../panic.h"
 #include "../multiboot.h"
 #include "../compiler.h"
@@ -173,7 +172,7 @@ void init_page(struct multiboot_info __physaddr *mbi) {
         "orl $0x00000010, %%eax;"
         "movl %%eax, %%cr4;"      // enable PSE (4 MiB pages) of %cr4
         "movl %%cr0, %%eax;"
-        "orl $0x80000000, %%eax;" // set the paging (PG) bits of %CR0
+        "orl $0x80010000, %%eax;" // set the paging (PG) and write protect (WP) bits of %CR0
         "movl %%eax, %%cr0;"
         :                     /* no outputs */
         : "r"(init_page_directory) /* put page directory address into cr3 */
@@ -691,6 +690,272 @@ void free_pages(void *page, uint32_t num, uint32_t gfp_flags) {
         free_one_page((void *)((uint32_t)page + page_size(gfp_flags) * i), gfp_flags);
 }
 
+/*  protect_pages
+ *  DESCRIPTION: make mapped userspace pages read-only
+ *  INPUTS: void *page, uint32_t num, uint32_t gfp_flags
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void protect_pages(void *page, uint32_t num, uint32_t gfp_flags) {
+    unsigned long flags;
+    uint32_t offset;
+
+    if (!(gfp_flags & GFP_USER))
+        return;
+
+    cli_and_save(flags);
+
+    page_directory_t *directory = current_page_directory();
+    for (offset = 0; offset < num; offset++) {
+        uint32_t addr = (uint32_t)page + page_size(gfp_flags) * offset;
+        struct page_directory_entry *dir_entry = &(*directory)[PAGE_DIR_IDX(addr)];
+        if (!dir_entry->present || !dir_entry->user)
+            continue;
+
+        if (dir_entry->size) {
+            if (gfp_flags & GFP_LARGE)
+                dir_entry->rw = 0;
+        } else if (!(gfp_flags & GFP_LARGE)) {
+            page_table_t *table = find_userspace_page_table(dir_entry);
+            struct page_table_entry *table_entry = &(*table)[PAGE_TABLE_IDX(addr)];
+            if (table_entry->present && table_entry->user)
+                table_entry->rw = 0;
+        }
+
+        invlpg((void *)addr);
+    }
+
+    restore_flags(flags);
+}
+
+/*  alloc_shared_page
+ *  DESCRIPTION: allocate a kernel heap page whose physical memory is
+ *               reference counted like userspace memory, so that it can be
+ *               mapped into processes with map_shared_page. The kernel keeps
+ *               its own reference until free_shared_page
+ *  INPUTS: none
+ *  OUTPUTS: none
+ *  RETURN VALUE: the zeroed page, or NULL
+ */
+void *alloc_shared_page(void) {
+    unsigned long flags;
+    void *ret = NULL;
+    uint32_t idx;
+
+    cli_and_save(flags);
+
+    for (idx = KHEAP_ADDR_IDX; idx < KHEAP_ADDR_IDX + NUM_KHEAP_PAGES; idx++) {
+        if (heap_tables[idx].present)
+            continue;
+
+        void __physaddr *physaddr = alloc_phys_mem(GFP_USER);
+        if (!physaddr)
+            break;
+
+        heap_tables[idx] = (struct page_table_entry){
+            .present = 1,
+            .user    = 0,
+            .rw      = 1,
+            .global  = 1,
+            .addr    = PAGE_IDX((uint32_t)physaddr)
+        };
+        ret = (void *)PAGE_IDX_ADDR(idx);
+        invlpg(ret);
+        break;
+    }
+
+    restore_flags(flags);
+
+    if (ret)
+        memset(ret, 0, PAGE_SIZE_SMALL);
+    return ret;
+}
+
+/*  map_shared_page
+ *  DESCRIPTION: map a page from alloc_shared_page into the current process
+ *  INPUTS: void *page -- the userspace address
+ *          void *shared -- the kernel address of the shared page
+ *          uint32_t gfp_flags -- GFP_USER, optionally GFP_RO
+ *  OUTPUTS: none
+ *  RETURN VALUE: page, or NULL if it could not be mapped there
+ */
+void *map_shared_page(void *page, void *shared, uint32_t gfp_flags) {
+    unsigned long flags;
+    uint32_t addr = (uint32_t)page;
+    page_table_t *table;
+
+    if (!(gfp_flags & GFP_USER) || (gfp_flags & GFP_LARGE) || addr % PAGE_SIZE_SMALL)
+        return NULL;
+
+    cli_and_save(flags);
+
+    page_directory_t *directory = current_page_directory();
+    struct page_directory_entry *dir_entry = &(*directory)[PAGE_DIR_IDX(addr)];
+    if (dir_entry->present) {
+        if (!dir_entry->user || dir_entry->size)
+            goto err;
+        table = find_userspace_page_table(dir_entry);
+    } else {
+        table = mk_user_table(dir_entry);
+        if (!table)
+            goto err;
+    }
+
+    struct page_table_entry *table_entry = &(*table)[PAGE_TABLE_IDX(addr)];
+    if (table_entry->present)
+        goto err;
+
+    void __physaddr *physaddr = kheap_virtual2phys(shared);
+    use_phys_mem(physaddr, GFP_USER);
+
+    // PAGE_SHARED keeps fork from turning this into a private copy
+    *table_entry = (struct page_table_entry){
+        .present = 1,
+        .user    = 1,
+        .rw      = !(gfp_flags & GFP_RO),
+        .global  = 0,
+        .flags   = PAGE_SHARED,
+        .addr    = PAGE_IDX((uint32_t)physaddr)
+    };
+    invlpg(page);
+
+    restore_flags(flags);
+    return page;
+
+err:
+    restore_flags(flags);
+    return NULL;
+}
+
+/*  unmap_shared_page
+ *  DESCRIPTION: undo map_shared_page in the current process, if the page is
+ *               still mapped there
+ *  INPUTS: void *page -- the userspace address
+ *          void *shared -- the kernel address of the shared page
+ *  OUTPUTS: none
+ *  RETURN VALUE: true if it was unmapped
+ */
+bool unmap_shared_page(void *page, void *shared) {
+    unsigned long flags;
+    uint32_t addr = (uint32_t)page;
+    bool ret = false;
+
+    cli_and_save(flags);
+
+    page_directory_t *directory = current_page_directory();
+    struct page_directory_entry *dir_entry = &(*directory)[PAGE_DIR_IDX(addr)];
+    if (!dir_entry->present || !dir_entry->user || dir_entry->size)
+        goto out;
+
+    page_table_t *table = find_userspace_page_table(dir_entry);
+    struct page_table_entry *table_entry = &(*table)[PAGE_TABLE_IDX(addr)];
+    void __physaddr *physaddr = kheap_virtual2phys(shared);
+    if (!table_entry->present || table_entry->flags != PAGE_SHARED ||
+            table_entry->addr != PAGE_IDX((uint32_t)physaddr))
+        goto out;
+
+    *table_entry = (struct page_table_entry){0};
+    invlpg(page);
+    free_phys_mem(physaddr, GFP_USER);
+    ret = true;
+
+out:
+    restore_flags(flags);
+    return ret;
+}
+
+/*  free_shared_page
+ *  DESCRIPTION: drop the kernel's mapping of a page from alloc_shared_page.
+ *               The memory is freed once no process maps it either
+ *  INPUTS: void *shared
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void free_shared_page(void *shared) {
+    unsigned long flags;
+
+    cli_and_save(flags);
+
+    void __physaddr *physaddr = kheap_virtual2phys(shared);
+    heap_tables[PAGE_IDX((uint32_t)shared)] = (struct page_table_entry){0};
+    invlpg(shared);
+    free_phys_mem(physaddr, GFP_USER);
+
+    restore_flags(flags);
+}
+
+/*  ioremap
+ *  DESCRIPTION: map device memory or firmware tables into the kernel heap,
+ *               uncached. The physical pages are not tracked in the physical
+ *               directory, so they must not be freed with free_pages
+ *  INPUTS: uint32_t physaddr -- need not be page aligned
+ *          uint32_t size -- in bytes
+ *  OUTPUTS: none
+ *  RETURN VALUE: the kernel address of physaddr, or NULL
+ */
+void *ioremap(uint32_t __physaddr physaddr, uint32_t size) {
+    unsigned long flags;
+    uint32_t offset = physaddr % PAGE_SIZE_SMALL;
+    uint32_t num = (offset + size + PAGE_SIZE_SMALL - 1) / PAGE_SIZE_SMALL;
+    uint32_t start, i;
+    void *ret = NULL;
+
+    if (!size)
+        return NULL;
+
+    cli_and_save(flags);
+
+    for (start = KHEAP_ADDR_IDX; start + num <= KHEAP_ADDR_IDX + NUM_KHEAP_PAGES; start++) {
+        for (i = 0; i < num; i++) {
+            if (heap_tables[start + i].present)
+                goto cont;
+        }
+
+        for (i = 0; i < num; i++) {
+            heap_tables[start + i] = (struct page_table_entry){
+                .present       = 1,
+                .user          = 0,
+                .rw            = 1,
+                .write_through = 1,
+                .cache         = 1, // cache disabled
+                .global        = 1,
+                .addr          = PAGE_IDX(physaddr) + i
+            };
+            invlpg((void *)PAGE_IDX_ADDR(start + i));
+        }
+        ret = (void *)(PAGE_IDX_ADDR(start) + offset);
+        break;
+    cont:;
+    }
+
+    restore_flags(flags);
+    return ret;
+}
+
+/*  iounmap
+ *  DESCRIPTION: unmap memory mapped by ioremap
+ *  INPUTS: void *addr, uint32_t size -- as given to and returned by ioremap
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void iounmap(void *addr, uint32_t size) {
+    unsigned long flags;
+    uint32_t offset = (uint32_t)addr % PAGE_SIZE_SMALL;
+    uint32_t num = (offset + size + PAGE_SIZE_SMALL - 1) / PAGE_SIZE_SMALL;
+    uint32_t start = PAGE_IDX((uint32_t)addr);
+    uint32_t i;
+
+    if (!addr)
+        return;
+
+    cli_and_save(flags);
+    for (i = 0; i < num; i++) {
+        heap_tables[start + i] = (struct page_table_entry){0};
+        invlpg((void *)PAGE_IDX_ADDR(start + i));
+    }
+    restore_flags(flags);
+}
+
 /*  remap_to_user
  *  DESCRIPTION: map some used memory address to another page table
  *  INPUTS: void *src, struct page_table_entry **dest, void **newmap_addr
@@ -948,98 +1213,6 @@ void free_directory(page_directory_t *dir) {
     restore_flags(flags);
 }
 
-/*
- *  addr_is_safe
- *  DESCRIPTION: check whether the given address is safe to write on
- *  INPUTS: page_directory_t *directory, const void *addr, bool write
- *  OUTPUTS: none
- *  RETURN VALUE: bool
- */
-static bool addr_is_safe(page_directory_t *directory, const void *addr, bool write) {
-    struct page_directory_entry *dir_entry = &(*directory)[PAGE_DIR_IDX((uint32_t)addr)];
-    if (!dir_entry->present || !dir_entry->user)
-        return false;
-    else if (dir_entry->size) {
-        if (write && !dir_entry->rw)
-            return false;
-    } else {
-        page_table_t *table = find_userspace_page_table(dir_entry);
-
-        struct page_table_entry *table_entry = &(*table)[PAGE_TABLE_IDX((uint32_t)addr)];
-
-        if (!table_entry->present)
-            return false;
-        if (write && !dir_entry->rw)
-            return _clone_cow(directory, addr);
-    }
-    return true;
-}
-
-/*
- *  safe_buf
- *  DESCRIPTION: create a temporary buf to write on
- *  INPUTS: const void *buf, uint32_t nbytes, bool write
- *  OUTPUTS: none
- *  RETURN VALUE: number of writed bytes
- */
-uint32_t safe_buf(const void *buf, uint32_t nbytes, bool write) {
-    const char *buf_char = buf;
-    uint32_t ret = 0;
-
-    page_directory_t *dir = current_page_directory();
-
-    while (nbytes) {
-        uint16_t nbytes_cancheck = ((uint32_t)buf_char / LEN_4K + 1) * LEN_4K - (uint32_t)buf_char;
-        if (nbytes_cancheck > nbytes)
-            nbytes_cancheck = nbytes;
-
-        if (!addr_is_safe(dir, buf_char, write))
-            break;
-
-        ret += nbytes_cancheck;
-        buf_char += nbytes_cancheck;
-        nbytes -= nbytes_cancheck;
-    }
-
-    return ret;
-}
-
-/*
- *  safe_arr_null_term
- *  DESCRIPTION: safe_arr_null_term
- *  INPUTS: const void *buf, uint32_t entry_size, bool write
- *  OUTPUTS: none
- *  RETURN VALUE: uint32_t
- */
-uint32_t safe_arr_null_term(const void *buf, uint32_t entry_size, bool write) {
-    if (entry_size == 1)
-        return safe_buf(buf, UINT_MAX, write);
-
-    const char *buf_char = buf;
-    uint32_t ret = 0;
-
-    page_directory_t *dir = current_page_directory();
-
-    for (;; ret++) {
-        int i;
-        bool zero = true;
-        for (i = 0; i < entry_size; i++) {
-            if (!addr_is_safe(dir, buf_char, write))
-                goto out;
-
-            if (*buf_char)
-                zero = false;
-
-            buf_char++;
-        }
-        if (zero)
-            break;
-    }
-
-out:
-    return ret;
-}
-
 #include "../tests.h"
 #if RUN_TESTS
 /* Paging Test
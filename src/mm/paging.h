@@ -178,7 +178,14 @@ bool clone_cow(const void *addr);
 
 void free_directory(page_directory_t *dir);
 
-uint32_t safe_buf(const void *buf, uint32_t nbytes, bool write);
-uint32_t safe_arr_null_term(const void *buf, uint32_t entry_size, bool write);
+void protect_pages(void *page, uint32_t num, uint32_t gfp_flags);
+
+void *alloc_shared_page(void);
+void *map_shared_page(void *page, void *shared, uint32_t gfp_flags);
+bool unmap_shared_page(void *page, void *shared);
+void free_shared_page(void *shared);
+
+void *ioremap(uint32_t __physaddr physaddr, uint32_t size);
+void iounmap(void *addr, uint32_t size);
 
 #endif
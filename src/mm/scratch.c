@@ -0,0 +1,92 @@
+#include "scratch.h"
+#include "kmalloc.h"
+#include "paging.h"
+#include "../task/task.h"
+#include "../lib/string.h"
+#include "../lib/limits.h"
+
+#define SCRATCH_ALIGN 16
+
+static inline bool in_scratch(struct scratch *scratch, void *ptr) {
+    return scratch->base && (char *)ptr >= scratch->base &&
+        (char *)ptr < scratch->base + SCRATCH_SIZE;
+}
+
+/*  scratch_alloc
+ *  DESCRIPTION: allocate a short-lived buffer for the current task
+ *  INPUTS: uint32_t size
+ *  OUTPUTS: none
+ *  RETURN VALUE: the buffer, or NULL if out of memory
+ */
+void *scratch_alloc(uint32_t size) {
+    struct scratch *scratch = &current->scratch;
+    unsigned long flags;
+    void *ret = NULL;
+
+    // interrupt handlers may share the arena of the task they interrupted
+    cli_and_save(flags);
+    if (!scratch->base) {
+        scratch->base = alloc_pages(SCRATCH_SIZE / PAGE_SIZE_SMALL, 0, 0);
+        scratch->top = 0;
+    }
+    if (scratch->base && size <= SCRATCH_SIZE - scratch->top) {
+        ret = scratch->base + scratch->top;
+        scratch->top += (size + SCRATCH_ALIGN - 1) & ~(SCRATCH_ALIGN - 1);
+        if (scratch->top > SCRATCH_SIZE)
+            scratch->top = SCRATCH_SIZE;
+    }
+    restore_flags(flags);
+
+    if (!ret)
+        ret = kmalloc(size);
+    return ret;
+}
+
+/*  scratch_calloc
+ *  DESCRIPTION: allocate a zeroed short-lived array for the current task
+ *  INPUTS: uint32_t nobj, uint32_t size
+ *  OUTPUTS: none
+ *  RETURN VALUE: the buffer, or NULL if out of memory
+ */
+void *scratch_calloc(uint32_t nobj, uint32_t size) {
+    if (size && nobj > UINT_MAX / size)
+        return NULL;
+
+    void *ret = scratch_alloc(nobj * size);
+    if (ret)
+        memset(ret, 0, nobj * size);
+    return ret;
+}
+
+/*  scratch_free
+ *  DESCRIPTION: free a buffer from scratch_alloc, and everything allocated
+ *               after it
+ *  INPUTS: void *ptr
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void scratch_free(void *ptr) {
+    struct scratch *scratch = &current->scratch;
+    unsigned long flags;
+
+    if (!in_scratch(scratch, ptr)) {
+        kfree(ptr);
+        return;
+    }
+
+    cli_and_save(flags);
+    uint32_t offset = (char *)ptr - scratch->base;
+    if (offset < scratch->top)
+        scratch->top = offset;
+    restore_flags(flags);
+}
+
+void scratch_reset(void) {
+    current->scratch.top = 0;
+}
+
+void scratch_release(struct task_struct *task) {
+    if (task->scratch.base)
+        free_pages(task->scratch.base, SCRATCH_SIZE / PAGE_SIZE_SMALL, 0);
+    task->scratch = (struct scratch){0};
+}
@@ -0,0 +1,38 @@
+#ifndef _SCRATCH_H
+#define _SCRATCH_H
+
+#include "paging.h"
+#include "../lib/stdint.h"
+
+/*
+ * Per-task scratch arena for short-lived buffers, like a path copied in from
+ * userspace for the duration of a syscall. Allocating is a pointer bump in a
+ * page owned by the task, and freeing pops the arena back to the freed
+ * pointer, so buffers must be freed in reverse order of allocation. Anything
+ * still allocated is dropped when the task returns to userspace.
+ *
+ * Requests that don't fit in the arena transparently fall back to kmalloc;
+ * scratch_free handles both.
+ */
+
+#define SCRATCH_SIZE PAGE_SIZE_SMALL
+
+struct scratch {
+    char *base;    // allocated on first use
+    uint32_t top;
+};
+
+struct task_struct;
+
+__attribute__ ((malloc))
+void *scratch_alloc(uint32_t size);
+__attribute__ ((malloc))
+void *scratch_calloc(uint32_t nobj, uint32_t size);
+void scratch_free(void *ptr);
+
+// Drop everything allocated by the current task
+void scratch_reset(void);
+// Give back the arena of a dead task
+void scratch_release(struct task_struct *task);
+
+#endif
@@ -0,0 +1,351 @@
+#include "slab.h"
+#include "paging.h"
+#include "kmalloc.h"
+#include "../lib/cli.h"
+#include "../lib/string.h"
+#include "../lib/stdio.h"
+#include "../printk.h"
+#include "../panic.h"
+
+#define SLAB_SIZE PAGE_SIZE_SMALL
+#define SLAB_ALIGN 8
+
+// header at the start of each slab page
+struct slab {
+    struct kmem_cache *cache;
+    struct slab *prev;
+    struct slab *next;
+    void *freelist;
+    uint32_t inuse;
+};
+
+#define SLAB_OBJ_START ((sizeof(struct slab) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1))
+
+struct kmem_cache *kmem_cache_list;
+
+static inline struct slab *obj_to_slab(void *obj) {
+    return (struct slab *)((uint32_t)obj & ~(SLAB_SIZE - 1));
+}
+
+static inline void **freeptr(struct kmem_cache *cache, void *obj) {
+    return (void **)((char *)obj + cache->freeptr_offset);
+}
+
+static void slab_list_add(struct slab **head, struct slab *slab) {
+    slab->prev = NULL;
+    slab->next = *head;
+    if (*head)
+        (*head)->prev = slab;
+    *head = slab;
+}
+
+static void slab_list_del(struct slab **head, struct slab *slab) {
+    if (slab->prev)
+        slab->prev->next = slab->next;
+    else
+        *head = slab->next;
+    if (slab->next)
+        slab->next->prev = slab->prev;
+    slab->prev = slab->next = NULL;
+}
+
+/*  kmem_cache_setup
+ *  DESCRIPTION: compute the layout of a cache, called with interrupts off
+ *  INPUTS: struct kmem_cache *cache
+ *  OUTPUTS: none
+ *  RETURN VALUE: false if the object can't fit in a slab
+ */
+static bool kmem_cache_setup(struct kmem_cache *cache) {
+    if (cache->initialized)
+        return true;
+
+    uint32_t size = cache->object_size;
+    // with a constructor, the free pointer can't overlap the object
+    cache->freeptr_offset = cache->ctor ? size : 0;
+    size = cache->freeptr_offset + sizeof(void *);
+    if (size < cache->object_size)
+        size = cache->object_size;
+
+    cache->stride = (size + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1);
+    if (cache->stride > SLAB_SIZE - SLAB_OBJ_START)
+        return false;
+    cache->objs_per_slab = (SLAB_SIZE - SLAB_OBJ_START) / cache->stride;
+
+    cache->next = kmem_cache_list;
+    kmem_cache_list = cache;
+    cache->initialized = true;
+    return true;
+}
+
+/*  kmem_cache_grow
+ *  DESCRIPTION: allocate a new slab for a cache
+ *  INPUTS: struct kmem_cache *cache
+ *  OUTPUTS: none
+ *  RETURN VALUE: the new slab, or NULL if out of memory
+ */
+static struct slab *kmem_cache_grow(struct kmem_cache *cache) {
+    struct slab *slab = alloc_pages(1, 0, 0);
+    if (!slab)
+        return NULL;
+
+    *slab = (struct slab){
+        .cache = cache,
+    };
+
+    // thread the free list in address order
+    char *obj = (char *)slab + SLAB_OBJ_START;
+    void **prevp = &slab->freelist;
+    uint32_t i;
+    for (i = 0; i < cache->objs_per_slab; i++, obj += cache->stride) {
+        if (cache->ctor)
+            cache->ctor(obj);
+        *prevp = obj;
+        prevp = freeptr(cache, obj);
+    }
+    *prevp = NULL;
+
+    cache->num_slabs++;
+    return slab;
+}
+
+static void kmem_cache_release(struct kmem_cache *cache, struct slab *slab) {
+    cache->num_slabs--;
+    free_pages(slab, 1, 0);
+}
+
+/*  kmem_cache_create
+ *  DESCRIPTION: create a new dynamically allocated cache
+ *  INPUTS: const char *name, uint32_t size, void (*ctor)(void *obj)
+ *  OUTPUTS: none
+ *  RETURN VALUE: the cache, or NULL on failure
+ */
+struct kmem_cache *kmem_cache_create(const char *name, uint32_t size, void (*ctor)(void *obj)) {
+    struct kmem_cache *cache = kmalloc(sizeof(*cache));
+    if (!cache)
+        return NULL;
+
+    *cache = (struct kmem_cache)KMEM_CACHE_INITIALIZER(name, size, ctor);
+
+    unsigned long flags;
+    cli_and_save(flags);
+    bool ok = kmem_cache_setup(cache);
+    restore_flags(flags);
+
+    if (!ok) {
+        kfree(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+/*  kmem_cache_destroy
+ *  DESCRIPTION: destroy a cache created by kmem_cache_create
+ *  INPUTS: struct kmem_cache *cache
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void kmem_cache_destroy(struct kmem_cache *cache) {
+    unsigned long flags;
+    cli_and_save(flags);
+
+    if (cache->num_active)
+        printk("slab: WARNING: destroying cache %s with %u active objects\n",
+               cache->name, cache->num_active);
+
+    struct slab **lists[] = { &cache->partial, &cache->full, &cache->empty };
+    uint32_t i;
+    for (i = 0; i < sizeof(lists) / sizeof(*lists); i++) {
+        while (*lists[i]) {
+            struct slab *slab = *lists[i];
+            slab_list_del(lists[i], slab);
+            kmem_cache_release(cache, slab);
+        }
+    }
+
+    struct kmem_cache **prevp;
+    for (prevp = &kmem_cache_list; *prevp; prevp = &(*prevp)->next) {
+        if (*prevp == cache) {
+            *prevp = cache->next;
+            break;
+        }
+    }
+
+    restore_flags(flags);
+    kfree(cache);
+}
+
+/*  kmem_cache_alloc
+ *  DESCRIPTION: allocate an object from a cache
+ *  INPUTS: struct kmem_cache *cache
+ *  OUTPUTS: none
+ *  RETURN VALUE: the object, or NULL if out of memory
+ */
+void *kmem_cache_alloc(struct kmem_cache *cache) {
+    unsigned long flags;
+    void *obj = NULL;
+
+    cli_and_save(flags);
+
+    if (!kmem_cache_setup(cache))
+        goto out;
+
+    struct slab *slab = cache->partial;
+    if (!slab) {
+        slab = cache->empty;
+        if (slab) {
+            cache->empty = NULL;
+        } else {
+            slab = kmem_cache_grow(cache);
+            if (!slab)
+                goto out;
+        }
+        slab_list_add(&cache->partial, slab);
+    }
+
+    obj = slab->freelist;
+    slab->freelist = *freeptr(cache, obj);
+    slab->inuse++;
+    cache->num_active++;
+
+    if (!slab->freelist) {
+        slab_list_del(&cache->partial, slab);
+        slab_list_add(&cache->full, slab);
+    }
+
+out:
+    restore_flags(flags);
+    return obj;
+}
+
+/*  kmem_cache_zalloc
+ *  DESCRIPTION: allocate a zeroed object from a cache without a
+ *               constructor, since zeroing would undo what it set up
+ *  INPUTS: struct kmem_cache *cache
+ *  OUTPUTS: none
+ *  RETURN VALUE: the object, or NULL if out of memory
+ */
+void *kmem_cache_zalloc(struct kmem_cache *cache) {
+    if (cache->ctor)
+        BUG();
+
+    void *obj = kmem_cache_alloc(cache);
+    if (obj)
+        memset(obj, 0, cache->object_size);
+    return obj;
+}
+
+/*  kmem_cache_free
+ *  DESCRIPTION: return an object to its cache
+ *  INPUTS: struct kmem_cache *cache, void *obj
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void kmem_cache_free(struct kmem_cache *cache, void *obj) {
+    unsigned long flags;
+
+    if (!obj) {
+        printk("slab: WARNING: kmem_cache_free(%s, NULL) called from %p\n",
+               cache->name, __builtin_return_address(0));
+        return;
+    }
+
+    struct slab *slab = obj_to_slab(obj);
+    if (slab->cache != cache) {
+        printk("slab: ERROR: Bad kmem_cache_free(%s, %p) called from %p\n",
+               cache->name, obj, __builtin_return_address(0));
+        return;
+    }
+
+    cli_and_save(flags);
+
+    if (!slab->freelist) {
+        slab_list_del(&cache->full, slab);
+        slab_list_add(&cache->partial, slab);
+    }
+
+    *freeptr(cache, obj) = slab->freelist;
+    slab->freelist = obj;
+    slab->inuse--;
+    cache->num_active--;
+
+    // keep one empty slab around so that alloc / free in a loop doesn't
+    // bounce pages with the page allocator
+    if (!slab->inuse) {
+        slab_list_del(&cache->partial, slab);
+        if (cache->empty) {
+            kmem_cache_release(cache, slab);
+        } else {
+            cache->empty = slab;
+        }
+    }
+
+    restore_flags(flags);
+}
+
+/*  slab_report
+ *  DESCRIPTION: write a per-cache summary of all caches in use
+ *  INPUTS: char *buf, uint32_t size
+ *  OUTPUTS: none
+ *  RETURN VALUE: number of characters written, not including the terminator
+ */
+uint32_t slab_report(char *buf, uint32_t size) {
+    unsigned long flags;
+    uint32_t len = 0;
+
+    len += scnprintf(buf + len, size - len,
+        "NAME                    OBJSIZE ACTIVE  TOTAL   SLABS\n");
+
+    cli_and_save(flags);
+
+    struct kmem_cache *cache;
+    for (cache = kmem_cache_list; cache; cache = cache->next) {
+        len += scnprintf(buf + len, size - len, "%-24s%-8u%-8u%-8u%u\n",
+            cache->name, cache->object_size, cache->num_active,
+            cache->num_slabs * cache->objs_per_slab, cache->num_slabs);
+    }
+
+    restore_flags(flags);
+    return len;
+}
+
+#include "../tests.h"
+#if RUN_TESTS
+/* slab allocator tests
+ *
+ * Asserts that objects are reused and slabs are shared and released
+ * Coverage: kmem_cache_create, kmem_cache_alloc, kmem_cache_free
+ */
+__testfunc
+static void slab_test() {
+    struct kmem_cache *cache = kmem_cache_create("test", 100, NULL);
+    TEST_ASSERT(cache);
+
+    void *a = kmem_cache_alloc(cache);
+    void *b = kmem_cache_alloc(cache);
+    TEST_ASSERT(a && b && a != b);
+    TEST_ASSERT(obj_to_slab(a) == obj_to_slab(b));
+    TEST_ASSERT(cache->num_active == 2 && cache->num_slabs == 1);
+
+    kmem_cache_free(cache, b);
+    TEST_ASSERT(kmem_cache_alloc(cache) == b);
+
+    // fill more than a slab
+    void *objs[64];
+    uint32_t i;
+    for (i = 0; i < 64; i++)
+        TEST_ASSERT(objs[i] = kmem_cache_alloc(cache));
+    TEST_ASSERT(cache->num_slabs > 1);
+    for (i = 0; i < 64; i++)
+        kmem_cache_free(cache, objs[i]);
+
+    kmem_cache_free(cache, a);
+    kmem_cache_free(cache, b);
+    TEST_ASSERT(!cache->num_active && cache->num_slabs == 1);
+
+    kmem_cache_destroy(cache);
+
+    // too big for a slab
+    TEST_ASSERT(!kmem_cache_create("test", SLAB_SIZE, NULL));
+}
+DEFINE_TEST(slab_test);
+#endif
@@ -0,0 +1,72 @@
+// slab.h -- object caches for fixed-size kernel objects
+// loosely modeled after <linux/slab.h>
+
+#ifndef _SLAB_H
+#define _SLAB_H
+
+#include "../lib/stdint.h"
+#include "../lib/stdbool.h"
+
+/*
+ * A kmem_cache hands out objects of a single size carved out of whole 4K
+ * pages ("slabs"). Each slab begins with a struct slab header; the rest of
+ * the page is an array of objects threaded through a free list. An object's
+ * slab is found by masking its address down to the page boundary, so freeing
+ * never has to search. This avoids going through liballoc for small objects
+ * that are allocated and freed all the time, like list nodes and inodes.
+ *
+ * If the cache has a constructor, it is called once per object when a slab
+ * is created, and objects must be freed back in their constructed state. The
+ * free list pointer then lives right after the object so it doesn't clobber
+ * constructed fields.
+ */
+
+struct slab;
+
+struct kmem_cache {
+    const char *name;
+    uint32_t object_size;
+    void (*ctor)(void *obj);
+
+    // filled in lazily on first allocation
+    bool initialized;
+    uint32_t stride;
+    uint32_t freeptr_offset;
+    uint32_t objs_per_slab;
+
+    struct slab *partial;   // slabs with both used and free objects
+    struct slab *full;      // slabs with no free objects
+    struct slab *empty;     // at most one slab with no used objects
+
+    uint32_t num_slabs;
+    uint32_t num_active;
+
+    struct kmem_cache *next;
+};
+
+// Statically define a cache, usable from any point, even before initcalls
+#define KMEM_CACHE_INITIALIZER(_name, _size, _ctor) { \
+    .name = (_name),                                  \
+    .object_size = (_size),                           \
+    .ctor = (_ctor),                                  \
+}
+
+#define DEFINE_KMEM_CACHE(cache, type, ctor) \
+struct kmem_cache cache = KMEM_CACHE_INITIALIZER(#type, sizeof(type), ctor)
+
+struct kmem_cache *kmem_cache_create(const char *name, uint32_t size, void (*ctor)(void *obj));
+void kmem_cache_destroy(struct kmem_cache *cache);
+
+__attribute__ ((malloc))
+void *kmem_cache_alloc(struct kmem_cache *cache);
+__attribute__ ((malloc))
+void *kmem_cache_zalloc(struct kmem_cache *cache);
+void kmem_cache_free(struct kmem_cache *cache, void *obj);
+
+// Walk over all caches that have been used so far
+extern struct kmem_cache *kmem_cache_list;
+
+// Write a per-cache summary into buf, return length written
+uint32_t slab_report(char *buf, uint32_t size);
+
+#endif
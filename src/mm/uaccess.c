@@ -0,0 +1,265 @@
+#include "uaccess.h"
+#include "kmalloc.h"
+#include "../lib/string.h"
+#include "../err.h"
+
+/*  fixup_exception
+ *  DESCRIPTION: redirect a faulting kernel instruction to its fixup
+ *  INPUTS: struct intr_info *info
+ *  OUTPUTS: none
+ *  RETURN VALUE: true if a fixup is found and info->eip is updated
+ */
+bool fixup_exception(struct intr_info *info) {
+    extern struct exception_table_entry __start_ex_table;
+    extern struct exception_table_entry __stop_ex_table;
+
+    struct exception_table_entry *entry;
+    for (entry = &__start_ex_table; entry < &__stop_ex_table; entry++) {
+        if (entry->insn == info->eip) {
+            info->eip = entry->fixup;
+            return true;
+        }
+    }
+    return false;
+}
+
+// copy with rep movsb; on fault, ecx has the number of bytes remaining
+static inline __always_inline uint32_t __copy_user(void *to, const void *from, uint32_t n) {
+    asm volatile (
+        "1: rep movsb\n"
+        "2:\n"
+        _ASM_EXTABLE(1b, 2b)
+        : "+c"(n), "+D"(to), "+S"(from)
+        :
+        : "memory"
+    );
+    return n;
+}
+
+/*  copy_from_user
+ *  DESCRIPTION: copy n bytes from userspace
+ *  INPUTS: void *to, const void *from, uint32_t n
+ *  OUTPUTS: none
+ *  RETURN VALUE: number of bytes that could not be copied
+ */
+uint32_t copy_from_user(void *to, const void *from, uint32_t n) {
+    if (!access_ok(from, n)) {
+        memset(to, 0, n);
+        return n;
+    }
+
+    uint32_t left = __copy_user(to, from, n);
+    // don't leak whatever was in the kernel buffer
+    if (left)
+        memset((char *)to + (n - left), 0, left);
+    return left;
+}
+
+/*  copy_to_user
+ *  DESCRIPTION: copy n bytes to userspace
+ *  INPUTS: void *to, const void *from, uint32_t n
+ *  OUTPUTS: none
+ *  RETURN VALUE: number of bytes that could not be copied
+ */
+uint32_t copy_to_user(void *to, const void *from, uint32_t n) {
+    if (!access_ok(to, n))
+        return n;
+
+    return __copy_user(to, from, n);
+}
+
+// clamp a scan starting at a userspace address to the end of userspace
+static inline uint32_t user_clamp(const void *addr, uint32_t n) {
+    uint32_t max = USER_ADDR_END - (uint32_t)addr;
+    return n > max ? max : n;
+}
+
+/*  strncpy_from_user
+ *  DESCRIPTION: copy a null-terminated string from userspace
+ *  INPUTS: char *dst, const char *src, uint32_t count
+ *  OUTPUTS: none
+ *  RETURN VALUE: length of string copied, or -EFAULT
+ */
+int32_t strncpy_from_user(char *dst, const char *src, uint32_t count) {
+    if (!access_ok(src, 0))
+        return -EFAULT;
+
+    uint32_t max = user_clamp(src, count);
+    uint32_t i;
+    for (i = 0; i < max; i++) {
+        char c;
+        if (__get_user(c, &src[i]))
+            return -EFAULT;
+        dst[i] = c;
+        if (!c)
+            return i;
+    }
+
+    // hitting the end of userspace is a fault, not a truncation
+    if (max < count)
+        return -EFAULT;
+    return count;
+}
+
+/*  strnlen_user
+ *  DESCRIPTION: get the size of a string in userspace
+ *  INPUTS: const char *s, uint32_t n
+ *  OUTPUTS: none
+ *  RETURN VALUE: size including the null terminator, 0 on fault, or n + 1 if
+ *                the string is longer than n
+ */
+uint32_t strnlen_user(const char *s, uint32_t n) {
+    if (!access_ok(s, 0))
+        return 0;
+
+    uint32_t max = user_clamp(s, n);
+    uint32_t i;
+    for (i = 0; i < max; i++) {
+        char c;
+        if (__get_user(c, &s[i]))
+            return 0;
+        if (!c)
+            return i + 1;
+    }
+
+    if (max < n)
+        return 0;
+    return n + 1;
+}
+
+/*  strndup_user
+ *  DESCRIPTION: duplicate a userspace string into kernel heap
+ *  INPUTS: const char *s, uint32_t n
+ *  OUTPUTS: none
+ *  RETURN VALUE: the string, truncated to n bytes, or ERR_PTR
+ */
+char *strndup_user(const char *s, uint32_t n) {
+    uint32_t len = strnlen_user(s, n);
+    if (!len)
+        return ERR_PTR(-EFAULT);
+    if (len > n)
+        len = n + 1;
+
+    char *ret = kmalloc(len);
+    if (!ret)
+        return ERR_PTR(-ENOMEM);
+
+    if (copy_from_user(ret, s, len - 1)) {
+        kfree(ret);
+        return ERR_PTR(-EFAULT);
+    }
+    ret[len - 1] = '\0';
+    return ret;
+}
+
+/*  safe_buf
+ *  DESCRIPTION: fault in a userspace buffer, one access per page
+ *  INPUTS: const void *buf, uint32_t nbytes, bool write
+ *  OUTPUTS: none
+ *  RETURN VALUE: number of accessible bytes from the start of buf
+ */
+uint32_t safe_buf(const void *buf, uint32_t nbytes, bool write) {
+    if (!access_ok(buf, 0))
+        return 0;
+
+    nbytes = user_clamp(buf, nbytes);
+
+    const char *buf_char = buf;
+    uint32_t ret = 0;
+
+    while (ret < nbytes) {
+        uint32_t nbytes_cancheck = LEN_4K - (uint32_t)buf_char % LEN_4K;
+        if (nbytes_cancheck > nbytes - ret)
+            nbytes_cancheck = nbytes - ret;
+
+        int32_t err = 0;
+        if (write) {
+            // A locked no-op RMW. It faults like a write would, breaking
+            // COW if needed, but can't race with other threads' writes
+            asm volatile (
+                "1: lock orb $0,%1\n"
+                "2:\n"
+                ".pushsection .fixup,\"ax\"\n"
+                "3: movl %2,%0\n"
+                "   jmp 2b\n"
+                ".popsection\n"
+                _ASM_EXTABLE(1b, 3b)
+                : "+r"(err), "+m"(*(char *)buf_char)
+                : "i"(-EFAULT)
+            );
+        } else {
+            __attribute__((unused)) char c;
+            err = __get_user(c, buf_char);
+        }
+        if (err)
+            break;
+
+        ret += nbytes_cancheck;
+        buf_char += nbytes_cancheck;
+    }
+
+    return ret;
+}
+
+/*  safe_arr_null_term
+ *  DESCRIPTION: count the entries in a zero-terminated userspace array
+ *  INPUTS: const void *buf, uint32_t entry_size
+ *  OUTPUTS: none
+ *  RETURN VALUE: number of non-zero entries
+ */
+uint32_t safe_arr_null_term(const void *buf, uint32_t entry_size) {
+    const char *buf_char = buf;
+    uint32_t ret = 0;
+
+    if (!access_ok(buf, 0))
+        return 0;
+
+    for (;; ret++) {
+        uint32_t i;
+        bool zero = true;
+
+        if (!access_ok(buf_char, entry_size))
+            break;
+
+        for (i = 0; i < entry_size; i++) {
+            char c;
+            if (__get_user(c, buf_char))
+                return ret;
+
+            if (c)
+                zero = false;
+
+            buf_char++;
+        }
+        if (zero)
+            break;
+    }
+
+    return ret;
+}
+
+#include "../tests.h"
+#if RUN_TESTS
+/* uaccess fault tests
+ *
+ * Asserts that bad userspace pointers are rejected or recovered from
+ * Coverage: access_ok, exception table fixups in page fault handler
+ */
+__testfunc
+static void uaccess_fault_test() {
+    char buf[4];
+    // kernel memory is never userspace
+    TEST_ASSERT(copy_from_user(buf, (void *)KLOW_ADDR, sizeof(buf)) == sizeof(buf));
+    TEST_ASSERT(copy_to_user((void *)KLOW_ADDR, buf, sizeof(buf)) == sizeof(buf));
+    TEST_ASSERT(!safe_buf((void *)VIDEO_ADDR, sizeof(buf), false));
+    // the top of userspace is never mapped, these must fault and be fixed up
+    char *top = (char *)USER_ADDR_END - sizeof(buf);
+    TEST_ASSERT(copy_from_user(buf, top, sizeof(buf)) == sizeof(buf));
+    TEST_ASSERT(copy_to_user(top, buf, sizeof(buf)) == sizeof(buf));
+    TEST_ASSERT(strncpy_from_user(buf, top, sizeof(buf)) == -EFAULT);
+    TEST_ASSERT(!strnlen_user(top, sizeof(buf)));
+    TEST_ASSERT(!safe_buf(top, sizeof(buf), true));
+    TEST_ASSERT(IS_ERR(strndup_user(top, sizeof(buf))));
+}
+DEFINE_TEST(uaccess_fault_test);
+#endif
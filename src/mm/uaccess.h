@@ -0,0 +1,139 @@
+// uaccess.h -- access userspace memory from the kernel
+// adapted from:
+// <arch/x86/include/asm/uaccess.h>
+// <arch/x86/include/asm/asm.h>
+
+#ifndef _UACCESS_H
+#define _UACCESS_H
+
+#include "paging.h"
+#include "../lib/stdint.h"
+#include "../lib/stdbool.h"
+#include "../interrupt.h"
+#include "../errno.h"
+#include "../compiler.h"
+
+// Userspace lives in [USER_ADDR_START, USER_ADDR_END), see paging.h
+#define USER_ADDR_START (KLOW_ADDR + LEN_4M)
+#define USER_ADDR_END   KDIR_VIRT_ADDR
+
+/*
+ * Instead of walking the page tables to check if a userspace pointer is good
+ * before touching it, we just touch it. Every instruction that may fault on a
+ * userspace address registers itself into the 'ex_table' section along with
+ * a fixup address. If the page fault handler sees a kernel fault from one of
+ * these instructions, it resumes execution at the fixup instead of panicking.
+ */
+struct exception_table_entry {
+    uint32_t insn;
+    uint32_t fixup;
+};
+
+#define _ASM_EXTABLE(from, to)         \
+    ".pushsection ex_table,\"a\"\n"    \
+    ".balign 4\n"                      \
+    ".long " #from "," #to "\n"        \
+    ".popsection\n"
+
+// Resume at fixup if the faulting instruction is in the exception table
+bool fixup_exception(struct intr_info *info);
+
+// check if [addr, addr+size) is entirely in userspace
+static inline __always_inline bool access_ok(const void *addr, uint32_t size) {
+    uint32_t start = (uint32_t)addr;
+    return start >= USER_ADDR_START && start <= USER_ADDR_END &&
+        size <= USER_ADDR_END - start;
+}
+
+#define __get_user_asm(x, addr, err, itype, rtype, ltype) \
+    asm volatile (                                        \
+        "1: mov" itype " %2,%" rtype "1\n"                \
+        "2:\n"                                            \
+        ".pushsection .fixup,\"ax\"\n"                    \
+        "3: movl %3,%0\n"                                 \
+        "   xor" itype " %" rtype "1,%" rtype "1\n"       \
+        "   jmp 2b\n"                                     \
+        ".popsection\n"                                   \
+        _ASM_EXTABLE(1b, 3b)                              \
+        : "=r"(err), ltype(x)                             \
+        : "m"(*(addr)), "i"(-EFAULT), "0"(err))
+
+#define __put_user_asm(x, addr, err, itype, rtype, ltype) \
+    asm volatile (                                        \
+        "1: mov" itype " %" rtype "1,%2\n"                \
+        "2:\n"                                            \
+        ".pushsection .fixup,\"ax\"\n"                    \
+        "3: movl %3,%0\n"                                 \
+        "   jmp 2b\n"                                     \
+        ".popsection\n"                                   \
+        _ASM_EXTABLE(1b, 3b)                              \
+        : "=r"(err)                                       \
+        : ltype(x), "m"(*(addr)), "i"(-EFAULT), "0"(err))
+
+// get / put a single 1, 2, or 4 byte value, without access_ok checks.
+// Evaluates to 0 on success and -EFAULT on fault.
+#define __get_user(x, ptr) ({                                            \
+    int32_t __gu_err = 0;                                                \
+    uint32_t __gu_val;                                                   \
+    switch (sizeof(*(ptr))) {                                            \
+    case 1: __get_user_asm(__gu_val, (ptr), __gu_err, "b", "b", "=q"); break; \
+    case 2: __get_user_asm(__gu_val, (ptr), __gu_err, "w", "w", "=r"); break; \
+    case 4: __get_user_asm(__gu_val, (ptr), __gu_err, "l", "k", "=r"); break; \
+    default: __gu_val = 0; __gu_err = -EFAULT; break;                    \
+    }                                                                    \
+    (x) = (__typeof__(*(ptr)))__gu_val;                                  \
+    __gu_err;                                                            \
+})
+
+#define __put_user(x, ptr) ({                                            \
+    int32_t __pu_err = 0;                                                \
+    __typeof__(*(ptr)) __pu_val = (x);                                   \
+    switch (sizeof(*(ptr))) {                                            \
+    case 1: __put_user_asm(__pu_val, (ptr), __pu_err, "b", "b", "iq"); break; \
+    case 2: __put_user_asm(__pu_val, (ptr), __pu_err, "w", "w", "ir"); break; \
+    case 4: __put_user_asm(__pu_val, (ptr), __pu_err, "l", "k", "ir"); break; \
+    default: __pu_err = -EFAULT; break;                                  \
+    }                                                                    \
+    __pu_err;                                                            \
+})
+
+#define get_user(x, ptr) ({                        \
+    int32_t __gu_ret = -EFAULT;                    \
+    if (access_ok((ptr), sizeof(*(ptr))))          \
+        __gu_ret = __get_user((x), (ptr));         \
+    else                                           \
+        (x) = (__typeof__(*(ptr)))0;               \
+    __gu_ret;                                      \
+})
+
+#define put_user(x, ptr) ({                        \
+    int32_t __pu_ret = -EFAULT;                    \
+    if (access_ok((ptr), sizeof(*(ptr))))          \
+        __pu_ret = __put_user((x), (ptr));         \
+    __pu_ret;                                      \
+})
+
+// These return the number of bytes that could NOT be copied
+uint32_t copy_from_user(void *to, const void *from, uint32_t n);
+uint32_t copy_to_user(void *to, const void *from, uint32_t n);
+
+// Returns length of the string copied, not including the null terminator,
+// or -EFAULT. If there is no terminator in the first count bytes, count is
+// returned and dst is not null-terminated.
+int32_t strncpy_from_user(char *dst, const char *src, uint32_t count);
+
+// Returns size of the string including the null terminator, 0 on fault, or a
+// value greater than n if the string is too long.
+uint32_t strnlen_user(const char *s, uint32_t n);
+
+// kmalloc-ed copy of a userspace string, truncated to n bytes, or ERR_PTR
+char *strndup_user(const char *s, uint32_t n);
+
+// Number of bytes from buf that are accessible. Userspace buffers passed down
+// to drivers are pre-faulted with this since drivers access them directly.
+uint32_t safe_buf(const void *buf, uint32_t nbytes, bool write);
+// Number of non-zero entries before the terminator in a zero-terminated
+// userspace array, or before the first inaccessible entry
+uint32_t safe_arr_null_term(const void *buf, uint32_t entry_size);
+
+#endif
@@ -2,58 +2,122 @@
 #include "task/task.h"
 #include "task/sched.h"
 #include "task/signal.h"
+#include "atomic.h"
 #include "panic.h"
 #include "errno.h"
 
+struct mutex_waiter {
+    struct task_struct *task;
+    volatile bool granted;
+    struct mutex_waiter *next;
+};
+
 void mutex_init(struct mutex *mutex) {
-    list_init(&mutex->queue);
+    *mutex = (struct mutex)MUTEX_INITIALIZER;
 }
 
-int32_t mutex_lock_interruptable(struct mutex *mutex) {
-    if (list_contains(&mutex->queue, current))
-        BUG();
-
-    int32_t res = list_insert_back(&mutex->queue, current);
-    if (res < 0)
-        return res;
+static inline struct task_struct *mutex_owner(struct mutex *mutex) {
+    return (struct task_struct *)(mutex->owner & ~MUTEX_FLAG_WAITERS);
+}
 
-    current->state = TASK_INTERRUPTIBLE;
-    while (list_peek_front(&mutex->queue) != current && !signal_pending(current)) {
-        schedule();
+// unlink a waiter from anywhere in the queue, called with interrupts off
+static void mutex_dequeue(struct mutex *mutex, struct mutex_waiter *waiter) {
+    struct mutex_waiter **prevp;
+    struct mutex_waiter *prev = NULL;
+    for (prevp = &mutex->head; *prevp; prev = *prevp, prevp = &(*prevp)->next) {
+        if (*prevp == waiter) {
+            *prevp = waiter->next;
+            if (mutex->tail == waiter)
+                mutex->tail = prev;
+            break;
+        }
     }
-    current->state = TASK_RUNNING;
+}
 
-    if (!signal_pending(current))
-        return 0;
+/*  mutex_lock_slow
+ *  DESCRIPTION: queue up behind the current owner and sleep until the mutex
+ *               is handed over
+ *  INPUTS: struct mutex *mutex, bool interruptible
+ *  OUTPUTS: none
+ *  RETURN VALUE: 0 once the mutex is held, or -EINTR
+ */
+static int32_t mutex_lock_slow(struct mutex *mutex, bool interruptible) {
+    struct mutex_waiter waiter = {
+        .task = current,
+    };
+    int32_t ret = 0;
+    unsigned long flags;
 
-    list_remove(&mutex->queue, current);
-    return -EINTR;
-}
+    cli_and_save(flags);
 
-int32_t mutex_lock_uninterruptable(struct mutex *mutex) {
-    if (list_contains(&mutex->queue, current))
+    if (mutex_owner(mutex) == current)
         BUG();
 
-    int32_t res = list_insert_back(&mutex->queue, current);
-    if (res < 0)
-        return res;
+    // the owner may have unlocked before we got here
+    if (!mutex->owner) {
+        mutex->owner = (uint32_t)current;
+        goto out;
+    }
 
-    current->state = TASK_UNINTERRUPTIBLE;
-    while (list_peek_front(&mutex->queue) != current) {
+    // from now on the owner's unlock cmpxchg fails and it comes to the queue
+    mutex->owner |= MUTEX_FLAG_WAITERS;
+    if (mutex->tail)
+        mutex->tail->next = &waiter;
+    else
+        mutex->head = &waiter;
+    mutex->tail = &waiter;
+
+    current->state = interruptible ? TASK_INTERRUPTIBLE : TASK_UNINTERRUPTIBLE;
+    while (!waiter.granted && !(interruptible && signal_pending(current)))
         schedule();
-    }
     current->state = TASK_RUNNING;
 
-    return 0;
+    if (!waiter.granted) {
+        mutex_dequeue(mutex, &waiter);
+        if (!mutex->head)
+            mutex->owner &= ~MUTEX_FLAG_WAITERS;
+        ret = -EINTR;
+    }
+
+out:
+    restore_flags(flags);
+    return ret;
+}
+
+int32_t mutex_lock_interruptable(struct mutex *mutex) {
+    if (!cmpxchg(&mutex->owner, 0, (uint32_t)current))
+        return 0;
+    return mutex_lock_slow(mutex, true);
+}
+
+int32_t mutex_lock_uninterruptable(struct mutex *mutex) {
+    if (!cmpxchg(&mutex->owner, 0, (uint32_t)current))
+        return 0;
+    return mutex_lock_slow(mutex, false);
 }
 
 void mutex_unlock(struct mutex *mutex) {
-    cli();
-    if (list_pop_front(&mutex->queue) != current)
+    if (cmpxchg(&mutex->owner, (uint32_t)current, 0) == (uint32_t)current)
+        return;
+
+    unsigned long flags;
+    cli_and_save(flags);
+
+    if (mutex_owner(mutex) != current)
         BUG();
 
-    // Wake up the next in queue
-    if (!list_isempty(&mutex->queue))
-        wake_up_process(list_peek_front(&mutex->queue));
-    sti();
+    // hand the mutex to the first waiter
+    struct mutex_waiter *waiter = mutex->head;
+    mutex->head = waiter->next;
+    if (!mutex->head)
+        mutex->tail = NULL;
+
+    struct task_struct *task = waiter->task;
+    mutex->owner = (uint32_t)task | (mutex->head ? MUTEX_FLAG_WAITERS : 0);
+
+    // the waiter's stack frame may go away once granted is set
+    waiter->granted = true;
+    wake_up_process(task);
+
+    restore_flags(flags);
 }
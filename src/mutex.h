@@ -1,13 +1,30 @@
 #ifndef _MTUEX_H
 #define _MTUEX_H
 
-#include "structure/list.h"
+#include "lib/stdint.h"
 #include "initcall.h"
 
+struct mutex_waiter;
+
+/*
+ * owner holds the task_struct of the holder, or 0 if unlocked. Task
+ * structs are page aligned, so the low bit is free to flag that the wait
+ * queue is non-empty. Uncontended lock and unlock are then a single
+ * cmpxchg each; only when that fails do they fall back to the queue, which
+ * is FIFO and lives on the waiters' stacks. On unlock the mutex is handed
+ * directly to the first waiter. A zeroed mutex is unlocked.
+ */
 struct mutex {
-    struct list queue;
+    volatile uint32_t owner;
+    struct mutex_waiter *head;
+    struct mutex_waiter *tail;
 };
 
+#define MUTEX_FLAG_WAITERS 1
+
+#define MUTEX_INITIALIZER { .owner = 0 }
+#define DEFINE_MUTEX(name) struct mutex name = MUTEX_INITIALIZER
+
 void mutex_init(struct mutex *mutex);
 
 int32_t mutex_lock_interruptable(struct mutex *mutex);
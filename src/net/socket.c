@@ -6,7 +6,9 @@
 #include "../task/task.h"
 #include "../task/sched.h"
 #include "../mm/kmalloc.h"
+#include "../mm/uaccess.h"
 #include "../structure/array.h"
+#include "../structure/ring.h"
 #include "../printk.h"
 #include "../initcall.h"
 #include "../syscall.h"
@@ -81,13 +83,16 @@ static uint16_t allocate_port() {
     return ret;
 }
 
+// received data that doesn't fit is dropped, a datagram at a time
+#define UDP_RECV_BUF_SIZE 16384
+
 struct udp_socket {
     ip_addr_t host_addr;
     uint16_t host_port;
     ip_addr_t remote_addr;
     uint16_t remote_port;
-    char *recv_buf;
-    uint32_t buf_size;
+    // filled by udp_receive in interrupt context, drained by udp_read
+    struct ring recv;
     struct task_struct *task;
 };
 
@@ -110,7 +115,7 @@ static int32_t udp_read(struct file *file, char *buf, uint32_t nbytes) {
     socket->task = current;
 
     current->state = TASK_INTERRUPTIBLE;
-    while (!socket->recv_buf && !signal_pending(current))
+    while (ring_empty(&socket->recv) && !signal_pending(current))
         schedule();
     current->state = TASK_RUNNING;
 
@@ -119,26 +124,7 @@ static int32_t udp_read(struct file *file, char *buf, uint32_t nbytes) {
     if (signal_pending(current))
         return -EINTR;
 
-    if (nbytes > socket->buf_size)
-        nbytes = socket->buf_size;
-
-    // Don't let network interrupts interrupt us, or the buffer is gonna be messed up.
-    // FIXME: This is badly inefficient.
-    cli();
-    memcpy(buf, socket->recv_buf, nbytes);
-    socket->buf_size -= nbytes;
-    if (socket->buf_size) {
-        char *recv_buf_new = kmalloc(socket->buf_size);
-        memcpy(recv_buf_new, socket->recv_buf + nbytes, socket->buf_size);
-        kfree(socket->recv_buf);
-        socket->recv_buf = recv_buf_new;
-    } else {
-        kfree(socket->recv_buf);
-        socket->recv_buf = NULL;
-    }
-    sti();
-
-    return nbytes;
+    return ring_pop(&socket->recv, buf, nbytes);
 }
 
 static int32_t udp_write(struct file *file, const char *buf, uint32_t nbytes) {
@@ -155,6 +141,13 @@ static int32_t udp_open(struct file *file, struct inode *inode) {
     if (!socket)
         return -ENOMEM;
 
+    char *recv_buf = kmalloc(UDP_RECV_BUF_SIZE);
+    if (!recv_buf) {
+        kfree(socket);
+        return -ENOMEM;
+    }
+    ring_init(&socket->recv, recv_buf, UDP_RECV_BUF_SIZE, sizeof(char));
+
     file->vendor = socket;
     return 0;
 }
@@ -164,8 +157,7 @@ static void udp_release(struct file *file) {
     if (socket->host_port)
         array_set(&udp_sockets, socket->host_port, NULL);
 
-    if (socket->recv_buf)
-        kfree(socket->recv_buf);
+    kfree(socket->recv.data);
 
     kfree(socket);
 }
@@ -188,7 +180,7 @@ static int32_t udp_poll(struct file *file, struct poll_entry *poll_entry) {
             socket->task = current;
         }
 
-        if (socket->task == current && socket->recv_buf)
+        if (socket->task == current && !ring_empty(&socket->recv))
             poll_entry->revents |= POLLIN;
 
         if (!list_contains(&poll_entry->cleanup_cb, &udp_poll_cb))
@@ -203,15 +195,9 @@ void udp_receive(ip_addr_t *src_ip, uint16_t src_port, uint16_t dst_port, const
     if (!socket)
         return; // TODO: send back 'connection refused' ICMP packet
 
-    char *recv_buf_new = kmalloc(socket->buf_size + nbytes);
-    if (socket->buf_size) {
-        memcpy(recv_buf_new, socket->recv_buf, socket->buf_size);
-        kfree(socket->recv_buf);
-    }
-
-    memcpy(recv_buf_new + socket->buf_size, data, nbytes);
-    socket->recv_buf = recv_buf_new;
-    socket->buf_size += nbytes;
+    if (ring_space(&socket->recv) < nbytes)
+        return;
+    ring_push(&socket->recv, data, nbytes);
 
     if (socket->task)
         wake_up_process(socket->task);
@@ -240,22 +226,16 @@ DEFINE_SYSCALL3(LINUX, socket, int, domain, int, type, int, protocol) {
         goto out;
     }
 
-    for (res = 0;; res++) {
-        if (
-            !array_get(&current->files->files, res) &&
-            !array_set(&current->files->files, res, file)
-        )
-            break;
-    }
-
-    array_set(&current->files->cloexec, res, (void *)(type & O_CLOEXEC));
+    res = fd_alloc(current->files, 0, file, type & O_CLOEXEC);
+    if (res < 0)
+        filp_close(file);
 
 out:
     return res;
 }
 
 DEFINE_SYSCALL3(LINUX, bind, int, fd, const struct sockaddr_in *, addr, uint32_t, addrlen) {
-    struct file *file = array_get(&current->files->files, fd);
+    struct file *file = fd_get(current->files, fd);
     if (!file)
         return -EBADF;
     if (file->op != &udp_sock_op)
@@ -263,15 +243,16 @@ DEFINE_SYSCALL3(LINUX, bind, int, fd, const struct sockaddr_in *, addr, uint32_t
 
     if (addrlen < sizeof(*addr))
         return -EINVAL;
-    if (safe_buf(addr, sizeof(*addr), false) != sizeof(*addr))
+    struct sockaddr_in sin;
+    if (copy_from_user(&sin, addr, sizeof(sin)))
         return -EFAULT;
-    if (addr->sin_family != AF_INET)
+    if (sin.sin_family != AF_INET)
         return -EINVAL;
 
     struct udp_socket *socket = file->vendor;
 
-    memcpy(&socket->host_addr, &addr->sin_addr, sizeof(addr->sin_addr));
-    uint16_t new_port = ntohs(addr->sin_port);
+    memcpy(&socket->host_addr, &sin.sin_addr, sizeof(sin.sin_addr));
+    uint16_t new_port = ntohs(sin.sin_port);
     if (!new_port) {
         if (socket->host_port)
             new_port = socket->host_port;
@@ -288,7 +269,7 @@ DEFINE_SYSCALL3(LINUX, bind, int, fd, const struct sockaddr_in *, addr, uint32_t
 }
 
 DEFINE_SYSCALL3(LINUX, connect, int, fd, const struct sockaddr_in *, addr, uint32_t, addrlen) {
-    struct file *file = array_get(&current->files->files, fd);
+    struct file *file = fd_get(current->files, fd);
     if (!file)
         return -EBADF;
     if (file->op != &udp_sock_op)
@@ -296,15 +277,16 @@ DEFINE_SYSCALL3(LINUX, connect, int, fd, const struct sockaddr_in *, addr, uint3
 
     if (addrlen < sizeof(*addr))
         return -EINVAL;
-    if (safe_buf(addr, sizeof(*addr), false) != sizeof(*addr))
+    struct sockaddr_in sin;
+    if (copy_from_user(&sin, addr, sizeof(sin)))
         return -EFAULT;
-    if (addr->sin_family != AF_INET)
+    if (sin.sin_family != AF_INET)
         return -EINVAL;
 
     struct udp_socket *socket = file->vendor;
 
-    memcpy(&socket->remote_addr, &addr->sin_addr, sizeof(addr->sin_addr));
-    socket->remote_port = ntohs(addr->sin_port);
+    memcpy(&socket->remote_addr, &sin.sin_addr, sizeof(sin.sin_addr));
+    socket->remote_port = ntohs(sin.sin_port);
 
     return 0;
 }
@@ -337,11 +319,11 @@ DEFINE_SYSCALL2(LINUX, socketcall, uint32_t, call, void *, args) {
             int protocol;
         };
 
-        if (safe_buf(args, sizeof(struct sys_socket_args), false) != sizeof(struct sys_socket_args))
+        struct sys_socket_args args_s;
+        if (copy_from_user(&args_s, args, sizeof(args_s)))
             return -EFAULT;
 
-        struct sys_socket_args *args_s = args;
-        return sys_LINUX_socket(args_s->domain, args_s->type, args_s->protocol);
+        return sys_LINUX_socket(args_s.domain, args_s.type, args_s.protocol);
     }
     case SYS_BIND: {
         struct sys_bind_args {
@@ -350,11 +332,11 @@ DEFINE_SYSCALL2(LINUX, socketcall, uint32_t, call, void *, args) {
             uint32_t addrlen;
         };
 
-        if (safe_buf(args, sizeof(struct sys_bind_args), false) != sizeof(struct sys_bind_args))
+        struct sys_bind_args args_s;
+        if (copy_from_user(&args_s, args, sizeof(args_s)))
             return -EFAULT;
 
-        struct sys_bind_args *args_s = args;
-        return sys_LINUX_bind(args_s->fd, args_s->addr, args_s->addrlen);
+        return sys_LINUX_bind(args_s.fd, args_s.addr, args_s.addrlen);
     } // TODO
     case SYS_CONNECT: {
         struct sys_connect_args {
@@ -363,11 +345,11 @@ DEFINE_SYSCALL2(LINUX, socketcall, uint32_t, call, void *, args) {
             uint32_t addrlen;
         };
 
-        if (safe_buf(args, sizeof(struct sys_connect_args), false) != sizeof(struct sys_connect_args))
+        struct sys_connect_args args_s;
+        if (copy_from_user(&args_s, args, sizeof(args_s)))
             return -EFAULT;
 
-        struct sys_connect_args *args_s = args;
-        return sys_LINUX_connect(args_s->fd, args_s->addr, args_s->addrlen);
+        return sys_LINUX_connect(args_s.fd, args_s.addr, args_s.addrlen);
     }
     default:
         // printk("%s[%d]: Unknown socketcall: %u\n", current->comm, current->pid, call);
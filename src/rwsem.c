@@ -0,0 +1,190 @@
+#include "rwsem.h"
+#include "task/task.h"
+#include "task/sched.h"
+#include "lib/cli.h"
+#include "lib/tsc.h"
+#include "panic.h"
+
+struct rwsem_waiter {
+    struct task_struct *task;
+    bool write;
+    volatile bool granted;
+    struct rwsem_waiter *next;
+};
+
+void init_rwsem(struct rw_semaphore *sem, const char *name) {
+    *sem = (struct rw_semaphore)RWSEM_INITIALIZER(name);
+}
+
+// hand the lock to the front waiter, called with interrupts off
+static void rwsem_grant(struct rw_semaphore *sem) {
+    struct rwsem_waiter *waiter = sem->head;
+
+    sem->head = waiter->next;
+    if (!sem->head)
+        sem->tail = NULL;
+
+    sem->count = waiter->write ? -1 : sem->count + 1;
+
+    // the waiter's stack frame may go away once granted is set
+    struct task_struct *task = waiter->task;
+    waiter->granted = true;
+    wake_up_process(task);
+}
+
+// wake whoever can run now that the lock changed, called with interrupts off
+static void rwsem_wake(struct rw_semaphore *sem) {
+    if (!sem->head)
+        return;
+
+    if (sem->head->write) {
+        if (!sem->count)
+            rwsem_grant(sem);
+        return;
+    }
+
+    while (sem->head && !sem->head->write && sem->count >= 0)
+        rwsem_grant(sem);
+}
+
+/*  rwsem_wait
+ *  DESCRIPTION: queue up and sleep until the lock is granted, called with
+ *               interrupts off
+ *  INPUTS: struct rw_semaphore *sem, bool write
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+static void rwsem_wait(struct rw_semaphore *sem, bool write) {
+    struct rwsem_waiter waiter = {
+        .task = current,
+        .write = write,
+    };
+
+    if (sem->tail)
+        sem->tail->next = &waiter;
+    else
+        sem->head = &waiter;
+    sem->tail = &waiter;
+
+    current->state = TASK_UNINTERRUPTIBLE;
+    while (!waiter.granted)
+        schedule();
+    current->state = TASK_RUNNING;
+}
+
+/*  down_read
+ *  DESCRIPTION: acquire the lock shared, sleeping while a writer holds it or
+ *               anyone is queued
+ *  INPUTS: struct rw_semaphore *sem
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void down_read(struct rw_semaphore *sem) {
+    uint64_t wait_start = 0;
+    unsigned long flags;
+    cli_and_save(flags);
+
+    if (sem->count >= 0 && !sem->head) {
+        sem->count++;
+    } else {
+        wait_start = rdtsc();
+        rwsem_wait(sem, false);
+    }
+
+#if LOCK_STAT
+    lock_stat_acquired(&sem->stat, wait_start, false, __builtin_return_address(0));
+#else
+    (void)wait_start;
+#endif
+
+    restore_flags(flags);
+}
+
+bool down_read_trylock(struct rw_semaphore *sem) {
+    bool ret = false;
+    unsigned long flags;
+    cli_and_save(flags);
+
+    if (sem->count >= 0 && !sem->head) {
+        sem->count++;
+        ret = true;
+#if LOCK_STAT
+        lock_stat_acquired(&sem->stat, 0, false, __builtin_return_address(0));
+#endif
+    }
+
+    restore_flags(flags);
+    return ret;
+}
+
+void up_read(struct rw_semaphore *sem) {
+    unsigned long flags;
+    cli_and_save(flags);
+
+    if (sem->count <= 0)
+        BUG();
+    if (!--sem->count)
+        rwsem_wake(sem);
+
+    restore_flags(flags);
+}
+
+/*  down_write
+ *  DESCRIPTION: acquire the lock exclusive, sleeping while anyone holds it
+ *               or is queued
+ *  INPUTS: struct rw_semaphore *sem
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void down_write(struct rw_semaphore *sem) {
+    uint64_t wait_start = 0;
+    unsigned long flags;
+    cli_and_save(flags);
+
+    if (!sem->count && !sem->head) {
+        sem->count = -1;
+    } else {
+        wait_start = rdtsc();
+        rwsem_wait(sem, true);
+    }
+
+#if LOCK_STAT
+    lock_stat_acquired(&sem->stat, wait_start, true, __builtin_return_address(0));
+#else
+    (void)wait_start;
+#endif
+
+    restore_flags(flags);
+}
+
+bool down_write_trylock(struct rw_semaphore *sem) {
+    bool ret = false;
+    unsigned long flags;
+    cli_and_save(flags);
+
+    if (!sem->count && !sem->head) {
+        sem->count = -1;
+        ret = true;
+#if LOCK_STAT
+        lock_stat_acquired(&sem->stat, 0, true, __builtin_return_address(0));
+#endif
+    }
+
+    restore_flags(flags);
+    return ret;
+}
+
+void up_write(struct rw_semaphore *sem) {
+    unsigned long flags;
+    cli_and_save(flags);
+
+    if (sem->count != -1)
+        BUG();
+    sem->count = 0;
+#if LOCK_STAT
+    lock_stat_released(&sem->stat);
+#endif
+    rwsem_wake(sem);
+
+    restore_flags(flags);
+}
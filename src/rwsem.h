@@ -0,0 +1,44 @@
+#ifndef _RWSEM_H
+#define _RWSEM_H
+
+#include "lib/stdint.h"
+#include "lib/stdbool.h"
+#include "lockstat.h"
+
+struct rwsem_waiter;
+
+/*
+ * A sleeping reader-writer lock. Waiters queue in FIFO order on their own
+ * stacks, so no allocation is needed. When a writer releases, either the
+ * writer at the front of the queue or every reader up to the next writer is
+ * woken; a reader arriving while anyone is queued queues too, so writers are
+ * not starved. A zeroed rw_semaphore is unlocked.
+ */
+struct rw_semaphore {
+    int32_t count;      // number of readers, or -1 if write locked
+    struct rwsem_waiter *head;
+    struct rwsem_waiter *tail;
+#if LOCK_STAT
+    struct lock_stat stat;
+#endif
+};
+
+#if LOCK_STAT
+#define RWSEM_INITIALIZER(name) { .stat = LOCK_STAT_INITIALIZER(name) }
+#else
+#define RWSEM_INITIALIZER(name) { .count = 0 }
+#endif
+
+#define DEFINE_RWSEM(sem) struct rw_semaphore sem = RWSEM_INITIALIZER(#sem)
+
+void init_rwsem(struct rw_semaphore *sem, const char *name);
+
+void down_read(struct rw_semaphore *sem);
+bool down_read_trylock(struct rw_semaphore *sem);
+void up_read(struct rw_semaphore *sem);
+
+void down_write(struct rw_semaphore *sem);
+bool down_write_trylock(struct rw_semaphore *sem);
+void up_write(struct rw_semaphore *sem);
+
+#endif
@@ -0,0 +1,260 @@
+#include "softirq.h"
+#include "atomic.h"
+#include "eflags.h"
+#include "interrupt.h"
+#include "initcall.h"
+#include "lib/bsr.h"
+#include "lib/cli.h"
+#include "task/kthread.h"
+#include "task/sched.h"
+
+// rounds of re-raised softirqs to run on interrupt exit before deferring the
+// rest to ksoftirqd
+#define MAX_SOFTIRQ_RESTART 10
+
+static softirq_action_t *softirq_vec[NR_SOFTIRQS];
+static volatile uint32_t softirq_pending;
+
+// nesting depth of hard IRQ handlers, and whether softirqs are being run
+static uint32_t hardirq_count;
+static bool softirq_running;
+
+static struct task_struct *ksoftirqd_task;
+
+/*  open_softirq
+ *  DESCRIPTION: register the action of a softirq
+ *  INPUTS: uint32_t nr, softirq_action_t *action
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void open_softirq(uint32_t nr, softirq_action_t *action) {
+    softirq_vec[nr] = action;
+}
+
+/*  raise_softirq
+ *  DESCRIPTION: mark a softirq pending. From an interrupt, it runs when the
+ *               outermost handler returns; otherwise ksoftirqd runs it
+ *  INPUTS: uint32_t nr
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void raise_softirq(uint32_t nr) {
+    set_bit(nr, &softirq_pending);
+
+    if (!in_interrupt() && ksoftirqd_task)
+        wake_up_process(ksoftirqd_task);
+}
+
+bool in_interrupt(void) {
+    return hardirq_count || softirq_running;
+}
+
+/*  __do_softirq
+ *  DESCRIPTION: run pending softirqs, called with interrupts off and not
+ *               already running softirqs
+ *  INPUTS: bool irqs_on -- whether interrupts may be enabled while the
+ *          actions run
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+static void __do_softirq(bool irqs_on) {
+    uint32_t restart = MAX_SOFTIRQ_RESTART;
+    uint32_t pending;
+
+    softirq_running = true;
+
+    while ((pending = xchg(&softirq_pending, 0))) {
+        if (irqs_on)
+            sti();
+
+        while (pending) {
+            uint32_t nr = bsf(pending);
+            pending &= pending - 1;
+            if (softirq_vec[nr])
+                (*softirq_vec[nr])();
+        }
+
+        cli();
+        if (!--restart)
+            break;
+    }
+
+    softirq_running = false;
+
+    if (softirq_pending && ksoftirqd_task)
+        wake_up_process(ksoftirqd_task);
+}
+
+/*  do_softirq
+ *  DESCRIPTION: run pending softirqs from task context
+ *  INPUTS: none
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void do_softirq(void) {
+    unsigned long flags;
+    cli_and_save(flags);
+
+    if (!in_interrupt() && softirq_pending)
+        __do_softirq(flags & IF);
+
+    restore_flags(flags);
+}
+
+void irq_enter(void) {
+    hardirq_count++;
+}
+
+/*  irq_exit
+ *  DESCRIPTION: leave a hard IRQ handler, running pending softirqs if this
+ *               is the outermost one. Called with interrupts off
+ *  INPUTS: struct intr_info *info -- the interrupted context
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void irq_exit(struct intr_info *info) {
+    hardirq_count--;
+
+    if (!in_interrupt() && softirq_pending)
+        __do_softirq(info->eflags & IF);
+}
+
+struct tasklet_head {
+    struct tasklet_struct *head;
+    struct tasklet_struct **tail;
+};
+
+static struct tasklet_head tasklet_vec = { .tail = &tasklet_vec.head };
+static struct tasklet_head tasklet_hi_vec = { .tail = &tasklet_hi_vec.head };
+
+static void __tasklet_schedule(struct tasklet_head *list, struct tasklet_struct *t, uint32_t nr) {
+    // already queued, it will see whatever the caller wants it to see
+    if (test_and_set_bit(TASKLET_STATE_SCHED, &t->state))
+        return;
+
+    unsigned long flags;
+    cli_and_save(flags);
+
+    t->next = NULL;
+    *list->tail = t;
+    list->tail = &t->next;
+    raise_softirq(nr);
+
+    restore_flags(flags);
+}
+
+/*  tasklet_schedule
+ *  DESCRIPTION: queue a tasklet to run from TASKLET_SOFTIRQ, unless it is
+ *               already queued
+ *  INPUTS: struct tasklet_struct *t
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void tasklet_schedule(struct tasklet_struct *t) {
+    __tasklet_schedule(&tasklet_vec, t, TASKLET_SOFTIRQ);
+}
+
+/*  tasklet_hi_schedule
+ *  DESCRIPTION: queue a tasklet to run from HI_SOFTIRQ, ahead of other
+ *               softirqs, unless it is already queued
+ *  INPUTS: struct tasklet_struct *t
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void tasklet_hi_schedule(struct tasklet_struct *t) {
+    __tasklet_schedule(&tasklet_hi_vec, t, HI_SOFTIRQ);
+}
+
+static void tasklet_action_common(struct tasklet_head *list) {
+    unsigned long flags;
+    cli_and_save(flags);
+
+    struct tasklet_struct *t = list->head;
+    list->head = NULL;
+    list->tail = &list->head;
+
+    restore_flags(flags);
+
+    while (t) {
+        struct tasklet_struct *next = t->next;
+        // cleared first so the tasklet can be rescheduled while it runs
+        clear_bit(TASKLET_STATE_SCHED, &t->state);
+        (*t->func)(t->data);
+        t = next;
+    }
+}
+
+static void tasklet_action(void) {
+    tasklet_action_common(&tasklet_vec);
+}
+
+static void tasklet_hi_action(void) {
+    tasklet_action_common(&tasklet_hi_vec);
+}
+
+static void init_softirq() {
+    open_softirq(TASKLET_SOFTIRQ, &tasklet_action);
+    open_softirq(HI_SOFTIRQ, &tasklet_hi_action);
+}
+DEFINE_INITCALL(init_softirq, early);
+
+/*
+ *   ksoftirqd
+ *   DESCRIPTION: run softirqs raised outside interrupts, or re-raised too
+ *                often to finish on interrupt exit
+ *   INPUTS: void *args
+ */
+static int ksoftirqd(void *args) {
+    ksoftirqd_task = current;
+    set_current_comm("ksoftirqd");
+
+    while (1) {
+        current->state = TASK_INTERRUPTIBLE;
+        while (!softirq_pending)
+            schedule();
+        current->state = TASK_RUNNING;
+
+        do_softirq();
+        cond_schedule();
+    }
+
+    return 0;
+}
+DEFINE_INIT_KTHREAD(ksoftirqd);
+
+#include "tests.h"
+#if RUN_TESTS
+static unsigned long tasklet_test_runs;
+
+static void tasklet_test_func(unsigned long data) {
+    tasklet_test_runs += data;
+}
+
+/* tasklet tests
+ *
+ * Asserts that a tasklet scheduled twice before it runs runs once, and that
+ * it can be scheduled again afterwards
+ * Coverage: tasklet_schedule, do_softirq
+ */
+__testfunc
+static void tasklet_test() {
+    DECLARE_TASKLET(t, &tasklet_test_func, 2);
+    unsigned long flags;
+
+    tasklet_test_runs = 0;
+
+    cli_and_save(flags);
+    tasklet_schedule(&t);
+    tasklet_schedule(&t);
+    TEST_ASSERT(!tasklet_test_runs && test_bit(TASKLET_STATE_SCHED, &t.state));
+    restore_flags(flags);
+
+    do_softirq();
+    TEST_ASSERT(tasklet_test_runs == 2 && !t.state);
+
+    tasklet_hi_schedule(&t);
+    do_softirq();
+    TEST_ASSERT(tasklet_test_runs == 4);
+}
+DEFINE_TEST(tasklet_test);
+#endif
@@ -0,0 +1,57 @@
+// softirq.h -- deferred work run after hardware interrupts
+
+#ifndef _SOFTIRQ_H
+#define _SOFTIRQ_H
+
+#include "lib/stdint.h"
+#include "lib/stdbool.h"
+#include "interrupt.h"
+
+/*
+ * Hard IRQ handlers run with interrupts off and should only acknowledge the
+ * hardware and raise a softirq. Pending softirqs run when the outermost hard
+ * IRQ returns, with interrupts on, so that a burst of packets does not hold
+ * off the keyboard or the PIT. If they keep getting re-raised, the rest is
+ * left to ksoftirqd so that tasks still get to run.
+ *
+ * Softirq actions must not sleep.
+ */
+enum {
+    HI_SOFTIRQ,
+    NET_RX_SOFTIRQ,
+    TASKLET_SOFTIRQ,
+    NR_SOFTIRQS
+};
+
+typedef void softirq_action_t(void);
+
+void open_softirq(uint32_t nr, softirq_action_t *action);
+void raise_softirq(uint32_t nr);
+
+void irq_enter(void);
+void irq_exit(struct intr_info *info);
+bool in_interrupt(void);
+
+void do_softirq(void);
+
+/*
+ * A tasklet is a function run once from TASKLET_SOFTIRQ (or HI_SOFTIRQ) for
+ * each time it has been scheduled since it last started running. The same
+ * tasklet never runs concurrently with itself.
+ */
+struct tasklet_struct {
+    struct tasklet_struct *next;
+    volatile uint32_t state;
+    void (*func)(unsigned long data);
+    unsigned long data;
+};
+
+#define TASKLET_STATE_SCHED 0 // queued, not yet started
+
+#define DECLARE_TASKLET(name, _func, _data) \
+struct tasklet_struct name = { .func = (_func), .data = (_data) }
+
+void tasklet_schedule(struct tasklet_struct *t);
+void tasklet_hi_schedule(struct tasklet_struct *t);
+
+#endif
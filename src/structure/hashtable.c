@@ -0,0 +1,229 @@
+#include "hashtable.h"
+#include "../err.h"
+#include "../errno.h"
+#include "../compiler.h"
+#include "../mm/kmalloc.h"
+#include "../lib/bsr.h"
+#include "../lib/cli.h"
+
+#define HASHTABLE_MIN_CAPACITY 8
+
+// Fibonacci hashing: the top bits of key * 2^32 / phi
+static inline uint32_t hash_slot(uint32_t key, uint32_t capacity) {
+    return (key * 0x9E3779B9) >> (32 - bsr(capacity));
+}
+
+/*  hashtable_probe
+ *  DESCRIPTION: find the slot for a key, called with interrupts off
+ *  INPUTS: struct hashtable_table *table, uint32_t key
+ *  OUTPUTS: none
+ *  RETURN VALUE: the slot holding key, or if absent, the first free or
+ *                tombstone slot on its probe chain
+ */
+static struct hashtable_slot *hashtable_probe(struct hashtable_table *table, uint32_t key) {
+    uint32_t mask = table->capacity - 1;
+    uint32_t i = hash_slot(key, table->capacity);
+    struct hashtable_slot *reuse = NULL;
+
+    for (;; i = (i + 1) & mask) {
+        struct hashtable_slot *slot = &table->slots[i];
+        if (!slot->value)
+            return reuse ?: slot;
+        if (slot->value == HASHTABLE_TOMBSTONE) {
+            if (!reuse)
+                reuse = slot;
+        } else if (slot->key == key) {
+            return slot;
+        }
+    }
+}
+
+/*  hashtable_resize
+ *  DESCRIPTION: rebuild the table with room for its live entries, dropping
+ *               tombstones, called with interrupts off
+ *  INPUTS: struct hashtable *ht, uint32_t count -- entries to make room for
+ *  OUTPUTS: none
+ *  RETURN VALUE: 0 on success, or -ENOMEM
+ */
+static int32_t hashtable_resize(struct hashtable *ht, uint32_t count) {
+    uint32_t capacity = HASHTABLE_MIN_CAPACITY;
+    // stay at most half full right after a rebuild
+    while (capacity < count * 2)
+        capacity *= 2;
+
+    struct hashtable_table *table = kcalloc(1, sizeof(*table) + capacity * sizeof(table->slots[0]));
+    if (!table)
+        return -ENOMEM;
+    table->capacity = capacity;
+
+    struct hashtable_table *old = ht->table;
+    if (old) {
+        uint32_t i;
+        for (i = 0; i < old->capacity; i++) {
+            struct hashtable_slot *slot = &old->slots[i];
+            if (hashtable_slot_live(slot))
+                *hashtable_probe(table, slot->key) = *slot;
+        }
+    }
+
+    // publish only after the new table is complete
+    barrier();
+    ht->table = table;
+    ht->used = ht->count;
+    kfree(old);
+    return 0;
+}
+
+/*  hashtable_set
+ *  DESCRIPTION: map a key to a value, replacing any existing mapping
+ *  INPUTS: struct hashtable *ht, uint32_t key, void *value
+ *  OUTPUTS: none
+ *  RETURN VALUE: 0 on success, or negative errno
+ */
+int32_t hashtable_set(struct hashtable *ht, uint32_t key, void *value) {
+    unsigned long flags;
+    int32_t ret = 0;
+
+    if (!value || value == HASHTABLE_TOMBSTONE)
+        return -EINVAL;
+
+    cli_and_save(flags);
+
+    if (!ht->table || (ht->used + 1) * 4 > ht->table->capacity * 3) {
+        ret = hashtable_resize(ht, ht->count + 1);
+        if (ret < 0)
+            goto out;
+    }
+
+    struct hashtable_slot *slot = hashtable_probe(ht->table, key);
+    if (!hashtable_slot_live(slot)) {
+        ht->count++;
+        if (!slot->value)
+            ht->used++;
+        slot->key = key;
+    }
+    slot->value = value;
+
+out:
+    restore_flags(flags);
+    return ret;
+}
+
+/*  hashtable_get
+ *  DESCRIPTION: look up a key
+ *  INPUTS: struct hashtable *ht, uint32_t key
+ *  OUTPUTS: none
+ *  RETURN VALUE: the value, or NULL if absent
+ */
+void *hashtable_get(struct hashtable *ht, uint32_t key) {
+    struct hashtable_table *table = ht->table;
+    if (!table)
+        return NULL;
+
+    struct hashtable_slot *slot = hashtable_probe(table, key);
+    return hashtable_slot_live(slot) ? slot->value : NULL;
+}
+
+/*  hashtable_remove
+ *  DESCRIPTION: remove a key
+ *  INPUTS: struct hashtable *ht, uint32_t key
+ *  OUTPUTS: none
+ *  RETURN VALUE: the value that was removed, or NULL if absent
+ */
+void *hashtable_remove(struct hashtable *ht, uint32_t key) {
+    unsigned long flags;
+    void *ret = NULL;
+
+    cli_and_save(flags);
+
+    if (!ht->table)
+        goto out;
+
+    struct hashtable_slot *slot = hashtable_probe(ht->table, key);
+    if (!hashtable_slot_live(slot))
+        goto out;
+
+    ret = slot->value;
+    slot->value = HASHTABLE_TOMBSTONE;
+    ht->count--;
+
+    // failing to shrink is harmless
+    if (ht->table->capacity > HASHTABLE_MIN_CAPACITY &&
+        ht->count * 8 < ht->table->capacity)
+        hashtable_resize(ht, ht->count);
+
+out:
+    restore_flags(flags);
+    return ret;
+}
+
+/*  hashtable_destroy
+ *  DESCRIPTION: free the table, leaving an empty hashtable
+ *  INPUTS: struct hashtable *ht
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void hashtable_destroy(struct hashtable *ht) {
+    unsigned long flags;
+    cli_and_save(flags);
+
+    struct hashtable_table *table = ht->table;
+    *ht = (struct hashtable)HASHTABLE_INIT;
+
+    restore_flags(flags);
+    kfree(table);
+}
+
+#include "../tests.h"
+#if RUN_TESTS
+/* hashtable tests
+ *
+ * Asserts that entries survive growth, removal, reuse of tombstones and
+ * shrinking
+ * Coverage: hashtable_set, hashtable_get, hashtable_remove, hashtable_for_each
+ */
+__testfunc
+static void hashtable_test() {
+    struct hashtable ht = HASHTABLE_INIT;
+    uint32_t i;
+
+    TEST_ASSERT(!hashtable_get(&ht, 0));
+    TEST_ASSERT(!hashtable_remove(&ht, 0));
+    TEST_ASSERT(hashtable_set(&ht, 0, NULL) == -EINVAL);
+
+    // keys that collide in the low bits
+    for (i = 0; i < 200; i++)
+        TEST_ASSERT(!hashtable_set(&ht, i << 12, (void *)(i * 4 + 4)));
+    TEST_ASSERT(ht.count == 200 && ht.table->capacity >= 256);
+    for (i = 0; i < 200; i++)
+        TEST_ASSERT(hashtable_get(&ht, i << 12) == (void *)(i * 4 + 4));
+    TEST_ASSERT(!hashtable_get(&ht, 1));
+
+    // replace
+    TEST_ASSERT(!hashtable_set(&ht, 0, (void *)8));
+    TEST_ASSERT(ht.count == 200 && hashtable_get(&ht, 0) == (void *)8);
+
+    // remove every other, the rest must still be reachable past tombstones
+    for (i = 0; i < 200; i += 2)
+        TEST_ASSERT(hashtable_remove(&ht, i << 12));
+    for (i = 1; i < 200; i += 2)
+        TEST_ASSERT(hashtable_get(&ht, i << 12) == (void *)(i * 4 + 4));
+
+    struct hashtable_slot *slot;
+    uint32_t n = 0;
+    hashtable_for_each(&ht, slot) {
+        TEST_ASSERT((slot->key >> 12) & 1);
+        n++;
+    }
+    TEST_ASSERT(n == 100);
+
+    // shrink
+    for (i = 1; i < 200; i += 2)
+        TEST_ASSERT(hashtable_remove(&ht, i << 12));
+    TEST_ASSERT(!ht.count && ht.table->capacity == HASHTABLE_MIN_CAPACITY);
+
+    hashtable_destroy(&ht);
+    TEST_ASSERT(!ht.table);
+}
+DEFINE_TEST(hashtable_test);
+#endif
@@ -0,0 +1,59 @@
+#ifndef _HASHTABLE_H
+#define _HASHTABLE_H
+
+#include "../lib/stdint.h"
+#include "../lib/stdbool.h"
+
+/*
+ * An open-addressing hash table from uint32_t keys to non-NULL pointers,
+ * with linear probing. Removed slots are left as tombstones so probe chains
+ * stay intact; the table is rebuilt when live entries plus tombstones reach
+ * 3/4 of the capacity, and shrunk when it drops below 1/8 full.
+ *
+ * The slots and their capacity live in one allocation that is swapped in
+ * with a single pointer store once fully built, so a lookup that snapshots
+ * the table pointer always sees a consistent table. There is no grace
+ * period for the old table, so readers that can race with a writer (i.e.
+ * from an interrupt) still have to hold cli like all other structures here.
+ */
+
+struct hashtable_slot {
+    uint32_t key;
+    void *value;
+};
+
+struct hashtable_table {
+    uint32_t capacity;  // always a power of two
+    struct hashtable_slot slots[];
+};
+
+struct hashtable {
+    struct hashtable_table *table;
+    uint32_t count;     // live entries
+    uint32_t used;      // live entries and tombstones
+};
+
+// zero-initialized hashtables are empty and usable
+#define HASHTABLE_INIT { .table = NULL }
+
+// value of a removed slot, never returned to callers
+#define HASHTABLE_TOMBSTONE ((void *)1)
+
+int32_t hashtable_set(struct hashtable *ht, uint32_t key, void *value);
+void *hashtable_get(struct hashtable *ht, uint32_t key);
+void *hashtable_remove(struct hashtable *ht, uint32_t key);
+void hashtable_destroy(struct hashtable *ht);
+
+static inline bool hashtable_slot_live(struct hashtable_slot *slot) {
+    return slot->value && slot->value != HASHTABLE_TOMBSTONE;
+}
+
+// Iterate over all live slots. The table must not be modified while
+// iterating.
+#define hashtable_for_each(ht, slot) for (                                  \
+    slot = (ht)->table ? (ht)->table->slots : NULL;                         \
+    slot && slot < (ht)->table->slots + (ht)->table->capacity;              \
+    slot++                                                                  \
+) if (hashtable_slot_live(slot))
+
+#endif
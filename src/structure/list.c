@@ -1,8 +1,10 @@
 #include "list.h"
-#include "../mm/kmalloc.h"
+#include "../mm/slab.h"
 #include "../err.h"
 #include "../errno.h"
 
+DEFINE_KMEM_CACHE(list_node_cache, struct list_node, NULL);
+
 void list_init(struct list *list) {
     *list = (struct list){
         .first = {
@@ -24,7 +26,7 @@ int32_t list_insert_front(struct list *list, void *value) {
     if (!value)
         return -EINVAL;
 
-    struct list_node *node = kmalloc(sizeof(*node));
+    struct list_node *node = kmem_cache_alloc(&list_node_cache);
     if (!node)
         return -ENOMEM;
 
@@ -49,7 +51,7 @@ int32_t list_insert_back(struct list *list, void *value) {
     if (!value)
         return -EINVAL;
 
-    struct list_node *node = kmalloc(sizeof(*node));
+    struct list_node *node = kmem_cache_alloc(&list_node_cache);
     if (!node)
         return -ENOMEM;
 
@@ -74,7 +76,7 @@ int32_t list_insert_ordered(struct list *list, void *value, int (*compare)(const
     if (!value)
         return -EINVAL;
 
-    struct list_node *node = kmalloc(sizeof(*node));
+    struct list_node *node = kmem_cache_alloc(&list_node_cache);
     if (!node)
         return -ENOMEM;
 
@@ -127,7 +129,7 @@ void *list_pop_front(struct list *list) {
     node->prev->next = node->next;
 
     void *value = node->value;
-    kfree(node);
+    kmem_cache_free(&list_node_cache, node);
 
     restore_flags(flags);
 
@@ -146,7 +148,7 @@ void *list_pop_back(struct list *list) {
     node->prev->next = node->next;
 
     void *value = node->value;
-    kfree(node);
+    kmem_cache_free(&list_node_cache, node);
 
     restore_flags(flags);
 
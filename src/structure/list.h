@@ -5,6 +5,7 @@
 #include "../lib/stdbool.h"
 #include "../lib/cli.h"
 #include "../initcall.h"
+#include "../mm/slab.h"
 
 // This doublely linked list uses sentinel nodes for both first node
 // and last node
@@ -18,6 +19,9 @@ struct list {
     struct list_node last;
 };
 
+// list nodes are allocated from this cache
+extern struct kmem_cache list_node_cache;
+
 void list_init(struct list *list);
 
 int32_t list_insert_front(struct list *list, void *value);
@@ -57,7 +61,7 @@ void list_remove(struct list *list, void *value);
             __node->next->prev = __node->prev;                       \
             __node->prev->next = __node->next;                       \
             extra;                                                   \
-            kfree(__node);                                           \
+            kmem_cache_free(&list_node_cache, __node);               \
         }                                                            \
     }                                                                \
     restore_flags(__flags);                                          \
@@ -0,0 +1,445 @@
+#include "radix_tree.h"
+#include "../err.h"
+#include "../errno.h"
+#include "../compiler.h"
+#include "../mm/slab.h"
+#include "../lib/cli.h"
+#include "../tests.h"
+
+// enough levels to cover 32 bits
+#define RADIX_TREE_MAX_HEIGHT ((32 + RADIX_TREE_MAP_SHIFT - 1) / RADIX_TREE_MAP_SHIFT)
+
+static DEFINE_KMEM_CACHE(radix_tree_node_cache, struct radix_tree_node, NULL);
+
+// largest index reachable under a node with this shift
+static inline uint32_t shift_maxindex(uint32_t shift) {
+    if (shift + RADIX_TREE_MAP_SHIFT >= 32)
+        return 0xFFFFFFFF;
+    return (1 << (shift + RADIX_TREE_MAP_SHIFT)) - 1;
+}
+
+static inline uint32_t slot_offset(struct radix_tree_node *node, uint32_t index) {
+    return (index >> node->shift) & RADIX_TREE_MAP_MASK;
+}
+
+#if RUN_TESTS
+// if nonzero, the allocation that brings it to zero fails
+static uint32_t radix_tree_fail_countdown;
+#endif
+
+static struct radix_tree_node *radix_tree_node_alloc(uint32_t shift) {
+#if RUN_TESTS
+    if (radix_tree_fail_countdown && !--radix_tree_fail_countdown)
+        return NULL;
+#endif
+
+    struct radix_tree_node *node = kmem_cache_zalloc(&radix_tree_node_cache);
+    if (node)
+        node->shift = shift;
+    return node;
+}
+
+// a root with only its first child can be replaced by that child
+static void radix_tree_shrink(struct radix_tree *root) {
+    struct radix_tree_node *node;
+
+    while ((node = root->rnode) && node->shift && node->count == 1 && node->slots[0]) {
+        root->rnode = node->slots[0];
+        kmem_cache_free(&radix_tree_node_cache, node);
+    }
+}
+
+/*  radix_tree_trim
+ *  DESCRIPTION: free the empty nodes a failed insert left on the way to an
+ *               index, and the levels it added above the old root
+ *  INPUTS: struct radix_tree *root, uint32_t index
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+static void radix_tree_trim(struct radix_tree *root, uint32_t index) {
+    struct radix_tree_node *path[RADIX_TREE_MAX_HEIGHT];
+    struct radix_tree_node *node = root->rnode;
+    int32_t depth = 0;
+
+    if (node && index <= shift_maxindex(node->shift)) {
+        for (;;) {
+            path[depth++] = node;
+            if (!node->shift)
+                break;
+            node = node->slots[slot_offset(node, index)];
+            if (!node)
+                break;
+        }
+    }
+
+    // only the nodes just made can be empty, and they're all on this path
+    while (depth--) {
+        node = path[depth];
+        if (node->count)
+            break;
+
+        if (depth) {
+            path[depth - 1]->slots[slot_offset(path[depth - 1], index)] = NULL;
+            path[depth - 1]->count--;
+        } else {
+            root->rnode = NULL;
+        }
+        kmem_cache_free(&radix_tree_node_cache, node);
+    }
+
+    radix_tree_shrink(root);
+}
+
+/*  radix_tree_insert
+ *  DESCRIPTION: insert an item at an index
+ *  INPUTS: struct radix_tree *root, uint32_t index, void *item
+ *  OUTPUTS: none
+ *  RETURN VALUE: 0 on success, -EEXIST if the index is taken, or other
+ *                negative errno
+ */
+int32_t radix_tree_insert(struct radix_tree *root, uint32_t index, void *item) {
+    unsigned long flags;
+    int32_t ret = 0;
+
+    if (!item)
+        return -EINVAL;
+
+    cli_and_save(flags);
+
+    if (!root->rnode) {
+        uint32_t shift = 0;
+        while (index > shift_maxindex(shift))
+            shift += RADIX_TREE_MAP_SHIFT;
+
+        struct radix_tree_node *node = radix_tree_node_alloc(shift);
+        if (!node) {
+            ret = -ENOMEM;
+            goto out;
+        }
+        root->rnode = node;
+    }
+
+    // grow the tree upwards until index fits
+    while (index > shift_maxindex(root->rnode->shift)) {
+        struct radix_tree_node *node = radix_tree_node_alloc(root->rnode->shift + RADIX_TREE_MAP_SHIFT);
+        if (!node) {
+            ret = -ENOMEM;
+            goto out;
+        }
+        node->slots[0] = root->rnode;
+        node->count = 1;
+
+        barrier();
+        root->rnode = node;
+    }
+
+    struct radix_tree_node *node = root->rnode;
+    while (node->shift) {
+        void **slot = &node->slots[slot_offset(node, index)];
+        if (!*slot) {
+            struct radix_tree_node *child = radix_tree_node_alloc(node->shift - RADIX_TREE_MAP_SHIFT);
+            if (!child) {
+                ret = -ENOMEM;
+                goto out;
+            }
+
+            barrier();
+            *slot = child;
+            node->count++;
+        }
+        node = *slot;
+    }
+
+    void **slot = &node->slots[slot_offset(node, index)];
+    if (*slot) {
+        ret = -EEXIST;
+        goto out;
+    }
+    *slot = item;
+    node->count++;
+
+out:
+    if (ret == -ENOMEM)
+        radix_tree_trim(root, index);
+    restore_flags(flags);
+    return ret;
+}
+
+/*  radix_tree_lookup
+ *  DESCRIPTION: find the item at an index
+ *  INPUTS: struct radix_tree *root, uint32_t index
+ *  OUTPUTS: none
+ *  RETURN VALUE: the item, or NULL if absent
+ */
+void *radix_tree_lookup(struct radix_tree *root, uint32_t index) {
+    struct radix_tree_node *node = root->rnode;
+
+    if (!node || index > shift_maxindex(node->shift))
+        return NULL;
+
+    while (node->shift) {
+        node = node->slots[slot_offset(node, index)];
+        if (!node)
+            return NULL;
+    }
+    return node->slots[slot_offset(node, index)];
+}
+
+/*  radix_tree_delete
+ *  DESCRIPTION: remove the item at an index, freeing nodes that become
+ *               empty and shrinking the tree if possible
+ *  INPUTS: struct radix_tree *root, uint32_t index
+ *  OUTPUTS: none
+ *  RETURN VALUE: the item that was removed, or NULL if absent
+ */
+void *radix_tree_delete(struct radix_tree *root, uint32_t index) {
+    struct radix_tree_node *path[RADIX_TREE_MAX_HEIGHT];
+    unsigned long flags;
+    void *item = NULL;
+    int32_t depth = 0;
+
+    cli_and_save(flags);
+
+    struct radix_tree_node *node = root->rnode;
+    if (!node || index > shift_maxindex(node->shift))
+        goto out;
+
+    for (;;) {
+        path[depth++] = node;
+        if (!node->shift)
+            break;
+        node = node->slots[slot_offset(node, index)];
+        if (!node)
+            goto out;
+    }
+
+    item = node->slots[slot_offset(node, index)];
+    if (!item)
+        goto out;
+
+    // clear the slot, then free nodes bottom-up while they're empty
+    while (depth--) {
+        node = path[depth];
+        node->slots[slot_offset(node, index)] = NULL;
+        if (--node->count)
+            break;
+
+        if (!depth)
+            root->rnode = NULL;
+        kmem_cache_free(&radix_tree_node_cache, node);
+    }
+
+    radix_tree_shrink(root);
+
+out:
+    restore_flags(flags);
+    return item;
+}
+
+/*  radix_tree_node_next
+ *  DESCRIPTION: find the first item under a node at or after an index
+ *  INPUTS: struct radix_tree_node *node
+ *          uint32_t *index -- within the node's range
+ *  OUTPUTS: uint32_t *index -- the item's index
+ *  RETURN VALUE: the item, or NULL if none
+ */
+static void *radix_tree_node_next(struct radix_tree_node *node, uint32_t *index) {
+    uint32_t range = shift_maxindex(node->shift);
+    // the top node at shift 30 only has 4 reachable slots
+    uint32_t last = range >> node->shift;
+    uint32_t off;
+
+    for (off = slot_offset(node, *index); off <= last; off++) {
+        void *slot = node->slots[off];
+        if (slot) {
+            if (!node->shift) {
+                *index = (*index & ~range) | off;
+                return slot;
+            }
+            void *item = radix_tree_node_next(slot, index);
+            if (item)
+                return item;
+        }
+        if (off == last)
+            break;
+        // move to the start of the next slot
+        *index = (*index & ~range) | ((off + 1) << node->shift);
+    }
+    return NULL;
+}
+
+/*  radix_tree_next
+ *  DESCRIPTION: find the first item at or after an index
+ *  INPUTS: struct radix_tree *root, uint32_t *index
+ *  OUTPUTS: uint32_t *index -- the item's index
+ *  RETURN VALUE: the item, or NULL if none
+ */
+void *radix_tree_next(struct radix_tree *root, uint32_t *index) {
+    struct radix_tree_node *node = root->rnode;
+
+    if (!node || *index > shift_maxindex(node->shift))
+        return NULL;
+    return radix_tree_node_next(node, index);
+}
+
+/*  radix_tree_gang_lookup
+ *  DESCRIPTION: collect items in index order
+ *  INPUTS: struct radix_tree *root, uint32_t first_index, uint32_t max_items
+ *  OUTPUTS: void **results -- at most max_items items
+ *  RETURN VALUE: number of items found
+ */
+uint32_t radix_tree_gang_lookup(struct radix_tree *root, void **results,
+                                uint32_t first_index, uint32_t max_items) {
+    uint32_t index = first_index;
+    uint32_t n = 0;
+
+    while (n < max_items) {
+        void *item = radix_tree_next(root, &index);
+        if (!item)
+            break;
+        results[n++] = item;
+        if (!++index)
+            break;
+    }
+    return n;
+}
+
+static void radix_tree_node_destroy(struct radix_tree_node *node) {
+    if (node->shift) {
+        uint32_t i;
+        for (i = 0; i < RADIX_TREE_MAP_SIZE; i++) {
+            if (node->slots[i])
+                radix_tree_node_destroy(node->slots[i]);
+        }
+    }
+    kmem_cache_free(&radix_tree_node_cache, node);
+}
+
+/*  radix_tree_destroy
+ *  DESCRIPTION: free all nodes, leaving an empty tree. Items are not freed
+ *  INPUTS: struct radix_tree *root
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void radix_tree_destroy(struct radix_tree *root) {
+    unsigned long flags;
+    cli_and_save(flags);
+
+    if (root->rnode)
+        radix_tree_node_destroy(root->rnode);
+    root->rnode = NULL;
+
+    restore_flags(flags);
+}
+
+#if RUN_TESTS
+/* radix tree tests
+ *
+ * Asserts that items can be found at small and huge indices, iterated in
+ * order, and that deletion frees nodes
+ * Coverage: radix_tree_insert, radix_tree_lookup, radix_tree_delete,
+ *           radix_tree_next, radix_tree_gang_lookup
+ */
+__testfunc
+static void radix_tree_test() {
+    struct radix_tree tree = RADIX_TREE_INIT;
+    uint32_t active = radix_tree_node_cache.num_active;
+    static const uint32_t indices[] = { 0, 1, 63, 64, 4095, 4096, 0x12345678, 0xFFFFFFFF };
+    const uint32_t n = sizeof(indices) / sizeof(*indices);
+    uint32_t i;
+
+    TEST_ASSERT(!radix_tree_lookup(&tree, 0));
+    TEST_ASSERT(radix_tree_insert(&tree, 0, NULL) == -EINVAL);
+
+    // insert from the top so that the tree grows in both directions
+    TEST_ASSERT(!radix_tree_insert(&tree, 5, (void *)4));
+    TEST_ASSERT(tree.rnode->shift == 0);
+    for (i = n; i--;)
+        TEST_ASSERT(!radix_tree_insert(&tree, indices[i], (void *)(i * 4 + 8)));
+    TEST_ASSERT(radix_tree_insert(&tree, 64, (void *)4) == -EEXIST);
+
+    for (i = 0; i < n; i++)
+        TEST_ASSERT(radix_tree_lookup(&tree, indices[i]) == (void *)(i * 4 + 8));
+    TEST_ASSERT(radix_tree_lookup(&tree, 5) == (void *)4);
+    TEST_ASSERT(!radix_tree_lookup(&tree, 2));
+    TEST_ASSERT(!radix_tree_lookup(&tree, 0x12345679));
+
+    uint32_t index;
+    void *item;
+    uint32_t count = 0;
+    radix_tree_for_each(&tree, index, item) {
+        // 5 goes between 1 and 63
+        uint32_t expect = count < 2 ? count : count - 1;
+        if (count == 2)
+            TEST_ASSERT(index == 5 && item == (void *)4);
+        else
+            TEST_ASSERT(index == indices[expect] && item == (void *)(expect * 4 + 8));
+        count++;
+    }
+    TEST_ASSERT(count == n + 1);
+
+    void *results[4];
+    TEST_ASSERT(radix_tree_gang_lookup(&tree, results, 65, 4) == 4);
+    TEST_ASSERT(results[0] == (void *)(4 * 4 + 8) && results[3] == (void *)(7 * 4 + 8));
+    TEST_ASSERT(radix_tree_gang_lookup(&tree, results, 0x12345679, 4) == 1);
+
+    TEST_ASSERT(radix_tree_delete(&tree, 5) == (void *)4);
+    TEST_ASSERT(!radix_tree_delete(&tree, 5));
+    for (i = n; i--;)
+        TEST_ASSERT(radix_tree_delete(&tree, indices[i]) == (void *)(i * 4 + 8));
+    TEST_ASSERT(radix_tree_empty(&tree));
+    TEST_ASSERT(radix_tree_node_cache.num_active == active);
+
+    // deleting the large index shrinks the tree back down
+    TEST_ASSERT(!radix_tree_insert(&tree, 1, (void *)4));
+    TEST_ASSERT(!radix_tree_insert(&tree, 1 << 20, (void *)8));
+    TEST_ASSERT(radix_tree_delete(&tree, 1 << 20));
+    TEST_ASSERT(tree.rnode->shift == 0);
+    radix_tree_destroy(&tree);
+    TEST_ASSERT(radix_tree_node_cache.num_active == active);
+}
+DEFINE_TEST(radix_tree_test);
+
+/* radix tree allocation failure tests
+ *
+ * Asserts that an insert failing to allocate at any level leaves no empty
+ * nodes behind, and the items already in the tree where they were
+ * Coverage: radix_tree_insert, radix_tree_trim
+ */
+__testfunc
+static void radix_tree_enomem_test() {
+    struct radix_tree tree = RADIX_TREE_INIT;
+    uint32_t active = radix_tree_node_cache.num_active;
+    uint32_t base, i;
+
+    // into an empty tree, and into one that has to grow by several levels
+    for (i = 1; i <= RADIX_TREE_MAX_HEIGHT; i++) {
+        radix_tree_fail_countdown = i;
+        TEST_ASSERT(radix_tree_insert(&tree, 0xFFFFFFFF, (void *)4) == -ENOMEM);
+        TEST_ASSERT(radix_tree_empty(&tree));
+        TEST_ASSERT(radix_tree_node_cache.num_active == active);
+    }
+
+    // growing up, then down a new branch, next to an existing item
+    TEST_ASSERT(!radix_tree_insert(&tree, 1, (void *)4));
+    base = radix_tree_node_cache.num_active;
+    for (i = 1; ; i++) {
+        radix_tree_fail_countdown = i;
+        if (radix_tree_insert(&tree, 0x12345678, (void *)8) != -ENOMEM)
+            break;
+        TEST_ASSERT(tree.rnode->shift == 0);
+        TEST_ASSERT(radix_tree_lookup(&tree, 1) == (void *)4);
+        TEST_ASSERT(radix_tree_node_cache.num_active == base);
+    }
+    radix_tree_fail_countdown = 0;
+    // four levels up and four down
+    TEST_ASSERT(i == 9);
+
+    // the parent's count must not include the nodes taken back
+    TEST_ASSERT(radix_tree_delete(&tree, 0x12345678) == (void *)8);
+    TEST_ASSERT(radix_tree_delete(&tree, 1) == (void *)4);
+    TEST_ASSERT(radix_tree_empty(&tree));
+    TEST_ASSERT(radix_tree_node_cache.num_active == active);
+}
+DEFINE_TEST(radix_tree_enomem_test);
+#endif
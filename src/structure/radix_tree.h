@@ -0,0 +1,57 @@
+#ifndef _RADIX_TREE_H
+#define _RADIX_TREE_H
+
+#include "../lib/stdint.h"
+#include "../lib/stdbool.h"
+
+/*
+ * A radix tree from uint32_t indices to non-NULL pointers, 6 bits per level,
+ * loosely modeled after <linux/radix-tree.h>. The tree is only as tall as
+ * the largest index needs, so small dense indices (pids, file offsets in
+ * pages) take one or two levels.
+ *
+ * Every node records its own shift, so a lookup needs nothing but the root
+ * pointer it read at the start. Nodes are fully built before they are linked
+ * in with a single pointer store, so a lookup never sees a half-built node.
+ * Nodes are freed as soon as they're unlinked though, so readers that can
+ * race with a writer still need to hold cli.
+ */
+
+#define RADIX_TREE_MAP_SHIFT 6
+#define RADIX_TREE_MAP_SIZE  (1 << RADIX_TREE_MAP_SHIFT)
+#define RADIX_TREE_MAP_MASK  (RADIX_TREE_MAP_SIZE - 1)
+
+struct radix_tree_node {
+    uint8_t shift;      // bits of index below this node's slots
+    uint8_t count;      // non-NULL slots
+    void *slots[RADIX_TREE_MAP_SIZE];
+};
+
+struct radix_tree {
+    struct radix_tree_node *rnode;
+};
+
+// zero-initialized radix trees are empty and usable
+#define RADIX_TREE_INIT { .rnode = NULL }
+
+int32_t radix_tree_insert(struct radix_tree *root, uint32_t index, void *item);
+void *radix_tree_lookup(struct radix_tree *root, uint32_t index);
+void *radix_tree_delete(struct radix_tree *root, uint32_t index);
+void *radix_tree_next(struct radix_tree *root, uint32_t *index);
+uint32_t radix_tree_gang_lookup(struct radix_tree *root, void **results,
+                                uint32_t first_index, uint32_t max_items);
+void radix_tree_destroy(struct radix_tree *root);
+
+static inline bool radix_tree_empty(struct radix_tree *root) {
+    return !root->rnode;
+}
+
+// Iterate over items in index order. The current item may be deleted while
+// iterating.
+#define radix_tree_for_each(root, index, item) for (                        \
+    index = 0, item = radix_tree_next(root, &index);                        \
+    item;                                                                   \
+    item = ++index ? radix_tree_next(root, &index) : NULL                   \
+)
+
+#endif
@@ -0,0 +1,156 @@
+#include "ring.h"
+#include "../lib/string.h"
+#include "../panic.h"
+
+static inline void *ring_slot(struct ring *ring, uint32_t index) {
+    return (char *)ring->data + (index & (ring->size - 1)) * ring->esize;
+}
+
+/*  ring_init
+ *  DESCRIPTION: set up an empty ring over a caller-provided buffer
+ *  INPUTS: struct ring *ring, void *data -- size * esize bytes,
+ *          uint32_t size -- a power of two, uint32_t esize
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void ring_init(struct ring *ring, void *data, uint32_t size, uint32_t esize) {
+    if (!size || (size & (size - 1)))
+        BUG();
+
+    *ring = (struct ring)RING_INITIALIZER(data, size, esize);
+}
+
+// copy n elements between a linear buffer and the ring, starting at index,
+// in at most two pieces around the wrap
+static void ring_copy(struct ring *ring, uint32_t index, void *buf, uint32_t n, bool to_ring) {
+    uint32_t off = index & (ring->size - 1);
+    uint32_t first = ring->size - off;
+    if (first > n)
+        first = n;
+
+    void *slot = ring_slot(ring, index);
+    uint32_t first_bytes = first * ring->esize;
+    uint32_t rest_bytes = (n - first) * ring->esize;
+
+    if (to_ring) {
+        memcpy(slot, buf, first_bytes);
+        memcpy(ring->data, (char *)buf + first_bytes, rest_bytes);
+    } else {
+        memcpy(buf, slot, first_bytes);
+        memcpy((char *)buf + first_bytes, ring->data, rest_bytes);
+    }
+}
+
+/*  ring_push
+ *  DESCRIPTION: append as many elements as fit, producer side
+ *  INPUTS: struct ring *ring, const void *elems, uint32_t n
+ *  OUTPUTS: none
+ *  RETURN VALUE: number of elements pushed
+ */
+uint32_t ring_push(struct ring *ring, const void *elems, uint32_t n) {
+    uint32_t head = ring->head;
+    uint32_t space = ring->size - (head - ring->tail);
+    if (n > space)
+        n = space;
+    if (!n)
+        return 0;
+
+    // tail was read before the slots it freed are overwritten
+    smp_rmb();
+    ring_copy(ring, head, (void *)elems, n, true);
+    // slots are filled before they are published
+    smp_wmb();
+    ring->head = head + n;
+    return n;
+}
+
+/*  ring_pop
+ *  DESCRIPTION: remove up to n elements from the front, consumer side
+ *  INPUTS: struct ring *ring, uint32_t n
+ *  OUTPUTS: void *elems -- the elements removed
+ *  RETURN VALUE: number of elements popped
+ */
+uint32_t ring_pop(struct ring *ring, void *elems, uint32_t n) {
+    uint32_t tail = ring->tail;
+    uint32_t count = ring->head - tail;
+    if (n > count)
+        n = count;
+    if (!n)
+        return 0;
+
+    // head was read before the slots it published
+    smp_rmb();
+    ring_copy(ring, tail, elems, n, false);
+    // slots are read before they are handed back
+    smp_wmb();
+    ring->tail = tail + n;
+    return n;
+}
+
+/*  ring_unpush
+ *  DESCRIPTION: take back the most recently pushed element, producer side.
+ *               Only safe while the consumer is known not to pop it
+ *  INPUTS: struct ring *ring
+ *  OUTPUTS: none
+ *  RETURN VALUE: false if the ring was empty
+ */
+bool ring_unpush(struct ring *ring) {
+    if (ring_empty(ring))
+        return false;
+
+    ring->head--;
+    return true;
+}
+
+/*  ring_peek_back
+ *  DESCRIPTION: look at the most recently pushed element
+ *  INPUTS: struct ring *ring
+ *  OUTPUTS: none
+ *  RETURN VALUE: pointer to the element, or NULL if the ring is empty
+ */
+void *ring_peek_back(struct ring *ring) {
+    uint32_t head = ring->head;
+    if (head == ring->tail)
+        return NULL;
+
+    smp_rmb();
+    return ring_slot(ring, head - 1);
+}
+
+#include "../tests.h"
+#if RUN_TESTS
+/* ring buffer tests
+ *
+ * Asserts that batches wrap around the end of the buffer intact and that
+ * the ring never over or underflows
+ * Coverage: ring_push, ring_pop, ring_unpush, ring_peek_back
+ */
+__testfunc
+static void ring_test() {
+    uint16_t data[8];
+    uint16_t in[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    uint16_t out[8];
+    struct ring ring;
+
+    ring_init(&ring, data, 8, sizeof(*data));
+    TEST_ASSERT(ring_empty(&ring) && !ring_peek_back(&ring));
+    TEST_ASSERT(!ring_pop(&ring, out, 8));
+
+    TEST_ASSERT(ring_push(&ring, in, 5) == 5);
+    TEST_ASSERT(ring_pop(&ring, out, 3) == 3);
+    TEST_ASSERT(out[0] == 1 && out[2] == 3);
+
+    // wraps around, and only 6 slots are free
+    TEST_ASSERT(ring_push(&ring, in, 8) == 6);
+    TEST_ASSERT(ring_count(&ring) == 8 && !ring_space(&ring));
+    TEST_ASSERT(*(uint16_t *)ring_peek_back(&ring) == 6);
+
+    TEST_ASSERT(ring_unpush(&ring));
+    TEST_ASSERT(*(uint16_t *)ring_peek_back(&ring) == 5);
+
+    TEST_ASSERT(ring_pop(&ring, out, 8) == 7);
+    TEST_ASSERT(out[0] == 4 && out[1] == 5 && out[2] == 1 && out[6] == 5);
+    TEST_ASSERT(ring_empty(&ring) && !ring_unpush(&ring));
+}
+DEFINE_TEST(ring_test);
+#endif
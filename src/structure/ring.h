@@ -0,0 +1,56 @@
+#ifndef _RING_H
+#define _RING_H
+
+#include "../lib/stdint.h"
+#include "../lib/stdbool.h"
+#include "../atomic.h"
+
+/*
+ * A lock-free single-producer single-consumer ring of fixed-size elements,
+ * for handing data from an interrupt handler to a task without cli or
+ * allocation. head is only written by the producer and tail only by the
+ * consumer; both run freely and are masked on access, so the ring holds
+ * exactly size elements and count is always head - tail.
+ *
+ * The producer fills slots before publishing them with a store to head,
+ * and the consumer reads slots before handing them back with a store to
+ * tail, so neither side ever sees a slot the other is still using.
+ */
+struct ring {
+    volatile uint32_t head;     // next slot to push, producer only
+    volatile uint32_t tail;     // next slot to pop, consumer only
+    uint32_t size;              // in elements, a power of two
+    uint32_t esize;             // in bytes
+    void *data;
+};
+
+#define RING_INITIALIZER(_data, _size, _esize) { \
+    .size = (_size),                             \
+    .esize = (_esize),                           \
+    .data = (_data),                             \
+}
+
+// Statically define a ring backed by a static array of size elements
+#define DEFINE_RING(name, type, _size) \
+struct ring name = RING_INITIALIZER((type[_size]){}, _size, sizeof(type))
+
+void ring_init(struct ring *ring, void *data, uint32_t size, uint32_t esize);
+
+uint32_t ring_push(struct ring *ring, const void *elems, uint32_t n);
+uint32_t ring_pop(struct ring *ring, void *elems, uint32_t n);
+bool ring_unpush(struct ring *ring);
+void *ring_peek_back(struct ring *ring);
+
+static inline uint32_t ring_count(struct ring *ring) {
+    return ring->head - ring->tail;
+}
+
+static inline uint32_t ring_space(struct ring *ring) {
+    return ring->size - ring_count(ring);
+}
+
+static inline bool ring_empty(struct ring *ring) {
+    return ring->head == ring->tail;
+}
+
+#endif
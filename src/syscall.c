@@ -1,5 +1,12 @@
 #include "syscall.h"
 #include "task/sched.h"
+#include "task/ptrace.h"
+#include "mm/scratch.h"
+#include "mm/uaccess.h"
+#include "systrace.h"
+#include "lib/msr.h"
+#include "cpuid.h"
+#include "x86_desc.h"
 #include "printk.h"
 #include "errno.h"
 
@@ -7,13 +14,25 @@
 intr_handler_t *syscall_handlers[NUM_SUBSYSTEMS][MAX_SYSCALL];
 
 /*
- * syscall_handler
- *   DESCRIPTION: call system call handlers
+ * do_syscall
+ *   DESCRIPTION: call system call handlers, straight from the int $0x80 and
+ *                SYSENTER entries
  *   INPUTS: struct intr_info *info
  */
-static void syscall_handler(struct intr_info *info) {
+asmlinkage
+void do_syscall(struct intr_info *info) {
     intr_handler_t *handler = NULL;
+#if SYSTRACE
+    struct systrace_event event;
+    bool traced = systrace_enabled;
+
+    if (traced)
+        systrace_entry(&event, info);
+#endif
     // printk("%s[%d]: Syscall: %u %x %x %x %x\n", current->comm, current->pid, info->eax, info->ebx, info->ecx, info->edx, info->esi);
+    if (current->ptrace & PT_SYSCALL && info->cs == USER_CS)
+        ptrace_syscall_entry(info);
+
     // perform sanity check on the value of eax
     if (info->eax < MAX_SYSCALL) // load proper handler into handler
         handler = syscall_handlers[current->subsystem][info->eax];
@@ -27,17 +46,65 @@ static void syscall_handler(struct intr_info *info) {
         // printk("%s[%d]: Sysret: %x\n", current->comm, current->pid, info->eax);
     }
 
+    if (current->ptrace & PT_SYSCALL && info->cs == USER_CS)
+        ptrace_syscall_exit(info);
+
+#if SYSTRACE
+    if (traced)
+        systrace_exit(&event, info);
+#endif
+
+    // scratch buffers never outlive a syscall from userspace
+    if (info->cs == USER_CS)
+        scratch_reset();
+
     // Evil ece391 subsystem shim
     if (current->subsystem == SUBSYSTEM_ECE391 && (int32_t)info->eax < 0)
         info->eax = -1;
 }
 
+bool sysenter_enabled;
+
+/*
+ * do_sysenter
+ *   DESCRIPTION: handle a system call made with SYSENTER from the vDSO
+ *   INPUTS: struct intr_info *info -- the frame built by sysenter_entry,
+ *           where ebp holds the user stack pointer
+ */
+asmlinkage
+void do_sysenter(struct intr_info *info) {
+    // the vDSO pushed the real ebp, the sixth argument, on the user stack
+    if (get_user(info->ebp, (uint32_t *)info->esp)) {
+        info->eax = -EFAULT;
+        return;
+    }
+
+    do_syscall(info);
+}
+
 /*
- * init_syscall_handler
- *   DESCRIPTION: initiate system call handlers
+ * init_sysenter
+ *   DESCRIPTION: point the SYSENTER MSRs at sysenter_entry, if supported
  */
-static void init_syscall_handler() {
-    intr_setaction(INTR_SYSCALL, (struct intr_action){
-        .handler = &syscall_handler });
+static void init_sysenter() {
+    // only touched if an NMI hits before sysenter_entry switches stacks
+    static uint32_t sysenter_stack[16];
+    // function prototype don't matter here
+    extern void sysenter_entry(void);
+    uint32_t a, d;
+
+    cpuid(CPUID_GETFEATURES, &a, &d);
+    if (!(d & CPUID_FEAT_EDX_SEP))
+        return;
+    // early Pentium Pros report SEP without having it
+    if (((a >> 8) & 0xf) == 6 && ((a >> 4) & 0xf) < 3 && (a & 0xf) < 3)
+        return;
+
+    // SYSENTER derives every other selector from this one, which the GDT
+    // layout of KERNEL_CS, KERNEL_DS, USER_CS, USER_DS matches
+    wrmsr(MSR_IA32_SYSENTER_CS, KERNEL_CS);
+    wrmsr(MSR_IA32_SYSENTER_ESP, (uint32_t)&sysenter_stack[16]);
+    wrmsr(MSR_IA32_SYSENTER_EIP, (uint32_t)&sysenter_entry);
+    sysenter_enabled = true;
 }
-DEFINE_INITCALL(init_syscall_handler, drivers);
+DEFINE_INITCALL(init_sysenter, drivers);
@@ -382,6 +382,9 @@
 #define NR_LINUX_pkey_alloc 381
 #define NR_LINUX_pkey_free 382
 #define NR_LINUX_statx 383
+#define NR_LINUX_io_uring_setup 425
+#define NR_LINUX_io_uring_enter 426
+#define NR_LINUX_io_uring_register 427
 
 #define NR_ECE391_halt    1
 #define NR_ECE391_execute 2
@@ -394,7 +397,7 @@
 #define NR_ECE391_set_handler  9
 #define NR_ECE391_sigreturn  10
 
-#define MAX_SYSCALL 400
+#define MAX_SYSCALL 440
 
 #ifndef ASM
 
@@ -403,6 +406,11 @@
 
 extern intr_handler_t *syscall_handlers[NUM_SUBSYSTEMS][MAX_SYSCALL];
 
+asmlinkage void do_syscall(struct intr_info *info);
+
+// whether the CPU has SYSENTER and the entry has been set up
+extern bool sysenter_enabled;
+
 #define _EXPAND(val) val
 
 #define _DEFINE_SYSCALL(subsystem, name)                                                       \
@@ -0,0 +1,230 @@
+#include "systrace.h"
+#include "syscall.h"
+#include "interrupt.h"
+#include "task/task.h"
+#include "mm/kmalloc.h"
+#include "lib/cli.h"
+#include "lib/stdio.h"
+#include "lib/tsc.h"
+
+bool systrace_enabled;
+
+#if SYSTRACE
+struct syscall_hist {
+    uint32_t count;
+    uint32_t max_cycles;
+    uint64_t total_cycles;
+    uint32_t buckets[SYSTRACE_HIST_BUCKETS];
+};
+
+static struct systrace_event systrace_ring[SYSTRACE_RING_SIZE];
+static uint32_t systrace_head; // events recorded in total
+
+// allocated the first time a syscall is traced
+static struct syscall_hist *syscall_hists[NUM_SUBSYSTEMS][MAX_SYSCALL];
+
+static const char *subsystem_names[NUM_SUBSYSTEMS] = {
+    [SUBSYSTEM_LINUX]  = "linux",
+    [SUBSYSTEM_ECE391] = "ece391",
+};
+
+/*  hist_bucket
+ *  DESCRIPTION: find the histogram bucket of a latency
+ *  INPUTS: uint64_t cycles
+ *  OUTPUTS: none
+ *  RETURN VALUE: floor(log4(cycles)), at most SYSTRACE_HIST_BUCKETS - 1
+ */
+static uint32_t hist_bucket(uint64_t cycles) {
+    if (cycles >> 32)
+        return SYSTRACE_HIST_BUCKETS - 1;
+
+    uint32_t bucket = (31 - __builtin_clz((uint32_t)cycles | 1)) / 2;
+    return bucket < SYSTRACE_HIST_BUCKETS ? bucket : SYSTRACE_HIST_BUCKETS - 1;
+}
+
+/*  systrace_entry
+ *  DESCRIPTION: start recording a syscall, before its handler runs
+ *  INPUTS: struct systrace_event *event -- on the caller's stack
+ *          const struct intr_info *info -- the syscall frame
+ *  OUTPUTS: the arguments in event
+ *  RETURN VALUE: none
+ */
+void systrace_entry(struct systrace_event *event, const struct intr_info *info) {
+    *event = (struct systrace_event){
+        .pid       = current->pid,
+        .subsystem = current->subsystem,
+        .nr        = info->eax,
+        .args      = { info->ebx, info->ecx, info->edx, info->esi, info->edi, info->ebp },
+        .entry_tsc = rdtsc(),
+    };
+}
+
+/*  systrace_exit
+ *  DESCRIPTION: finish recording a syscall, after its handler returned, and
+ *               account its latency
+ *  INPUTS: struct systrace_event *event -- from systrace_entry
+ *          const struct intr_info *info -- the syscall frame
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void systrace_exit(struct systrace_event *event, const struct intr_info *info) {
+    unsigned long flags;
+
+    event->exit_tsc = rdtsc();
+    event->ret = info->eax;
+
+    uint64_t cycles = event->exit_tsc - event->entry_tsc;
+
+    cli_and_save(flags);
+
+    systrace_ring[systrace_head++ % SYSTRACE_RING_SIZE] = *event;
+
+    if (event->nr < MAX_SYSCALL) {
+        struct syscall_hist **histp = &syscall_hists[event->subsystem][event->nr];
+        if (!*histp)
+            *histp = kcalloc(1, sizeof(**histp));
+
+        struct syscall_hist *hist = *histp;
+        if (hist) {
+            hist->count++;
+            hist->total_cycles += cycles;
+            if (cycles > hist->max_cycles)
+                hist->max_cycles = cycles >> 32 ? 0xFFFFFFFF : cycles;
+            hist->buckets[hist_bucket(cycles)]++;
+        }
+    }
+
+    restore_flags(flags);
+}
+
+/*  systrace_clear
+ *  DESCRIPTION: drop all recorded events and histograms
+ *  INPUTS: none
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void systrace_clear(void) {
+    unsigned long flags;
+    uint32_t subsystem, nr;
+
+    cli_and_save(flags);
+
+    systrace_head = 0;
+    for (subsystem = 0; subsystem < NUM_SUBSYSTEMS; subsystem++) {
+        for (nr = 0; nr < MAX_SYSCALL; nr++) {
+            if (!syscall_hists[subsystem][nr])
+                continue;
+            kfree(syscall_hists[subsystem][nr]);
+            syscall_hists[subsystem][nr] = NULL;
+        }
+    }
+
+    restore_flags(flags);
+}
+
+/*  systrace_report
+ *  DESCRIPTION: write the most recent syscalls, oldest first
+ *  INPUTS: char *buf, uint32_t size
+ *  OUTPUTS: none
+ *  RETURN VALUE: number of characters written, not including the terminator
+ */
+uint32_t systrace_report(char *buf, uint32_t size) {
+    unsigned long flags;
+    uint32_t len = 0;
+
+    len += scnprintf(buf + len, size - len,
+        "PID   SYS    NR   RET        CYCLES     ENTRYTSC         ARGS\n");
+
+    cli_and_save(flags);
+
+    uint32_t i = systrace_head > SYSTRACE_RING_SIZE ? systrace_head - SYSTRACE_RING_SIZE : 0;
+    for (; i < systrace_head; i++) {
+        struct systrace_event *event = &systrace_ring[i % SYSTRACE_RING_SIZE];
+        uint64_t cycles = event->exit_tsc - event->entry_tsc;
+
+        len += scnprintf(buf + len, size - len,
+            "%-6u%-7s%-5u%-11d%-11u%08x%08x %x %x %x %x %x %x\n",
+            event->pid, subsystem_names[event->subsystem], event->nr, event->ret,
+            cycles >> 32 ? 0xFFFFFFFF : (uint32_t)cycles,
+            (uint32_t)(event->entry_tsc >> 32), (uint32_t)event->entry_tsc,
+            event->args[0], event->args[1], event->args[2],
+            event->args[3], event->args[4], event->args[5]);
+    }
+
+    restore_flags(flags);
+    return len;
+}
+
+/*  syscall_latency_report
+ *  DESCRIPTION: write the latency histogram of every syscall traced so far.
+ *               TOTALKCYC, the total latency in units of 1024 cycles, ranks
+ *               the syscalls by the time spent in them
+ *  INPUTS: char *buf, uint32_t size
+ *  OUTPUTS: none
+ *  RETURN VALUE: number of characters written, not including the terminator
+ */
+uint32_t syscall_latency_report(char *buf, uint32_t size) {
+    unsigned long flags;
+    uint32_t len = 0;
+    uint32_t subsystem, nr, i;
+
+    len += scnprintf(buf + len, size - len,
+        "SYS    NR   COUNT     AVGCYCLES MAXCYCLES TOTALKCYC BUCKETS (4^i cycles)\n");
+
+    cli_and_save(flags);
+
+    for (subsystem = 0; subsystem < NUM_SUBSYSTEMS; subsystem++) {
+        for (nr = 0; nr < MAX_SYSCALL; nr++) {
+            struct syscall_hist *hist = syscall_hists[subsystem][nr];
+            if (!hist)
+                continue;
+
+            // scale down to avoid a 64-bit division
+            uint64_t total = hist->total_cycles;
+            uint32_t n = hist->count;
+            while (total >> 32) {
+                total >>= 1;
+                n >>= 1;
+            }
+            uint32_t avg = n ? (uint32_t)total / n : 0;
+            uint64_t total_k = hist->total_cycles >> 10;
+
+            len += scnprintf(buf + len, size - len, "%-7s%-5u%-10u%-10u%-10u%-10u",
+                subsystem_names[subsystem], nr, hist->count, avg, hist->max_cycles,
+                total_k >> 32 ? 0xFFFFFFFF : (uint32_t)total_k);
+            for (i = 0; i < SYSTRACE_HIST_BUCKETS; i++)
+                len += scnprintf(buf + len, size - len, i ? " %u" : "%u", hist->buckets[i]);
+            len += scnprintf(buf + len, size - len, "\n");
+        }
+    }
+
+    restore_flags(flags);
+    return len;
+}
+#else
+void systrace_clear(void) {
+}
+
+uint32_t systrace_report(char *buf, uint32_t size) {
+    return scnprintf(buf, size, "syscall tracing disabled\n");
+}
+
+uint32_t syscall_latency_report(char *buf, uint32_t size) {
+    return scnprintf(buf, size, "syscall tracing disabled\n");
+}
+#endif
+
+#include "tests.h"
+#if RUN_TESTS && SYSTRACE
+__testfunc
+static void systrace_hist_bucket_test() {
+    TEST_ASSERT(hist_bucket(0) == 0);
+    TEST_ASSERT(hist_bucket(3) == 0);
+    TEST_ASSERT(hist_bucket(4) == 1);
+    TEST_ASSERT(hist_bucket(15) == 1);
+    TEST_ASSERT(hist_bucket(16) == 2);
+    TEST_ASSERT(hist_bucket(1U << 30) == SYSTRACE_HIST_BUCKETS - 1);
+    TEST_ASSERT(hist_bucket(1ULL << 40) == SYSTRACE_HIST_BUCKETS - 1);
+}
+DEFINE_TEST(systrace_hist_bucket_test);
+#endif
@@ -0,0 +1,48 @@
+#ifndef _SYSTRACE_H
+#define _SYSTRACE_H
+
+#include "lib/stdint.h"
+#include "lib/stdbool.h"
+
+// Set to 0 to compile out syscall tracing
+#define SYSTRACE 1
+
+/*
+ * While systrace_enabled is set, every syscall is recorded into a ring of
+ * the most recent SYSTRACE_RING_SIZE events, and its latency is added to a
+ * per-syscall histogram. Latencies are in TSC cycles, from entry into
+ * do_syscall until the handler returns, so time spent sleeping counts.
+ * Histogram bucket i counts latencies in [4^i, 4^(i+1)), with the last
+ * bucket taking everything above.
+ */
+#define SYSTRACE_RING_SIZE    256 // power of two
+#define SYSTRACE_HIST_BUCKETS 16
+
+struct systrace_event {
+    uint32_t pid;
+    uint32_t subsystem;
+    uint32_t nr;
+    uint32_t args[6];
+    int32_t ret;
+    uint64_t entry_tsc;
+    uint64_t exit_tsc;
+};
+
+struct intr_info;
+
+extern bool systrace_enabled;
+
+#if SYSTRACE
+void systrace_entry(struct systrace_event *event, const struct intr_info *info);
+void systrace_exit(struct systrace_event *event, const struct intr_info *info);
+#endif
+
+// Drop all recorded events and histograms
+void systrace_clear(void);
+
+// Write the recorded events, oldest first, into buf, return length written
+uint32_t systrace_report(char *buf, uint32_t size);
+// Write the per-syscall latency histograms into buf, return length written
+uint32_t syscall_latency_report(char *buf, uint32_t size);
+
+#endif
@@ -5,6 +5,7 @@
 #include "signal.h"
 #include "tls.h"
 #include "../mm/kmalloc.h"
+#include "../mm/uaccess.h"
 #include "../lib/string.h"
 #include "../eflags.h"
 #include "../panic.h"
@@ -14,37 +15,6 @@
 #include "../err.h"
 #include "../errno.h"
 
-/*
- *   _next_pid
- *   DESCRIPTION: loop over all pid numbers
- *   RETURN VALUE: next pid
- *   SIDE EFFECTS: change the return value of the next call
- */
-static uint16_t _next_pid() {
-    static uint16_t pid = 1;
-
-    // circularly get the next pid
-    uint16_t ret = pid++;
-    if (pid > MAXPID)
-        pid = LOOPPID;
-
-    return ret;
-}
-
-/*
- *   next_pid
- *   DESCRIPTION: get next available pid number
- *   RETURN VALUE: next available pid number
- *   SIDE EFFECTS: change the return value of _next_pid()
- */
-static uint16_t next_pid() {
-    uint16_t pid;
-    do {
-        pid = _next_pid();
-    } while (PTR_ERR(get_task_from_pid(pid)) != -ESRCH);
-    return pid;
-}
-
 /*
  *   clone_entry_handler
  *   DESCRIPTION: child entry point
@@ -56,11 +26,15 @@ static void clone_entry_handler(struct intr_info *info) {
     int *tidptr = (void *)info->edx;
     struct user_desc *newtls = (void *)info->esi;
 
-    if (flags & CLONE_PARENT_SETTID && tidptr)
-        *tidptr = current->pid;
+    // like Linux, a bad tidptr does not stop the child
+    if (flags & CLONE_CHILD_SETTID && tidptr)
+        put_user(current->pid, tidptr);
 
-    if (flags & CLONE_SETTLS && newtls)
-        do_set_thread_area(newtls);
+    if (flags & CLONE_SETTLS && newtls) {
+        struct user_desc desc;
+        if (!copy_from_user(&desc, newtls, sizeof(desc)))
+            do_set_thread_area(&desc);
+    }
 
     current->entry_regs = info;
 
@@ -93,30 +67,48 @@ DEFINE_INITCALL(init_clone_entry, early);
  *   SIDE EFFECTS: none
  */
 struct task_struct *do_clone(uint32_t flags, int (*fn)(void *args), void *args, int *ptid, int *ctid, struct user_desc *newtls) {
+    uint16_t pid = alloc_pid();
+    if (!pid)
+        return ERR_PTR(-EAGAIN);
+
     struct task_struct *task = alloc_pages(TASK_STACK_PAGES, TASK_STACK_PAGES_POW, 0);
-    if (!task)
+    if (!task) {
+        free_pid(pid);
         return ERR_PTR(-ENOMEM);
+    }
     // TODO: handle OOMs, if fail I think they should just be SIGSEGV-ed
 
-    // increase reference count
-    if (current->cwd)
-        atomic_inc(&current->cwd->refcount);
-    if (current->exe)
-        atomic_inc(&current->exe->refcount);
-    if (current->session)
-        atomic_inc(&current->session->refcount);
+    struct task_struct *parent = (flags & CLONE_PARENT && current->parent) ? current->parent : current;
 
     // set new pid, and copy the other task state
     *task = (struct task_struct){
-        .pid       = next_pid(),
-        .ppid      = (flags & CLONE_PARENT) ? current->ppid : current->pid,
+        .pid       = pid,
+        .ppid      = parent->pid,
+        .parent    = parent,
         .state     = TASK_RUNNING,
         .subsystem = current->subsystem,
         .cwd       = current->cwd,
         .exe       = current->exe,
         .session   = current->session,
-        .pgid      = current->pgid,
+        .clear_child_tid = flags & CLONE_CHILD_CLEARTID ? ctid : NULL,
     };
+    list_init(&task->children);
+
+    // a task outside its process group is missed by kill(0, ...) and pgrp walks
+    int32_t res = set_task_pgid(task, current->pgid);
+    if (res < 0) {
+        free_pages(task, TASK_STACK_PAGES, 0);
+        free_pid(pid);
+        return ERR_PTR(res);
+    }
+
+    // increase reference count
+    if (current->cwd)
+        atomic_inc(&current->cwd->refcount);
+    if (current->exe)
+        atomic_inc(&current->exe->refcount);
+    if (current->session)
+        atomic_inc(&current->session->refcount);
 
     strncpy(task->comm, current->comm, sizeof(task->comm));
 
@@ -145,24 +137,7 @@ struct task_struct *do_clone(uint32_t flags, int (*fn)(void *args), void *args,
             atomic_inc(&current->files->refcount);
             task->files = current->files;
         } else {
-            task->files = kmalloc(sizeof(*task->files));
-            *task->files = (struct files_struct){
-                .refcount = ATOMIC_INITIALIZER(1),
-            };
-            uint32_t i;
-            // loop over all files
-            array_for_each(&current->files->files, i) {
-                struct file *file = array_get(&current->files->files, i);
-                if (file) {
-                    array_set(&task->files->files, i, file);
-                    atomic_inc(&file->refcount);
-                }
-            }
-            array_for_each(&current->files->cloexec, i) {
-                void *val = array_get(&current->files->cloexec, i);
-                if (val)
-                    array_set(&task->files->cloexec, i, val);
-            }
+            task->files = files_dup(current->files);
         }
     }
 
@@ -185,8 +160,9 @@ struct task_struct *do_clone(uint32_t flags, int (*fn)(void *args), void *args,
             fxsave(task->fxsave_data);
     }
 
+    // like Linux, a bad ptid does not fail the clone
     if (flags & CLONE_PARENT_SETTID && ptid)
-        *ptid = task->pid;
+        put_user(task->pid, ptid);
 
     // The position of this struct intr_info controls where the stack is going
     // to end up, not any of the contents in the struct, bacause we are using
@@ -212,8 +188,12 @@ struct task_struct *do_clone(uint32_t flags, int (*fn)(void *args), void *args,
     // store registers for scheduler to switch to new task
     task->return_regs = regs;
 
-    // so we know this PID is used
     list_insert_back(&tasks, task);
+    list_insert_back(&parent->children, task);
+    hash_task(task);
+
+    if (task_is_ece391_user(task))
+        nr_ece391_tasks++;
 
     return task;
 }
@@ -235,13 +215,6 @@ DEFINE_SYSCALL_COMPLEX(LINUX, clone, regs) {
     struct user_desc *newtls = (void *)regs->esi;
     int *ctid = (void *)regs->edi;
 
-    if (ptid && safe_buf(ptid, sizeof(*ptid), true) != sizeof(*ptid))
-        ptid = NULL;
-    if (ctid && safe_buf(ctid, sizeof(*ctid), true) != sizeof(*ctid))
-        ctid = NULL;
-    if (newtls && safe_buf(newtls, sizeof(*newtls), false) != sizeof(*newtls))
-        newtls = NULL;
-
     struct intr_info *newregs = kmalloc(sizeof(*newregs));
     if (!newregs) {
         regs->eax = -ENOMEM;
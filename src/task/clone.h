@@ -20,7 +20,7 @@ struct user_desc;
 // #define CLONE_SYSVSEM        0x00040000 /* share system V SEM_UNDO semantics */
 #define CLONE_SETTLS         0x00080000 /* create a new TLS for the child */
 #define CLONE_PARENT_SETTID  0x00100000 /* set the TID in the parent */
-// #define CLONE_CHILD_CLEARTID 0x00200000 /* clear the TID in the child */ // TODO
+#define CLONE_CHILD_CLEARTID 0x00200000 /* clear the TID in the child */
 // #define CLONE_DETACHED       0x00400000 /* Unused, ignored */
 // #define CLONE_UNTRACED       0x00800000 /* set if the tracing process can't force CLONE_PTRACE on this clone */
 #define CLONE_CHILD_SETTID   0x01000000 /* set the TID in the child */
@@ -7,6 +7,7 @@
 #include "session.h"
 #include "../lib/string.h"
 #include "../mm/kmalloc.h"
+#include "../mm/uaccess.h"
 #include "../vfs/file.h"
 #include "../syscall.h"
 #include "../ioctls.h"
@@ -53,17 +54,11 @@ static int ece391execute_child(void *args) {
 }
 
 DEFINE_SYSCALL1(ECE391, execute, char *, command) {
-    // acquire the length of the command
-    uint32_t length = safe_arr_null_term(command, sizeof(char), false);
-    // sanity check
-    if (!length)
-        return -EFAULT;
-
     // copy command to comand_kern
-    char *command_kern = strndup(command, length);
+    char *command_kern = strndup_user(command, PAGE_SIZE_SMALL);
     // sanity check
-    if (!command_kern)
-        return -ENOMEM;
+    if (IS_ERR(command_kern))
+        return PTR_ERR(command_kern);
 
     // create child task struct
     struct task_struct *child = kernel_thread(&ece391execute_child, command_kern);
@@ -89,19 +84,19 @@ DEFINE_SYSCALL1(ECE391, execute, char *, command) {
 }
 
 DEFINE_SYSCALL2(ECE391, getargs, char *, buf, int32_t, nbytes) {
-    // acquire the length of arguments
-    uint32_t length = safe_arr_null_term((char *)ECE391_ARGSADDR, sizeof(char), false);
     // copy arguments to args_kern
-    char *args_kern = strndup((char *)ECE391_ARGSADDR, length);
+    char *args_kern = strndup_user((char *)ECE391_ARGSADDR, PAGE_SIZE_SMALL);
     // sanity check
-    if (!args_kern)
-        return -ENOMEM;
+    if (IS_ERR(args_kern))
+        return PTR_ERR(args_kern);
 
     // aquire length of buffer
     uint32_t safe_nbytes = safe_buf(buf, nbytes, true);
     // sanity check
-    if (!safe_nbytes && nbytes)
+    if (!safe_nbytes && nbytes) {
+        kfree(args_kern);
         return -EFAULT;
+    }
 
     // copy args_kern to buf
     strncpy(buf, args_kern, safe_nbytes);
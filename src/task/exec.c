@@ -3,11 +3,14 @@
 #include "userstack.h"
 #include "signal.h"
 #include "fp.h"
+#include "futex.h"
+#include "vdso.h"
 #include "../char/tty.h"
 #include "../char/random.h"
 #include "../lib/string.h"
 #include "../mm/paging.h"
 #include "../mm/kmalloc.h"
+#include "../mm/uaccess.h"
 #include "../vfs/file.h"
 #include "../vfs/device.h"
 #include "../vfs/path.h"
@@ -18,6 +21,8 @@
 #include "../err.h"
 #include "../errno.h"
 
+#define MAX_ARG_STRLEN (PAGE_SIZE_SMALL * 32)
+
 static char elf_magic[4] = {0x7f, 0x45, 0x4c, 0x46};
 
 struct elf_header {
@@ -177,14 +182,7 @@ int32_t do_execve(char *filename, char *argv[], char *envp[]) {
     // ECE391 subsystem cannot have more than 6 userspace processes
     // Grading criteria. Nothing can be said...
     if (subsystem == SUBSYSTEM_ECE391) {
-        uint32_t ece391_cnt = 0;
-
-        struct list_node *node;
-        list_for_each(&tasks, node) {
-            struct task_struct *task = node->value;
-            if (task->mm && task->subsystem == SUBSYSTEM_ECE391 && task != current)
-                ece391_cnt++;
-        }
+        uint32_t ece391_cnt = nr_ece391_tasks - task_is_ece391_user(current);
 
         if (ece391_cnt >= 6) {
             ret = -EAGAIN;
@@ -221,38 +219,31 @@ int32_t do_execve(char *filename, char *argv[], char *envp[]) {
 
     // check if the current thread have a file descriptor table
     if (current->files) {
-        // so it's inherited
-        uint32_t i;
-        array_for_each(&current->files->files, i) {
-            struct file *file = array_get(&current->files->files, i);
-            if (file && array_get(&current->files->cloexec, i)) {
-                // close the file if necessary
-                filp_close(file);
-                array_set(&current->files->files, i, NULL);
-                array_set(&current->files->cloexec, i, NULL);
-            }
-        }
+        // so it's inherited, except for close-on-exec files
+        fd_close_on_exec(current->files);
     } else {
         // if not, give it a default set of file descriptors
-        current->files = kmalloc(sizeof(*current->files));
-        *current->files = (struct files_struct){
-            .refcount = ATOMIC_INITIALIZER(1),
-        };
+        current->files = files_alloc();
         switch (subsystem) {
         case SUBSYSTEM_LINUX:;
             struct file *tty = filp_open_anondevice(TTY_CURRENT, O_RDWR, S_IFCHR | 0666);
-            array_set(&current->files->files, 0, tty);
-            array_set(&current->files->files, 1, tty);
-            array_set(&current->files->files, 2, tty);
+            fd_install(current->files, 0, tty, false);
+            fd_install(current->files, 1, tty, false);
+            fd_install(current->files, 2, tty, false);
             atomic_add(&tty->refcount, 2);
             break;
         case SUBSYSTEM_ECE391:
-            array_set(&current->files->files, 0, filp_open_anondevice(TTY_CURRENT, 0, S_IFCHR | 0666));
-            array_set(&current->files->files, 1, filp_open_anondevice(TTY_CURRENT, O_WRONLY, S_IFCHR | 0666));
+            fd_install(current->files, 0, filp_open_anondevice(TTY_CURRENT, 0, S_IFCHR | 0666), false);
+            fd_install(current->files, 1, filp_open_anondevice(TTY_CURRENT, O_WRONLY, S_IFCHR | 0666), false);
             break;
         }
     }
 
+    if (task_is_ece391_user(current))
+        nr_ece391_tasks--;
+
+    futex_release_child_tid();
+
     // new page directory
     page_directory_t *new_pagedir = new_directory();
     if (current->mm) {
@@ -287,6 +278,8 @@ int32_t do_execve(char *filename, char *argv[], char *envp[]) {
     };
 
     current->subsystem = subsystem;
+    if (task_is_ece391_user(current))
+        nr_ece391_tasks++;
 
     set_current_comm(list_peek_back(&exe->path->components));
 
@@ -320,7 +313,9 @@ int32_t do_execve(char *filename, char *argv[], char *envp[]) {
 
                 uint32_t mapaddr = PAGE_IDX_ADDR(PAGE_IDX(segment.virt_addr));
                 uint32_t numpages = PAGE_IDX(segment.mem_size + segment.virt_addr - mapaddr - 1) + 1;
-                if (!request_pages((void *)mapaddr, numpages, GFP_USER | ((segment.flags & 2) ? 0 : GFP_RO)))
+                // Map writable for now, the kernel can't write to read-only
+                // userspace pages
+                if (!request_pages((void *)mapaddr, numpages, GFP_USER))
                     goto force_sigsegv;
 
                 res = filp_seek(exe, segment.file_offset, SEEK_SET);
@@ -331,6 +326,9 @@ int32_t do_execve(char *filename, char *argv[], char *envp[]) {
                 if (res != segment.file_size)
                     goto force_sigsegv;
 
+                if (!(segment.flags & 2))
+                    protect_pages((void *)mapaddr, numpages, GFP_USER);
+
                 if (segment.flags & 2)
                     if (!current->mm->brk || segment.file_size != segment.mem_size)
                         current->mm->brk = segment.virt_addr + segment.mem_size;
@@ -359,11 +357,8 @@ int32_t do_execve(char *filename, char *argv[], char *envp[]) {
         // Now setup the stack
 
         // Map VDSO
-        // uint32_t vdso_addr = 2U << 30;
-        // extern unsigned char vdso_start, vdso_end, vsyscall;
-        // if (!request_pages((void *)vdso_addr, 1, GFP_USER | GFP_RO))
-        //     goto force_sigsegv;
-        // memcpy((void *)vdso_addr, &vdso_start, &vdso_end - &vdso_start);
+        if (map_vdso() < 0)
+            goto force_sigsegv;
 
         uint32_t envp_len = 0;
         if (envp)
@@ -420,10 +415,10 @@ int32_t do_execve(char *filename, char *argv[], char *envp[]) {
             &(struct auxv){ .type = AT_PAGESZ, .val = PAGE_SIZE_SMALL }, sizeof(struct auxv));
         push_userstack(current->entry_regs,
             &(struct auxv){ .type = AT_HWCAP, .val = hwcap() }, sizeof(struct auxv));
-        // push_userstack(current->entry_regs,
-        //     &(struct auxv){ .type = AT_SYSINFO, .val = vdso_addr + (&vsyscall - &vdso_start) }, sizeof(struct auxv));
-        // push_userstack(current->entry_regs,
-        //     &(struct auxv){ .type = AT_SYSINFO_EHDR, .val = vdso_addr }, sizeof(struct auxv));
+        push_userstack(current->entry_regs,
+            &(struct auxv){ .type = AT_SYSINFO, .val = vdso_vsyscall() }, sizeof(struct auxv));
+        push_userstack(current->entry_regs,
+            &(struct auxv){ .type = AT_SYSINFO_EHDR, .val = VDSO_ADDR }, sizeof(struct auxv));
 
         push_userstack(current->entry_regs, envp_user, (envp_len + 1) * sizeof(*envp_user));
         push_userstack(current->entry_regs, argv_user, (argv_len + 1) * sizeof(*argv_user));
@@ -464,48 +459,108 @@ force_sigsegv:
     return 0;
 }
 
+/*
+ *   exec_strdup_user
+ *   DESCRIPTION: copy a string for execve, refusing to cut it short, which
+ *                would run something other than what the caller asked for
+ *   INPUTS: const char *s -- in userspace
+ *           uint32_t n -- the most bytes, including the terminator
+ *           int32_t toolong -- the error for a longer string
+ *   RETURN VALUE: the string, or ERR_PTR
+ */
+static char *exec_strdup_user(const char *s, uint32_t n, int32_t toolong) {
+    if (strnlen_user(s, n) > n)
+        return ERR_PTR(toolong);
+    return strndup_user(s, n);
+}
+
 DEFINE_SYSCALL_COMPLEX(LINUX, execve, regs) {
     char *filename = (void *)regs->ebx;
     char **argv = (void *)regs->ecx;
     char **envp = (void *)regs->edx;
 
-    uint32_t filename_len, argv_len, envp_len;
+    uint32_t argv_len, envp_len;
 
     regs->eax = -EFAULT;
-    if (!filename || !(filename_len = safe_arr_null_term(filename, sizeof(*filename), false)))
+    if (!filename)
         return;
-    if (!argv || !(argv_len = safe_arr_null_term(argv, sizeof(*argv), false)))
+    if (!argv || !(argv_len = safe_arr_null_term(argv, sizeof(*argv))))
         return;
-    if (!envp || !(envp_len = safe_arr_null_term(envp, sizeof(*envp), false)))
+    if (!envp)
         return;
+    envp_len = safe_arr_null_term(envp, sizeof(*envp));
 
-    char *filename_k = strndup(filename, filename_len);
+    char *filename_k = exec_strdup_user(filename, MAX_PATH, -ENAMETOOLONG);
+    if (IS_ERR(filename_k)) {
+        regs->eax = PTR_ERR(filename_k);
+        return;
+    }
 
     char **argv_k = NULL;
     char **envp_k = NULL;
 
     uint32_t i;
+    int32_t res = 0;
     argv_k = kcalloc(argv_len + 1, sizeof(*argv));
-    for (i = 0; i < argv_len; i++)
-        argv_k[i] = strndup(argv[i], safe_arr_null_term(argv[i], 1, false));
-
     envp_k = kcalloc(envp_len + 1, sizeof(*envp));
-    for (i = 0; i < envp_len; i++)
-        envp_k[i] = strndup(envp[i], safe_arr_null_term(envp[i], 1, false));
+    if (!argv_k || !envp_k) {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    for (i = 0; i < argv_len; i++) {
+        char *arg;
+        if (get_user(arg, &argv[i])) {
+            res = -EFAULT;
+            goto out;
+        }
+        argv_k[i] = exec_strdup_user(arg, MAX_ARG_STRLEN, -E2BIG);
+        if (IS_ERR(argv_k[i])) {
+            res = PTR_ERR(argv_k[i]);
+            argv_k[i] = NULL;
+            goto out;
+        }
+    }
+
+    for (i = 0; i < envp_len; i++) {
+        char *env;
+        if (get_user(env, &envp[i])) {
+            res = -EFAULT;
+            goto out;
+        }
+        envp_k[i] = exec_strdup_user(env, MAX_ARG_STRLEN, -E2BIG);
+        if (IS_ERR(envp_k[i])) {
+            res = PTR_ERR(envp_k[i]);
+            envp_k[i] = NULL;
+            goto out;
+        }
+    }
 
     current->entry_regs = regs;
 
-    int32_t res = do_execve(filename_k, argv_k, envp_k);
+    res = do_execve(filename_k, argv_k, envp_k);
+
+    // a traced task stops before running the new image
+    if (res >= 0 && current->tracer)
+        send_sig(current, SIGTRAP);
+
+out:
     if (res < 0)
         regs->eax = res;
 
     kfree(filename_k);
 
-    for (i = 0; i < argv_len; i++)
-        kfree(argv_k[i]);
-    kfree(argv_k);
+    if (argv_k) {
+        for (i = 0; i < argv_len; i++)
+            if (argv_k[i])
+                kfree(argv_k[i]);
+        kfree(argv_k);
+    }
 
-    for (i = 0; i < envp_len; i++)
-        kfree(envp_k[i]);
-    kfree(envp_k);
+    if (envp_k) {
+        for (i = 0; i < envp_len; i++)
+            if (envp_k[i])
+                kfree(envp_k[i]);
+        kfree(envp_k);
+    }
 }
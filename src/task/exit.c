@@ -1,12 +1,15 @@
 #include "exit.h"
+#include "futex.h"
 #include "sched.h"
 #include "session.h"
 #include "signal.h"
+#include "ptrace.h"
 #include "../char/tty.h"
 #include "../syscall.h"
 #include "../panic.h"
 #include "../mm/paging.h"
 #include "../mm/kmalloc.h"
+#include "../mm/uaccess.h"
 #include "../syscall.h"
 #include "../err.h"
 #include "../errno.h"
@@ -18,8 +21,12 @@ static int _do_wait(struct task_struct *task) {
     // set task state to TASK_DEAD
     task->state = TASK_DEAD;
 
-    // remove task from task list_node
+    // remove task from task list_node, and release its pid
     list_remove(&tasks, task);
+    list_remove(&task->parent->children, task);
+    set_task_pgid(task, 0);
+    unhash_task(task);
+    free_pid(task->pid);
     // insert task to free_tasks list
     list_insert_back(&free_tasks, task);
 
@@ -27,10 +34,40 @@ static int _do_wait(struct task_struct *task) {
     return task->exitcode;
 }
 
+/*
+ *   notify_parent
+ *   DESCRIPTION: send SIGCHLD for a zombie to its parent, or reap it right
+ *                away if the parent ignores SIGCHLD
+ *   INPUTS: struct task_struct *task
+ */
+static void notify_parent(struct task_struct *task) {
+    struct task_struct *parent = task->parent;
+
+    if (parent->sigactions->sigactions[SIGCHLD].sigaction == SIG_IGN) {
+        _do_wait(task);
+    } else {
+        struct siginfo siginfo = {
+            .signo = SIGCHLD,
+            .code = CLD_EXITED,
+            .sifields.sigchld = {
+                .pid = task->pid,
+                .status = task->exitcode,
+            },
+        };
+        send_sig_info(parent, &siginfo);
+    }
+}
+
 noreturn
 void do_exit(int exitcode) {
-    // place exitcode into current
+    // wake anyone joining us while the mm is still ours to write
+    futex_release_child_tid();
+
+    // place exitcode into current, where a tracer may read it
     current->exitcode = exitcode;
+
+    ptrace_exit();
+
     // set the state of the current process to TASK_ZOMBIE
     current->state = TASK_ZOMBIE;
 
@@ -49,19 +86,11 @@ void do_exit(int exitcode) {
         put_session();
 
     // close opened files and free them
-    if (current->files) {
-        if (!atomic_dec(&current->files->refcount)) {
-            uint32_t i;
-            array_for_each(&current->files->files, i) {
-                struct file *file = array_get(&current->files->files, i);
-                if (file)
-                    filp_close(file);
-            }
-            array_destroy(&current->files->files);
-            array_destroy(&current->files->cloexec);
-            kfree(current->files);
-        }
-    }
+    if (current->files)
+        files_put(current->files);
+
+    if (task_is_ece391_user(current))
+        nr_ece391_tasks--;
 
     // free memory management information
     if (current->mm) {
@@ -78,41 +107,27 @@ void do_exit(int exitcode) {
     if (current->fxsave_data)
         kfree(current->fxsave_data);
 
-    uint32_t i;
-    array_for_each(&current->sigpending.siginfos, i) {
-        struct siginfo *siginfo = array_get(&current->sigpending.siginfos, i);
-        if (siginfo)
-            kfree(siginfo);
-    }
-    array_destroy(&current->sigpending.siginfos);
+    flush_signals(current);
 
     // if parent process id is 0, this is a child reaper
     if (!current->ppid)
         panic("Killing process tree! exitcode=%d\n", exitcode);
 
-    // Signal parent so it can mourn us
-    struct task_struct *parent = get_task_from_pid(current->ppid);
-    if (parent->sigactions->sigactions[SIGCHLD].sigaction == SIG_IGN) {
-        _do_wait(current);
-    } else {
-        struct siginfo siginfo = {
-            .signo = SIGCHLD,
-            .code = CLD_EXITED,
-            .sifields.sigchld = {
-                .pid = current->pid,
-                .status = exitcode,
-            },
-        };
-        send_sig_info(parent, &siginfo);
+    // Reparent children to init. Do this before we may get reaped.
+    struct task_struct *init = get_task_from_pid(1);
+    while (!list_isempty(&current->children)) {
+        struct task_struct *task = list_pop_front(&current->children);
+        task->ppid = 1;
+        task->parent = init;
+        list_insert_back(&init->children, task);
+
+        // the SIGCHLD it sent went to us, so init would never hear of it
+        if (task->state == TASK_ZOMBIE)
+            notify_parent(task);
     }
 
-    // Reparent children to init
-    struct list_node *node;
-    list_for_each(&tasks, node) {
-        struct task_struct *task = node->value;
-        if (task->ppid == current->pid)
-            task->ppid = 1;
-    }
+    // Signal parent so it can mourn us
+    notify_parent(current);
 
     schedule();
 
@@ -133,16 +148,10 @@ DEFINE_SYSCALL0(LINUX, exit_group) {
     return -ENOSYS;
 }
 
-// Reap a child process, return its exitcode
+// Reap a child process, return its exitcode, or the wait status of a
+// tracee's stop or exit
 int32_t do_wait(struct task_struct *task) {
-    // check whether the parent
-    if (task->ppid != current->pid)
-        return -ECHILD;
-
-    // if state is TASK_ZOMBIE, call _do_wait
-    if (task->state == TASK_ZOMBIE)
-        return _do_wait(task);
-
+    uint16_t pid = task->pid;
     int32_t ret;
 
     struct sigaction oldaction = current->sigactions->sigactions[SIGCHLD];
@@ -153,22 +162,38 @@ int32_t do_wait(struct task_struct *task) {
 
     // wait for the child process to end
     while (true) {
+        // A tracee that is not our child may be reaped by its parent, and
+        // freed, while we sleep, so look it up again every time
+        task = get_task_from_pid(pid);
+        if (IS_ERR(task) ||
+                (task->ppid != current->pid && task->tracer != current)) {
+            ret = -ECHILD;
+            break;
+        }
+
+        if (ptrace_stop_pending(task)) {
+            ret = ptrace_take_stopcode(task);
+            break;
+        }
+        if (task->state == TASK_ZOMBIE && task->ppid == current->pid) {
+            ret = _do_wait(task);
+            break;
+        }
+
         current->state = TASK_INTERRUPTIBLE;
         schedule();
         current->state = TASK_RUNNING;
 
         if (signal_pending(current)) {
             struct siginfo siginfo;
-            // return exitcode when SIGCHILD is received
-            if (kernel_peek_pending_sig(SIGCHLD, &siginfo)) {
-                if (siginfo.code == CLD_EXITED && siginfo.sifields.sigchld.pid == task->pid) {
-                    kernel_get_pending_sig(SIGCHLD, &siginfo);
-                    current->sigactions->sigactions[SIGCHLD] = oldaction;
-                    return _do_wait(task);
-                }
+            // a SIGCHLD of the child is ours, and it is now a zombie
+            if (kernel_peek_pending_sig(SIGCHLD, &siginfo) &&
+                    siginfo.code == CLD_EXITED && siginfo.sifields.sigchld.pid == pid) {
+                kernel_get_pending_sig(SIGCHLD, &siginfo);
+                continue;
             }
-            current->sigactions->sigactions[SIGCHLD] = oldaction;
-            return -EINTR;
+            ret = -EINTR;
+            break;
         }
     }
 
@@ -177,13 +202,16 @@ int32_t do_wait(struct task_struct *task) {
     return ret;
 }
 
-int32_t do_waitpg(uint32_t pgid, uint16_t *pid, bool wait) {
-    bool haschild = false;
+// Reap a zombie child or report a tracee's stop or exit, in the process
+// group pgid, or any if 0. Return -EAGAIN if there is none yet
+static int32_t try_waitpg(uint32_t pgid, uint16_t *pid) {
+    bool haschild = ptrace_has_tracees(pgid);
+    struct task_struct *tracee;
 
     struct list_node *node;
-    list_for_each(&tasks, node) {
+    list_for_each(&current->children, node) {
         struct task_struct *task = node->value;
-        if (task->ppid == current->pid && (!pgid || task->pgid == pgid)) {
+        if (!pgid || task->pgid == pgid) {
             haschild = true;
             if (task->state == TASK_ZOMBIE) {
                 *pid = task->pid;
@@ -195,44 +223,63 @@ int32_t do_waitpg(uint32_t pgid, uint16_t *pid, bool wait) {
     if (!haschild)
         return -ECHILD;
 
-    if (!wait) {
-        *pid = 0;
-        return 0;
+    tracee = ptrace_find_stopped(pgid);
+    if (tracee) {
+        *pid = tracee->pid;
+        return ptrace_take_stopcode(tracee);
     }
 
+    return -EAGAIN;
+}
+
+int32_t do_waitpg(uint32_t pgid, uint16_t *pid, bool wait) {
+    int32_t ret;
+
     struct sigaction oldaction = current->sigactions->sigactions[SIGCHLD];
 
     current->sigactions->sigactions[SIGCHLD] = (struct sigaction){
         .sigaction = SIG_DFL,
     };
 
-    while (true) {
+    // children and tracees come and go while we sleep, so check them all
+    // again on every wakeup
+    while ((ret = try_waitpg(pgid, pid)) == -EAGAIN) {
+        if (!wait) {
+            *pid = 0;
+            ret = 0;
+            break;
+        }
+
         current->state = TASK_INTERRUPTIBLE;
         schedule();
         current->state = TASK_RUNNING;
 
         if (signal_pending(current)) {
             struct siginfo siginfo;
-            if (kernel_peek_pending_sig(SIGCHLD, &siginfo)) {
-                if (siginfo.code == CLD_EXITED) {
-                    struct task_struct *task = get_task_from_pid(siginfo.sifields.sigchld.pid);
-                    if (!pgid || task->pgid == pgid) {
-                        kernel_get_pending_sig(SIGCHLD, &siginfo);
-                        current->sigactions->sigactions[SIGCHLD] = oldaction;
-                        *pid = task->pid;
-                        return _do_wait(task);
-                    }
+            // a SIGCHLD of a child we wait for is ours, and try_waitpg
+            // reaps it
+            if (kernel_peek_pending_sig(SIGCHLD, &siginfo) && siginfo.code == CLD_EXITED) {
+                struct task_struct *task = get_task_from_pid(siginfo.sifields.sigchld.pid);
+                if (!IS_ERR(task) && task->ppid == current->pid &&
+                        (!pgid || task->pgid == pgid)) {
+                    kernel_get_pending_sig(SIGCHLD, &siginfo);
+                    continue;
                 }
             }
-            current->sigactions->sigactions[SIGCHLD] = oldaction;
-            return -EINTR;
+            ret = -EINTR;
+            break;
         }
     }
+
+    current->sigactions->sigactions[SIGCHLD] = oldaction;
+
+    return ret;
 }
 
 void do_free_tasks() {
     while (!list_isempty(&free_tasks)) {
         struct task_struct *task = list_pop_front(&free_tasks);
+        scratch_release(task);
         free_pages(task, TASK_STACK_PAGES, 0);
     }
 }
@@ -260,7 +307,8 @@ int32_t do_sys_waitpid(int32_t pid, int *wstatus, int options) {
         if (IS_ERR(task))
             return PTR_ERR(task);
 
-        if (task->state != TASK_ZOMBIE && (options & WNOHANG))
+        if (task->state != TASK_ZOMBIE && (options & WNOHANG) &&
+                !ptrace_stop_pending(task))
             return 0;
         exitcode = do_wait(task);
     }
@@ -268,8 +316,8 @@ int32_t do_sys_waitpid(int32_t pid, int *wstatus, int options) {
     if (exitcode < 0)
         return exitcode;
 
-    if (safe_buf(wstatus, sizeof(*wstatus), true) == sizeof(*wstatus))
-        *wstatus = exitcode;
+    if (wstatus && put_user(exitcode, wstatus))
+        return -EFAULT;
 
     return pid;
 }
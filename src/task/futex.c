@@ -0,0 +1,390 @@
+#include "futex.h"
+#include "task.h"
+#include "sched.h"
+#include "signal.h"
+#include "../time/time.h"
+#include "../time/clock.h"
+#include "../time/sleep.h"
+#include "../time/uptime.h"
+#include "../mm/uaccess.h"
+#include "../lib/cli.h"
+#include "../syscall.h"
+#include "../err.h"
+#include "../errno.h"
+
+#define FUTEX_HASH_BITS 6
+#define FUTEX_HASH_SIZE (1 << FUTEX_HASH_BITS)
+
+/*
+ * A task blocked in FUTEX_WAIT. It lives on the waiter's stack and is linked
+ * into the bucket of its key, (mm, uaddr), in FIFO order. Wakers unlink it and
+ * set woken, so the waiter never has to look itself up again unless it gives
+ * up on its own. Buckets are only touched with interrupts off.
+ */
+struct futex_q {
+    struct futex_q *next;
+    struct task_struct *task;
+    struct mm_struct *mm;
+    uint32_t *uaddr;
+    uint32_t bitset;
+    bool woken;
+};
+
+static struct futex_q *futex_queues[FUTEX_HASH_SIZE];
+
+static inline struct futex_q **futex_bucket(struct mm_struct *mm, uint32_t *uaddr) {
+    uint32_t key = (uint32_t)mm ^ (uint32_t)uaddr;
+    return &futex_queues[(key * 0x9E3779B9) >> (32 - FUTEX_HASH_BITS)];
+}
+
+static inline bool futex_match(struct futex_q *q, struct mm_struct *mm, uint32_t *uaddr) {
+    return q->mm == mm && q->uaddr == uaddr;
+}
+
+// append a waiter to the bucket of its key, called with interrupts off
+static void futex_queue(struct futex_q *q) {
+    struct futex_q **pp = futex_bucket(q->mm, q->uaddr);
+    while (*pp)
+        pp = &(*pp)->next;
+    q->next = NULL;
+    *pp = q;
+}
+
+// unlink a waiter from the bucket of its key, called with interrupts off
+static void futex_unqueue(struct futex_q *q) {
+    struct futex_q **pp = futex_bucket(q->mm, q->uaddr);
+    for (; *pp; pp = &(*pp)->next) {
+        if (*pp == q) {
+            *pp = q->next;
+            return;
+        }
+    }
+}
+
+/*  futex_wake_locked
+ *  DESCRIPTION: wake waiters on a key, called with interrupts off
+ *  INPUTS: struct mm_struct *mm, uint32_t *uaddr, uint32_t nr_wake,
+ *          uint32_t bitset -- only wake waiters whose bitset intersects
+ *  OUTPUTS: none
+ *  RETURN VALUE: number of tasks woken
+ */
+static uint32_t futex_wake_locked(struct mm_struct *mm, uint32_t *uaddr, uint32_t nr_wake, uint32_t bitset) {
+    struct futex_q **pp = futex_bucket(mm, uaddr);
+    uint32_t woken = 0;
+
+    while (*pp && woken < nr_wake) {
+        struct futex_q *q = *pp;
+        if (!futex_match(q, mm, uaddr) || !(q->bitset & bitset)) {
+            pp = &q->next;
+            continue;
+        }
+
+        *pp = q->next;
+        q->woken = true;
+        wake_up_process(q->task);
+        woken++;
+    }
+    return woken;
+}
+
+/*  futex_wake
+ *  DESCRIPTION: wake tasks waiting on a futex of the current address space
+ *  INPUTS: uint32_t *uaddr, uint32_t nr_wake, uint32_t bitset
+ *  OUTPUTS: none
+ *  RETURN VALUE: number of tasks woken
+ */
+int32_t futex_wake(uint32_t *uaddr, uint32_t nr_wake, uint32_t bitset) {
+    unsigned long flags;
+    cli_and_save(flags);
+
+    int32_t ret = futex_wake_locked(current->mm, uaddr, nr_wake, bitset);
+
+    restore_flags(flags);
+    return ret;
+}
+
+/*  futex_wait
+ *  DESCRIPTION: sleep on a futex as long as it holds an expected value
+ *  INPUTS: uint32_t *uaddr, uint32_t val -- the expected value,
+ *          const struct timespec *reltime -- relative timeout, or NULL,
+ *          uint32_t bitset
+ *  OUTPUTS: none
+ *  RETURN VALUE: 0 if woken, -EAGAIN if *uaddr != val, -ETIMEDOUT, -EINTR,
+ *                or other negative errno
+ */
+static int32_t futex_wait(uint32_t *uaddr, uint32_t val, const struct timespec *reltime, uint32_t bitset) {
+    struct futex_q q = {
+        .task   = current,
+        .mm     = current->mm,
+        .uaddr  = uaddr,
+        .bitset = bitset,
+    };
+    struct sleep_spec *spec = NULL;
+    unsigned long flags;
+    uint32_t cur;
+    int32_t ret;
+
+    if (reltime) {
+        spec = sleep_add(reltime);
+        if (IS_ERR(spec))
+            return PTR_ERR(spec);
+    }
+
+    // The value check and the queueing must not be split by a waker, or a
+    // FUTEX_WAKE that follows a store to *uaddr could be lost
+    cli_and_save(flags);
+
+    ret = get_user(cur, uaddr);
+    if (ret)
+        goto out;
+    if (cur != val) {
+        ret = -EAGAIN;
+        goto out;
+    }
+
+    futex_queue(&q);
+
+    while (!q.woken && !signal_pending(current) && !(spec && sleep_hashit(spec))) {
+        current->state = TASK_INTERRUPTIBLE;
+        schedule();
+        current->state = TASK_RUNNING;
+    }
+
+    if (!q.woken) {
+        futex_unqueue(&q);
+        ret = signal_pending(current) ? -EINTR : -ETIMEDOUT;
+    }
+
+out:
+    restore_flags(flags);
+    if (spec)
+        sleep_finalize(spec);
+    return ret;
+}
+
+/*  futex_requeue
+ *  DESCRIPTION: wake some waiters on one futex and move others to wait on a
+ *               second one, so that a broadcast does not wake every waiter
+ *               just to have them block again on the mutex
+ *  INPUTS: uint32_t *uaddr, uint32_t nr_wake, uint32_t nr_requeue,
+ *          uint32_t *uaddr2, const uint32_t *cmpval -- if not NULL, fail
+ *          unless *uaddr holds this value
+ *  OUTPUTS: none
+ *  RETURN VALUE: number of tasks woken and requeued, or negative errno
+ */
+static int32_t futex_requeue(uint32_t *uaddr, uint32_t nr_wake, uint32_t nr_requeue,
+                             uint32_t *uaddr2, const uint32_t *cmpval) {
+    struct mm_struct *mm = current->mm;
+    unsigned long flags;
+    int32_t ret;
+
+    cli_and_save(flags);
+
+    if (cmpval) {
+        uint32_t cur;
+        ret = get_user(cur, uaddr);
+        if (ret)
+            goto out;
+        if (cur != *cmpval) {
+            ret = -EAGAIN;
+            goto out;
+        }
+    }
+
+    ret = futex_wake_locked(mm, uaddr, nr_wake, FUTEX_BITSET_MATCH_ANY);
+
+    struct futex_q **pp = futex_bucket(mm, uaddr);
+    uint32_t requeued = 0;
+    while (*pp && requeued < nr_requeue && uaddr2 != uaddr) {
+        struct futex_q *q = *pp;
+        if (!futex_match(q, mm, uaddr)) {
+            pp = &q->next;
+            continue;
+        }
+
+        *pp = q->next;
+        q->uaddr = uaddr2;
+        futex_queue(q);
+        requeued++;
+    }
+    ret += requeued;
+
+out:
+    restore_flags(flags);
+    return ret;
+}
+
+static inline int32_t sign_extend12(uint32_t val) {
+    return (int32_t)(val << 20) >> 20;
+}
+
+/*  futex_wake_op
+ *  DESCRIPTION: atomically modify *uaddr2, wake waiters on uaddr, and if the
+ *               old value of *uaddr2 passes a comparison, also wake waiters
+ *               on uaddr2
+ *  INPUTS: uint32_t *uaddr, uint32_t nr_wake, uint32_t nr_wake2,
+ *          uint32_t *uaddr2, uint32_t encoded_op -- see FUTEX_OP_*
+ *  OUTPUTS: none
+ *  RETURN VALUE: number of tasks woken, or negative errno
+ */
+static int32_t futex_wake_op(uint32_t *uaddr, uint32_t nr_wake, uint32_t nr_wake2,
+                             uint32_t *uaddr2, uint32_t encoded_op) {
+    uint32_t op = (encoded_op >> 28) & 0xf;
+    uint32_t cmp = (encoded_op >> 24) & 0xf;
+    int32_t oparg = sign_extend12(encoded_op >> 12);
+    int32_t cmparg = sign_extend12(encoded_op);
+    struct mm_struct *mm = current->mm;
+    unsigned long flags;
+    int32_t oldval, newval;
+    int32_t ret;
+
+    if (op & FUTEX_OP_OPARG_SHIFT) {
+        oparg = 1 << (oparg & 31);
+        op &= ~FUTEX_OP_OPARG_SHIFT;
+    }
+
+    // the read-modify-write is atomic against other tasks since nothing can
+    // preempt us here; a fault on a COW page is resolved in place
+    cli_and_save(flags);
+
+    ret = get_user(oldval, (int32_t *)uaddr2);
+    if (ret)
+        goto out;
+
+    switch (op) {
+    case FUTEX_OP_SET:  newval = oparg; break;
+    case FUTEX_OP_ADD:  newval = oldval + oparg; break;
+    case FUTEX_OP_OR:   newval = oldval | oparg; break;
+    case FUTEX_OP_ANDN: newval = oldval & ~oparg; break;
+    case FUTEX_OP_XOR:  newval = oldval ^ oparg; break;
+    default:
+        ret = -ENOSYS;
+        goto out;
+    }
+
+    bool wake2;
+    switch (cmp) {
+    case FUTEX_OP_CMP_EQ: wake2 = oldval == cmparg; break;
+    case FUTEX_OP_CMP_NE: wake2 = oldval != cmparg; break;
+    case FUTEX_OP_CMP_LT: wake2 = oldval < cmparg; break;
+    case FUTEX_OP_CMP_LE: wake2 = oldval <= cmparg; break;
+    case FUTEX_OP_CMP_GT: wake2 = oldval > cmparg; break;
+    case FUTEX_OP_CMP_GE: wake2 = oldval >= cmparg; break;
+    default:
+        ret = -ENOSYS;
+        goto out;
+    }
+
+    ret = put_user(newval, (int32_t *)uaddr2);
+    if (ret)
+        goto out;
+
+    ret = futex_wake_locked(mm, uaddr, nr_wake, FUTEX_BITSET_MATCH_ANY);
+    if (wake2)
+        ret += futex_wake_locked(mm, uaddr2, nr_wake2, FUTEX_BITSET_MATCH_ANY);
+
+out:
+    restore_flags(flags);
+    return ret;
+}
+
+/*  futex_release_child_tid
+ *  DESCRIPTION: on exit or exec, clear the TID word registered with
+ *               CLONE_CHILD_CLEARTID or set_tid_address and wake one waiter
+ *               on it, which is how pthread_join learns a thread is gone
+ *  INPUTS: none
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void futex_release_child_tid(void) {
+    uint32_t *tidptr = (uint32_t *)current->clear_child_tid;
+    current->clear_child_tid = NULL;
+
+    // nobody else can see the word if we're the last user of the mm
+    if (!tidptr || !current->mm || atomic_get(&current->mm->refcount) <= 1)
+        return;
+
+    if (!put_user(0, tidptr))
+        futex_wake(tidptr, 1, FUTEX_BITSET_MATCH_ANY);
+}
+
+DEFINE_SYSCALL6(LINUX, futex, uint32_t *, uaddr, int, op, uint32_t, val,
+                const struct timespec *, timeout, uint32_t *, uaddr2, uint32_t, val3) {
+    uint32_t cmd = op & FUTEX_CMD_MASK;
+    // for the requeue and wake-op commands, the timeout slot is a count
+    uint32_t val2 = (uint32_t)timeout;
+
+    if ((uint32_t)uaddr & 3)
+        return -EINVAL;
+
+    if (op & FUTEX_CLOCK_REALTIME && cmd != FUTEX_WAIT_BITSET)
+        return -ENOSYS;
+
+    switch (cmd) {
+    case FUTEX_REQUEUE:
+    case FUTEX_CMP_REQUEUE:
+    case FUTEX_WAKE_OP:
+        if ((uint32_t)uaddr2 & 3)
+            return -EINVAL;
+        break;
+    }
+
+    switch (cmd) {
+    case FUTEX_WAIT:
+        val3 = FUTEX_BITSET_MATCH_ANY;
+        // fallthrough
+    case FUTEX_WAIT_BITSET: {
+        struct timespec reltime;
+
+        if (!val3)
+            return -EINVAL;
+        if (!timeout)
+            return futex_wait(uaddr, val, NULL, val3);
+
+        if (copy_from_user(&reltime, timeout, sizeof(reltime)))
+            return -EFAULT;
+        if (reltime.nsec >= NSEC)
+            return -EINVAL;
+
+        // FUTEX_WAIT_BITSET takes an absolute time
+        if (cmd == FUTEX_WAIT_BITSET) {
+            struct timespec now;
+            if (op & FUTEX_CLOCK_REALTIME)
+                now = (struct timespec){ .sec = time_now() };
+            else
+                get_uptime(&now);
+
+            if (timespec_cmp(&reltime, &now) <= 0)
+                return -ETIMEDOUT;
+            timespec_sub(&reltime, &now);
+        }
+
+        return futex_wait(uaddr, val, &reltime, val3);
+    }
+
+    case FUTEX_WAKE:
+        val3 = FUTEX_BITSET_MATCH_ANY;
+        // fallthrough
+    case FUTEX_WAKE_BITSET:
+        if (!val3)
+            return -EINVAL;
+        return futex_wake(uaddr, val, val3);
+
+    case FUTEX_REQUEUE:
+        return futex_requeue(uaddr, val, val2, uaddr2, NULL);
+
+    case FUTEX_CMP_REQUEUE:
+        return futex_requeue(uaddr, val, val2, uaddr2, &val3);
+
+    case FUTEX_WAKE_OP:
+        return futex_wake_op(uaddr, val, val2, uaddr2, val3);
+
+    default:
+        return -ENOSYS;
+    }
+}
+
+DEFINE_SYSCALL1(LINUX, set_tid_address, int *, tidptr) {
+    current->clear_child_tid = tidptr;
+    return current->pid;
+}
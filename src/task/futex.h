@@ -0,0 +1,41 @@
+#ifndef _FUTEX_H
+#define _FUTEX_H
+
+#include "../lib/stdint.h"
+
+// copied from <uapi/linux/futex.h>
+
+#define FUTEX_WAIT            0
+#define FUTEX_WAKE            1
+#define FUTEX_REQUEUE         3
+#define FUTEX_CMP_REQUEUE     4
+#define FUTEX_WAKE_OP         5
+#define FUTEX_WAIT_BITSET     9
+#define FUTEX_WAKE_BITSET     10
+
+#define FUTEX_PRIVATE_FLAG    128
+#define FUTEX_CLOCK_REALTIME  256
+#define FUTEX_CMD_MASK        ~(FUTEX_PRIVATE_FLAG | FUTEX_CLOCK_REALTIME)
+
+#define FUTEX_BITSET_MATCH_ANY 0xffffffff
+
+#define FUTEX_OP_SET          0 /* *(int *)UADDR2 = OPARG; */
+#define FUTEX_OP_ADD          1 /* *(int *)UADDR2 += OPARG; */
+#define FUTEX_OP_OR           2 /* *(int *)UADDR2 |= OPARG; */
+#define FUTEX_OP_ANDN         3 /* *(int *)UADDR2 &= ~OPARG; */
+#define FUTEX_OP_XOR          4 /* *(int *)UADDR2 ^= OPARG; */
+
+#define FUTEX_OP_OPARG_SHIFT  8 /* Use (1 << OPARG) instead of OPARG. */
+
+#define FUTEX_OP_CMP_EQ       0 /* if (oldval == CMPARG) wake */
+#define FUTEX_OP_CMP_NE       1 /* if (oldval != CMPARG) wake */
+#define FUTEX_OP_CMP_LT       2 /* if (oldval < CMPARG) wake */
+#define FUTEX_OP_CMP_LE       3 /* if (oldval <= CMPARG) wake */
+#define FUTEX_OP_CMP_GT       4 /* if (oldval > CMPARG) wake */
+#define FUTEX_OP_CMP_GE       5 /* if (oldval >= CMPARG) wake */
+
+int32_t futex_wake(uint32_t *uaddr, uint32_t nr_wake, uint32_t bitset);
+
+void futex_release_child_tid(void);
+
+#endif
@@ -0,0 +1,327 @@
+#include "ptrace.h"
+#include "task.h"
+#include "sched.h"
+#include "signal.h"
+#include "../mm/paging.h"
+#include "../mm/uaccess.h"
+#include "../lib/cli.h"
+#include "../syscall.h"
+#include "../err.h"
+#include "../errno.h"
+
+/*
+ *   ptrace_detach
+ *   DESCRIPTION: stop tracing a task, and resume it if it is stopped
+ *   INPUTS: struct task_struct *task
+ *           uint16_t signum -- signal to resume with
+ */
+static void ptrace_detach(struct task_struct *task, uint16_t signum) {
+    task->tracer = NULL;
+    task->ptrace = 0;
+
+    if (task->ptrace_stopped) {
+        task->ptrace_stopped = false;
+        task->ptrace_resume_sig = signum;
+        wake_up_process(task);
+    }
+}
+
+/*
+ *   ptrace_stop
+ *   DESCRIPTION: stop current until the tracer resumes it, reporting signum
+ *                as the stop signal in its wait status. SIGKILL always gets
+ *                through
+ *   INPUTS: uint16_t signum
+ *           struct intr_info *regs -- the userspace registers shown to the
+ *                                     tracer
+ *   RETURN VALUE: the signal the tracer resumed current with, or 0
+ */
+uint16_t ptrace_stop(uint16_t signum, struct intr_info *regs) {
+    struct task_struct *tracer = current->tracer;
+
+    current->ptrace_regs = regs;
+    current->ptrace_stopcode = (signum << 8) | 0x7f;
+    current->ptrace_resume_sig = 0;
+    current->ptrace_stopped = true;
+
+    // the tracer is likely sleeping in waitpid
+    if (tracer->state == TASK_INTERRUPTIBLE)
+        wake_up_process(tracer);
+
+    while (current->ptrace_stopped &&
+            !(current->sigpending.pending_mask & MASKVAL(SIGKILL))) {
+        current->state = TASK_INTERRUPTIBLE;
+        schedule();
+        current->state = TASK_RUNNING;
+    }
+
+    current->ptrace_stopped = false;
+    current->ptrace_stopcode = 0;
+    current->ptrace_regs = NULL;
+    return current->ptrace_resume_sig;
+}
+
+/*
+ *   ptrace_syscall_stop
+ *   DESCRIPTION: stop at a syscall entry or exit, and queue whatever signal
+ *                the tracer resumes with
+ *   INPUTS: struct intr_info *regs
+ */
+static void ptrace_syscall_stop(struct intr_info *regs) {
+    uint16_t signum = ptrace_stop(
+        SIGTRAP | (current->ptrace & PT_SYSGOOD ? 0x80 : 0), regs);
+    if (signum)
+        send_sig(current, signum);
+}
+
+/*
+ *   ptrace_syscall_entry
+ *   DESCRIPTION: syscall-entry-stop, before the handler runs
+ *   INPUTS: struct intr_info *regs
+ */
+void ptrace_syscall_entry(struct intr_info *regs) {
+    current->ptrace_orig_eax = regs->eax;
+    ptrace_syscall_stop(regs);
+}
+
+/*
+ *   ptrace_syscall_exit
+ *   DESCRIPTION: syscall-exit-stop, with the return value in eax
+ *   INPUTS: struct intr_info *regs
+ */
+void ptrace_syscall_exit(struct intr_info *regs) {
+    ptrace_syscall_stop(regs);
+    current->ptrace_orig_eax = -1;
+}
+
+/*
+ *   ptrace_exit
+ *   DESCRIPTION: detach current's tracees from it as it exits. A tracer
+ *                that is also the parent learns of the exit from SIGCHLD,
+ *                so current detaches from it too. Any other tracer stays
+ *                attached until waitpid reports the exit to it
+ */
+void ptrace_exit(void) {
+    struct task_struct *tracer = current->tracer;
+    if (tracer) {
+        if (tracer == current->parent) {
+            current->tracer = NULL;
+            current->ptrace = 0;
+        } else {
+            current->ptrace = PT_EXITED;
+        }
+        // so a tracer waiting for us finds us gone
+        if (tracer->state == TASK_INTERRUPTIBLE)
+            wake_up_process(tracer);
+    }
+
+    struct list_node *node;
+    list_for_each(&tasks, node) {
+        struct task_struct *task = node->value;
+        if (task->tracer == current)
+            ptrace_detach(task, 0);
+    }
+}
+
+/*
+ *   ptrace_stop_pending
+ *   DESCRIPTION: check whether a tracee of current has a stop or an exit
+ *                yet to be waited for
+ *   INPUTS: struct task_struct *task
+ */
+bool ptrace_stop_pending(struct task_struct *task) {
+    return task->tracer == current &&
+        (task->ptrace_stopcode || (task->ptrace & PT_EXITED));
+}
+
+/*
+ *   ptrace_find_stopped
+ *   DESCRIPTION: find a tracee of current with a stop yet to be waited for
+ *   INPUTS: uint32_t pgid -- its process group, or 0 for any
+ *   RETURN VALUE: the tracee, or NULL
+ */
+struct task_struct *ptrace_find_stopped(uint32_t pgid) {
+    struct list_node *node;
+    list_for_each(&tasks, node) {
+        struct task_struct *task = node->value;
+        if (ptrace_stop_pending(task) && (!pgid || task->pgid == pgid))
+            return task;
+    }
+
+    return NULL;
+}
+
+/*
+ *   ptrace_has_tracees
+ *   DESCRIPTION: check whether current traces any task
+ *   INPUTS: uint32_t pgid -- their process group, or 0 for any
+ */
+bool ptrace_has_tracees(uint32_t pgid) {
+    struct list_node *node;
+    list_for_each(&tasks, node) {
+        struct task_struct *task = node->value;
+        if (task->tracer == current && (!pgid || task->pgid == pgid))
+            return true;
+    }
+
+    return false;
+}
+
+/*
+ *   ptrace_take_stopcode
+ *   DESCRIPTION: report a stop or an exit to the tracer's waitpid, only
+ *                once. Reporting an exit detaches the tracee, leaving it
+ *                for its parent to reap
+ *   INPUTS: struct task_struct *task -- a tracee with ptrace_stop_pending
+ *   RETURN VALUE: the wait status
+ */
+int32_t ptrace_take_stopcode(struct task_struct *task) {
+    if (task->ptrace & PT_EXITED) {
+        task->tracer = NULL;
+        task->ptrace = 0;
+        return task->exitcode;
+    }
+
+    int32_t stopcode = task->ptrace_stopcode;
+    task->ptrace_stopcode = 0;
+    return stopcode;
+}
+
+/*
+ *   ptrace_peekdata
+ *   DESCRIPTION: read a word from a tracee's memory
+ *   INPUTS: struct task_struct *task
+ *           const uint32_t *addr -- in the tracee
+ *           uint32_t *data -- where to put it, in current
+ *   RETURN VALUE: 0 on success, or negative errno
+ */
+static int32_t ptrace_peekdata(struct task_struct *task, const uint32_t *addr, uint32_t *data) {
+    unsigned long flags;
+    uint32_t word;
+    int32_t res;
+
+    page_directory_t *dir = current->mm ? current->mm->page_directory : current_page_directory();
+
+    cli_and_save(flags);
+    switch_directory(task->mm->page_directory);
+    res = get_user(word, addr);
+    switch_directory(dir);
+    restore_flags(flags);
+
+    if (res)
+        return -EIO;
+
+    return put_user(word, data);
+}
+
+/*
+ *   ptrace_getregs
+ *   DESCRIPTION: read the userspace registers of a stopped tracee
+ *   INPUTS: struct task_struct *task
+ *           struct user_regs_struct *data -- in current
+ *   RETURN VALUE: 0 on success, or negative errno
+ */
+static int32_t ptrace_getregs(struct task_struct *task, struct user_regs_struct *data) {
+    struct intr_info *regs = task->ptrace_regs;
+    struct user_regs_struct user_regs = {
+        .ebx      = regs->ebx,
+        .ecx      = regs->ecx,
+        .edx      = regs->edx,
+        .esi      = regs->esi,
+        .edi      = regs->edi,
+        .ebp      = regs->ebp,
+        .eax      = regs->eax,
+        .xds      = regs->ds,
+        .xes      = regs->es,
+        .xfs      = regs->fs,
+        .xgs      = regs->gs,
+        .orig_eax = task->ptrace_orig_eax,
+        .eip      = regs->eip,
+        .xcs      = regs->cs,
+        .eflags   = regs->eflags,
+        .esp      = regs->esp,
+        .xss      = regs->ss,
+    };
+
+    if (copy_to_user(data, &user_regs, sizeof(user_regs)))
+        return -EFAULT;
+    return 0;
+}
+
+/*
+ *   ptrace_attach
+ *   DESCRIPTION: start tracing a task, stopping it with SIGSTOP
+ *   INPUTS: struct task_struct *task
+ *   RETURN VALUE: 0 on success, or negative errno
+ */
+static int32_t ptrace_attach(struct task_struct *task) {
+    if (task == current || !task->mm || task->tracer || current->tracer == task)
+        return -EPERM;
+    if (task->state == TASK_ZOMBIE)
+        return -ESRCH;
+
+    task->tracer = current;
+    task->ptrace = 0;
+    task->ptrace_orig_eax = -1;
+    send_sig(task, SIGSTOP);
+    return 0;
+}
+
+DEFINE_SYSCALL4(LINUX, ptrace, int32_t, request, int32_t, pid, void *, addr, void *, data) {
+    if (request == PTRACE_TRACEME) {
+        if (current->tracer)
+            return -EPERM;
+        current->tracer = current->parent;
+        current->ptrace = 0;
+        current->ptrace_orig_eax = -1;
+        return 0;
+    }
+
+    struct task_struct *task = get_task_from_pid(pid);
+    if (IS_ERR(task))
+        return PTR_ERR(task);
+
+    if (request == PTRACE_ATTACH)
+        return ptrace_attach(task);
+
+    // everything else needs a stopped tracee
+    if (task->tracer != current || !task->ptrace_stopped)
+        return -ESRCH;
+
+    uint32_t signum = (uint32_t)data;
+
+    switch (request) {
+    case PTRACE_PEEKTEXT:
+    case PTRACE_PEEKDATA:
+        return ptrace_peekdata(task, addr, data);
+    case PTRACE_GETREGS:
+        return ptrace_getregs(task, data);
+    case PTRACE_SETOPTIONS:
+        if ((uint32_t)data & ~PTRACE_O_TRACESYSGOOD)
+            return -EINVAL;
+        if ((uint32_t)data & PTRACE_O_TRACESYSGOOD)
+            task->ptrace |= PT_SYSGOOD;
+        else
+            task->ptrace &= ~PT_SYSGOOD;
+        return 0;
+    case PTRACE_CONT:
+    case PTRACE_SYSCALL:
+        if (signum >= NSIG)
+            return -EIO;
+        if (request == PTRACE_SYSCALL)
+            task->ptrace |= PT_SYSCALL;
+        else
+            task->ptrace &= ~PT_SYSCALL;
+        task->ptrace_stopped = false;
+        task->ptrace_resume_sig = signum;
+        wake_up_process(task);
+        return 0;
+    case PTRACE_DETACH:
+        if (signum >= NSIG)
+            return -EIO;
+        ptrace_detach(task, signum);
+        return 0;
+    default:
+        return -EIO;
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef _PTRACE_H
+#define _PTRACE_H
+
+#include "../lib/stdint.h"
+#include "../lib/stdbool.h"
+
+// source: <uapi/linux/ptrace.h>
+#define PTRACE_TRACEME    0
+#define PTRACE_PEEKTEXT   1
+#define PTRACE_PEEKDATA   2
+#define PTRACE_CONT       7
+#define PTRACE_GETREGS    12
+#define PTRACE_ATTACH     16
+#define PTRACE_DETACH     17
+#define PTRACE_SYSCALL    24
+#define PTRACE_SETOPTIONS 0x4200
+
+#define PTRACE_O_TRACESYSGOOD 1
+
+/*
+ * A traced task has a tracer, and stops instead of taking signals, after a
+ * successful execve, and, with PT_SYSCALL, at the entry and exit of every
+ * syscall. While stopped, its wait status is reported to the tracer by
+ * waitpid, and the tracer may read its memory and registers before
+ * resuming it.
+ */
+
+// task->ptrace
+#define PT_SYSCALL (1 << 0) // stop at syscall entry and exit
+#define PT_SYSGOOD (1 << 1) // report syscall stops as SIGTRAP | 0x80
+#define PT_EXITED  (1 << 2) // exited, yet to be reported to a non-parent tracer
+
+// source: <asm/user_32.h>
+struct user_regs_struct {
+    uint32_t ebx;
+    uint32_t ecx;
+    uint32_t edx;
+    uint32_t esi;
+    uint32_t edi;
+    uint32_t ebp;
+    uint32_t eax;
+    uint32_t xds;
+    uint32_t xes;
+    uint32_t xfs;
+    uint32_t xgs;
+    uint32_t orig_eax;
+    uint32_t eip;
+    uint32_t xcs;
+    uint32_t eflags;
+    uint32_t esp;
+    uint32_t xss;
+};
+
+struct task_struct;
+struct intr_info;
+
+uint16_t ptrace_stop(uint16_t signum, struct intr_info *regs);
+void ptrace_syscall_entry(struct intr_info *regs);
+void ptrace_syscall_exit(struct intr_info *regs);
+void ptrace_exit(void);
+
+bool ptrace_stop_pending(struct task_struct *task);
+struct task_struct *ptrace_find_stopped(uint32_t pgid);
+bool ptrace_has_tracees(uint32_t pgid);
+int32_t ptrace_take_stopcode(struct task_struct *task);
+
+#endif
@@ -1,17 +1,99 @@
 #include "session.h"
 #include "task.h"
 #include "../mm/kmalloc.h"
+#include "../mm/slab.h"
 #include "../syscall.h"
 #include "../err.h"
 #include "../errno.h"
 
-int32_t do_setsid(void) {
-    struct list_node *node;
-    list_for_each(&tasks, node) {
-        struct task_struct *task = node->value;
-        if (task->pgid == current->pid)
-            return -EPERM;
+#define PGRP_HASH_SIZE 64
+
+static struct pgrp *pgrp_hash[PGRP_HASH_SIZE];
+static DEFINE_KMEM_CACHE(pgrp_cache, struct pgrp, NULL);
+
+/*
+ *   find_pgrp
+ *   DESCRIPTION: find a process group with members
+ *   INPUTS: uint32_t pgid
+ *   RETURN VALUE: the group, or NULL if there is none
+ */
+struct pgrp *find_pgrp(uint32_t pgid) {
+    struct pgrp *pgrp;
+    for (pgrp = pgrp_hash[pgid % PGRP_HASH_SIZE]; pgrp; pgrp = pgrp->hash_next) {
+        if (pgrp->pgid == pgid)
+            return pgrp;
+    }
+    return NULL;
+}
+
+// unlink and free a group once its last member is gone
+static void pgrp_put_if_empty(struct pgrp *pgrp) {
+    if (!list_isempty(&pgrp->members))
+        return;
+
+    struct pgrp **prevp;
+    for (prevp = &pgrp_hash[pgrp->pgid % PGRP_HASH_SIZE]; *prevp; prevp = &(*prevp)->hash_next) {
+        if (*prevp == pgrp) {
+            *prevp = pgrp->hash_next;
+            break;
+        }
+    }
+    kmem_cache_free(&pgrp_cache, pgrp);
+}
+
+/*
+ *   set_task_pgid
+ *   DESCRIPTION: move a task into another process group, 0 for none
+ *   INPUTS: struct task_struct *task, uint32_t pgid
+ *   RETURN VALUE: 0 on success, or negative errno
+ */
+int32_t set_task_pgid(struct task_struct *task, uint32_t pgid) {
+    unsigned long flags;
+    int32_t res = 0;
+
+    cli_and_save(flags);
+
+    if (task->pgid == pgid)
+        goto out;
+
+    if (pgid) {
+        struct pgrp *newgrp = find_pgrp(pgid);
+        if (!newgrp) {
+            newgrp = kmem_cache_alloc(&pgrp_cache);
+            if (!newgrp) {
+                res = -ENOMEM;
+                goto out;
+            }
+            newgrp->pgid = pgid;
+            list_init(&newgrp->members);
+            newgrp->hash_next = pgrp_hash[pgid % PGRP_HASH_SIZE];
+            pgrp_hash[pgid % PGRP_HASH_SIZE] = newgrp;
+        }
+
+        res = list_insert_back(&newgrp->members, task);
+        if (res < 0) {
+            pgrp_put_if_empty(newgrp);
+            goto out;
+        }
+    }
+
+    if (task->pgid) {
+        struct pgrp *oldgrp = find_pgrp(task->pgid);
+        if (oldgrp) {
+            list_remove(&oldgrp->members, task);
+            pgrp_put_if_empty(oldgrp);
+        }
     }
+    task->pgid = pgid;
+
+out:
+    restore_flags(flags);
+    return res;
+}
+
+int32_t do_setsid(void) {
+    if (find_pgrp(current->pid))
+        return -EPERM;
 
     struct session *session = kmalloc(sizeof(*session));
     if (!session)
@@ -22,8 +104,13 @@ int32_t do_setsid(void) {
         .refcount = ATOMIC_INITIALIZER(1),
     };
 
+    int32_t res = set_task_pgid(current, current->pid);
+    if (res < 0) {
+        kfree(session);
+        return res;
+    }
+
     current->session = session;
-    current->pgid = current->pid;
 
     return current->session->sid;
 }
@@ -31,7 +118,7 @@ int32_t do_setsid(void) {
 void put_session() {
     struct session *session = current->session;
     current->session = NULL;
-    current->pgid = 0;
+    set_task_pgid(current, 0);
 
     if (!session)
         return;
@@ -70,8 +157,7 @@ int32_t do_setpgid(int32_t pid, int32_t pgid) {
     if (task->session != leader->session)
         return -EPERM;
 
-    task->pgid = pgid;
-    return 0;
+    return set_task_pgid(task, pgid);
 }
 
 DEFINE_SYSCALL0(LINUX, setsid) {
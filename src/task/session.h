@@ -3,6 +3,7 @@
 
 #include "../lib/stdint.h"
 #include "../char/tty.h"
+#include "../structure/list.h"
 
 struct session {
     atomic_t refcount;
@@ -11,6 +12,19 @@ struct session {
     uint32_t foreground_pgid;
 };
 
+// Members of a process group, so group-wide operations don't need to walk
+// every task. Groups exist as long as they have members.
+struct pgrp {
+    uint32_t pgid;
+    struct list members;
+    struct pgrp *hash_next;
+};
+
+struct task_struct;
+
+struct pgrp *find_pgrp(uint32_t pgid);
+int32_t set_task_pgid(struct task_struct *task, uint32_t pgid);
+
 int32_t do_setsid(void);
 
 void put_session();
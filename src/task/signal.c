@@ -3,9 +3,17 @@
 #include "task.h"
 #include "exit.h"
 #include "userstack.h"
+#include "session.h"
+#include "ptrace.h"
 #include "../lib/bsr.h"
+#include "../lib/cli.h"
 #include "../mm/kmalloc.h"
+#include "../mm/slab.h"
+#include "../mm/uaccess.h"
+#include "../time/time.h"
+#include "../time/sleep.h"
 #include "../panic.h"
+#include "../eflags.h"
 #include "../syscall.h"
 #include "../err.h"
 
@@ -41,56 +49,127 @@ static enum default_action default_sig_action(uint16_t signum) {
     }
 }
 
-uint32_t fatal_signal_pending(struct task_struct *task) {
+static DEFINE_KMEM_CACHE(sigqueue_cache, struct sigqueue, NULL);
+
+uint64_t fatal_signal_pending(struct task_struct *task) {
     // We assume all forced signals are fatal
     return (task->sigpending.pending_mask & (task->sigpending.forced_mask | SIG_UNMASKABLE));
 }
 
-uint32_t signal_pending(struct task_struct *task) {
+uint64_t signal_pending(struct task_struct *task) {
     return fatal_signal_pending(task) | (task->sigpending.pending_mask & ~task->sigpending.blocked_mask);
 }
 
+// The lowest numbered signal in a mask, so that standard signals go before
+// real-time ones, and real-time ones in order, as POSIX wants
+static uint16_t first_signal(uint64_t mask) {
+    if ((uint32_t)mask)
+        return bsf(mask) + 1;
+    if (mask >> 32)
+        return bsf(mask >> 32) + 33;
+    return 0;
+}
+
 uint16_t signal_pending_one(struct task_struct *task) {
-    uint32_t mask;
     // priortize fatals
-    mask = fatal_signal_pending(task);
-    if (mask)
-        return bsr(mask);
-    mask = signal_pending(task);
-    if (mask)
-        return bsr(mask);
-    return 0;
+    uint16_t signum = first_signal(fatal_signal_pending(task));
+    if (signum)
+        return signum;
+    return first_signal(signal_pending(task));
 }
 
 bool signal_is_fatal(struct task_struct *task, uint16_t signum) {
     return MASKVAL(signum) & (task->sigpending.forced_mask | SIG_UNMASKABLE);
 }
 
-void send_sig_info(struct task_struct *task, struct siginfo *siginfo) {
-    if (task->sigpending.pending_mask & MASKVAL(siginfo->signo))
-        return;
-    struct sigaction *sigaction = &task->sigactions->sigactions[siginfo->signo];
+/*
+ *   sigqueue_pop
+ *   DESCRIPTION: take the oldest instance of a pending signal
+ *   INPUTS: struct sigpending *sigpending, uint16_t signum
+ *   OUTPUTS: struct siginfo *siginfo -- its siginfo, if not NULL
+ */
+static void sigqueue_pop(struct sigpending *sigpending, uint16_t signum, struct siginfo *siginfo) {
+    unsigned long flags;
+    cli_and_save(flags);
+
+    struct sigqueue *tail = sigpending->queue[signum];
+    struct sigqueue *head = NULL;
+    if (tail) {
+        head = tail->next;
+        if (head == tail)
+            sigpending->queue[signum] = NULL;
+        else
+            tail->next = head->next;
+        sigpending->nr_queued--;
+    }
+
+    sigpending->forced_mask &= ~MASKVAL(signum);
+    if (!sigpending->queue[signum])
+        sigpending->pending_mask &= ~MASKVAL(signum);
+
+    restore_flags(flags);
+
+    if (siginfo) {
+        if (head)
+            *siginfo = head->info;
+        else
+            *siginfo = (struct siginfo){ .signo = signum, .code = SI_KERNEL };
+    }
+    if (head)
+        kmem_cache_free(&sigqueue_cache, head);
+}
+
+int32_t send_sig_info(struct task_struct *task, struct siginfo *siginfo) {
+    uint16_t signum = siginfo->signo;
+    struct sigpending *sigpending = &task->sigpending;
+    unsigned long flags;
+
+    struct sigaction *sigaction = &task->sigactions->sigactions[signum];
     if (sigaction->sigaction == SIG_IGN)
-        return;
+        return 0;
 
     // special case SIGCONT
-    if (siginfo->signo == SIGCONT) {
+    if (signum == SIGCONT) {
         if (task->stopped) {
             task->stopped = false;
             wake_up_process(task);
         }
-        return;
+        return 0;
     }
 
-    task->sigpending.pending_mask |= MASKVAL(siginfo->signo);
+    // standard signals don't queue
+    if (signum < SIGRTMIN && (sigpending->pending_mask & MASKVAL(signum)))
+        return 0;
+    if (signum >= SIGRTMIN && sigpending->nr_queued >= SIGQUEUE_MAX)
+        return -EAGAIN;
+
+    struct sigqueue *sigqueue = kmem_cache_alloc(&sigqueue_cache);
+    if (!sigqueue && signum >= SIGRTMIN)
+        return -EAGAIN;
+
+    cli_and_save(flags);
+
+    if (sigqueue) {
+        sigqueue->info = *siginfo;
+
+        struct sigqueue **tail = &sigpending->queue[signum];
+        if (*tail) {
+            sigqueue->next = (*tail)->next;
+            (*tail)->next = sigqueue;
+        } else {
+            sigqueue->next = sigqueue;
+        }
+        *tail = sigqueue;
+        sigpending->nr_queued++;
+    }
 
-    struct siginfo *siginfo_h = kmalloc(sizeof(*siginfo_h));
-    *siginfo_h = *siginfo;
+    sigpending->pending_mask |= MASKVAL(signum);
 
-    array_set(&task->sigpending.siginfos, siginfo->signo, siginfo_h);
+    restore_flags(flags);
 
     if (task->state == TASK_INTERRUPTIBLE)
         wake_up_process(task);
+    return 0;
 }
 
 void force_sig_info(struct task_struct *task, struct siginfo *siginfo) {
@@ -116,21 +195,20 @@ void force_sig(struct task_struct *task, uint16_t signum) {
 }
 
 int32_t send_sig_info_pg(uint16_t pgid, struct siginfo *siginfo) {
-    struct task_struct *leader = get_task_from_pid(pgid);
-    if (IS_ERR(leader))
-        return PTR_ERR(leader);
+    struct pgrp *pgrp = find_pgrp(pgid);
+    if (!pgrp) {
+        // Not a group, just a task
+        struct task_struct *task = get_task_from_pid(pgid);
+        if (IS_ERR(task))
+            return PTR_ERR(task);
 
-    if (leader->pgid != pgid) {
-        // Not a leader
-        send_sig_info(leader, siginfo);
+        send_sig_info(task, siginfo);
         return 0;
     }
 
     struct list_node *node;
-    list_for_each(&tasks, node) {
-        struct task_struct *task = node->value;
-        if (task->pgid == pgid)
-            send_sig_info(task, siginfo);
+    list_for_each(&pgrp->members, node) {
+        send_sig_info(node->value, siginfo);
     }
 
     return 0;
@@ -152,19 +230,78 @@ bool kernel_peek_pending_sig(uint16_t signum, struct siginfo *siginfo) {
     if (!kernel_sig_ispending(signum))
         return false;
 
-    if (siginfo)
-        *siginfo = *(struct siginfo *)array_get(&current->sigpending.siginfos, signum);
+    if (siginfo) {
+        struct sigqueue *tail = current->sigpending.queue[signum];
+        if (tail)
+            *siginfo = tail->next->info;
+        else
+            *siginfo = (struct siginfo){ .signo = signum, .code = SI_KERNEL };
+    }
     return true;
 }
 
 bool kernel_get_pending_sig(uint16_t signum, struct siginfo *siginfo) {
-    bool ret = kernel_peek_pending_sig(signum, siginfo);
-    current->sigpending.pending_mask &= ~MASKVAL(signum);
-    current->sigpending.forced_mask &= ~MASKVAL(signum);
-    return ret;
+    if (!kernel_sig_ispending(signum))
+        return false;
+
+    sigqueue_pop(&current->sigpending, signum, siginfo);
+    return true;
 }
 
-static void set_sigmask(uint32_t newmask) {
+/*
+ *   dequeue_signal
+ *   DESCRIPTION: take the lowest numbered pending signal in a mask from
+ *                current, blocked or not
+ *   INPUTS: uint64_t mask
+ *   OUTPUTS: struct siginfo *siginfo -- its siginfo, if not NULL
+ *   RETURN VALUE: the signal, or 0 if none is pending
+ */
+uint16_t dequeue_signal(uint64_t mask, struct siginfo *siginfo) {
+    uint16_t signum = first_signal(current->sigpending.pending_mask & mask);
+    if (signum)
+        sigqueue_pop(&current->sigpending, signum, siginfo);
+    return signum;
+}
+
+/*
+ *   peek_signal
+ *   DESCRIPTION: like dequeue_signal, but leave the signal pending, so the
+ *                caller can take it with kernel_get_pending_sig once it has
+ *                made use of the siginfo
+ *   INPUTS: uint64_t mask
+ *   OUTPUTS: struct siginfo *siginfo -- its siginfo, if not NULL
+ *   RETURN VALUE: the signal, or 0 if none is pending
+ */
+uint16_t peek_signal(uint64_t mask, struct siginfo *siginfo) {
+    unsigned long flags;
+    uint16_t signum;
+
+    // an interrupt may be queueing behind the head we look at
+    cli_and_save(flags);
+    signum = first_signal(current->sigpending.pending_mask & mask);
+    if (signum)
+        kernel_peek_pending_sig(signum, siginfo);
+    restore_flags(flags);
+
+    return signum;
+}
+
+/*
+ *   flush_signals
+ *   DESCRIPTION: drop every pending signal of a task
+ *   INPUTS: struct task_struct *task
+ */
+void flush_signals(struct task_struct *task) {
+    uint16_t signum;
+    for (signum = 1; signum < NSIG; signum++) {
+        while (task->sigpending.queue[signum])
+            sigqueue_pop(&task->sigpending, signum, NULL);
+    }
+    task->sigpending.pending_mask = 0;
+    task->sigpending.forced_mask = 0;
+}
+
+static void set_sigmask(uint64_t newmask) {
     current->sigpending.blocked_mask = newmask & ~SIG_UNMASKABLE;
 }
 
@@ -359,6 +496,94 @@ static const struct {
     0x80cd,        /* int $0x80 */
 };
 
+// source: <uapi/asm-generic/ucontext.h>
+struct ucontext {
+    uint32_t uc_flags;
+    struct ucontext *uc_link;
+    struct {
+        void *ss_sp;
+        int ss_flags;
+        uint32_t ss_size;
+    } uc_stack;
+    struct sigcontext uc_mcontext;
+    uint64_t uc_sigmask;
+};
+
+// source: "arch/x86/include/asm/sigframe.h"
+struct rt_sigframe {
+    void *pretcode;
+    int sig;
+    struct siginfo *pinfo;
+    void *puc;
+    struct siginfo info;
+    struct ucontext uc;
+    // char retcode[8];
+    uint64_t retcode;
+};
+
+static const struct {
+    uint8_t movl;
+    uint32_t val;
+    uint16_t int80;
+    uint8_t pad;
+} __attribute__((packed)) rt_retcode = {
+    0xb8,          /* movl $..., %eax */
+    NR_LINUX_rt_sigreturn,
+    0x80cd,        /* int $0x80 */
+    0,
+};
+
+static void setup_sigcontext(struct sigcontext *sc, struct intr_info *regs, uint32_t saved_esp, uint64_t mask) {
+    *sc = (struct sigcontext){
+        .gs  = regs->gs,
+        .fs  = regs->fs,
+        .es  = regs->es,
+        .ds  = regs->ds,
+        .edi = regs->edi,
+        .esi = regs->esi,
+        .ebp = regs->ebp,
+        .esp = regs->intr_esp,
+        .ebx = regs->ebx,
+        .edx = regs->edx,
+        .ecx = regs->ecx,
+        .eax = regs->eax,
+        .trapno = regs->intr_num,
+        .err    = regs->error_code,
+        .eip    = regs->eip,
+        .cs     = regs->cs,
+        .eflags = regs->eflags,
+        .esp_at_signal = saved_esp,
+        .ss  = regs->ss,
+        // .struct _fpstate *fpstate = regs->struct,
+        .oldmask = mask,
+        // .cr2 = regs->cr2,
+    };
+}
+
+// The eflags a signal handler may hand back; IF, IOPL, NT and VM stay as
+// they are in the frame we entered with. source: FIX_EFLAGS in Linux
+#define FIX_EFLAGS (CF | PF | AF | ZF | SF | TF | DF | OF | RF | AC)
+
+static void restore_sigcontext(struct intr_info *regs, const struct sigcontext *sc) {
+    regs->ebx    = sc->ebx;
+    regs->ecx    = sc->ecx;
+    regs->edx    = sc->edx;
+    regs->esi    = sc->esi;
+    regs->edi    = sc->edi;
+    regs->ebp    = sc->ebp;
+    regs->eax    = sc->eax;
+    regs->eip    = sc->eip;
+    regs->eflags = (regs->eflags & ~FIX_EFLAGS) | (sc->eflags & FIX_EFLAGS) | IF;
+    regs->esp    = sc->esp_at_signal;
+    regs->ss     = sc->ss;
+    regs->ds     = sc->ds;
+    regs->es     = sc->es;
+    regs->fs     = sc->fs;
+    regs->gs     = sc->gs;
+
+    // FIXME: Bad regs here can cause a panic
+}
+
 struct sigframe test;
 
 void deliver_signal(struct intr_info *regs) {
@@ -368,8 +593,20 @@ void deliver_signal(struct intr_info *regs) {
 
     bool is_fatal = signal_is_fatal(current, signum);
 
-    current->sigpending.pending_mask &= ~MASKVAL(signum);
-    current->sigpending.forced_mask &= ~MASKVAL(signum);
+    struct siginfo siginfo;
+    sigqueue_pop(&current->sigpending, signum, &siginfo);
+
+    // a tracer sees every signal but SIGKILL first, and picks what to deliver
+    if (current->tracer && signum != SIGKILL) {
+        uint16_t newsig = ptrace_stop(signum, regs);
+        if (!newsig)
+            return;
+        if (newsig != signum) {
+            signum = newsig;
+            is_fatal = MASKVAL(signum) & SIG_UNMASKABLE;
+            siginfo = (struct siginfo){ .signo = signum, .code = SI_USER };
+        }
+    }
 
     struct sigaction *sigaction = &current->sigactions->sigactions[signum];
 
@@ -398,44 +635,51 @@ void deliver_signal(struct intr_info *regs) {
 
     switch (current->subsystem) {
     case SUBSYSTEM_LINUX: {
+        uint64_t blocked = current->sigpending.blocked_mask;
         uint32_t saved_esp = regs->esp;
-        if (push_userstack(regs, NULL, sizeof(struct sigframe)) < 0)
-            goto force_segv;
 
-        struct sigframe *sigframe = (void *)regs->esp;
-        *sigframe = (struct sigframe){
-            .pretcode = &sigframe->retcode,
-            .sig = signum,
-            .sc = {
-                .gs  = regs->gs,
-                .fs  = regs->fs,
-                .es  = regs->es,
-                .ds  = regs->ds,
-                .edi = regs->edi,
-                .esi = regs->esi,
-                .ebp = regs->ebp,
-                .esp = regs->intr_esp,
-                .ebx = regs->ebx,
-                .edx = regs->edx,
-                .ecx = regs->ecx,
-                .eax = regs->eax,
-                .trapno = regs->intr_num,
-                .err    = regs->error_code,
-                .eip    = regs->eip,
-                .cs     = regs->cs,
-                .eflags = regs->eflags,
-                .esp_at_signal = saved_esp,
-                .ss  = regs->ss,
-                // .struct _fpstate *fpstate = regs->struct,
-                .oldmask = current->sigpending.blocked_mask,
-                // .cr2 = regs->cr2,
-            },
-            .retcode = *(uint64_t *)&retcode,
-        };
-        if (sigaction->flags & SA_RESTORER)
-            sigframe->pretcode = sigaction->restorer;
+        if (sigaction->flags & SA_SIGINFO) {
+            if (push_userstack(regs, NULL, sizeof(struct rt_sigframe)) < 0)
+                goto force_segv;
+
+            struct rt_sigframe *frame = (void *)regs->esp;
+            *frame = (struct rt_sigframe){
+                .pretcode = &frame->retcode,
+                .sig = signum,
+                .pinfo = &frame->info,
+                .puc = &frame->uc,
+                .info = siginfo,
+                .uc.uc_sigmask = blocked,
+                .retcode = *(uint64_t *)&rt_retcode,
+            };
+            setup_sigcontext(&frame->uc.uc_mcontext, regs, saved_esp, blocked);
+            if (sigaction->flags & SA_RESTORER)
+                frame->pretcode = sigaction->restorer;
+
+            // for handlers built with regparm(3)
+            regs->edx = (uint32_t)&frame->info;
+            regs->ecx = (uint32_t)&frame->uc;
+        } else {
+            if (push_userstack(regs, NULL, sizeof(struct sigframe)) < 0)
+                goto force_segv;
+
+            struct sigframe *sigframe = (void *)regs->esp;
+            *sigframe = (struct sigframe){
+                .pretcode = &sigframe->retcode,
+                .sig = signum,
+                .extramask = { blocked >> 32 },
+                .retcode = *(uint64_t *)&retcode,
+            };
+            setup_sigcontext(&sigframe->sc, regs, saved_esp, blocked);
+            if (sigaction->flags & SA_RESTORER)
+                sigframe->pretcode = sigaction->restorer;
+        }
 
-        set_sigmask(sigaction->mask);
+        // the handler runs with the signal itself blocked, so a burst of
+        // real-time signals is handled one after another
+        if (!(sigaction->flags & SA_NODEFER))
+            blocked |= MASKVAL(signum);
+        set_sigmask(blocked | sigaction->mask);
         regs->eip = (uint32_t)sigaction->sigaction;
         regs->eax = signum;
         return;
@@ -537,17 +781,27 @@ DEFINE_SYSCALL2(ECE391, set_handler, int32_t, signum, void *, handler_address) {
     return 0;
 }
 
-DEFINE_SYSCALL3(LINUX, rt_sigaction, int, signum, const struct sigaction *, act, struct sigaction *, oldact) {
+DEFINE_SYSCALL4(LINUX, rt_sigaction, int, signum, const struct sigaction *, act, struct sigaction *, oldact,
+        uint32_t, sigsetsize) {
+    if (sigsetsize != sizeof(act->mask))
+        return -EINVAL;
     if (signum <= 0 || signum >= NSIG)
         return -EINVAL;
     if (signum == SIGKILL || signum == SIGSTOP)
         return -EINVAL;
 
-    if (safe_buf(oldact, sizeof(*oldact), false) == sizeof(*oldact))
-        *oldact = current->sigactions->sigactions[signum];
+    struct sigaction newact;
+    if (act) {
+        if (copy_from_user(&newact, act, sizeof(newact)))
+            return -EFAULT;
+        newact.mask &= ~(MASKVAL(SIGKILL) | MASKVAL(SIGSTOP));
+    }
 
-    if (safe_buf(act, sizeof(*act), false) == sizeof(*act))
-        current->sigactions->sigactions[signum] = *act;
+    if (oldact && copy_to_user(oldact, &current->sigactions->sigactions[signum], sizeof(*oldact)))
+        return -EFAULT;
+
+    if (act)
+        current->sigactions->sigactions[signum] = newact;
 
     return 0;
 }
@@ -556,26 +810,27 @@ DEFINE_SYSCALL_COMPLEX(ECE391, sigreturn, regs) {
     extern uint8_t ECE391_sigret_start;
     extern uint8_t ECE391_sigret_postint;
 
-    struct ece391_user_context *context = (void *)(regs->eip - (&ECE391_sigret_postint - &ECE391_sigret_start) - sizeof(struct ece391_user_context));
-    if (safe_buf(context, sizeof(*context), false) != sizeof(*context)) {
+    struct ece391_user_context *ucontext = (void *)(regs->eip - (&ECE391_sigret_postint - &ECE391_sigret_start) - sizeof(struct ece391_user_context));
+    struct ece391_user_context context;
+    if (copy_from_user(&context, ucontext, sizeof(context))) {
         force_sig(current, SIGSEGV);
         return;
     }
 
-    regs->ebx    = context->ebx;
-    regs->ecx    = context->ecx;
-    regs->edx    = context->edx;
-    regs->esi    = context->esi;
-    regs->edi    = context->edi;
-    regs->ebp    = context->ebp;
-    regs->eax    = context->eax;
-    regs->ds     = context->ds;
-    regs->es     = context->es;
-    regs->fs     = context->fs;
-    regs->eip    = context->eip;
-    regs->eflags = context->eflags;
-    regs->esp    = context->esp;
-    regs->ss     = context->ss;
+    regs->ebx    = context.ebx;
+    regs->ecx    = context.ecx;
+    regs->edx    = context.edx;
+    regs->esi    = context.esi;
+    regs->edi    = context.edi;
+    regs->ebp    = context.ebp;
+    regs->eax    = context.eax;
+    regs->ds     = context.ds;
+    regs->es     = context.es;
+    regs->fs     = context.fs;
+    regs->eip    = context.eip;
+    regs->eflags = (regs->eflags & ~FIX_EFLAGS) | (context.eflags & FIX_EFLAGS) | IF;
+    regs->esp    = context.esp;
+    regs->ss     = context.ss;
 
     // FIXME: Bad regs here can cause a panic
 
@@ -583,54 +838,56 @@ DEFINE_SYSCALL_COMPLEX(ECE391, sigreturn, regs) {
 }
 
 DEFINE_SYSCALL_COMPLEX(LINUX, sigreturn, regs) {
-    struct sigframe *context = (void *)(regs->eip - sizeof(struct sigframe));
-    if (safe_buf(context, sizeof(*context), false) != sizeof(*context)) {
+    struct sigframe *frame = (void *)(regs->eip - sizeof(struct sigframe));
+    // the fpstate in between is big and unused, so leave it in userspace
+    struct sigcontext sc;
+    unsigned long extramask;
+    if (copy_from_user(&sc, &frame->sc, sizeof(sc)) ||
+            get_user(extramask, &frame->extramask[0])) {
         force_sig(current, SIGSEGV);
         return;
     }
 
-    regs->ebx    = context->sc.ebx;
-    regs->ecx    = context->sc.ecx;
-    regs->edx    = context->sc.edx;
-    regs->esi    = context->sc.esi;
-    regs->edi    = context->sc.edi;
-    regs->ebp    = context->sc.ebp;
-    regs->eax    = context->sc.eax;
-    regs->ds     = context->sc.ds;
-    regs->es     = context->sc.es;
-    regs->fs     = context->sc.fs;
-    regs->eip    = context->sc.eip;
-    regs->eflags = context->sc.eflags;
-    regs->esp    = context->sc.esp_at_signal;
-    regs->ss     = context->sc.ss;
-    regs->ds     = context->sc.ds;
-    regs->es     = context->sc.es;
-    regs->fs     = context->sc.fs;
-    regs->gs     = context->sc.gs;
-
-    set_sigmask(context->sc.oldmask);
+    restore_sigcontext(regs, &sc);
+    set_sigmask(sc.oldmask | (uint64_t)extramask << 32);
+}
 
-    // FIXME: Bad regs here can cause a panic
+DEFINE_SYSCALL_COMPLEX(LINUX, rt_sigreturn, regs) {
+    // the handler returned by popping pretcode
+    struct rt_sigframe *uframe = (void *)(regs->esp - sizeof(uframe->pretcode));
+    struct rt_sigframe frame;
+    if (copy_from_user(&frame, uframe, sizeof(frame))) {
+        force_sig(current, SIGSEGV);
+        return;
+    }
 
-    return;
+    restore_sigcontext(regs, &frame.uc.uc_mcontext);
+    set_sigmask(frame.uc.uc_sigmask);
 }
 
-DEFINE_SYSCALL4(LINUX, rt_sigprocmask, int, how, const uint32_t *, set, uint32_t *, oldset, uint32_t, sigsetsize) {
-    if (safe_buf(oldset, sizeof(*oldset), false) == sizeof(*oldset))
-        *oldset = current->sigpending.blocked_mask;
+DEFINE_SYSCALL4(LINUX, rt_sigprocmask, int, how, const uint64_t *, set, uint64_t *, oldset, uint32_t, sigsetsize) {
+    if (sigsetsize != sizeof(*set))
+        return -EINVAL;
 
-    if (safe_buf(set, sizeof(*set), false) == sizeof(*set)) {
-        uint32_t curset = current->sigpending.blocked_mask;
+    uint64_t newset;
+    if (set && copy_from_user(&newset, set, sizeof(newset)))
+        return -EFAULT;
+
+    if (oldset && copy_to_user(oldset, &current->sigpending.blocked_mask, sizeof(*oldset)))
+        return -EFAULT;
+
+    if (set) {
+        uint64_t curset = current->sigpending.blocked_mask;
 
         switch (how) {
         case SIG_BLOCK:
-            curset |= *set;
+            curset |= newset;
             break;
         case SIG_UNBLOCK:
-            curset &= ~*set;
+            curset &= ~newset;
             break;
         case SIG_SETMASK:
-            curset = *set;
+            curset = newset;
             break;
         default:
             return -EINVAL;
@@ -642,8 +899,104 @@ DEFINE_SYSCALL4(LINUX, rt_sigprocmask, int, how, const uint32_t *, set, uint32_t
     return 0;
 }
 
+DEFINE_SYSCALL2(LINUX, rt_sigpending, uint64_t *, set, uint32_t, sigsetsize) {
+    if (sigsetsize != sizeof(*set))
+        return -EINVAL;
+
+    uint64_t pending = current->sigpending.pending_mask & current->sigpending.blocked_mask;
+    if (copy_to_user(set, &pending, sizeof(pending)))
+        return -EFAULT;
+    return 0;
+}
+
+DEFINE_SYSCALL3(LINUX, rt_sigqueueinfo, int32_t, pid, int, signum, struct siginfo *, uinfo) {
+    struct siginfo siginfo;
+    if (copy_from_user(&siginfo, uinfo, sizeof(siginfo)))
+        return -EFAULT;
+
+    if (signum <= 0 || signum >= NSIG)
+        return -EINVAL;
+
+    // only the kernel may claim to be kill or the kernel, except to oneself
+    if ((siginfo.code >= 0 || siginfo.code == SI_TKILL) && pid != current->pid)
+        return -EPERM;
+
+    siginfo.signo = signum;
+
+    struct task_struct *task = get_task_from_pid(pid);
+    if (IS_ERR(task))
+        return PTR_ERR(task);
+
+    return send_sig_info(task, &siginfo);
+}
+
+DEFINE_SYSCALL4(LINUX, rt_sigtimedwait, const uint64_t *, uthese, struct siginfo *, uinfo,
+        const struct timespec *, uts, uint32_t, sigsetsize) {
+    if (sigsetsize != sizeof(*uthese))
+        return -EINVAL;
+
+    uint64_t these;
+    if (copy_from_user(&these, uthese, sizeof(these)))
+        return -EFAULT;
+    // SIGKILL and SIGSTOP can't be waited for
+    these &= ~(MASKVAL(SIGKILL) | MASKVAL(SIGSTOP));
+
+    struct timespec ts;
+    if (uts) {
+        if (copy_from_user(&ts, uts, sizeof(ts)))
+            return -EFAULT;
+        if (ts.nsec >= NSEC)
+            return -EINVAL;
+    }
+
+    struct sleep_spec *sleep_spec = NULL;
+    struct siginfo siginfo;
+    int32_t res;
+
+    while (true) {
+        res = dequeue_signal(these, &siginfo);
+        if (res)
+            break;
+
+        if (signal_pending(current)) {
+            res = -EINTR;
+            break;
+        }
+
+        if (uts) {
+            if (!sleep_spec) {
+                if (!ts.sec && !ts.nsec) {
+                    res = -EAGAIN;
+                    break;
+                }
+                sleep_spec = sleep_add(&ts);
+                if (IS_ERR(sleep_spec)) {
+                    res = PTR_ERR(sleep_spec);
+                    sleep_spec = NULL;
+                    break;
+                }
+            } else if (sleep_hashit(sleep_spec)) {
+                res = -EAGAIN;
+                break;
+            }
+        }
+
+        current->state = TASK_INTERRUPTIBLE;
+        schedule();
+        current->state = TASK_RUNNING;
+    }
+
+    if (sleep_spec)
+        sleep_finalize(sleep_spec);
+
+    if (res > 0 && uinfo && copy_to_user(uinfo, &siginfo, sizeof(siginfo)))
+        return -EFAULT;
+
+    return res;
+}
+
 DEFINE_SYSCALL2(LINUX, kill, int32_t, pid, uint32_t, signum) {
-    if (signum > NSIG)
+    if (signum >= NSIG)
         return -EINVAL;
 
     struct siginfo siginfo = {
@@ -663,10 +1016,19 @@ DEFINE_SYSCALL2(LINUX, kill, int32_t, pid, uint32_t, signum) {
         else // pid == 0
             pgid = current->pgid;
 
+        // Only kill(-1) has to go through every task
+        struct list *list = &tasks;
+        if (pgid) {
+            struct pgrp *pgrp = find_pgrp(pgid);
+            if (!pgrp)
+                return -ESRCH;
+            list = &pgrp->members;
+        }
+
         struct list_node *node;
-        list_for_each(&tasks, node) {
+        list_for_each(list, node) {
             struct task_struct *task = node->value;
-            if ((!pgid && task->pid > 1) || task->pgid == pgid) {
+            if (pgid || task->pid > 1) {
                 hashit = true;
                 if (signum)
                     send_sig_info(task, &siginfo);
@@ -688,7 +1050,7 @@ DEFINE_SYSCALL2(LINUX, kill, int32_t, pid, uint32_t, signum) {
 }
 
 DEFINE_SYSCALL3(LINUX, tgkill, int32_t, tgid, int32_t, tid, uint32_t, signum) {
-    if (signum > NSIG)
+    if (signum >= NSIG)
         return -EINVAL;
 
     if (tid != tgid)
@@ -709,3 +1071,87 @@ DEFINE_SYSCALL3(LINUX, tgkill, int32_t, tgid, int32_t, tid, uint32_t, signum) {
 
     return 0;
 }
+
+#include "../tests.h"
+#if RUN_TESTS
+#define SIGNAL_TEST_MASK (MASKVAL(SIGUSR1) | MASKVAL(SIGUSR2) | \
+    MASKVAL(SIGRTMIN) | MASKVAL(SIGRTMIN + 1) | MASKVAL(SIGRTMIN + 2))
+
+static int32_t signal_test_send(uint16_t signum, int value) {
+    struct siginfo siginfo = {
+        .signo = signum,
+        .code = SI_QUEUE,
+        .sifields.rt = {
+            .pid = current->pid,
+            .sigval.sival_int = value,
+        },
+    };
+    return send_sig_info(current, &siginfo);
+}
+
+/* Signal queue tests
+ *
+ * Asserts that real-time signals queue in order with their values up to
+ * SIGQUEUE_MAX, that standard signals coalesce, and that the lowest
+ * numbered pending signal is taken first, and that peeking leaves it there
+ * Coverage: send_sig_info, dequeue_signal, peek_signal, sigqueue
+ */
+__testfunc
+static void signal_queue_test() {
+    struct siginfo siginfo;
+    uint64_t oldmask = current->sigpending.blocked_mask;
+    uint32_t i;
+
+    // keep them pending, and from anything else pending
+    set_sigmask(oldmask | SIGNAL_TEST_MASK);
+    while (dequeue_signal(SIGNAL_TEST_MASK, &siginfo));
+
+    for (i = 0; i < 4; i++)
+        TEST_ASSERT(!signal_test_send(SIGRTMIN + 1, i));
+    for (i = 0; i < 4; i++) {
+        TEST_ASSERT(dequeue_signal(MASKVAL(SIGRTMIN + 1), &siginfo) == SIGRTMIN + 1);
+        TEST_ASSERT(siginfo.code == SI_QUEUE);
+        TEST_ASSERT(siginfo.sifields.rt.sigval.sival_int == i);
+    }
+    TEST_ASSERT(!dequeue_signal(MASKVAL(SIGRTMIN + 1), &siginfo));
+
+    TEST_ASSERT(!signal_test_send(SIGRTMIN + 1, 5));
+    TEST_ASSERT(!signal_test_send(SIGRTMIN + 1, 6));
+    TEST_ASSERT(peek_signal(SIGNAL_TEST_MASK, &siginfo) == SIGRTMIN + 1);
+    TEST_ASSERT(siginfo.sifields.rt.sigval.sival_int == 5);
+    TEST_ASSERT(peek_signal(SIGNAL_TEST_MASK, &siginfo) == SIGRTMIN + 1);
+    TEST_ASSERT(siginfo.sifields.rt.sigval.sival_int == 5);
+    TEST_ASSERT(dequeue_signal(SIGNAL_TEST_MASK, &siginfo) == SIGRTMIN + 1);
+    TEST_ASSERT(siginfo.sifields.rt.sigval.sival_int == 5);
+    TEST_ASSERT(dequeue_signal(SIGNAL_TEST_MASK, &siginfo) == SIGRTMIN + 1);
+    TEST_ASSERT(siginfo.sifields.rt.sigval.sival_int == 6);
+    TEST_ASSERT(!peek_signal(SIGNAL_TEST_MASK, &siginfo));
+
+    TEST_ASSERT(!signal_test_send(SIGUSR1, 1));
+    TEST_ASSERT(!signal_test_send(SIGUSR1, 2));
+    TEST_ASSERT(dequeue_signal(MASKVAL(SIGUSR1), &siginfo) == SIGUSR1);
+    TEST_ASSERT(siginfo.sifields.rt.sigval.sival_int == 1);
+    TEST_ASSERT(!dequeue_signal(MASKVAL(SIGUSR1), &siginfo));
+
+    TEST_ASSERT(!signal_test_send(SIGRTMIN + 2, 0));
+    TEST_ASSERT(!signal_test_send(SIGRTMIN, 0));
+    TEST_ASSERT(!signal_test_send(SIGUSR2, 0));
+    TEST_ASSERT(dequeue_signal(SIGNAL_TEST_MASK, &siginfo) == SIGUSR2);
+    TEST_ASSERT(dequeue_signal(SIGNAL_TEST_MASK, &siginfo) == SIGRTMIN);
+    TEST_ASSERT(dequeue_signal(SIGNAL_TEST_MASK, &siginfo) == SIGRTMIN + 2);
+    TEST_ASSERT(!dequeue_signal(SIGNAL_TEST_MASK, &siginfo));
+
+    // other signals may hold some of the queue already
+    for (i = 0; i <= SIGQUEUE_MAX; i++) {
+        if (signal_test_send(SIGRTMIN, i) == -EAGAIN)
+            break;
+    }
+    TEST_ASSERT(i <= SIGQUEUE_MAX);
+    TEST_ASSERT(current->sigpending.nr_queued == SIGQUEUE_MAX);
+    TEST_ASSERT(signal_test_send(SIGRTMIN, 0) == -EAGAIN);
+
+    while (dequeue_signal(SIGNAL_TEST_MASK, &siginfo));
+    set_sigmask(oldmask);
+}
+DEFINE_TEST(signal_queue_test);
+#endif
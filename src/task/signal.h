@@ -41,6 +41,10 @@
 #define SIGSYS    31
 #define SIGUNUSED 31
 
+// Real-time signals queue every instance, standard signals at most one
+#define SIGRTMIN  32
+#define SIGRTMAX  64
+
 #define SA_NOCLDSTOP 0x00000001u
 #define SA_NOCLDWAIT 0x00000002u
 #define SA_SIGINFO   0x00000004u
@@ -56,6 +60,8 @@
 
 #define SI_USER   0    /* sent by kill, sigsend, raise */
 #define SI_KERNEL 0x80 /* sent by the kernel from somewhere */
+#define SI_QUEUE  -1   /* sent by sigqueue */
+#define SI_TKILL  -6   /* sent by tkill system call */
 
 #define CLD_EXITED  1   /* child has exited */
 #define CLD_KILLED  2   /* child was killed */
@@ -75,13 +81,17 @@
 #define SIG_ECE391_ALARM     3
 #define SIG_ECE391_USER1     4
 
-#define MASKVAL(signum) (1 << (signum))
+// the bit of a signal in a sigset, as laid out by Linux
+#define MASKVAL(signum) (1ULL << ((signum) - 1))
 
 // source: <asm/signal.h>
 
 #define SIG_UNMASKABLE (MASKVAL(SIGKILL) | MASKVAL(SIGSTOP) | MASKVAL(SIGCONT))
 
-#define NSIG 32
+#define NSIG (SIGRTMAX + 1)
+
+// most real-time signals queued to a task at once, like RLIMIT_SIGPENDING
+#define SIGQUEUE_MAX 64
 
 #ifdef ASM
 
@@ -96,7 +106,6 @@
 
 #include "../lib/stdint.h"
 #include "../lib/stdbool.h"
-#include "../structure/array.h"
 #include "../atomic.h"
 
 // source : <asm-generic/siginfo.h>
@@ -165,22 +174,31 @@ struct siginfo {
 struct task_struct;
 struct intr_info;
 
+// the kernel_sigaction of rt_sigaction on i386
 struct sigaction {
     // union {
     //     void (*handler)(int);
     //     void (*sigaction)(int, struct siginfo *, void *);
     // } _u9;
     void *sigaction;
-    uint32_t mask;
     uint32_t flags;
     void (*restorer)(void);
+    uint64_t mask;
+};
+
+struct sigqueue {
+    struct sigqueue *next;
+    struct siginfo info;
 };
 
 struct sigpending {
-    uint32_t blocked_mask;
-    uint32_t pending_mask;
-    uint32_t forced_mask;
-    struct array siginfos;
+    uint64_t blocked_mask;
+    uint64_t pending_mask;
+    uint64_t forced_mask;
+    uint32_t nr_queued;
+    // A circular list per signal, pointing at the newest entry. A pending
+    // signal with an empty queue ran out of memory and has a default siginfo
+    struct sigqueue *queue[NSIG];
 };
 
 struct sigactions {
@@ -188,12 +206,12 @@ struct sigactions {
     struct sigaction sigactions[NSIG];
 };
 
-uint32_t fatal_signal_pending(struct task_struct *task);
-uint32_t signal_pending(struct task_struct *task);
+uint64_t fatal_signal_pending(struct task_struct *task);
+uint64_t signal_pending(struct task_struct *task);
 uint16_t signal_pending_one(struct task_struct *task);
 bool signal_is_fatal(struct task_struct *task, uint16_t signum);
 
-void send_sig_info(struct task_struct *task, struct siginfo *siginfo);
+int32_t send_sig_info(struct task_struct *task, struct siginfo *siginfo);
 void force_sig_info(struct task_struct *task, struct siginfo *siginfo);
 
 void send_sig(struct task_struct *task, uint16_t signum);
@@ -208,6 +226,10 @@ bool kernel_sig_ispending(uint16_t signum);
 bool kernel_peek_pending_sig(uint16_t signum, struct siginfo *siginfo);
 bool kernel_get_pending_sig(uint16_t signum, struct siginfo *siginfo);
 
+uint16_t dequeue_signal(uint64_t mask, struct siginfo *siginfo);
+uint16_t peek_signal(uint64_t mask, struct siginfo *siginfo);
+void flush_signals(struct task_struct *task);
+
 void deliver_signal(struct intr_info *regs);
 
 #endif
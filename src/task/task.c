@@ -4,23 +4,42 @@
 #include "tls.h"
 #include "fp.h"
 #include "../syscall.h"
+#include "../lib/bsr.h"
 #include "../err.h"
 #include "../errno.h"
 
 struct list tasks;
 LIST_STATIC_INIT(tasks);
 
-// get the pid of a process
+// Tasks are looked up by pid through a chained hash, and pids are handed
+// out from a bitmap, so neither has to walk the task list
+#define PID_HASH_SIZE 256
+#define PID_MAP_WORDS ((MAXPID + 1 + 31) / 32)
+
+static struct task_struct *pid_hash[PID_HASH_SIZE];
+// pid 0 is the swapper and is never handed out
+static uint32_t pid_map[PID_MAP_WORDS] = { 1 };
+static uint16_t last_pid;
+
+uint32_t nr_ece391_tasks;
+
+static inline uint32_t pid_hashfn(uint16_t pid) {
+    return pid % PID_HASH_SIZE;
+}
+
+/*
+ *   get_task_from_pid
+ *   DESCRIPTION: find the task with a pid
+ *   INPUTS: uint16_t pid
+ *   RETURN VALUE: the task, or ERR_PTR(-ESRCH)
+ */
 struct task_struct *get_task_from_pid(uint16_t pid) {
     // check if pid exceeds the upper limit
     if (pid > MAXPID)
         return ERR_PTR(-ESRCH);
 
-    // check each element in the task list and find the one that matches the
-    // specified pid
-    struct list_node *node;
-    list_for_each(&tasks, node) {
-        struct task_struct *task = node->value;
+    struct task_struct *task;
+    for (task = pid_hash[pid_hashfn(pid)]; task; task = task->pid_hash_next) {
         if (task->pid == pid)
             return task;
     }
@@ -29,6 +48,91 @@ struct task_struct *get_task_from_pid(uint16_t pid) {
     return ERR_PTR(-ESRCH);
 }
 
+// find a clear bit in pid_map in [start, end], or return 0
+static uint16_t find_free_pid(uint32_t start, uint32_t end) {
+    uint32_t pid = start;
+    while (pid <= end) {
+        // mask off the bits below the starting point in the first word
+        uint32_t free = ~pid_map[pid / 32] & (~0U << (pid % 32));
+        if (free) {
+            pid = (pid & ~31) + bsf(free);
+            return pid <= end ? pid : 0;
+        }
+        pid = (pid & ~31) + 32;
+    }
+    return 0;
+}
+
+/*
+ *   alloc_pid
+ *   DESCRIPTION: reserve the next free pid, circularly. Once MAXPID is
+ *                reached, allocation restarts from LOOPPID.
+ *   RETURN VALUE: the pid, or 0 if all are in use
+ */
+uint16_t alloc_pid(void) {
+    unsigned long flags;
+    cli_and_save(flags);
+
+    uint16_t pid = find_free_pid(last_pid + 1, MAXPID);
+    if (!pid)
+        pid = find_free_pid(LOOPPID, last_pid);
+    if (pid) {
+        pid_map[pid / 32] |= 1U << (pid % 32);
+        last_pid = pid;
+    }
+
+    restore_flags(flags);
+    return pid;
+}
+
+/*
+ *   free_pid
+ *   DESCRIPTION: release a pid from alloc_pid
+ *   INPUTS: uint16_t pid
+ */
+void free_pid(uint16_t pid) {
+    unsigned long flags;
+    cli_and_save(flags);
+    pid_map[pid / 32] &= ~(1U << (pid % 32));
+    restore_flags(flags);
+}
+
+/*
+ *   hash_task
+ *   DESCRIPTION: make a task findable by get_task_from_pid
+ *   INPUTS: struct task_struct *task
+ */
+void hash_task(struct task_struct *task) {
+    unsigned long flags;
+    cli_and_save(flags);
+
+    struct task_struct **head = &pid_hash[pid_hashfn(task->pid)];
+    task->pid_hash_next = *head;
+    *head = task;
+
+    restore_flags(flags);
+}
+
+/*
+ *   unhash_task
+ *   DESCRIPTION: remove a task from the pid hash
+ *   INPUTS: struct task_struct *task
+ */
+void unhash_task(struct task_struct *task) {
+    unsigned long flags;
+    cli_and_save(flags);
+
+    struct task_struct **prevp;
+    for (prevp = &pid_hash[pid_hashfn(task->pid)]; *prevp; prevp = &(*prevp)->pid_hash_next) {
+        if (*prevp == task) {
+            *prevp = task->pid_hash_next;
+            break;
+        }
+    }
+
+    restore_flags(flags);
+}
+
 asmlinkage
 void return_to_userspace(struct intr_info *info) {
     deliver_signal(info);
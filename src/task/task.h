@@ -7,11 +7,13 @@
 #include "../lib/stdbool.h"
 #include "../lib/string.h"
 #include "../mm/paging.h"
+#include "../mm/scratch.h"
 #include "../compiler.h"
 #include "../interrupt.h"
 #include "../structure/list.h"
 #include "../structure/array.h"
 #include "../vfs/file.h"
+#include "../vfs/fdtable.h"
 #include "../x86_desc.h"
 #include "../panic.h"
 #include "../atomic.h"
@@ -27,13 +29,6 @@ struct mm_struct {
     page_directory_t *page_directory;
 };
 
-struct files_struct {
-    atomic_t refcount;
-    struct array files;
-    // This is a hack, but I'm too lazy to manage the array within array files
-    struct array cloexec;
-};
-
 enum task_state {
     TASK_RUNNING,
     TASK_INTERRUPTIBLE,
@@ -51,6 +46,8 @@ enum subsystem {
 struct task_struct {
     uint16_t pid;
     uint16_t ppid;
+    struct task_struct *parent;
+    struct list children;
     char comm[16];
     struct mm_struct *mm;
     struct files_struct *files;
@@ -63,13 +60,23 @@ struct task_struct {
     tls_seg_t ldt;
     tls_seg_t gdt_tls;
     fxsave_data_t *fxsave_data;
+    struct scratch scratch;
     struct intr_info *entry_regs;  // for kernel execve
     struct intr_info *return_regs; // for scheduler
+    int *clear_child_tid;          // zeroed and futex-woken at exit
+    struct task_struct *tracer;    // see ptrace.h
+    uint32_t ptrace;
+    bool ptrace_stopped;
+    int ptrace_stopcode;           // wait status the tracer has yet to see
+    uint16_t ptrace_resume_sig;
+    int32_t ptrace_orig_eax;
+    struct intr_info *ptrace_regs;
     enum task_state state;
     bool wakeup_current;
     bool stopped;
     enum subsystem subsystem;
     int exitcode;
+    struct task_struct *pid_hash_next;
 };
 
 #define TASK_STACK_PAGES_POW 2  // each task has 4 (1<<2) pages for kernel stack
@@ -107,6 +114,17 @@ extern struct list tasks;
 
 struct task_struct *get_task_from_pid(uint16_t pid);
 
+// number of ECE391 userspace processes, limited by do_execve
+extern uint32_t nr_ece391_tasks;
+static inline bool task_is_ece391_user(struct task_struct *task) {
+    return task->mm && task->subsystem == SUBSYSTEM_ECE391;
+}
+
+uint16_t alloc_pid(void);
+void free_pid(uint16_t pid);
+void hash_task(struct task_struct *task);
+void unhash_task(struct task_struct *task);
+
 static inline void set_current_comm(char *newcomm) {
     strncpy(current->comm, newcomm, sizeof(current->comm) - 1);
 }
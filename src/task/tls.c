@@ -1,6 +1,7 @@
 #include "tls.h"
 #include "task.h"
 #include "../lib/string.h"
+#include "../mm/uaccess.h"
 #include "../syscall.h"
 #include "../errno.h"
 
@@ -56,11 +57,21 @@ int32_t do_set_thread_area(struct user_desc * u_info) {
 }
 
 DEFINE_SYSCALL1(LINUX, set_thread_area, struct user_desc *, u_info) {
-    uint32_t nbytes = safe_buf(u_info, sizeof(*u_info), true);
-    if (nbytes != sizeof(*u_info))
+    struct user_desc desc;
+    int32_t res;
+
+    if (copy_from_user(&desc, u_info, sizeof(desc)))
         return -EFAULT;
 
-    return do_set_thread_area(u_info);
+    res = do_set_thread_area(&desc);
+    if (res < 0)
+        return res;
+
+    // tell the caller which entry it got
+    if (put_user(desc.entry_number, &u_info->entry_number))
+        return -EFAULT;
+
+    return 0;
 }
 
 void load_tls(void) {
@@ -1,17 +1,19 @@
 #include "userstack.h"
 #include "../lib/string.h"
-#include "../mm/paging.h"
+#include "../mm/uaccess.h"
 #include "../errno.h"
 
 int32_t push_userstack(struct intr_info *regs, const void *data, uint32_t size) {
     char *esp = (void *)regs->esp;
     esp -= size;
 
-    if (safe_buf(esp, size, true) != size)
-        return -EFAULT;
-
-    if (data)
-        memcpy(esp, data, size);
+    if (data) {
+        if (copy_to_user(esp, data, size))
+            return -EFAULT;
+    } else {
+        if (safe_buf(esp, size, true) != size)
+            return -EFAULT;
+    }
     regs->esp = (uint32_t)esp;
 
     return 0;
@@ -0,0 +1,54 @@
+#include "vdso.h"
+#include "../time/vvar.h"
+#include "../mm/paging.h"
+#include "../lib/string.h"
+#include "../syscall.h"
+#include "../initcall.h"
+#include "../panic.h"
+#include "../errno.h"
+
+// function prototypes don't matter here
+extern unsigned char vdso_start[], vdso_end[];
+extern unsigned char vsyscall_int80[], vsyscall_sysenter[], sysenter_return[];
+
+#define VDSO_SYM(sym) (VDSO_ADDR + ((sym) - vdso_start))
+
+uint32_t vdso_sysenter_return;
+
+/*  map_vdso
+ *  DESCRIPTION: map a read-only copy of the vDSO, and the vvar page it reads
+ *               the time from, into the current process
+ *  INPUTS: none
+ *  OUTPUTS: none
+ *  RETURN VALUE: 0 on success, or negative errno
+ */
+int32_t map_vdso(void) {
+    if (!request_pages((void *)VDSO_ADDR, 1, GFP_USER))
+        return -ENOMEM;
+
+    memcpy((void *)VDSO_ADDR, vdso_start, vdso_end - vdso_start);
+    protect_pages((void *)VDSO_ADDR, 1, GFP_USER);
+
+    if (!map_shared_page((void *)VVAR_ADDR, vvar, GFP_USER | GFP_RO))
+        return -ENOMEM;
+    return 0;
+}
+
+/*  vdso_vsyscall
+ *  DESCRIPTION: the __kernel_vsyscall to hand to userspace in AT_SYSINFO
+ *  INPUTS: none
+ *  OUTPUTS: none
+ *  RETURN VALUE: its address in the mapped vDSO
+ */
+uint32_t vdso_vsyscall(void) {
+    return sysenter_enabled ? VDSO_SYM(vsyscall_sysenter) : VDSO_SYM(vsyscall_int80);
+}
+
+static void init_vdso() {
+    // it has to fit in the page before the vvar page
+    if (vdso_end - vdso_start > VVAR_ADDR - VDSO_ADDR)
+        BUG();
+
+    vdso_sysenter_return = VDSO_SYM(sysenter_return);
+}
+DEFINE_INITCALL(init_vdso, early);
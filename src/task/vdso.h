@@ -0,0 +1,20 @@
+#ifndef _VDSO_H
+#define _VDSO_H
+
+// right above the stack of Linux processes
+#define VDSO_ADDR (2U << 30)
+// the vvar page, right after the vDSO
+#define VVAR_ADDR (VDSO_ADDR + 0x1000)
+
+#ifndef ASM
+
+#include "../lib/stdint.h"
+
+// where SYSEXIT returns to in the vDSO, used by the SYSENTER entry
+extern uint32_t vdso_sysenter_return;
+
+int32_t map_vdso(void);
+uint32_t vdso_vsyscall(void);
+
+#endif
+#endif
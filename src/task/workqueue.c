@@ -0,0 +1,396 @@
+#include "workqueue.h"
+#include "kthread.h"
+#include "sched.h"
+#include "../drivers/rtc.h"
+#include "../time/uptime.h"
+#include "../mm/kmalloc.h"
+#include "../lib/cli.h"
+#include "../lib/string.h"
+#include "../initcall.h"
+#include "../panic.h"
+#include "../err.h"
+#include "../errno.h"
+
+#define WORKQUEUE_INIT(wq, _name) { .name = _name, .tail = &(wq).head }
+
+static struct workqueue_struct system_wq_struct = WORKQUEUE_INIT(system_wq_struct, "events");
+struct workqueue_struct *system_wq = &system_wq_struct;
+
+// delayed work waiting on its timer, soonest first
+static struct delayed_work *delayed_work_timers;
+
+/*  insert_work
+ *  DESCRIPTION: link a work item into a queue after pos and kick the
+ *               worker, called with interrupts off
+ *  INPUTS: struct workqueue_struct *wq, struct work_struct *work,
+ *          struct work_struct **pos -- the link to insert at
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+static void insert_work(struct workqueue_struct *wq, struct work_struct *work, struct work_struct **pos) {
+    work->wq = wq;
+    work->next = *pos;
+    *pos = work;
+    if (wq->tail == pos)
+        wq->tail = &work->next;
+
+    if (wq->worker)
+        wake_up_process(wq->worker);
+}
+
+// find the link to a queued work item, called with interrupts off
+static struct work_struct **find_work(struct workqueue_struct *wq, struct work_struct *work) {
+    struct work_struct **pp;
+    for (pp = &wq->head; *pp; pp = &(*pp)->next) {
+        if (*pp == work)
+            return pp;
+    }
+    return NULL;
+}
+
+// unlink a queued work item, called with interrupts off
+static bool unlink_work(struct workqueue_struct *wq, struct work_struct *work) {
+    struct work_struct **pp = find_work(wq, work);
+    if (!pp)
+        return false;
+
+    *pp = work->next;
+    if (wq->tail == &work->next)
+        wq->tail = pp;
+    return true;
+}
+
+/*  queue_work
+ *  DESCRIPTION: queue a work item, unless it is already pending. Safe to
+ *               call from interrupts
+ *  INPUTS: struct workqueue_struct *wq, struct work_struct *work
+ *  OUTPUTS: none
+ *  RETURN VALUE: true if queued, false if it was already pending
+ */
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work) {
+    if (test_and_set_bit(WORK_STRUCT_PENDING, &work->flags))
+        return false;
+
+    unsigned long flags;
+    cli_and_save(flags);
+    insert_work(wq, work, wq->tail);
+    restore_flags(flags);
+    return true;
+}
+
+/*  queue_delayed_work
+ *  DESCRIPTION: queue a work item after a delay, unless it is already
+ *               pending. Safe to call from interrupts
+ *  INPUTS: struct workqueue_struct *wq, struct delayed_work *dwork,
+ *          uint32_t msecs
+ *  OUTPUTS: none
+ *  RETURN VALUE: true if queued, false if it was already pending
+ */
+bool queue_delayed_work(struct workqueue_struct *wq, struct delayed_work *dwork, uint32_t msecs) {
+    if (!msecs)
+        return queue_work(wq, &dwork->work);
+
+    if (test_and_set_bit(WORK_STRUCT_PENDING, &dwork->work.flags))
+        return false;
+
+    struct timespec delay = {
+        .sec  = msecs / 1000,
+        .nsec = (msecs % 1000) * (NSEC / 1000),
+    };
+
+    unsigned long flags;
+    cli_and_save(flags);
+
+    dwork->work.wq = wq;
+    get_uptime(&dwork->expires);
+    timespec_add(&dwork->expires, &delay);
+
+    struct delayed_work **pp = &delayed_work_timers;
+    while (*pp && timespec_cmp(&(*pp)->expires, &dwork->expires) <= 0)
+        pp = &(*pp)->next;
+    dwork->next = *pp;
+    *pp = dwork;
+
+    restore_flags(flags);
+    return true;
+}
+
+// RTC tick, moves expired delayed work onto their queues
+static void delayed_work_timer(void) {
+    if (!delayed_work_timers)
+        return;
+
+    struct timespec now;
+    get_uptime(&now);
+
+    while (delayed_work_timers && timespec_cmp(&now, &delayed_work_timers->expires) >= 0) {
+        struct delayed_work *dwork = delayed_work_timers;
+        delayed_work_timers = dwork->next;
+        insert_work(dwork->work.wq, &dwork->work, dwork->work.wq->tail);
+    }
+}
+
+// unlink a delayed work item from the timers, called with interrupts off
+static bool unlink_delayed_work(struct delayed_work *dwork) {
+    struct delayed_work **pp;
+    for (pp = &delayed_work_timers; *pp; pp = &(*pp)->next) {
+        if (*pp == dwork) {
+            *pp = dwork->next;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct wq_barrier {
+    struct work_struct work;
+    struct task_struct *task;
+    volatile bool done;
+};
+
+static void wq_barrier_func(struct work_struct *work) {
+    struct wq_barrier *barrier = (void *)work;
+    barrier->done = true;
+    wake_up_process(barrier->task);
+}
+
+// queue a barrier at pos and sleep until the worker reaches it
+static void wait_on_barrier(struct workqueue_struct *wq, struct work_struct **pos, unsigned long flags) {
+    struct wq_barrier barrier = {
+        .work = { .func = &wq_barrier_func },
+        .task = current,
+    };
+
+    // the worker can't wait on itself
+    if (current == wq->worker)
+        BUG();
+
+    set_bit(WORK_STRUCT_PENDING, &barrier.work.flags);
+    insert_work(wq, &barrier.work, pos);
+    restore_flags(flags);
+
+    current->state = TASK_UNINTERRUPTIBLE;
+    while (!barrier.done)
+        schedule();
+    current->state = TASK_RUNNING;
+}
+
+/*  flush_work
+ *  DESCRIPTION: wait for a work item to finish its last queued run
+ *  INPUTS: struct work_struct *work
+ *  OUTPUTS: none
+ *  RETURN VALUE: true if it had to wait, false if the item was idle
+ */
+bool flush_work(struct work_struct *work) {
+    struct workqueue_struct *wq = work->wq;
+    unsigned long flags;
+    struct work_struct **pos;
+
+    if (!wq)
+        return false;
+
+    cli_and_save(flags);
+
+    if (work_pending(work) && find_work(wq, work)) {
+        // queued, so a barrier right behind it
+        pos = &work->next;
+    } else if (wq->current_work == work) {
+        // running, so a barrier ahead of everything else
+        pos = &wq->head;
+    } else {
+        // idle, or still waiting on its timer
+        restore_flags(flags);
+        return false;
+    }
+
+    wait_on_barrier(wq, pos, flags);
+    return true;
+}
+
+/*  flush_workqueue
+ *  DESCRIPTION: wait for every work item queued so far to finish
+ *  INPUTS: struct workqueue_struct *wq
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void flush_workqueue(struct workqueue_struct *wq) {
+    unsigned long flags;
+    cli_and_save(flags);
+    wait_on_barrier(wq, wq->tail, flags);
+}
+
+/*  cancel_work_sync
+ *  DESCRIPTION: unqueue a work item and wait for a running instance of it
+ *               to finish
+ *  INPUTS: struct work_struct *work
+ *  OUTPUTS: none
+ *  RETURN VALUE: true if it was pending
+ */
+bool cancel_work_sync(struct work_struct *work) {
+    unsigned long flags;
+    bool pending = false;
+
+    cli_and_save(flags);
+    if (work->wq && unlink_work(work->wq, work)) {
+        clear_bit(WORK_STRUCT_PENDING, &work->flags);
+        pending = true;
+    }
+    restore_flags(flags);
+
+    flush_work(work);
+    return pending;
+}
+
+/*  cancel_delayed_work_sync
+ *  DESCRIPTION: stop a delayed work item's timer or unqueue it, and wait
+ *               for a running instance of it to finish
+ *  INPUTS: struct delayed_work *dwork
+ *  OUTPUTS: none
+ *  RETURN VALUE: true if it was pending
+ */
+bool cancel_delayed_work_sync(struct delayed_work *dwork) {
+    unsigned long flags;
+    bool pending = false;
+
+    cli_and_save(flags);
+    if (unlink_delayed_work(dwork)) {
+        clear_bit(WORK_STRUCT_PENDING, &dwork->work.flags);
+        pending = true;
+    }
+    restore_flags(flags);
+
+    return cancel_work_sync(&dwork->work) || pending;
+}
+
+/*
+ *   worker_thread
+ *   DESCRIPTION: run the work items of a queue as they come
+ *   INPUTS: void *args -- the workqueue
+ */
+static int worker_thread(void *args) {
+    struct workqueue_struct *wq = args;
+    set_current_comm(wq->name);
+
+    while (1) {
+        unsigned long flags;
+        cli_and_save(flags);
+
+        current->state = TASK_INTERRUPTIBLE;
+        while (!wq->head)
+            schedule();
+        current->state = TASK_RUNNING;
+
+        struct work_struct *work = wq->head;
+        wq->head = work->next;
+        if (!wq->head)
+            wq->tail = &wq->head;
+        wq->current_work = work;
+        // cleared first so the item can requeue itself
+        clear_bit(WORK_STRUCT_PENDING, &work->flags);
+
+        restore_flags(flags);
+
+        (*work->func)(work);
+
+        wq->current_work = NULL;
+        cond_schedule();
+    }
+
+    return 0;
+}
+
+static int32_t start_worker(struct workqueue_struct *wq) {
+    struct task_struct *worker = kthread(&worker_thread, wq);
+    if (IS_ERR(worker))
+        return PTR_ERR(worker);
+
+    wq->worker = worker;
+    wake_up_process(worker);
+    return 0;
+}
+
+/*  create_workqueue
+ *  DESCRIPTION: make a workqueue with its own worker kthread
+ *  INPUTS: const char *name -- also the name of the worker
+ *  OUTPUTS: none
+ *  RETURN VALUE: the workqueue, or ERR_PTR
+ */
+struct workqueue_struct *create_workqueue(const char *name) {
+    struct workqueue_struct *wq = kmalloc(sizeof(*wq));
+    if (!wq)
+        return ERR_PTR(-ENOMEM);
+
+    *wq = (struct workqueue_struct)WORKQUEUE_INIT(*wq, "");
+    strncpy(wq->name, name, sizeof(wq->name) - 1);
+
+    int32_t res = start_worker(wq);
+    if (res < 0) {
+        kfree(wq);
+        return ERR_PTR(res);
+    }
+    return wq;
+}
+
+static void init_delayed_work() {
+    register_rtc_handler(&delayed_work_timer);
+}
+DEFINE_INITCALL(init_delayed_work, drivers);
+
+static void init_system_wq() {
+    // work queued before now is picked up as soon as the worker runs
+    if (start_worker(system_wq) < 0)
+        BUG();
+}
+DEFINE_INITCALL(init_system_wq, init_kthread);
+
+#include "../tests.h"
+#if RUN_TESTS
+static uint32_t workqueue_test_runs;
+
+static void workqueue_test_func(struct work_struct *work) {
+    workqueue_test_runs++;
+}
+
+/* workqueue tests
+ *
+ * Asserts that work runs once per time it is queued while idle, and that
+ * cancelled and flushed work behave
+ * Coverage: queue_work, queue_delayed_work, flush_work, flush_workqueue,
+ *           cancel_work_sync, cancel_delayed_work_sync
+ */
+__testfunc
+static void workqueue_test() {
+    DECLARE_WORK(work, &workqueue_test_func);
+    DECLARE_DELAYED_WORK(dwork, &workqueue_test_func);
+    unsigned long flags;
+
+    workqueue_test_runs = 0;
+
+    cli_and_save(flags);
+    TEST_ASSERT(schedule_work(&work));
+    TEST_ASSERT(!schedule_work(&work));
+    restore_flags(flags);
+    TEST_ASSERT(flush_work(&work));
+    TEST_ASSERT(workqueue_test_runs == 1 && !work_pending(&work));
+    TEST_ASSERT(!flush_work(&work));
+
+    cli_and_save(flags);
+    TEST_ASSERT(schedule_work(&work));
+    TEST_ASSERT(cancel_work_sync(&work));
+    restore_flags(flags);
+    flush_workqueue(system_wq);
+    TEST_ASSERT(workqueue_test_runs == 1);
+
+    TEST_ASSERT(schedule_delayed_work(&dwork, 100000));
+    TEST_ASSERT(!schedule_delayed_work(&dwork, 0));
+    TEST_ASSERT(cancel_delayed_work_sync(&dwork));
+    TEST_ASSERT(!work_pending(&dwork.work));
+
+    TEST_ASSERT(schedule_delayed_work(&dwork, 1));
+    while (work_pending(&dwork.work))
+        schedule();
+    flush_workqueue(system_wq);
+    TEST_ASSERT(workqueue_test_runs == 2);
+}
+DEFINE_TEST(workqueue_test);
+#endif
@@ -0,0 +1,85 @@
+#ifndef _WORKQUEUE_H
+#define _WORKQUEUE_H
+
+#include "task.h"
+#include "../time/time.h"
+#include "../lib/stdint.h"
+#include "../lib/stdbool.h"
+#include "../atomic.h"
+
+struct work_struct;
+struct workqueue_struct;
+
+typedef void work_func_t(struct work_struct *work);
+
+#define WORK_STRUCT_PENDING 0 // queued, or waiting on its timer
+
+/*
+ * A unit of deferred work, run in task context by the worker kthread of the
+ * workqueue it is queued on, so unlike a tasklet it may sleep. A work item
+ * queued again while still pending runs once.
+ */
+struct work_struct {
+    struct work_struct *next;
+    volatile uint32_t flags;
+    work_func_t *func;
+    struct workqueue_struct *wq; // last queued on
+};
+
+// work_struct must stay first, work functions get at the rest by casting
+struct delayed_work {
+    struct work_struct work;
+    struct delayed_work *next;
+    struct timespec expires;
+};
+
+#define INIT_WORK(_work, _func) \
+    (*(_work) = (struct work_struct){ .func = (_func) })
+#define INIT_DELAYED_WORK(_dwork, _func) \
+    (*(_dwork) = (struct delayed_work){ .work = { .func = (_func) } })
+
+#define DECLARE_WORK(name, _func) \
+struct work_struct name = { .func = (_func) }
+#define DECLARE_DELAYED_WORK(name, _func) \
+struct delayed_work name = { .work = { .func = (_func) } }
+
+/*
+ * Work items are run one at a time, in the order they were queued, by a
+ * single worker kthread named after the queue.
+ */
+struct workqueue_struct {
+    char name[16];
+    struct work_struct *head;
+    struct work_struct **tail;
+    struct work_struct *current_work;
+    struct task_struct *worker;
+};
+
+// the shared queue behind schedule_work(), for short items that don't
+// warrant a kthread of their own
+extern struct workqueue_struct *system_wq;
+
+struct workqueue_struct *create_workqueue(const char *name);
+
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work);
+bool queue_delayed_work(struct workqueue_struct *wq, struct delayed_work *dwork, uint32_t msecs);
+
+bool flush_work(struct work_struct *work);
+void flush_workqueue(struct workqueue_struct *wq);
+
+bool cancel_work_sync(struct work_struct *work);
+bool cancel_delayed_work_sync(struct delayed_work *dwork);
+
+static inline bool work_pending(struct work_struct *work) {
+    return test_bit(WORK_STRUCT_PENDING, &work->flags);
+}
+
+static inline bool schedule_work(struct work_struct *work) {
+    return queue_work(system_wq, work);
+}
+
+static inline bool schedule_delayed_work(struct delayed_work *dwork, uint32_t msecs) {
+    return queue_delayed_work(system_wq, dwork, msecs);
+}
+
+#endif
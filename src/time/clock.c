@@ -1,6 +1,9 @@
+#include "clock.h"
+#include "vvar.h"
 #include "../drivers/rtc.h"
+#include "../errno.h"
 #include "../lib/stdint.h"
-#include "../mm/paging.h"
+#include "../mm/uaccess.h"
 #include "../syscall.h"
 
 // source: kernel/time/time.c
@@ -39,10 +42,76 @@ uint64_t time_now() {
 }
 
 DEFINE_SYSCALL1(LINUX, time, uint64_t *, tloc) {
-    uint64_t time = time_now();
+    struct timespec mono;
+    uint32_t wall_offset;
+    vvar_read(&mono, &wall_offset, true);
 
-    if (safe_buf(tloc, sizeof(*tloc), true) == sizeof(*tloc))
-        *tloc = time;
+    uint64_t time = mono.sec + wall_offset;
+
+    if (tloc)
+        copy_to_user(tloc, &time, sizeof(time));
 
     return time;
 }
+
+// The vDSO serves these without a syscall, except for clocks it doesn't know
+DEFINE_SYSCALL2(LINUX, clock_gettime, uint32_t, clockid, struct timespec *, tp) {
+    struct timespec ts;
+    uint32_t wall_offset;
+
+    switch (clockid) {
+    case CLOCK_REALTIME:
+    case CLOCK_MONOTONIC:
+    case CLOCK_MONOTONIC_RAW:
+    case CLOCK_BOOTTIME:
+        vvar_read(&ts, &wall_offset, false);
+        break;
+    case CLOCK_REALTIME_COARSE:
+    case CLOCK_MONOTONIC_COARSE:
+        vvar_read(&ts, &wall_offset, true);
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    if (clockid == CLOCK_REALTIME || clockid == CLOCK_REALTIME_COARSE)
+        ts.sec += wall_offset;
+
+    if (copy_to_user(tp, &ts, sizeof(ts)))
+        return -EFAULT;
+    return 0;
+}
+
+struct timeval {
+    uint32_t sec;
+    uint32_t usec;
+};
+
+struct timezone {
+    int32_t minuteswest;
+    int32_t dsttime;
+};
+
+DEFINE_SYSCALL2(LINUX, gettimeofday, struct timeval *, tv, struct timezone *, tz) {
+    if (tv) {
+        struct timespec ts;
+        uint32_t wall_offset;
+        vvar_read(&ts, &wall_offset, false);
+
+        struct timeval tv_k = {
+            .sec  = ts.sec + wall_offset,
+            .usec = ts.nsec / 1000,
+        };
+        if (copy_to_user(tv, &tv_k, sizeof(tv_k)))
+            return -EFAULT;
+    }
+
+    // the RTC is kept in UTC
+    if (tz) {
+        struct timezone tz_k = {0};
+        if (copy_to_user(tz, &tz_k, sizeof(tz_k)))
+            return -EFAULT;
+    }
+
+    return 0;
+}
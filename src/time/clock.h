@@ -1,6 +1,16 @@
 #ifndef _CLOCK_H
 #define _CLOCK_H
 
+#include "../lib/stdint.h"
+
+// source: <uapi/linux/time.h>
+#define CLOCK_REALTIME         0
+#define CLOCK_MONOTONIC        1
+#define CLOCK_MONOTONIC_RAW    4
+#define CLOCK_REALTIME_COARSE  5
+#define CLOCK_MONOTONIC_COARSE 6
+#define CLOCK_BOOTTIME         7
+
 uint64_t mktime64(const unsigned int year0, const unsigned int mon0,
                   const unsigned int day, const unsigned int hour,
                   const unsigned int min, const unsigned int sec);
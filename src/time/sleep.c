@@ -2,8 +2,8 @@
 #include "clock.h"
 #include "uptime.h"
 #include "../drivers/rtc.h"
-#include "../mm/paging.h"
-#include "../mm/kmalloc.h"
+#include "../mm/uaccess.h"
+#include "../mm/slab.h"
 #include "../structure/list.h"
 #include "../task/sched.h"
 #include "../syscall.h"
@@ -19,6 +19,8 @@ struct sleep_spec {
     struct timespec endtime;
 };
 
+static DEFINE_KMEM_CACHE(sleep_spec_cache, struct sleep_spec, NULL);
+
 // void timespec_now(struct timespec *spec) {
 //     get_uptime(&spec);
 //     spec->sec = time_now();
@@ -60,7 +62,7 @@ static void rtc_handler() {
 }
 
 struct sleep_spec *sleep_add(const struct timespec *time) {
-    struct sleep_spec *spec = kmalloc(sizeof(*spec));
+    struct sleep_spec *spec = kmem_cache_alloc(&sleep_spec_cache);
     if (!spec)
         return ERR_PTR(-ENOMEM);
 
@@ -81,22 +83,24 @@ bool sleep_hashit(const struct sleep_spec *spec) {
 
 void sleep_finalize(struct sleep_spec *spec) {
     list_remove(&sleep_queue, spec);
-    kfree(spec);
+    kmem_cache_free(&sleep_spec_cache, spec);
 }
 
 DEFINE_SYSCALL2(LINUX, nanosleep, const struct timespec *, req, struct timespec *, rem) {
-    if (safe_buf(req, sizeof(*req), false) != sizeof(*req))
+    struct timespec req_k;
+    if (copy_from_user(&req_k, req, sizeof(req_k)))
         return -EFAULT;
 
-    if (req->nsec >= NSEC)
+    if (req_k.nsec >= NSEC)
         return -EINVAL;
 
-    struct sleep_spec *spec = sleep_add(req);
+    struct sleep_spec *spec = sleep_add(&req_k);
     if (IS_ERR(spec))
         return PTR_ERR(spec);
 
-    if (safe_buf(rem, sizeof(*rem), true) == sizeof(*rem))
-        *rem = (struct timespec){0};
+    struct timespec rem_k = {0};
+    if (rem)
+        copy_to_user(rem, &rem_k, sizeof(rem_k));
 
     int32_t res = 0;
 
@@ -105,12 +109,13 @@ DEFINE_SYSCALL2(LINUX, nanosleep, const struct timespec *, req, struct timespec
             break;
 
         if (signal_pending(current)) {
-            if (safe_buf(rem, sizeof(*rem), true) == sizeof(*rem)) {
+            if (rem) {
                 struct timespec now;
                 get_uptime(&now);
 
-                *rem = spec->endtime;
-                timespec_sub(rem, &now);
+                rem_k = spec->endtime;
+                timespec_sub(&rem_k, &now);
+                copy_to_user(rem, &rem_k, sizeof(rem_k));
             }
 
             res = -EINTR;
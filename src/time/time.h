@@ -10,4 +10,8 @@ struct timespec {
     uint32_t nsec; /* nanoseconds */
 };
 
+int timespec_cmp(const struct timespec *x, const struct timespec *y);
+void timespec_add(struct timespec *x, const struct timespec *y);
+void timespec_sub(struct timespec *x, const struct timespec *y);
+
 #endif
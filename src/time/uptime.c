@@ -1,13 +1,78 @@
 #include "uptime.h"
+#include "vvar.h"
+#include "clock.h"
 #include "../lib/cli.h"
+#include "../lib/tsc.h"
 #include "../drivers/rtc.h"
+#include "../mm/paging.h"
+#include "../cpuid.h"
+#include "../compiler.h"
 #include "../initcall.h"
+#include "../panic.h"
 
 static uint32_t last_calibration = rtc_rate_to_freq(RTC_HW_RATE);
 static uint32_t rtc_counter = 0;
 static uint32_t seconds = 0;
 static uint16_t last_second = -1;
 
+struct vvar_data *vvar;
+
+static bool has_tsc;
+static uint64_t last_second_tsc;
+
+/*  tsc_mult
+ *  DESCRIPTION: the vvar mult for a TSC that ran some cycles in a second,
+ *               (NSEC << VVAR_SHIFT) / cycles without needing libgcc
+ *  INPUTS: uint64_t cycles
+ *  OUTPUTS: none
+ *  RETURN VALUE: the mult, or 0 if it does not fit
+ */
+static uint32_t tsc_mult(uint64_t cycles) {
+    uint64_t ns = (uint64_t)NSEC << VVAR_SHIFT;
+    uint32_t mult, rem;
+
+    // dropping low bits of both keeps the ratio
+    while (cycles >> 32) {
+        cycles >>= 1;
+        ns >>= 1;
+    }
+
+    if ((uint32_t)(ns >> 32) >= (uint32_t)cycles)
+        return 0;
+
+    asm ("divl %4"
+        : "=a"(mult), "=d"(rem)
+        : "a"((uint32_t)ns), "d"((uint32_t)(ns >> 32)), "rm"((uint32_t)cycles)
+    );
+    return mult;
+}
+
+/*  update_vvar
+ *  DESCRIPTION: publish the time of this tick to the vvar page, called
+ *               from the RTC interrupt
+ *  INPUTS: uint64_t tsc -- TSC at this tick
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+static void update_vvar(uint64_t tsc) {
+    struct timespec now;
+    get_uptime(&now);
+
+    vvar->seq++;
+    barrier();
+
+    // uptime stalls at the end of a second if the RTC runs fast, keep
+    // extrapolating from where it stalled so the time doesn't go back
+    if (timespec_cmp(&now, &vvar->mono)) {
+        vvar->mono = now;
+        vvar->tsc = tsc;
+    }
+    vvar->tick_nsec = NSEC / last_calibration;
+
+    barrier();
+    vvar->seq++;
+}
+
 static void rtc_handler() {
     // This is an FSM:
     // State 0 = initial loaded, last_second undefined
@@ -15,6 +80,8 @@ static void rtc_handler() {
     // State 2 = normal mode
     static uint8_t state = 0;
     uint8_t second = rtc_get_second();
+    uint64_t tsc = has_tsc ? rdtsc() : 0;
+
     switch (state) {
     case 0:
         state++;
@@ -32,10 +99,18 @@ static void rtc_handler() {
 
             seconds++;
             rtc_counter = 0;
+
+            // a reader this interrupted retries on the seq bump below
+            vvar->wall_offset = time_now() - seconds;
+            if (has_tsc && last_second_tsc)
+                vvar->mult = tsc_mult(tsc - last_second_tsc);
+            last_second_tsc = tsc;
         }
     }
     last_second = second;
     rtc_counter++;
+
+    update_vvar(tsc);
 }
 
 void get_uptime(struct timespec *data) {
@@ -56,7 +131,85 @@ void get_uptime(struct timespec *data) {
     restore_flags(flags);
 }
 
+/*  vvar_read
+ *  DESCRIPTION: read the time the way the vDSO does, for the syscalls it
+ *               falls back to
+ *  INPUTS: bool coarse -- only to the last tick, without the TSC
+ *  OUTPUTS: struct timespec *mono -- uptime
+ *           uint32_t *wall_offset -- realtime - uptime, in seconds
+ *  RETURN VALUE: none
+ */
+void vvar_read(struct timespec *mono, uint32_t *wall_offset, bool coarse) {
+    unsigned long flags;
+    uint32_t ns = 0;
+
+    cli_and_save(flags);
+
+    if (!coarse && vvar->mult) {
+        uint64_t delta = rdtsc() - vvar->tsc;
+        if (delta >> 32)
+            ns = vvar->tick_nsec;
+        else
+            ns = (delta * vvar->mult) >> VVAR_SHIFT;
+
+        if (ns > vvar->tick_nsec)
+            ns = vvar->tick_nsec;
+    }
+
+    *mono = vvar->mono;
+    *wall_offset = vvar->wall_offset;
+
+    restore_flags(flags);
+
+    timespec_add(mono, &(struct timespec){ .nsec = ns });
+}
+
 static void init_uptime() {
+    uint32_t a, d;
+
+    vvar = alloc_shared_page();
+    if (!vvar)
+        panic("uptime: Cannot allocate vvar page\n");
+
+    cpuid(CPUID_GETFEATURES, &a, &d);
+    has_tsc = d & CPUID_FEAT_EDX_TSC;
+
+    vvar->wall_offset = time_now();
+    vvar->tick_nsec = NSEC / last_calibration;
+
     register_rtc_handler(&rtc_handler);
 }
 DEFINE_INITCALL(init_uptime, drivers);
+
+#include "../tests.h"
+#if RUN_TESTS
+/* vvar tests
+ *
+ * Asserts that the time read off the vvar page never goes backwards and
+ * stays within a tick of get_uptime
+ * Coverage: vvar_read, update_vvar
+ */
+__testfunc
+static void vvar_test() {
+    struct timespec prev, now, uptime;
+    uint32_t wall_offset;
+    int i;
+
+    vvar_read(&prev, &wall_offset, false);
+    TEST_ASSERT(wall_offset);
+
+    for (i = 0; i < 1000; i++) {
+        vvar_read(&now, &wall_offset, false);
+        TEST_ASSERT(timespec_cmp(&prev, &now) <= 0);
+        prev = now;
+    }
+
+    unsigned long flags;
+    cli_and_save(flags);
+    vvar_read(&now, &wall_offset, true);
+    get_uptime(&uptime);
+    restore_flags(flags);
+    TEST_ASSERT(!timespec_cmp(&now, &uptime));
+}
+DEFINE_TEST(vvar_test);
+#endif
@@ -0,0 +1,46 @@
+// vvar.h -- time data the kernel shares read-only with userspace
+
+#ifndef _VVAR_H
+#define _VVAR_H
+
+/*
+ * The vvar page is updated on every RTC tick and mapped read-only right
+ * after the vDSO, so that the vDSO can read the time without a syscall.
+ * Readers retry if seq changed or was odd while they read. Between ticks,
+ * the time is extrapolated from the TSC: ns = (tsc - tsc_base) * mult >>
+ * VVAR_SHIFT, never more than a tick.
+ *
+ * The offsets are for the vDSO and must match struct vvar_data.
+ */
+#define VVAR_SEQ       0
+#define VVAR_MONO_SEC  4
+#define VVAR_MONO_NSEC 8
+#define VVAR_WALL_SEC  12
+#define VVAR_TSC_LO    16
+#define VVAR_TSC_HI    20
+#define VVAR_MULT      24
+#define VVAR_TICK_NSEC 28
+
+#define VVAR_SHIFT 24
+
+#ifndef ASM
+
+#include "time.h"
+#include "../lib/stdint.h"
+#include "../lib/stdbool.h"
+
+struct vvar_data {
+    volatile uint32_t seq;
+    struct timespec mono;  // uptime at the last tick
+    uint32_t wall_offset;  // realtime - uptime, in seconds
+    uint64_t tsc;          // TSC at the last tick
+    uint32_t mult;         // ns per TSC cycle << VVAR_SHIFT, 0 if unusable
+    uint32_t tick_nsec;    // ns per tick
+};
+
+extern struct vvar_data *vvar;
+
+void vvar_read(struct timespec *mono, uint32_t *wall_offset, bool coarse);
+
+#endif
+#endif
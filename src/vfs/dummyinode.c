@@ -1,6 +1,5 @@
 #include "dummyinode.h"
 #include "superblock.h"
-#include "../mm/kmalloc.h"
 #include "../initcall.h"
 #include "../err.h"
 #include "../errno.h"
@@ -25,7 +24,7 @@ struct super_block dummy_sb = {
 
 struct inode *mk_dummyinode() {
     // This is freed by put_inode of super_block
-    struct inode *inode = kmalloc(sizeof(*inode));
+    struct inode *inode = kmem_cache_alloc(&inode_cache);
     if (!inode)
         return ERR_PTR(-ENOMEM);
 
@@ -0,0 +1,333 @@
+#include "fdtable.h"
+#include "file.h"
+#include "../mm/kmalloc.h"
+#include "../lib/bsr.h"
+#include "../lib/cli.h"
+#include "../lib/string.h"
+#include "../err.h"
+#include "../errno.h"
+
+static inline void assign_bit(uint32_t *bitmap, uint32_t bit, bool val) {
+    if (val)
+        set_bit(bit, bitmap);
+    else
+        clear_bit(bit, bitmap);
+}
+
+/*  find_next_zero_bit
+ *  DESCRIPTION: find the first clear bit at or after start
+ *  INPUTS: const uint32_t *bitmap, uint32_t size -- in bits, a multiple of
+ *          BITS_PER_WORD, uint32_t start
+ *  OUTPUTS: none
+ *  RETURN VALUE: the bit number, or size if none
+ */
+static uint32_t find_next_zero_bit(const uint32_t *bitmap, uint32_t size, uint32_t start) {
+    uint32_t i;
+    for (i = start / BITS_PER_WORD; i < size / BITS_PER_WORD; i++) {
+        uint32_t word = ~bitmap[i];
+        if (i == start / BITS_PER_WORD)
+            word &= ~0U << (start % BITS_PER_WORD);
+        if (word)
+            return i * BITS_PER_WORD + bsf(word);
+    }
+    return size;
+}
+
+/*  files_expand
+ *  DESCRIPTION: grow a table so that fd nr is a valid slot, called with
+ *               interrupts off
+ *  INPUTS: struct files_struct *files, uint32_t nr
+ *  OUTPUTS: none
+ *  RETURN VALUE: 0 on success, or negative errno
+ */
+static int32_t files_expand(struct files_struct *files, uint32_t nr) {
+    if (nr < files->max_fds)
+        return 0;
+    if (nr >= NR_OPEN)
+        return -EMFILE;
+
+    uint32_t max_fds = files->max_fds ?: BITS_PER_WORD;
+    while (max_fds <= nr)
+        max_fds *= 2;
+
+    struct file **fd = kcalloc(max_fds, sizeof(*fd));
+    uint32_t *open_fds = kcalloc(max_fds / BITS_PER_WORD, sizeof(*open_fds));
+    uint32_t *close_on_exec = kcalloc(max_fds / BITS_PER_WORD, sizeof(*close_on_exec));
+    if (!fd || !open_fds || !close_on_exec) {
+        kfree(fd);
+        kfree(open_fds);
+        kfree(close_on_exec);
+        return -ENOMEM;
+    }
+
+    if (files->max_fds) {
+        memcpy(fd, files->fd, files->max_fds * sizeof(*fd));
+        memcpy(open_fds, files->open_fds, files->max_fds / 8);
+        memcpy(close_on_exec, files->close_on_exec, files->max_fds / 8);
+        kfree(files->fd);
+        kfree(files->open_fds);
+        kfree(files->close_on_exec);
+    }
+
+    files->fd = fd;
+    files->open_fds = open_fds;
+    files->close_on_exec = close_on_exec;
+    files->max_fds = max_fds;
+    return 0;
+}
+
+/*  files_alloc
+ *  DESCRIPTION: allocate an empty descriptor table
+ *  INPUTS: none
+ *  OUTPUTS: none
+ *  RETURN VALUE: the table, or NULL if out of memory
+ */
+struct files_struct *files_alloc(void) {
+    struct files_struct *files = kmalloc(sizeof(*files));
+    if (!files)
+        return NULL;
+
+    *files = (struct files_struct){
+        .refcount = ATOMIC_INITIALIZER(1),
+    };
+    return files;
+}
+
+/*  files_dup
+ *  DESCRIPTION: copy a descriptor table, taking a reference to every file
+ *  INPUTS: struct files_struct *files
+ *  OUTPUTS: none
+ *  RETURN VALUE: the new table, or NULL if out of memory
+ */
+struct files_struct *files_dup(struct files_struct *files) {
+    struct files_struct *new = files_alloc();
+    if (!new)
+        return NULL;
+
+    unsigned long flags;
+    cli_and_save(flags);
+
+    if (files->max_fds && files_expand(new, files->max_fds - 1) < 0) {
+        restore_flags(flags);
+        kfree(new);
+        return NULL;
+    }
+
+    memcpy(new->fd, files->fd, files->max_fds * sizeof(*files->fd));
+    memcpy(new->open_fds, files->open_fds, files->max_fds / 8);
+    memcpy(new->close_on_exec, files->close_on_exec, files->max_fds / 8);
+
+    uint32_t i;
+    for (i = 0; i < new->max_fds; i++) {
+        if (new->fd[i])
+            atomic_inc(&new->fd[i]->refcount);
+    }
+
+    restore_flags(flags);
+    return new;
+}
+
+/*  files_put
+ *  DESCRIPTION: drop a reference to a table, closing all its files and
+ *               freeing it on the last one
+ *  INPUTS: struct files_struct *files
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void files_put(struct files_struct *files) {
+    if (atomic_dec(&files->refcount))
+        return;
+
+    uint32_t i;
+    for (i = 0; i < files->max_fds; i++) {
+        if (files->fd[i])
+            filp_close(files->fd[i]);
+    }
+
+    kfree(files->fd);
+    kfree(files->open_fds);
+    kfree(files->close_on_exec);
+    kfree(files);
+}
+
+/*  fd_get
+ *  DESCRIPTION: look up a descriptor
+ *  INPUTS: struct files_struct *files, int32_t fd
+ *  OUTPUTS: none
+ *  RETURN VALUE: the file, or NULL if fd is not open
+ */
+struct file *fd_get(struct files_struct *files, int32_t fd) {
+    if (fd < 0 || fd >= files->max_fds)
+        return NULL;
+    return files->fd[fd];
+}
+
+/*  fd_alloc
+ *  DESCRIPTION: put a file at the lowest free descriptor at or after start.
+ *               The file's refcount is not touched
+ *  INPUTS: struct files_struct *files, int32_t start, struct file *file,
+ *          bool cloexec
+ *  OUTPUTS: none
+ *  RETURN VALUE: the descriptor, or negative errno
+ */
+int32_t fd_alloc(struct files_struct *files, int32_t start, struct file *file, bool cloexec) {
+    unsigned long flags;
+    int32_t fd;
+
+    if (start < 0)
+        return -EINVAL;
+
+    cli_and_save(flags);
+
+    fd = find_next_zero_bit(files->open_fds, files->max_fds, start);
+    if (fd < start)
+        fd = start;
+
+    int32_t res = files_expand(files, fd);
+    if (res < 0) {
+        fd = res;
+        goto out;
+    }
+
+    files->fd[fd] = file;
+    assign_bit(files->open_fds, fd, true);
+    assign_bit(files->close_on_exec, fd, cloexec);
+
+out:
+    restore_flags(flags);
+    return fd;
+}
+
+/*  fd_install
+ *  DESCRIPTION: put a file at a given descriptor, replacing what was there.
+ *               The refcounts of neither file are touched
+ *  INPUTS: struct files_struct *files, int32_t fd, struct file *file,
+ *          bool cloexec
+ *  OUTPUTS: none
+ *  RETURN VALUE: the file previously at fd, NULL if none, or ERR_PTR
+ */
+struct file *fd_install(struct files_struct *files, int32_t fd, struct file *file, bool cloexec) {
+    unsigned long flags;
+    struct file *old;
+
+    if (fd < 0)
+        return ERR_PTR(-EBADF);
+
+    cli_and_save(flags);
+
+    int32_t res = files_expand(files, fd);
+    if (res < 0) {
+        old = ERR_PTR(res == -EMFILE ? -EBADF : res);
+        goto out;
+    }
+
+    old = files->fd[fd];
+    files->fd[fd] = file;
+    assign_bit(files->open_fds, fd, true);
+    assign_bit(files->close_on_exec, fd, cloexec);
+
+out:
+    restore_flags(flags);
+    return old;
+}
+
+/*  fd_remove
+ *  DESCRIPTION: free a descriptor. The file's refcount is not touched
+ *  INPUTS: struct files_struct *files, int32_t fd
+ *  OUTPUTS: none
+ *  RETURN VALUE: the file that was at fd, or NULL if none
+ */
+struct file *fd_remove(struct files_struct *files, int32_t fd) {
+    unsigned long flags;
+    struct file *file = NULL;
+
+    cli_and_save(flags);
+
+    if (fd >= 0 && fd < files->max_fds) {
+        file = files->fd[fd];
+        files->fd[fd] = NULL;
+        assign_bit(files->open_fds, fd, false);
+        assign_bit(files->close_on_exec, fd, false);
+    }
+
+    restore_flags(flags);
+    return file;
+}
+
+bool fd_get_cloexec(struct files_struct *files, int32_t fd) {
+    if (fd < 0 || fd >= files->max_fds)
+        return false;
+    return test_bit(fd, files->close_on_exec);
+}
+
+void fd_set_cloexec(struct files_struct *files, int32_t fd, bool cloexec) {
+    unsigned long flags;
+    cli_and_save(flags);
+
+    if (fd >= 0 && fd < files->max_fds && files->fd[fd])
+        assign_bit(files->close_on_exec, fd, cloexec);
+
+    restore_flags(flags);
+}
+
+/*  fd_close_on_exec
+ *  DESCRIPTION: close every descriptor marked close-on-exec
+ *  INPUTS: struct files_struct *files
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+void fd_close_on_exec(struct files_struct *files) {
+    uint32_t i;
+    for (i = 0; i < files->max_fds / BITS_PER_WORD; i++) {
+        uint32_t word;
+        // filp_close may sleep, so pick one bit at a time
+        while ((word = files->close_on_exec[i])) {
+            int32_t fd = i * BITS_PER_WORD + bsf(word);
+            struct file *file = fd_remove(files, fd);
+            if (file)
+                filp_close(file);
+        }
+    }
+}
+
+#include "../tests.h"
+#if RUN_TESTS
+/* fd table tests
+ *
+ * Asserts that the lowest free descriptor is handed out, the table grows,
+ * and close-on-exec bits follow their descriptors
+ * Coverage: fd_alloc, fd_install, fd_remove, fd_get, fd_get_cloexec
+ */
+__testfunc
+static void fdtable_test() {
+    struct files_struct *files = files_alloc();
+    struct file *dummy = (void *)4;
+    int32_t i;
+
+    TEST_ASSERT(files);
+    TEST_ASSERT(!fd_get(files, 0) && !fd_get(files, -1));
+
+    for (i = 0; i < 40; i++)
+        TEST_ASSERT(fd_alloc(files, 0, dummy, i & 1) == i);
+    TEST_ASSERT(files->max_fds == 64);
+    TEST_ASSERT(fd_get(files, 39) == dummy && !fd_get(files, 40));
+    TEST_ASSERT(fd_get_cloexec(files, 33) && !fd_get_cloexec(files, 34));
+
+    TEST_ASSERT(fd_remove(files, 5) == dummy);
+    TEST_ASSERT(!fd_get_cloexec(files, 5));
+    TEST_ASSERT(fd_alloc(files, 0, dummy, false) == 5);
+    TEST_ASSERT(fd_alloc(files, 10, dummy, false) == 40);
+    TEST_ASSERT(fd_alloc(files, 100, dummy, false) == 100);
+    TEST_ASSERT(files->max_fds == 128);
+    TEST_ASSERT(fd_alloc(files, NR_OPEN, dummy, false) == -EMFILE);
+
+    TEST_ASSERT(!fd_install(files, 200, dummy, true));
+    TEST_ASSERT(fd_install(files, 200, dummy, false) == dummy);
+    TEST_ASSERT(!fd_get_cloexec(files, 200));
+
+    for (i = 0; i < files->max_fds; i++)
+        fd_remove(files, i);
+    files_put(files);
+}
+DEFINE_TEST(fdtable_test);
+#endif
@@ -0,0 +1,42 @@
+#ifndef _FDTABLE_H
+#define _FDTABLE_H
+
+#include "../lib/stdint.h"
+#include "../lib/stdbool.h"
+#include "../atomic.h"
+
+// Hard limit on descriptors per table, like RLIMIT_NOFILE
+#define NR_OPEN 1024
+
+#define BITS_PER_WORD 32
+
+struct file;
+
+/*
+ * A file descriptor table. fd[] is indexed by descriptor; open_fds and
+ * close_on_exec are bitmaps with one bit per slot of fd[], so finding a
+ * free descriptor scans a word (32 descriptors) at a time. All three grow
+ * together, in powers of two, and never shrink.
+ */
+struct files_struct {
+    atomic_t refcount;
+    uint32_t max_fds;           // slots in fd[], a multiple of BITS_PER_WORD
+    struct file **fd;
+    uint32_t *open_fds;
+    uint32_t *close_on_exec;
+};
+
+struct files_struct *files_alloc(void);
+struct files_struct *files_dup(struct files_struct *files);
+void files_put(struct files_struct *files);
+
+struct file *fd_get(struct files_struct *files, int32_t fd);
+int32_t fd_alloc(struct files_struct *files, int32_t start, struct file *file, bool cloexec);
+struct file *fd_install(struct files_struct *files, int32_t fd, struct file *file, bool cloexec);
+struct file *fd_remove(struct files_struct *files, int32_t fd);
+
+bool fd_get_cloexec(struct files_struct *files, int32_t fd);
+void fd_set_cloexec(struct files_struct *files, int32_t fd, bool cloexec);
+void fd_close_on_exec(struct files_struct *files);
+
+#endif
@@ -8,9 +8,13 @@
 #include "../lib/string.h"
 #include "../task/task.h"
 #include "../mm/kmalloc.h"
+#include "../mm/scratch.h"
 #include "../err.h"
 #include "../errno.h"
 
+DEFINE_KMEM_CACHE(file_cache, struct file, NULL);
+DEFINE_KMEM_CACHE(inode_cache, struct inode, NULL);
+
 /*
  *   put_inode
  *   DESCRIPTION: destroy the inode
@@ -45,7 +49,7 @@ struct inode *inode_open(int32_t dfd, const char *path, uint32_t flags, uint16_t
         if (dfd == AT_FDCWD) {
             rel = current->cwd;
         } else {
-            rel = array_get(&current->files->files, dfd);
+            rel = fd_get(current->files, dfd);
         }
         if (!rel) {
             ret = ERR_PTR(-EBADF);
@@ -113,7 +117,7 @@ resolve_mount:;
     }
 
     if ((inode->mode & S_IFMT) == S_IFLNK && !(flags & O_NOFOLLOW)) {
-        char *link_target = kmalloc(MAX_PATH + 1);
+        char *link_target = scratch_alloc(MAX_PATH + 1);
         if (!link_target) {
             ret = ERR_PTR(-ENOMEM);
             goto out_put_inode;
@@ -122,12 +126,12 @@ resolve_mount:;
 
         int32_t res = (*inode->op->readlink)(inode, link_target, MAX_PATH);
         if (res < 0) {
-            kfree(link_target);
+            scratch_free(link_target);
             ret = ERR_PTR(res);
             goto out_put_inode;
         }
         if (!res) {
-            kfree(link_target);
+            scratch_free(link_target);
             ret = ERR_PTR(-EINVAL);
             goto out_put_inode;
         }
@@ -137,7 +141,7 @@ resolve_mount:;
         list_pop_back(&path_dest->components);
 
         struct path *path_target_rel = path_fromstr(link_target);
-        kfree(link_target);
+        scratch_free(link_target);
         if (IS_ERR(path_target_rel)) {
             ret = ERR_CAST(path_target_rel);
             goto out_put_inode;
@@ -215,7 +219,7 @@ struct file *filp_openat(int32_t dfd, const char *path, uint32_t flags, uint16_t
         }
 
     // allocate the space in the kernel
-    ret = kmalloc(sizeof(*ret));
+    ret = kmem_cache_alloc(&file_cache);
     if (!ret) {
         ret = ERR_PTR(-ENOMEM);
         goto out;
@@ -230,7 +234,7 @@ struct file *filp_openat(int32_t dfd, const char *path, uint32_t flags, uint16_t
 
     int32_t res = (*ret->op->open)(ret, inode);
     if (res < 0) {
-        kfree(ret);
+        kmem_cache_free(&file_cache, ret);
         ret = ERR_PTR(res);
         goto out;
     }
@@ -273,7 +277,7 @@ struct file *filp_open_dummy(struct file_operations *file_op, int32_t (*prep_ino
             goto out_put_inode;
     }
 
-    ret = kmalloc(sizeof(*ret));
+    ret = kmem_cache_alloc(&file_cache);
     if (!ret) {
         ret = ERR_PTR(-ENOMEM);
         goto out_put_inode;
@@ -293,7 +297,7 @@ struct file *filp_open_dummy(struct file_operations *file_op, int32_t (*prep_ino
     // check the res's value
     int32_t res = (*ret->op->open)(ret, inode);
     if (res < 0) {
-        kfree(ret);
+        kmem_cache_free(&file_cache, ret);
         ret = ERR_PTR(res);
         goto out_put_inode;
     }
@@ -426,7 +430,7 @@ int32_t filp_close(struct file *file) {
     // destroy the path
     path_destroy(file->path);
     put_inode(file->inode);
-    kfree(file);
+    kmem_cache_free(&file_cache, file);
     return 0;
 }
 
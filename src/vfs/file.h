@@ -6,6 +6,7 @@
 #include "../time/time.h"
 #include "readdir.h"
 #include "../atomic.h"
+#include "../mm/slab.h"
 
 #define MAX_PATH 260
 
@@ -17,6 +18,7 @@
 #define O_NOCTTY    0x100
 #define O_TRUNC     0x200
 #define O_APPEND    0x400
+#define O_NONBLOCK  0x800
 #define O_DIRECTORY 0x10000
 #define O_NOFOLLOW  0x20000
 #define O_CLOEXEC   0x80000
@@ -145,6 +147,10 @@ struct file {
     // struct address_space *mapping;
 };
 
+// struct file and struct inode are allocated from these caches
+extern struct kmem_cache file_cache;
+extern struct kmem_cache inode_cache;
+
 void put_inode(struct inode *inode);
 struct inode *inode_open(int32_t dfd, const char *path, uint32_t flags, uint16_t mode, struct path **path_out);
 
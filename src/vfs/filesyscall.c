@@ -2,12 +2,36 @@
 #include "path.h"
 #include "superblock.h"
 #include "../lib/string.h"
-#include "../mm/kmalloc.h"
+#include "../mm/uaccess.h"
+#include "../mm/scratch.h"
 #include "../task/task.h"
 #include "../syscall.h"
 #include "../err.h"
 #include "../errno.h"
 
+/*
+ *   getname
+ *   DESCRIPTION: copy a path from userspace into the scratch arena
+ *   INPUTS: const char *path
+ *   RETURN VALUE: the path, to be freed with putname, or ERR_PTR
+ */
+static char *getname(const char *path) {
+    char *name = scratch_alloc(MAX_PATH + 1);
+    if (!name)
+        return ERR_PTR(-ENOMEM);
+
+    int32_t len = strncpy_from_user(name, path, MAX_PATH + 1);
+    if (len < 0 || len > MAX_PATH) {
+        scratch_free(name);
+        return ERR_PTR(len < 0 ? len : -ENAMETOOLONG);
+    }
+    return name;
+}
+
+static inline void putname(char *name) {
+    scratch_free(name);
+}
+
 struct iovec {
     void *iov_base;   // Starting address
     uint32_t iov_len; // Number of bytes to transfer
@@ -15,14 +39,18 @@ struct iovec {
 
 static int32_t do_iov(int32_t (*cb)(int32_t fd, void *buf, int32_t nbytes),
         int32_t fd, const struct iovec *iov, int iovcnt) {
-    uint32_t safe_nbytes = safe_buf(iov, iovcnt * sizeof(*iov), false);
-    if (!safe_nbytes && iovcnt)
-        return -EFAULT;
-
     uint32_t i;
     int32_t ret = 0;
     for (i = 0; i < iovcnt; i++) {
-        int32_t res = (*cb)(fd, iov[i].iov_base, iov[i].iov_len);
+        struct iovec iov_k;
+        if (copy_from_user(&iov_k, &iov[i], sizeof(iov_k))) {
+            if (!i)
+                return -EFAULT;
+            else
+                break;
+        }
+
+        int32_t res = (*cb)(fd, iov_k.iov_base, iov_k.iov_len);
         if (res < 0) {
             if (!i)
                 return res;
@@ -43,7 +71,7 @@ static int32_t do_iov(int32_t (*cb)(int32_t fd, void *buf, int32_t nbytes),
  *   RETURN VALUE: int32_t result code
  */
 int32_t do_sys_read(int32_t fd, void *buf, int32_t nbytes) {
-    struct file *file = array_get(&current->files->files, fd);
+    struct file *file = fd_get(current->files, fd);
     if (!file)
         return -EBADF;
 
@@ -52,7 +80,7 @@ int32_t do_sys_read(int32_t fd, void *buf, int32_t nbytes) {
     if (!safe_nbytes && nbytes)
         return -EFAULT;
 
-    return filp_read(file, buf, nbytes);
+    return filp_read(file, buf, safe_nbytes);
 }
 DEFINE_SYSCALL3(ECE391, read, int32_t, fd, void *, buf, int32_t, nbytes) {
     return do_sys_read(fd, buf, nbytes);
@@ -71,7 +99,7 @@ DEFINE_SYSCALL3(LINUX, readv, int32_t, fd, const struct iovec *, iov, int, iovcn
  *   RETURN VALUE: int32_t result code
  */
 int32_t do_sys_write(int32_t fd, const void *buf, int32_t nbytes) {
-    struct file *file = array_get(&current->files->files, fd);
+    struct file *file = fd_get(current->files, fd);
     if (!file)
         return -EBADF;
 
@@ -80,7 +108,7 @@ int32_t do_sys_write(int32_t fd, const void *buf, int32_t nbytes) {
     if (!safe_nbytes && nbytes)
         return -EFAULT;
 
-    return filp_write(file, buf, nbytes);
+    return filp_write(file, buf, safe_nbytes);
 }
 DEFINE_SYSCALL3(ECE391, write, int32_t, fd, const void *, buf, int32_t, nbytes) {
     return do_sys_write(fd, buf, nbytes);
@@ -101,39 +129,27 @@ DEFINE_SYSCALL3(LINUX, writev, int32_t, fd, const struct iovec *, iov, int, iovc
  *   RETURN VALUE: int32_t result code
  */
 int32_t do_sys_openat(int32_t dfd, const char *path, uint32_t flags, uint16_t mode) {
-    // determine the length of the path
-    uint32_t length = safe_arr_null_term(path, sizeof(*path), false);
-    if (!length)
-        return -EFAULT;
-
-    // allocate kernel memory to store path
-    char *path_kern = strndup(path, length);
-    if (!path_kern)
-        return -ENOMEM;
+    // copy the path into kernel memory
+    char *path_kern = getname(path);
+    if (IS_ERR(path_kern))
+        return PTR_ERR(path_kern);
 
     int32_t res;
 
     // call filp_open
-    struct file *file = filp_openat(dfd, path, flags, mode);
+    struct file *file = filp_openat(dfd, path_kern, flags, mode);
     if (IS_ERR(file)) {
         res = PTR_ERR(file);
         goto out_free;
     }
 
-    // loop until fd is free
-    for (res = 0;; res++) {
-        if (
-            !array_get(&current->files->files, res) &&
-            !array_set(&current->files->files, res, file)
-        )
-            break;
-    }
-
-    array_set(&current->files->cloexec, res, (void *)(flags & O_CLOEXEC));
+    res = fd_alloc(current->files, 0, file, flags & O_CLOEXEC);
+    if (res < 0)
+        filp_close(file);
 
 // free the memory allocated to store path
 out_free:
-    kfree(path_kern);
+    putname(path_kern);
     return res;
 }
 DEFINE_SYSCALL1(ECE391, open, const char *, filename) {
@@ -161,7 +177,7 @@ DEFINE_SYSCALL4(LINUX, openat, int, dirfd, char *, path, uint32_t, flags, uint16
  */
 int32_t do_sys_close(int32_t fd) {
     int32_t res;
-    struct file *file = array_get(&current->files->files, fd);
+    struct file *file = fd_get(current->files, fd);
     if (!file)
         return -EBADF;
 
@@ -169,11 +185,7 @@ int32_t do_sys_close(int32_t fd) {
     if (res < 0)
         return res;
 
-    res = array_set(&current->files->files, fd, NULL);
-    if (res < 0)
-        return res;
-
-    array_set(&current->files->cloexec, fd, NULL);
+    fd_remove(current->files, fd);
 
     return 0;
 }
@@ -189,23 +201,24 @@ DEFINE_SYSCALL1(LINUX, close, int32_t, fd) {
 
 DEFINE_SYSCALL5(LINUX, _llseek, uint32_t, fd, uint32_t, offset_high,
                 uint32_t, offset_low, uint32_t *, result, uint32_t, whence) {
-    struct file *file = array_get(&current->files->files, fd);
+    struct file *file = fd_get(current->files, fd);
     if (!file)
         return -EBADF;
 
-    if (safe_buf(result, sizeof(*result), true) != sizeof(*result))
+    if (!access_ok(result, sizeof(*result)))
         return -EFAULT;
 
     int32_t res = filp_seek(file, offset_low, whence);
     if (res < 0)
         return res;
 
-    *result = res;
+    if (put_user(res, result))
+        return -EFAULT;
     return 0;
 }
 
 DEFINE_SYSCALL3(LINUX, ioctl, int32_t, fd, uint32_t, request, unsigned long, arg) {
-    struct file *file = array_get(&current->files->files, fd);
+    struct file *file = fd_get(current->files, fd);
     if (!file)
         return -EBADF;
 
@@ -217,7 +230,12 @@ DEFINE_SYSCALL3(LINUX, readlink, const char *, path, char *, buf, uint32_t, nbyt
     if (!safe_nbytes && nbytes)
         return -EFAULT;
 
-    struct inode *inode = inode_open(AT_FDCWD, path, O_NOFOLLOW, 0, NULL);
+    char *path_kern = getname(path);
+    if (IS_ERR(path_kern))
+        return PTR_ERR(path_kern);
+
+    struct inode *inode = inode_open(AT_FDCWD, path_kern, O_NOFOLLOW, 0, NULL);
+    putname(path_kern);
     if (IS_ERR(inode))
         return PTR_ERR(inode);
 
@@ -228,7 +246,11 @@ DEFINE_SYSCALL3(LINUX, readlink, const char *, path, char *, buf, uint32_t, nbyt
 }
 
 DEFINE_SYSCALL2(LINUX, getcwd, char *, buf, uint32_t, nbytes) {
-    return path_tostring(current->cwd->path, buf, nbytes);
+    uint32_t safe_nbytes = safe_buf(buf, nbytes, true);
+    if (!safe_nbytes && nbytes)
+        return -EFAULT;
+
+    return path_tostring(current->cwd->path, buf, safe_nbytes);
 }
 
 struct stat {
@@ -274,11 +296,7 @@ struct stat64 {
 };
 
 static int32_t do_stat(struct inode *inode, struct stat64 *statbuf) {
-    uint32_t nbytes = safe_buf(statbuf, sizeof(*statbuf), true);
-    if (nbytes != sizeof(*statbuf))
-        return -EFAULT;
-
-    *statbuf = (struct stat64){
+    struct stat64 stat = {
         .dev     = inode->sb->dev ? inode->sb->dev->inode->rdev : 0,
         .ino     = inode->ino,
         .mode    = inode->mode,
@@ -294,27 +312,25 @@ static int32_t do_stat(struct inode *inode, struct stat64 *statbuf) {
         .blocks  = inode->size ? (inode->size - 1)/512 + 1 : 0,
     };
 
+    if (copy_to_user(statbuf, &stat, sizeof(stat)))
+        return -EFAULT;
+
     return 0;
 }
 
 DEFINE_SYSCALL2(LINUX, stat64, const char *, path, struct stat64 *, statbuf) {
-    uint32_t length = safe_arr_null_term(path, sizeof(*path), false);
-    if (!length)
-        return -EFAULT;
-
-    // allocate kernel memory to store path
-    char *path_kern = strndup(path, length);
-    if (!path_kern)
-        return -ENOMEM;
+    // copy the path into kernel memory
+    char *path_kern = getname(path);
+    if (IS_ERR(path_kern))
+        return PTR_ERR(path_kern);
 
     // This is lstat
     // struct inode *inode = inode_open(AT_FDCWD, path, O_NOFOLLOW, 0, NULL);
-    struct inode *inode = inode_open(AT_FDCWD, path, 0, 0, NULL);
+    struct inode *inode = inode_open(AT_FDCWD, path_kern, 0, 0, NULL);
+    putname(path_kern);
     if (IS_ERR(inode))
         return PTR_ERR(inode);
 
-    kfree(path_kern);
-
     int32_t res = do_stat(inode, statbuf);
 
     put_inode(inode);
@@ -322,21 +338,16 @@ DEFINE_SYSCALL2(LINUX, stat64, const char *, path, struct stat64 *, statbuf) {
 }
 
 DEFINE_SYSCALL2(LINUX, lstat64, const char *, path, struct stat64 *, statbuf) {
-    uint32_t length = safe_arr_null_term(path, sizeof(*path), false);
-    if (!length)
-        return -EFAULT;
+    // copy the path into kernel memory
+    char *path_kern = getname(path);
+    if (IS_ERR(path_kern))
+        return PTR_ERR(path_kern);
 
-    // allocate kernel memory to store path
-    char *path_kern = strndup(path, length);
-    if (!path_kern)
-        return -ENOMEM;
-
-    struct inode *inode = inode_open(AT_FDCWD, path, O_NOFOLLOW, 0, NULL);
+    struct inode *inode = inode_open(AT_FDCWD, path_kern, O_NOFOLLOW, 0, NULL);
+    putname(path_kern);
     if (IS_ERR(inode))
         return PTR_ERR(inode);
 
-    kfree(path_kern);
-
     int32_t res = do_stat(inode, statbuf);
 
     put_inode(inode);
@@ -344,7 +355,7 @@ DEFINE_SYSCALL2(LINUX, lstat64, const char *, path, struct stat64 *, statbuf) {
 }
 
 DEFINE_SYSCALL2(LINUX, fstat64, int32_t, fd, struct stat64 *, statbuf) {
-    struct file *file = array_get(&current->files->files, fd);
+    struct file *file = fd_get(current->files, fd);
     if (!file)
         return -EBADF;
 
@@ -395,7 +406,7 @@ static int getdents64_cb(void *_data, const char *name, uint32_t namelen, uint32
 }
 
 DEFINE_SYSCALL3(LINUX, getdents64, int32_t, fd, struct linux_dirent64_head *, dirp, uint32_t, nbytes) {
-    struct file *file = array_get(&current->files->files, fd);
+    struct file *file = fd_get(current->files, fd);
     if (!file)
         return -EBADF;
 
@@ -417,18 +428,20 @@ DEFINE_SYSCALL3(LINUX, getdents64, int32_t, fd, struct linux_dirent64_head *, di
 
 // TODO: All these three variants of 'dup needs code dedup cleanup
 DEFINE_SYSCALL2(LINUX, dup2, int32_t, oldfd, int32_t, newfd) {
-    struct file *file = array_get(&current->files->files, oldfd);
+    struct file *file = fd_get(current->files, oldfd);
     if (!file)
         return -EBADF;
 
-    struct file *newfile = array_get(&current->files->files, newfd);
-    if (newfile)
-        filp_close(newfile);
+    if (oldfd == newfd)
+        return newfd;
 
-    array_set(&current->files->files, newfd, file);
-    atomic_inc(&file->refcount);
+    struct file *newfile = fd_install(current->files, newfd, file, false);
+    if (IS_ERR(newfile))
+        return PTR_ERR(newfile);
 
-    array_set(&current->files->cloexec, newfd, array_get(&current->files->cloexec, oldfd));
+    atomic_inc(&file->refcount);
+    if (newfile)
+        filp_close(newfile);
 
     return newfd;
 }
@@ -465,43 +478,28 @@ DEFINE_SYSCALL2(LINUX, dup2, int32_t, oldfd, int32_t, newfd) {
 #define F_DUPFD_CLOEXEC (F_LINUX_SPECIFIC_BASE + 6)
 
 DEFINE_SYSCALL3(LINUX, fcntl64, int32_t, fd, uint32_t, request, unsigned long, arg) {
-    struct file *file = array_get(&current->files->files, fd);
+    struct file *file = fd_get(current->files, fd);
     if (!file)
         return -EBADF;
 
-    // int32_t res;
+    int32_t res;
 
     switch (request) {
     case F_DUPFD:
-        // loop until fd is free
-        for (;; arg++) {
-            if (
-                !array_get(&current->files->files, arg) &&
-                !array_set(&current->files->files, arg, file)
-            )
-                break;
-        }
-        atomic_inc(&file->refcount);
-
-        array_set(&current->files->cloexec, arg, array_get(&current->files->cloexec, fd));
-        return arg;
     case F_DUPFD_CLOEXEC:
-        // loop until fd is free
-        for (;; arg++) {
-            if (
-                !array_get(&current->files->files, arg) &&
-                !array_set(&current->files->files, arg, file)
-            )
-                break;
-        }
-        atomic_inc(&file->refcount);
+        if (arg >= NR_OPEN)
+            return -EINVAL;
 
-        array_set(&current->files->cloexec, arg, (void *)true);
-        return arg;
+        res = fd_alloc(current->files, arg, file, request == F_DUPFD_CLOEXEC);
+        if (res < 0)
+            return res;
+
+        atomic_inc(&file->refcount);
+        return res;
     case F_GETFD:
-        return !!array_get(&current->files->cloexec, fd);
+        return fd_get_cloexec(current->files, fd);
     case F_SETFD:
-        array_set(&current->files->cloexec, fd, (void *)(arg & FD_CLOEXEC));
+        fd_set_cloexec(current->files, fd, arg & FD_CLOEXEC);
         return 0;
     }
 
@@ -509,20 +507,15 @@ DEFINE_SYSCALL3(LINUX, fcntl64, int32_t, fd, uint32_t, request, unsigned long, a
 }
 
 DEFINE_SYSCALL1(LINUX, chdir, const char *, path) {
-    // determine the length of the path
-    uint32_t length = safe_arr_null_term(path, sizeof(*path), false);
-    if (!length)
-        return -EFAULT;
-
-    // allocate kernel memory to store path
-    char *path_kern = strndup(path, length);
-    if (!path_kern)
-        return -ENOMEM;
+    // copy the path into kernel memory
+    char *path_kern = getname(path);
+    if (IS_ERR(path_kern))
+        return PTR_ERR(path_kern);
 
     int32_t res = 0;
 
     // call filp_open
-    struct file *file = filp_openat(AT_FDCWD, path, O_DIRECTORY, 0);
+    struct file *file = filp_openat(AT_FDCWD, path_kern, O_DIRECTORY, 0);
     if (IS_ERR(file)) {
         res = PTR_ERR(file);
         goto out_free;
@@ -533,7 +526,7 @@ DEFINE_SYSCALL1(LINUX, chdir, const char *, path) {
 
 // free the memory allocated to store path
 out_free:
-    kfree(path_kern);
+    putname(path_kern);
     return res;
 }
 
@@ -543,20 +536,15 @@ DEFINE_SYSCALL0(LINUX, _newselect) {
 }
 
 int32_t do_sys_faccessat(int32_t dfd, const char *path, uint16_t mode, uint32_t flags) {
-    // determine the length of the path
-    uint32_t length = safe_arr_null_term(path, sizeof(*path), false);
-    if (!length)
-        return -EFAULT;
-
-    // allocate kernel memory to store path
-    char *path_kern = strndup(path, length);
-    if (!path_kern)
-        return -ENOMEM;
+    // copy the path into kernel memory
+    char *path_kern = getname(path);
+    if (IS_ERR(path_kern))
+        return PTR_ERR(path_kern);
 
     int32_t res = 0;
 
     // call filp_open
-    struct file *file = filp_openat(dfd, path, flags, mode);
+    struct file *file = filp_openat(dfd, path_kern, flags, mode);
     if (IS_ERR(file)) {
         res = PTR_ERR(file);
         goto out_free;
@@ -566,7 +554,7 @@ int32_t do_sys_faccessat(int32_t dfd, const char *path, uint16_t mode, uint32_t
 
 // free the memory allocated to store path
 out_free:
-    kfree(path_kern);
+    putname(path_kern);
     return res;
 }
 DEFINE_SYSCALL2(LINUX, access, const char *, path, int, mode) {
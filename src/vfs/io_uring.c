@@ -0,0 +1,483 @@
+#include "io_uring.h"
+#include "file.h"
+#include "fdtable.h"
+#include "poll.h"
+#include "../task/task.h"
+#include "../task/sched.h"
+#include "../task/signal.h"
+#include "../task/vdso.h"
+#include "../mm/kmalloc.h"
+#include "../mm/paging.h"
+#include "../mm/scratch.h"
+#include "../mm/uaccess.h"
+#include "../time/time.h"
+#include "../time/sleep.h"
+#include "../lib/string.h"
+#include "../atomic.h"
+#include "../compiler.h"
+#include "../initcall.h"
+#include "../syscall.h"
+#include "../err.h"
+#include "../errno.h"
+
+// Rings are mapped above the vDSO, two pages each
+#define IORING_MAP_ADDR  (VDSO_ADDR + LEN_4M)
+#define IORING_MAP_SLOTS 32
+
+#define IORING_CQ_ENTRIES (IORING_MAX_ENTRIES * 2)
+
+// The page userspace sees the heads, tails and CQEs through
+struct io_rings {
+    uint32_t sq_head;
+    uint32_t sq_tail;
+    uint32_t sq_ring_mask;
+    uint32_t sq_ring_entries;
+    uint32_t sq_flags;
+    uint32_t sq_dropped;
+    uint32_t cq_head;
+    uint32_t cq_tail;
+    uint32_t cq_ring_mask;
+    uint32_t cq_ring_entries;
+    uint32_t cq_overflow;
+    uint32_t cq_flags;
+    struct io_uring_cqe cqes[IORING_CQ_ENTRIES];
+    uint32_t sq_array[IORING_MAX_ENTRIES];
+};
+
+struct io_ring_ctx {
+    struct io_rings *rings;
+    struct io_uring_sqe *sqes;
+    uint32_t sq_entries;
+    uint32_t cq_entries;
+    // where the pages are mapped in the process that set it up
+    void *user_rings;
+    void *user_sqes;
+};
+
+int32_t do_sys_read(int32_t fd, void *buf, int32_t nbytes);
+int32_t do_sys_write(int32_t fd, const void *buf, int32_t nbytes);
+int32_t do_sys_openat(int32_t dfd, const char *path, uint32_t flags, uint16_t mode);
+int32_t do_sys_close(int32_t fd);
+
+static struct file_operations io_uring_fops;
+
+/*  io_ring_alloc
+ *  DESCRIPTION: allocate the shared pages of a ring
+ *  INPUTS: uint32_t entries -- SQ size, a power of two up to IORING_MAX_ENTRIES
+ *  OUTPUTS: none
+ *  RETURN VALUE: the ring, or ERR_PTR
+ */
+static struct io_ring_ctx *io_ring_alloc(uint32_t entries) {
+    struct io_ring_ctx *ctx = kmalloc(sizeof(*ctx));
+    if (!ctx)
+        return ERR_PTR(-ENOMEM);
+
+    *ctx = (struct io_ring_ctx){
+        .sq_entries = entries,
+        .cq_entries = entries * 2,
+    };
+
+    ctx->rings = alloc_shared_page();
+    if (!ctx->rings)
+        goto err_free_ctx;
+
+    ctx->sqes = alloc_shared_page();
+    if (!ctx->sqes)
+        goto err_free_rings;
+
+    ctx->rings->sq_ring_mask = ctx->sq_entries - 1;
+    ctx->rings->sq_ring_entries = ctx->sq_entries;
+    ctx->rings->cq_ring_mask = ctx->cq_entries - 1;
+    ctx->rings->cq_ring_entries = ctx->cq_entries;
+
+    return ctx;
+
+err_free_rings:
+    free_shared_page(ctx->rings);
+err_free_ctx:
+    kfree(ctx);
+    return ERR_PTR(-ENOMEM);
+}
+
+/*  io_ring_free
+ *  DESCRIPTION: unmap a ring from the current process, if it is mapped there,
+ *               and drop the kernel's reference to it
+ *  INPUTS: struct io_ring_ctx *ctx
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+static void io_ring_free(struct io_ring_ctx *ctx) {
+    if (ctx->user_rings) {
+        unmap_shared_page(ctx->user_rings, ctx->rings);
+        unmap_shared_page(ctx->user_sqes, ctx->sqes);
+    }
+
+    free_shared_page(ctx->rings);
+    free_shared_page(ctx->sqes);
+    kfree(ctx);
+}
+
+/*  io_ring_map
+ *  DESCRIPTION: map a ring into the first free slot of the current process
+ *  INPUTS: struct io_ring_ctx *ctx
+ *  OUTPUTS: ctx->user_rings, ctx->user_sqes
+ *  RETURN VALUE: 0 on success, or negative errno
+ */
+static int32_t io_ring_map(struct io_ring_ctx *ctx) {
+    uint32_t i;
+    for (i = 0; i < IORING_MAP_SLOTS; i++) {
+        void *user_rings = (void *)(IORING_MAP_ADDR + i * 2 * PAGE_SIZE_SMALL);
+        void *user_sqes = user_rings + PAGE_SIZE_SMALL;
+
+        if (!map_shared_page(user_rings, ctx->rings, GFP_USER))
+            continue;
+        if (!map_shared_page(user_sqes, ctx->sqes, GFP_USER)) {
+            unmap_shared_page(user_rings, ctx->rings);
+            continue;
+        }
+
+        ctx->user_rings = user_rings;
+        ctx->user_sqes = user_sqes;
+        return 0;
+    }
+
+    return -ENOMEM;
+}
+
+/*  io_uring_poll_add
+ *  DESCRIPTION: wait for any of the events on a file
+ *  INPUTS: int32_t fd, uint16_t events
+ *  OUTPUTS: none
+ *  RETURN VALUE: the events that happened, or negative errno
+ */
+static int32_t io_uring_poll_add(int32_t fd, uint16_t events) {
+    struct poll_entry entry = {
+        .task = current,
+        .events = events,
+    };
+    list_init(&entry.cleanup_cb);
+
+    struct file *file = fd_get(current->files, fd);
+    if (file) {
+        atomic_inc(&file->refcount);
+        entry.file = file;
+    } else {
+        entry.revents |= POLLNVAL;
+    }
+
+    int32_t res = do_poll(&entry, 1, -1);
+    if (res < 0)
+        return res;
+
+    return entry.revents;
+}
+
+/*  io_uring_timeout
+ *  DESCRIPTION: sleep for the 64-bit timespec of an IORING_OP_TIMEOUT
+ *  INPUTS: const struct __kernel_timespec *ts -- in userspace
+ *  OUTPUTS: none
+ *  RETURN VALUE: -ETIME once it expires, or negative errno
+ */
+static int32_t io_uring_timeout(const struct __kernel_timespec *ts) {
+    struct __kernel_timespec ts_k;
+    if (copy_from_user(&ts_k, ts, sizeof(ts_k)))
+        return -EFAULT;
+
+    if (ts_k.tv_sec < 0 || ts_k.tv_nsec < 0 || ts_k.tv_nsec >= NSEC)
+        return -EINVAL;
+
+    // keep the end time from wrapping around
+    struct timespec req = {
+        .sec  = ts_k.tv_sec > 0x7FFFFFFF ? 0x7FFFFFFF : (uint32_t)ts_k.tv_sec,
+        .nsec = ts_k.tv_nsec,
+    };
+
+    struct sleep_spec *spec = sleep_add(&req);
+    if (IS_ERR(spec))
+        return PTR_ERR(spec);
+
+    // like Linux, a timeout that expires completes with -ETIME
+    int32_t res = -ETIME;
+
+    while (!sleep_hashit(spec)) {
+        if (signal_pending(current)) {
+            res = -EINTR;
+            break;
+        }
+
+        current->state = TASK_INTERRUPTIBLE;
+        schedule();
+        current->state = TASK_RUNNING;
+    }
+
+    sleep_finalize(spec);
+    return res;
+}
+
+/*  io_uring_issue
+ *  DESCRIPTION: run one submission to completion
+ *  INPUTS: const struct io_uring_sqe *sqe
+ *  OUTPUTS: none
+ *  RETURN VALUE: the res of its CQE
+ */
+static int32_t io_uring_issue(const struct io_uring_sqe *sqe) {
+    void *addr = (void *)(uint32_t)sqe->addr;
+    struct file *file;
+
+    switch (sqe->opcode) {
+    case IORING_OP_NOP:
+        return 0;
+    case IORING_OP_READ:
+    case IORING_OP_WRITE:
+        // there is no positioned I/O, only the file position
+        if (sqe->off && sqe->off != (uint64_t)-1)
+            return -EINVAL;
+        if (sqe->opcode == IORING_OP_READ)
+            return do_sys_read(sqe->fd, addr, sqe->len);
+        return do_sys_write(sqe->fd, addr, sqe->len);
+    case IORING_OP_OPENAT:
+        return do_sys_openat(sqe->fd, addr, sqe->open_flags, sqe->len);
+    case IORING_OP_CLOSE:
+        // like Linux, a ring cannot close itself under its own submission
+        file = fd_get(current->files, sqe->fd);
+        if (file && file->op == &io_uring_fops)
+            return -EBADF;
+        return do_sys_close(sqe->fd);
+    case IORING_OP_POLL_ADD:
+        return io_uring_poll_add(sqe->fd, sqe->poll_events);
+    case IORING_OP_TIMEOUT:
+        return io_uring_timeout(addr);
+    default:
+        return -EINVAL;
+    }
+}
+
+/*  io_ring_submit
+ *  DESCRIPTION: consume SQEs and post a CQE for each of them. Submissions
+ *               run one after another in the submitting task, so
+ *               everything is complete by the time this returns
+ *  INPUTS: struct io_ring_ctx *ctx
+ *          uint32_t to_submit -- the most SQEs to consume
+ *  OUTPUTS: none
+ *  RETURN VALUE: the number of SQEs consumed, or negative errno
+ */
+static int32_t io_ring_submit(struct io_ring_ctx *ctx, uint32_t to_submit) {
+    struct io_rings *rings = ctx->rings;
+    uint32_t submitted = 0;
+
+    while (submitted < to_submit) {
+        uint32_t sq_head = rings->sq_head;
+        barrier();
+        if (sq_head == rings->sq_tail)
+            break;
+
+        uint32_t cq_tail = rings->cq_tail;
+        if (cq_tail - rings->cq_head >= ctx->cq_entries) {
+            if (!submitted)
+                return -EBUSY;
+            break;
+        }
+
+        uint32_t idx = rings->sq_array[sq_head & (ctx->sq_entries - 1)];
+
+        // the SQE may be rewritten as soon as the head moves past it
+        struct io_uring_sqe sqe;
+        if (idx < ctx->sq_entries)
+            sqe = ctx->sqes[idx];
+
+        barrier();
+        rings->sq_head = sq_head + 1;
+        submitted++;
+
+        if (idx >= ctx->sq_entries) {
+            rings->sq_dropped++;
+            continue;
+        }
+
+        int32_t res = io_uring_issue(&sqe);
+        // nothing the op left in the scratch arena is needed past here
+        scratch_reset();
+
+        rings->cqes[cq_tail & (ctx->cq_entries - 1)] = (struct io_uring_cqe){
+            .user_data = sqe.user_data,
+            .res       = res,
+            .flags     = 0,
+        };
+        barrier();
+        rings->cq_tail = cq_tail + 1;
+    }
+
+    return submitted;
+}
+
+static int32_t io_uring_open(struct file *file, struct inode *inode) {
+    return 0;
+}
+
+static void io_uring_release(struct file *file) {
+    if (file->vendor)
+        io_ring_free(file->vendor);
+}
+
+static struct file_operations io_uring_fops = {
+    .open    = &io_uring_open,
+    .release = &io_uring_release,
+};
+
+DEFINE_SYSCALL2(LINUX, io_uring_setup, uint32_t, entries, struct io_uring_params *, params) {
+    struct io_uring_params p;
+    if (copy_from_user(&p, params, sizeof(p)))
+        return -EFAULT;
+
+    if (p.flags & ~IORING_SETUP_CLAMP)
+        return -EINVAL;
+    if (!entries)
+        return -EINVAL;
+    if (entries > IORING_MAX_ENTRIES) {
+        if (!(p.flags & IORING_SETUP_CLAMP))
+            return -EINVAL;
+        entries = IORING_MAX_ENTRIES;
+    }
+
+    uint32_t sq_entries = 1;
+    while (sq_entries < entries)
+        sq_entries <<= 1;
+
+    struct io_ring_ctx *ctx = io_ring_alloc(sq_entries);
+    if (IS_ERR(ctx))
+        return PTR_ERR(ctx);
+
+    int32_t res = io_ring_map(ctx);
+    if (res < 0) {
+        io_ring_free(ctx);
+        return res;
+    }
+
+    p.sq_entries = ctx->sq_entries;
+    p.cq_entries = ctx->cq_entries;
+    p.features = 0;
+    p.sq_off = (struct io_sqring_offsets){
+        .head         = __builtin_offsetof(struct io_rings, sq_head),
+        .tail         = __builtin_offsetof(struct io_rings, sq_tail),
+        .ring_mask    = __builtin_offsetof(struct io_rings, sq_ring_mask),
+        .ring_entries = __builtin_offsetof(struct io_rings, sq_ring_entries),
+        .flags        = __builtin_offsetof(struct io_rings, sq_flags),
+        .dropped      = __builtin_offsetof(struct io_rings, sq_dropped),
+        .array        = __builtin_offsetof(struct io_rings, sq_array),
+        .user_addr    = (uint32_t)ctx->user_sqes,
+    };
+    p.cq_off = (struct io_cqring_offsets){
+        .head         = __builtin_offsetof(struct io_rings, cq_head),
+        .tail         = __builtin_offsetof(struct io_rings, cq_tail),
+        .ring_mask    = __builtin_offsetof(struct io_rings, cq_ring_mask),
+        .ring_entries = __builtin_offsetof(struct io_rings, cq_ring_entries),
+        .overflow     = __builtin_offsetof(struct io_rings, cq_overflow),
+        .cqes         = __builtin_offsetof(struct io_rings, cqes),
+        .flags        = __builtin_offsetof(struct io_rings, cq_flags),
+        .user_addr    = (uint32_t)ctx->user_rings,
+    };
+
+    if (copy_to_user(params, &p, sizeof(p))) {
+        io_ring_free(ctx);
+        return -EFAULT;
+    }
+
+    struct file *file = filp_open_dummy(&io_uring_fops, NULL, NULL, O_RDWR, 0600);
+    if (IS_ERR(file)) {
+        io_ring_free(ctx);
+        return PTR_ERR(file);
+    }
+    file->vendor = ctx;
+
+    res = fd_alloc(current->files, 0, file, false);
+    if (res < 0)
+        filp_close(file);
+
+    return res;
+}
+
+DEFINE_SYSCALL6(LINUX, io_uring_enter, int32_t, fd, uint32_t, to_submit, uint32_t, min_complete,
+        uint32_t, flags, const void *, sig, uint32_t, sigsz) {
+    struct file *file = fd_get(current->files, fd);
+    if (!file)
+        return -EBADF;
+    if (file->op != &io_uring_fops)
+        return -EOPNOTSUPP;
+    if (flags & ~IORING_ENTER_GETEVENTS)
+        return -EINVAL;
+
+    // The fd may be closed while a submission blocks, possibly by another
+    // task sharing the fd table, so hold the ring for the whole submit
+    atomic_inc(&file->refcount);
+
+    // Every submission has completed by the time io_ring_submit returns, so
+    // min_complete never needs waiting for beyond that
+    int32_t res = io_ring_submit(file->vendor, to_submit);
+
+    filp_close(file);
+    return res;
+}
+
+DEFINE_SYSCALL4(LINUX, io_uring_register, int32_t, fd, uint32_t, opcode, void *, arg, uint32_t, nr_args) {
+    return -EINVAL;
+}
+
+static void init_io_uring() {
+    fill_default_file_op(&io_uring_fops);
+}
+DEFINE_INITCALL(init_io_uring, drivers);
+
+#include "../tests.h"
+#if RUN_TESTS
+/* io_uring NOP tests
+ *
+ * Asserts that SQEs submitted in batches complete in order with their
+ * user_data, that bad SQ indexes are dropped and that a full CQ stops
+ * submission
+ * Coverage: io_ring_submit, SQ and CQ ring indexing
+ */
+__testfunc
+static void io_uring_nop_test() {
+    struct io_ring_ctx *ctx = io_ring_alloc(4);
+    TEST_ASSERT(!IS_ERR(ctx));
+    TEST_ASSERT(sizeof(struct io_rings) <= PAGE_SIZE_SMALL);
+    TEST_ASSERT(sizeof(struct io_uring_sqe) * IORING_MAX_ENTRIES <= PAGE_SIZE_SMALL);
+
+    uint32_t i;
+    for (i = 0; i < 6; i++) {
+        ctx->sqes[i & 3] = (struct io_uring_sqe){
+            .opcode = IORING_OP_NOP,
+            .user_data = i,
+        };
+        ctx->rings->sq_array[i & 3] = i & 3;
+        ctx->rings->sq_tail++;
+
+        // submit in batches of two
+        if (i & 1)
+            TEST_ASSERT(io_ring_submit(ctx, 4) == 2);
+    }
+
+    TEST_ASSERT(ctx->rings->sq_head == 6);
+    TEST_ASSERT(ctx->rings->cq_tail == 6);
+    for (i = 0; i < 6; i++) {
+        TEST_ASSERT(ctx->rings->cqes[i].user_data == i);
+        TEST_ASSERT(ctx->rings->cqes[i].res == 0);
+    }
+
+    // an index outside the SQ is dropped without a completion
+    ctx->rings->sq_array[ctx->rings->sq_tail & 3] = 4;
+    ctx->rings->sq_tail++;
+    TEST_ASSERT(io_ring_submit(ctx, 1) == 1);
+    TEST_ASSERT(ctx->rings->sq_dropped == 1);
+    TEST_ASSERT(ctx->rings->cq_tail == 6);
+
+    // with the CQ full, nothing more is taken
+    ctx->rings->cq_tail = ctx->rings->cq_head + ctx->cq_entries;
+    ctx->rings->sq_array[ctx->rings->sq_tail & 3] = 0;
+    ctx->rings->sq_tail++;
+    TEST_ASSERT(io_ring_submit(ctx, 1) == -EBUSY);
+
+    io_ring_free(ctx);
+}
+DEFINE_TEST(io_uring_nop_test);
+#endif
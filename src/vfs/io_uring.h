@@ -0,0 +1,103 @@
+// io_uring.h -- batched syscalls through rings shared with userspace
+
+#ifndef _IO_URING_H
+#define _IO_URING_H
+
+#include "../lib/stdint.h"
+
+/*
+ * The layouts and opcodes follow Linux, but there is no mmap: the kernel
+ * maps the rings into the process itself, and io_uring_setup returns where
+ * in sq_off.user_addr (the SQE array) and cq_off.user_addr (the rings),
+ * like IORING_SETUP_NO_MMAP does the other way around. Each fits a page.
+ */
+
+#define IORING_MAX_ENTRIES 64
+
+// setup flags
+#define IORING_SETUP_CLAMP (1 << 4)
+
+// enter flags
+#define IORING_ENTER_GETEVENTS (1 << 0)
+
+// Every op works on the submitter's files, with the arguments of the
+// syscall it stands for
+enum {
+    IORING_OP_NOP      = 0,
+    IORING_OP_POLL_ADD = 6,  // fd, poll_events; waits for one of them
+    IORING_OP_TIMEOUT  = 11, // addr = struct __kernel_timespec *; a nanosleep
+    IORING_OP_OPENAT   = 18, // fd = dirfd, addr = path, len = mode, open_flags
+    IORING_OP_CLOSE    = 19, // fd
+    IORING_OP_READ     = 22, // fd, addr, len; off must be 0 or -1
+    IORING_OP_WRITE    = 23, // fd, addr, len; off must be 0 or -1
+    IORING_OP_LAST,
+};
+
+// source: <uapi/linux/time_types.h>
+struct __kernel_timespec {
+    int64_t tv_sec;
+    int64_t tv_nsec;
+};
+
+struct io_uring_sqe {
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t ioprio;
+    int32_t fd;
+    uint64_t off;
+    uint64_t addr;
+    uint32_t len;
+    union {
+        uint32_t rw_flags;
+        uint16_t poll_events;
+        uint32_t timeout_flags;
+        uint32_t open_flags;
+    };
+    uint64_t user_data;
+    uint64_t pad[3];
+};
+
+struct io_uring_cqe {
+    uint64_t user_data;
+    int32_t res;
+    uint32_t flags;
+};
+
+struct io_sqring_offsets {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t ring_mask;
+    uint32_t ring_entries;
+    uint32_t flags;
+    uint32_t dropped;
+    uint32_t array;
+    uint32_t resv1;
+    uint64_t user_addr;
+};
+
+struct io_cqring_offsets {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t ring_mask;
+    uint32_t ring_entries;
+    uint32_t overflow;
+    uint32_t cqes;
+    uint32_t flags;
+    uint32_t resv1;
+    uint64_t user_addr;
+};
+
+struct io_uring_params {
+    uint32_t sq_entries;
+    uint32_t cq_entries;
+    uint32_t flags;
+    uint32_t sq_thread_cpu;
+    uint32_t sq_thread_idle;
+    uint32_t features;
+    uint32_t wq_fd;
+    uint32_t resv[3];
+    struct io_sqring_offsets sq_off;
+    struct io_cqring_offsets cq_off;
+};
+
+#endif
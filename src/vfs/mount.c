@@ -8,6 +8,7 @@
 
 struct list mounttable;
 LIST_STATIC_INIT(mounttable);
+DEFINE_RWSEM(mounttable_sem);
 
 int32_t do_mount(struct file *dev, struct super_block_operations *sb_op, struct path *path) {
     struct super_block *super_block = kmalloc(sizeof(*super_block));
@@ -21,7 +22,7 @@ int32_t do_mount(struct file *dev, struct super_block_operations *sb_op, struct
     if (res < 0)
         goto err_free_sb;
 
-    struct inode *root = kmalloc(sizeof(*root));
+    struct inode *root = kmem_cache_alloc(&inode_cache);
     if (!root) {
         res = -ENOMEM;
         goto err_put_sb;
@@ -52,7 +53,9 @@ int32_t do_mount(struct file *dev, struct super_block_operations *sb_op, struct
         .refcount = ATOMIC_INITIALIZER(1),
     };
 
+    down_write(&mounttable_sem);
     res = list_insert_back(&mounttable, entry);
+    up_write(&mounttable_sem);
     if (res < 0)
         goto err_free_entry;
 
@@ -65,7 +68,7 @@ err_destoy_path:
     path_destroy(path);
 
 err_free_root:
-    kfree(root);
+    kmem_cache_free(&inode_cache, root);
 
 err_put_sb:
     (*sb_op->put_super)(super_block);
@@ -102,7 +105,9 @@ int32_t do_umount(struct path *path) {
     }
 
     struct mount *entry = path->mnt;
+    down_write(&mounttable_sem);
     list_remove(&mounttable, entry);
+    up_write(&mounttable_sem);
 
     put_mount(entry);
 
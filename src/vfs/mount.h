@@ -5,6 +5,7 @@
 #include "../structure/list.h"
 #include "../lib/stdint.h"
 #include "../atomic.h"
+#include "../rwsem.h"
 
 struct path;
 struct inode;
@@ -16,6 +17,8 @@ struct mount {
 };
 
 extern struct list mounttable;
+// held shared while walking mounttable, exclusive while changing it
+extern struct rw_semaphore mounttable_sem;
 
 void put_mount(struct mount *mount);
 
@@ -2,6 +2,7 @@
 #include "../lib/string.h"
 #include "../lib/stdbool.h"
 #include "../mm/kmalloc.h"
+#include "../mm/slab.h"
 #include "mount.h"
 #include "../initcall.h"
 #include "../err.h"
@@ -9,6 +10,8 @@
 
 struct path root_path;
 
+static DEFINE_KMEM_CACHE(path_cache, struct path, NULL);
+
 // TODO: support for ..
 
 void path_destroy(struct path *path) {
@@ -19,7 +22,7 @@ void path_destroy(struct path *path) {
     list_destroy(&path->components);
     if (path->mnt)
         put_mount(path->mnt);
-    kfree(path);
+    kmem_cache_free(&path_cache, path);
 }
 
 static int32_t path_add_component(struct path *path, const char *component, uint32_t size) {
@@ -50,7 +53,7 @@ struct path *path_fromstr(const char *pathstr) {
     if (!*pathstr)
         return ERR_PTR(-ENOENT);
 
-    struct path *path = kmalloc(sizeof(*path));
+    struct path *path = kmem_cache_alloc(&path_cache);
     if (!path)
         return ERR_PTR(-ENOMEM);
     path->absolute = false;
@@ -94,7 +97,7 @@ struct path *path_join(struct path *x, struct path *y) {
     else if (y->absolute)
         return path_clone(y);
 
-    struct path *path = kmalloc(sizeof(*path));
+    struct path *path = kmem_cache_alloc(&path_cache);
     if (!path)
         return ERR_PTR(-ENOMEM);
     path->absolute = x->absolute;
@@ -128,18 +131,14 @@ err_destroy:
 }
 
 struct path *path_clone(struct path *old) {
-    struct path *empty = kmalloc(sizeof(*empty));
-    if (!empty)
-        return ERR_PTR(-ENOMEM);
-    empty->absolute = false;
-    empty->mnt = NULL;
-    list_init(&empty->components);
-
-    // just join this and an empty path
-    struct path *path = path_join(old, empty);
-
-    path_destroy(empty);
-    return path;
+    // just join this and an empty path, which has nothing to free
+    struct path empty = {
+        .absolute = false,
+        .mnt = NULL,
+    };
+    list_init(&empty.components);
+
+    return path_join(old, &empty);
 }
 
 uint32_t path_size(struct path *path) {
@@ -203,6 +202,7 @@ struct path *path_checkmnt(struct path *old) {
         struct mount *bestmatch = NULL;
         int32_t bestmatchsize = 0;
         struct list_node *mountnode;
+        down_read(&mounttable_sem);
         list_for_each(&mounttable, mountnode) {
             struct mount *entry = mountnode->value;
 
@@ -215,14 +215,18 @@ struct path *path_checkmnt(struct path *old) {
             }
         }
 
-        if (!bestmatch)
+        if (!bestmatch) {
+            up_read(&mounttable_sem);
             return path;
+        }
 
         // ... and truncate the path to the mount
+        atomic_inc(&bestmatch->refcount);
+        up_read(&mounttable_sem);
+
         if (path->mnt)
             put_mount(path->mnt);
         path->mnt = bestmatch;
-        atomic_inc(&path->mnt->refcount);
 
         path->absolute = false;
 
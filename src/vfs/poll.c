@@ -1,5 +1,7 @@
 #include "poll.h"
-#include "../mm/kmalloc.h"
+#include "../mm/scratch.h"
+#include "../mm/uaccess.h"
+#include "../lib/limits.h"
 #include "../task/task.h"
 #include "../task/sched.h"
 #include "../time/sleep.h"
@@ -14,30 +16,43 @@ struct pollfd {
     short revents;    /* returned events */
 };
 
-DEFINE_SYSCALL3(LINUX, poll, struct pollfd *, fds, int32_t, nfds, int32_t, timeout) {
-    if (safe_buf(fds, nfds * sizeof(*fds), true) != nfds * sizeof(*fds))
-        return -EFAULT;
-
-    struct poll_entry *poll_table = kcalloc(nfds, sizeof(*poll_table));
-    if (!poll_table)
-        return -ENOMEM;
-
+/*  poll_release
+ *  DESCRIPTION: run the cleanup callbacks of poll entries and drop their
+ *               files
+ *  INPUTS: struct poll_entry *poll_table, uint32_t nfds
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ */
+static void poll_release(struct poll_entry *poll_table, uint32_t nfds) {
     uint32_t i;
     for (i = 0; i < nfds; i++) {
-        poll_table[i].task = current;
-        poll_table[i].events = fds[i].events;
-        list_init(&poll_table[i].cleanup_cb);
-
-        struct file *file = array_get(&current->files->files, fds[i].fd);
-        if (file) {
-            atomic_inc(&file->refcount);
-            poll_table[i].file = file;
-        } else {
-            poll_table[i].revents |= POLLNVAL;
+        struct list_node *node;
+        list_for_each(&poll_table[i].cleanup_cb, node) {
+            poll_cleanup_t *cleanup_cb = node->value;
+            (*cleanup_cb)(&poll_table[i]);
         }
+        list_destroy(&poll_table[i].cleanup_cb);
+
+        if (poll_table[i].file)
+            filp_close(poll_table[i].file);
     }
+}
 
+/*  do_poll
+ *  DESCRIPTION: wait until any of the entries has an event, and then
+ *               release them
+ *  INPUTS: struct poll_entry *poll_table -- with task, events, an empty
+ *                                           cleanup_cb, and a file reference
+ *                                           or POLLNVAL in revents
+ *          uint32_t nfds
+ *          int32_t timeout -- in ms, negative to wait forever
+ *  OUTPUTS: revents of every entry
+ *  RETURN VALUE: the number of entries with events, or negative errno
+ */
+int32_t do_poll(struct poll_entry *poll_table, uint32_t nfds, int32_t timeout) {
     struct sleep_spec *sleep_spec = NULL;
+    int32_t res = 0;
+    uint32_t i;
 
     if (timeout > 0) {
         struct timespec timespec = {
@@ -46,11 +61,13 @@ DEFINE_SYSCALL3(LINUX, poll, struct pollfd *, fds, int32_t, nfds, int32_t, timeo
         };
         sleep_spec = sleep_add(&timespec);
 
-        if (IS_ERR(sleep_spec))
-            return PTR_ERR(sleep_spec);
+        if (IS_ERR(sleep_spec)) {
+            res = PTR_ERR(sleep_spec);
+            sleep_spec = NULL;
+            goto out;
+        }
     }
 
-    int32_t res;
     while (true) {
         if (signal_pending(current)) {
             res = -EINTR;
@@ -88,22 +105,58 @@ DEFINE_SYSCALL3(LINUX, poll, struct pollfd *, fds, int32_t, nfds, int32_t, timeo
         current->state = TASK_RUNNING;
     }
 
+out:
+    poll_release(poll_table, nfds);
+
+    if (sleep_spec)
+        sleep_finalize(sleep_spec);
+
+    return res;
+}
+
+DEFINE_SYSCALL3(LINUX, poll, struct pollfd *, fds, int32_t, nfds, int32_t, timeout) {
+    if (nfds < 0 || nfds > INT_MAX / sizeof(*fds))
+        return -EINVAL;
+    if (!access_ok(fds, nfds * sizeof(*fds)))
+        return -EFAULT;
+
+    struct poll_entry *poll_table = scratch_calloc(nfds, sizeof(*poll_table));
+    if (!poll_table)
+        return -ENOMEM;
+
+    int32_t res;
+
+    uint32_t i;
     for (i = 0; i < nfds; i++) {
-        struct list_node *node;
-        list_for_each(&poll_table[i].cleanup_cb, node) {
-            poll_cleanup_t *cleanup_cb = node->value;
-            (*cleanup_cb)(&poll_table[i]);
+        struct pollfd pollfd;
+        if (copy_from_user(&pollfd, &fds[i], sizeof(pollfd))) {
+            poll_release(poll_table, i);
+            res = -EFAULT;
+            goto out;
         }
-        list_destroy(&poll_table[i].cleanup_cb);
 
-        if (poll_table[i].file)
-            filp_close(poll_table[i].file);
+        poll_table[i].task = current;
+        poll_table[i].events = pollfd.events;
+        list_init(&poll_table[i].cleanup_cb);
 
-        fds[i].revents = poll_table[i].revents;
+        struct file *file = fd_get(current->files, pollfd.fd);
+        if (file) {
+            atomic_inc(&file->refcount);
+            poll_table[i].file = file;
+        } else {
+            poll_table[i].revents |= POLLNVAL;
+        }
     }
 
-    if (sleep_spec)
-        sleep_finalize(sleep_spec);
+    res = do_poll(poll_table, nfds, timeout);
+
+    for (i = 0; res >= 0 && i < nfds; i++) {
+        if (__put_user(poll_table[i].revents, &fds[i].revents))
+            res = -EFAULT;
+    }
+
+out:
+    scratch_free(poll_table);
 
     return res;
 }
@@ -25,4 +25,6 @@ struct poll_entry {
     struct list cleanup_cb;
 };
 
+int32_t do_poll(struct poll_entry *poll_table, uint32_t nfds, int32_t timeout);
+
 #endif
@@ -0,0 +1,208 @@
+#include "file.h"
+#include "fdtable.h"
+#include "poll.h"
+#include "../task/task.h"
+#include "../task/sched.h"
+#include "../task/signal.h"
+#include "../mm/kmalloc.h"
+#include "../mm/uaccess.h"
+#include "../initcall.h"
+#include "../syscall.h"
+#include "../err.h"
+#include "../errno.h"
+
+// source: <uapi/linux/signalfd.h>
+#define SFD_CLOEXEC  O_CLOEXEC
+#define SFD_NONBLOCK O_NONBLOCK
+
+struct signalfd_siginfo {
+    uint32_t ssi_signo;
+    int32_t ssi_errno;
+    int32_t ssi_code;
+    uint32_t ssi_pid;
+    uint32_t ssi_uid;
+    int32_t ssi_fd;
+    uint32_t ssi_tid;
+    uint32_t ssi_band;
+    uint32_t ssi_overrun;
+    uint32_t ssi_trapno;
+    int32_t ssi_status;
+    int32_t ssi_int;
+    uint64_t ssi_ptr;
+    uint64_t ssi_utime;
+    uint64_t ssi_stime;
+    uint64_t ssi_addr;
+    uint16_t ssi_addr_lsb;
+    uint8_t __pad[46];
+};
+
+/*
+ * A signalfd hands the signals in its mask to whoever reads it, from the
+ * reader's own pending signals, instead of them being delivered to a
+ * handler. They should be blocked for that, or they may be delivered first.
+ */
+struct signalfd_ctx {
+    uint64_t sigmask;
+};
+
+static struct file_operations signalfd_fops;
+
+/*
+ *   signalfd_copyinfo
+ *   DESCRIPTION: convert a siginfo to what read on a signalfd returns
+ *   INPUTS: struct signalfd_siginfo *ssi, const struct siginfo *siginfo
+ */
+static void signalfd_copyinfo(struct signalfd_siginfo *ssi, const struct siginfo *siginfo) {
+    *ssi = (struct signalfd_siginfo){
+        .ssi_signo = siginfo->signo,
+        .ssi_errno = siginfo->errno,
+        .ssi_code  = siginfo->code,
+    };
+
+    switch (siginfo->signo) {
+    case SIGILL:
+    case SIGFPE:
+    case SIGSEGV:
+    case SIGBUS:
+        ssi->ssi_addr = (uint32_t)siginfo->sifields.sigfault.addr;
+        break;
+    case SIGCHLD:
+        ssi->ssi_pid = siginfo->sifields.sigchld.pid;
+        ssi->ssi_uid = siginfo->sifields.sigchld.uid;
+        ssi->ssi_status = siginfo->sifields.sigchld.status;
+        break;
+    default:
+        ssi->ssi_pid = siginfo->sifields.rt.pid;
+        ssi->ssi_uid = siginfo->sifields.rt.uid;
+        ssi->ssi_int = siginfo->sifields.rt.sigval.sival_int;
+        ssi->ssi_ptr = (uint32_t)siginfo->sifields.rt.sigval.sival_ptr;
+        break;
+    }
+}
+
+/*
+ *   signalfd_read
+ *   DESCRIPTION: take as many pending signals in the mask as fit, waiting
+ *                for the first unless O_NONBLOCK. A signal stays pending
+ *                if it could not be copied out.
+ *   INPUTS: struct file *file, char *buf, uint32_t nbytes
+ *   RETURN VALUE: number of bytes read, or negative errno
+ */
+static int32_t signalfd_read(struct file *file, char *buf, uint32_t nbytes) {
+    struct signalfd_ctx *ctx = file->vendor;
+    struct signalfd_siginfo *ussi = (void *)buf;
+    uint32_t count = nbytes / sizeof(*ussi);
+    uint32_t i;
+
+    if (!count)
+        return -EINVAL;
+
+    for (i = 0; i < count; i++) {
+        struct signalfd_siginfo ssi;
+        struct siginfo siginfo;
+        uint16_t signum;
+
+        while (!(signum = peek_signal(ctx->sigmask, &siginfo))) {
+            if (i)
+                goto out;
+            if (file->flags & O_NONBLOCK)
+                return -EAGAIN;
+            if (signal_pending(current))
+                return -EINTR;
+
+            current->state = TASK_INTERRUPTIBLE;
+            schedule();
+            current->state = TASK_RUNNING;
+        }
+
+        signalfd_copyinfo(&ssi, &siginfo);
+        if (copy_to_user(&ussi[i], &ssi, sizeof(ssi))) {
+            if (!i)
+                return -EFAULT;
+            break;
+        }
+        kernel_get_pending_sig(signum, NULL);
+    }
+
+out:
+    return i * sizeof(*ussi);
+}
+
+static int32_t signalfd_poll(struct file *file, struct poll_entry *poll_entry) {
+    struct signalfd_ctx *ctx = file->vendor;
+
+    // a signal sent to the poller wakes it up by itself
+    if ((poll_entry->events & POLLIN) &&
+            (current->sigpending.pending_mask & ctx->sigmask))
+        poll_entry->revents |= POLLIN;
+
+    return 0;
+}
+
+static int32_t signalfd_open(struct file *file, struct inode *inode) {
+    return 0;
+}
+
+static void signalfd_release(struct file *file) {
+    kfree(file->vendor);
+}
+
+static struct file_operations signalfd_fops = {
+    .read    = &signalfd_read,
+    .poll    = &signalfd_poll,
+    .open    = &signalfd_open,
+    .release = &signalfd_release,
+};
+
+DEFINE_SYSCALL4(LINUX, signalfd4, int32_t, fd, const uint64_t *, mask, uint32_t, sizemask, int, flags) {
+    if (sizemask != sizeof(*mask))
+        return -EINVAL;
+    if (flags & ~(SFD_CLOEXEC | SFD_NONBLOCK))
+        return -EINVAL;
+
+    uint64_t sigmask;
+    if (copy_from_user(&sigmask, mask, sizeof(sigmask)))
+        return -EFAULT;
+    sigmask &= ~(MASKVAL(SIGKILL) | MASKVAL(SIGSTOP));
+
+    // an existing signalfd only gets a new mask
+    if (fd != -1) {
+        struct file *file = fd_get(current->files, fd);
+        if (!file)
+            return -EBADF;
+        if (file->op != &signalfd_fops)
+            return -EINVAL;
+
+        struct signalfd_ctx *ctx = file->vendor;
+        ctx->sigmask = sigmask;
+        return fd;
+    }
+
+    struct signalfd_ctx *ctx = kmalloc(sizeof(*ctx));
+    if (!ctx)
+        return -ENOMEM;
+    ctx->sigmask = sigmask;
+
+    struct file *file = filp_open_dummy(&signalfd_fops, NULL, NULL,
+        O_RDWR | (flags & SFD_NONBLOCK), 0600);
+    if (IS_ERR(file)) {
+        kfree(ctx);
+        return PTR_ERR(file);
+    }
+    file->vendor = ctx;
+
+    int32_t res = fd_alloc(current->files, 0, file, flags & SFD_CLOEXEC);
+    if (res < 0)
+        filp_close(file);
+
+    return res;
+}
+
+DEFINE_SYSCALL3(LINUX, signalfd, int32_t, fd, const uint64_t *, mask, uint32_t, sizemask) {
+    return sys_LINUX_signalfd4(fd, mask, sizemask, 0);
+}
+
+static void init_signalfd() {
+    fill_default_file_op(&signalfd_fops);
+}
+DEFINE_INITCALL(init_signalfd, drivers);
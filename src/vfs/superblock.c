@@ -1,7 +1,6 @@
 #include "superblock.h"
 #include "file.h"
 #include "../lib/string.h"
-#include "../mm/kmalloc.h"
 #include "../atomic.h"
 #include "../errno.h"
 
@@ -21,7 +20,7 @@ int32_t default_sb_write_inode(struct inode *inode) {
     return -EROFS;
 }
 void default_sb_put_inode(struct inode *inode) {
-    kfree(inode);
+    kmem_cache_free(&inode_cache, inode);
 }
 void default_sb_put_super(struct super_block *sb) {
     filp_close(sb->dev);